@@ -22,6 +22,8 @@
 #include <znc/Message.h>
 #include <sys/time.h>
 #include <deque>
+#include <memory>
+#include <vector>
 
 // Forward Declarations
 class CClient;
@@ -44,36 +46,72 @@ class CBufLine {
     /// @deprecated
     void UpdateTime();
 
-    bool Equals(const CMessage& Format) const {
-        return m_Message.Equals(Format);
-    }
+    bool Equals(const CMessage& Format) const;
 
     // Setters
-    void SetFormat(const CString& sFormat) { m_Message.Parse(sFormat); }
+    void SetFormat(const CString& sFormat);
     void SetText(const CString& sText) { m_sText = sText; }
-    void SetTime(const timeval& ts) { m_Message.SetTime(ts); }
-    void SetTags(const MCString& mssTags) { m_Message.SetTags(mssTags); }
+    void SetTime(const timeval& ts) { m_time = ts; }
+    void SetTags(const MCString& mssTags);
     // !Setters
 
     // Getters
-    const CString& GetCommand() const { return m_Message.GetCommand(); }
-    CString GetFormat() const {
-        return m_Message.ToString(CMessage::ExcludeTags);
-    }
+    const CString& GetCommand() const { return m_sCommand; }
+    CString GetFormat() const;
     const CString& GetText() const { return m_sText; }
-    timeval GetTime() const { return m_Message.GetTime(); }
-    const MCString& GetTags() const { return m_Message.GetTags(); }
+    timeval GetTime() const { return m_time; }
+    /** Unpacks the tags of the line. Since 1.11 this returns a copy instead
+     *  of a reference, because the line doesn't keep a map of its tags.
+     *  Modules built against older headers need to be rebuilt.
+     */
+    MCString GetTags() const;
     // !Getters
 
+    /// Case-insensitive comparison of the command, without copying strings.
+    bool CommandEquals(const CInternedString& sCommand) const {
+        return m_sCommand.Equals(sCommand);
+    }
+
+    /// Bytes of text held by this line alone, not counting shared strings.
+    size_t GetMemoryUsage() const {
+        return m_sRecord.size() + m_sText.size();
+    }
+
   private:
+    /// Rebuilds the stored message, without any substitutions.
+    CMessage GetMessage() const;
+    void SetMessage(const CMessage& Message);
+
   protected:
-    CMessage m_Message;
+    // Buffers can hold many thousands of lines, so instead of keeping a
+    // whole CMessage around, the line is packed into a single string:
+    // flags, tags and params, each prefixed by its length.
+    // The command and the sender are shared with other lines.
+    CInternedString m_sCommand;
+    CInternedString m_sNick;
+    CInternedString m_sIdent;
+    CInternedString m_sHost;
+    CString m_sRecord;
     CString m_sText;
+    timeval m_time;
 };
 
-class CBuffer : private std::deque<CBufLine> {
+class CBuffer {
   public:
+    typedef size_t size_type;
+
+    /// Size() and GetMemoryUsage() added up over several buffers.
+    struct SUsage {
+        size_t uLines = 0;
+        size_t uMemory = 0;
+    };
+
     CBuffer(unsigned int uLineCount = 100);
+    /// Copies aren't counted in the SUsage of the original, see SetUsage().
+    CBuffer(const CBuffer& Other);
+    CBuffer(CBuffer&& Other);
+    CBuffer& operator=(const CBuffer& Other);
+    CBuffer& operator=(CBuffer&& Other);
     ~CBuffer();
 
     size_type AddLine(const CMessage& Format, const CString& sText = "");
@@ -95,9 +133,33 @@ class CBuffer : private std::deque<CBufLine> {
     const CBufLine& GetBufLine(unsigned int uIdx) const;
     CString GetLine(size_type uIdx, const CClient& Client,
                     const MCString& msParams = MCString::EmptyMap) const;
-    size_type Size() const { return size(); }
-    bool IsEmpty() const { return empty(); }
-    void Clear() { clear(); }
+    /** Same as GetBufLine(uIdx).ToMessage(Client, msParams), but the result
+     *  is kept for other clients which render lines the same way, until the
+     *  buffer changes. Lines are kept for a few different ways of rendering
+     *  at once, see GetRenderProfile(). Copies of the buffer share these
+     *  lines.
+     */
+    const CMessage& ToMessage(size_type uIdx, const CClient& Client,
+                              const MCString& msParams = MCString::EmptyMap) const;
+    /// Same, with sProfile from GetRenderProfile(Client, msParams).
+    const CMessage& ToMessage(size_type uIdx, const CClient& Client,
+                              const MCString& msParams,
+                              const CString& sProfile) const;
+    /** Everything which the output of ToMessage() depends on, besides the
+     *  line. Compute it once when rendering many lines for the same client.
+     */
+    static CString GetRenderProfile(
+        const CClient& Client, const MCString& msParams = MCString::EmptyMap);
+    /// Forgets the lines kept by ToMessage().
+    void ClearRenderCache() const { m_spRendered.reset(); }
+    /** A copy of the buffer as it is now. Until the buffer changes, everyone
+     *  gets the same copy. It is freed with the lines which ToMessage()
+     *  rendered on it when the last user drops it.
+     */
+    std::shared_ptr<const CBuffer> GetSnapshot() const;
+    size_type Size() const { return m_vLines.size(); }
+    bool IsEmpty() const { return m_vLines.empty(); }
+    void Clear();
 
     // Setters
     bool SetLineCount(unsigned int u, bool bForce = false);
@@ -105,10 +167,70 @@ class CBuffer : private std::deque<CBufLine> {
 
     // Getters
     unsigned int GetLineCount() const { return m_uLineCount; }
+    /** @return An estimate of the memory used by the lines, in bytes. It is
+     *          kept up to date as lines come and go, so this is cheap. */
+    size_t GetMemoryUsage() const {
+        return m_vLines.capacity() * sizeof(CBufLine) + m_uLineMemory;
+    }
     // !Getters
+
+    /** Adds the lines and memory of this buffer to *pUsage, and keeps it up
+     *  to date until the buffer is destroyed or SetUsage() is called again.
+     *  @param pUsage nullptr to stop counting this buffer.
+     */
+    void SetUsage(SUsage* pUsage);
+
   private:
+    CBufLine& At(size_type uIdx) {
+        return m_vLines[(m_uFirst + uIdx) % m_vLines.size()];
+    }
+    const CBufLine& At(size_type uIdx) const {
+        return m_vLines[(m_uFirst + uIdx) % m_vLines.size()];
+    }
+    /// Rotates the ring so that the oldest line is at the front again.
+    void Linearize();
+    /// Brings m_pUsage up to date after the lines changed.
+    void UpdateUsage();
+
+    struct SRendered {
+        CString sProfile;
+        std::vector<std::unique_ptr<CMessage>> vpMessages;
+    };
+    // How many profiles ToMessage() keeps lines for
+    static const size_t RENDER_PROFILES = 4;
+
   protected:
     unsigned int m_uLineCount;
+    // Ring buffer of lines. It grows up to m_uLineCount lines, after that the
+    // oldest line (at m_uFirst) gets overwritten.
+    std::vector<CBufLine> m_vLines;
+    size_type m_uFirst = 0;
+    // Sum of GetMemoryUsage() of all lines
+    size_t m_uLineMemory = 0;
+    // Lines rendered for each kind of client, the most recently used one
+    // first, see ToMessage()
+    mutable std::shared_ptr<std::deque<SRendered>> m_spRendered;
+    // See GetSnapshot()
+    mutable std::weak_ptr<const CBuffer> m_wpSnapshot;
+    // See SetUsage(), and what was added to it so far
+    SUsage* m_pUsage = nullptr;
+    SUsage m_Counted;
+};
+
+/** A buffer which is being played back to a client, see
+ *  CClient::QueuePlayback().
+ */
+class CBufferPlayback {
+  public:
+    virtual ~CBufferPlayback() {}
+
+    /** Sends the next line of the playback to the client.
+     *  @return false if there was nothing left to send.
+     */
+    virtual bool Play(CClient& Client) = 0;
+    /// Called instead of the remaining Play() calls, if the playback can't
+    /// be finished.
+    virtual void Cancel(CClient& Client) {}
 };
 
 #endif  // !ZNC_BUFFER_H
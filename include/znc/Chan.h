@@ -22,7 +22,9 @@
 #include <znc/ZNCString.h>
 #include <znc/Buffer.h>
 #include <znc/Translation.h>
+#include <iterator>
 #include <map>
+#include <vector>
 
 // Forward Declarations
 class CUser;
@@ -32,6 +34,119 @@ class CConfig;
 class CFile;
 // !Forward Declarations
 
+/**
+ * @brief The nicks in a channel.
+ *
+ * A hash table keyed by the nick, with the case mapping of the server. It can
+ * be iterated like the std::map<CString, CNick> it replaced, but in no
+ * particular order. ToMap() copies it into such a map for code which needs
+ * one.
+ *
+ * Adding or removing nicks moves the others, don't keep pointers to them.
+ */
+class CNickMap {
+    struct SSlot {
+        // 0 for empty slots
+        unsigned int uHash = 0;
+        CNick Nick;
+    };
+
+  public:
+    struct SEntry {
+        const CString& first;
+        const CNick& second;
+    };
+
+    class const_iterator {
+      public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef SEntry value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef SEntry reference;
+        struct pointer {
+            SEntry Entry;
+            const SEntry* operator->() const { return &Entry; }
+        };
+
+        const_iterator(const SSlot* pSlot, const SSlot* pEnd)
+            : m_pSlot(pSlot), m_pEnd(pEnd) {
+            SkipEmpty();
+        }
+
+        reference operator*() const {
+            return {m_pSlot->Nick.GetNick(), m_pSlot->Nick};
+        }
+        pointer operator->() const { return {**this}; }
+        const_iterator& operator++() {
+            ++m_pSlot;
+            SkipEmpty();
+            return *this;
+        }
+        const_iterator operator++(int) {
+            const_iterator Ret = *this;
+            ++*this;
+            return Ret;
+        }
+        bool operator==(const const_iterator& Other) const {
+            return m_pSlot == Other.m_pSlot;
+        }
+        bool operator!=(const const_iterator& Other) const {
+            return m_pSlot != Other.m_pSlot;
+        }
+
+      private:
+        void SkipEmpty() {
+            while (m_pSlot != m_pEnd && !m_pSlot->uHash) ++m_pSlot;
+        }
+
+        const SSlot* m_pSlot;
+        const SSlot* m_pEnd;
+    };
+    typedef const_iterator iterator;
+
+    explicit CNickMap(const unsigned char* puCaseFold)
+        : m_vSlots(), m_uSize(0), m_puCaseFold(puCaseFold) {}
+
+    // std::map compatible interface
+    const_iterator begin() const {
+        return const_iterator(m_vSlots.data(),
+                              m_vSlots.data() + m_vSlots.size());
+    }
+    const_iterator end() const {
+        return const_iterator(m_vSlots.data() + m_vSlots.size(),
+                              m_vSlots.data() + m_vSlots.size());
+    }
+    size_t size() const { return m_uSize; }
+    bool empty() const { return m_uSize == 0; }
+    const_iterator find(const CString& sNick) const;
+    size_t count(const CString& sNick) const { return Find(sNick) ? 1 : 0; }
+    /// Throws std::out_of_range if there is no such nick.
+    const CNick& at(const CString& sNick) const;
+    /// Copies all nicks, sorted by nick. Prefer iterating over the CNickMap.
+    std::map<CString, CNick> ToMap() const;
+
+    CNick* Find(const CString& sNick);
+    const CNick* Find(const CString& sNick) const;
+    /// Adds the nick, or replaces the one which is equal to it.
+    CNick& Insert(const CNick& Nick);
+    bool Erase(const CString& sNick);
+    void Clear();
+    /// Rehashes the nicks, see CIRCNetwork::GetCaseFoldTable().
+    void SetCaseFold(const unsigned char* puCaseFold);
+
+  private:
+    unsigned int Hash(const CString& sNick) const;
+    bool NickEquals(const CString& sNick1, const CString& sNick2) const;
+    /// Index of the slot with this nick, or of the empty slot where it
+    /// belongs.
+    size_t FindSlot(const CString& sNick, unsigned int uHash) const;
+    void Rehash(size_t uSlots);
+
+    std::vector<SSlot> m_vSlots;
+    size_t m_uSize;
+    const unsigned char* m_puCaseFold;
+};
+
 class CChan : private CCoreTranslationMixin {
   public:
     typedef enum {
@@ -107,6 +222,9 @@ class CChan : private CCoreTranslationMixin {
     bool AddNick(const CString& sNick);
     bool RemNick(const CString& sNick);
     bool ChangeNick(const CString& sOldNick, const CString& sNewNick);
+    /// Called by the network when the server announced a different
+    /// CASEMAPPING.
+    void UpdateCaseMapping();
     // !Nicks
 
     // Buffer
@@ -188,8 +306,11 @@ class CChan : private CCoreTranslationMixin {
     const CString& GetTopicOwner() const { return m_sTopicOwner; }
     unsigned long GetTopicDate() const { return m_ulTopicDate; }
     const CString& GetDefaultModes() const { return m_sDefaultModes; }
-    const std::map<CString, CNick>& GetNicks() const { return m_msNicks; }
-    size_t GetNickCount() const { return m_msNicks.size(); }
+    /// @deprecated Use GetNickMap() instead. This copies all nicks into a
+    /// sorted map, which is kept until the nicks change.
+    const std::map<CString, CNick>& GetNicks() const;
+    const CNickMap& GetNickMap() const { return m_Nicks; }
+    size_t GetNickCount() const { return m_Nicks.size(); }
     bool AutoClearChanBuffer() const { return m_bAutoClearChanBuffer; }
     bool IsDetached() const { return m_bDetached; }
     bool InConfig() const { return m_bInConfig; }
@@ -203,6 +324,9 @@ class CChan : private CCoreTranslationMixin {
     bool IsParting() const { return m_bParting; }
     // !Getters
   private:
+    void QueueBuffer(CClient* pClient, std::shared_ptr<const CBuffer> spBuffer);
+    void ClearNicksCopy();
+
   protected:
     bool m_bDetached;
     bool m_bIsOn;
@@ -221,7 +345,10 @@ class CChan : private CCoreTranslationMixin {
     CNick m_Nick;
     unsigned int m_uJoinTries;
     CString m_sDefaultModes;
-    std::map<CString, CNick> m_msNicks;  // Todo: make this caseless (irc style)
+    CNickMap m_Nicks;
+    // For GetNicks(), only valid if m_bNicksCopied
+    mutable std::map<CString, CNick> m_msNicks;
+    mutable bool m_bNicksCopied;
     CBuffer m_Buffer;
 
     bool m_bModeKnown;
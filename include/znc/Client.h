@@ -24,9 +24,11 @@
 #include <znc/main.h>
 #include <memory>
 #include <functional>
+#include <deque>
 
 // Forward Declarations
 class CZNC;
+class CBufferPlayback;
 class CUser;
 class CIRCNetwork;
 class CIRCSock;
@@ -138,6 +140,15 @@ class CClient : public CIRCSocket {
     bool IsPlaybackActive() const { return m_bPlaybackActive; }
     void SetPlaybackActive(bool bActive) { m_bPlaybackActive = bActive; }
 
+    /** Plays back a buffer to this client. The lines are sent a few at a
+     *  time while the client keeps up with reading them, so that big
+     *  buffers don't stall everyone else. Until the playback is done,
+     *  anything else sent to this client is queued behind it.
+     */
+    void QueuePlayback(std::unique_ptr<CBufferPlayback> pPlayback);
+    bool IsPlaybackQueued() const { return !m_dqPlayback.empty(); }
+    size_t GetPlaybackQueueSize() const { return m_dqPlayback.size(); }
+
     void PutIRC(const CString& sLine);
     // Strips prefix and potentially tags before sending to server.
     void PutIRCStripping(CMessage Message);
@@ -211,6 +222,23 @@ class CClient : public CIRCSocket {
      *  \endcode
      */
     bool PutClient(const CMessage& Message);
+    /** Whether messages sent by \l PutClient(const CMessage&) end up the
+     *  same for both clients, as long as modules don't change them.
+     */
+    bool HasSameMessageFormat(const CClient& Other) const;
+    /** Sends a message, which \l AdaptMessage() of a client with the same
+     *  message format has already prepared, to this client.
+     *
+     *  This allows to serialize a message once for many clients. Modules
+     *  still get a copy of their own in OnSendToClientMessage(). Unless they
+     *  change it, the line is cached in @p sLine, which must be shared by
+     *  all clients which are sent the same @p Adapted.
+     */
+    bool PutClientAdapted(const CMessage& Adapted, CString& sLine);
+    /** Rewrites @p Message to contain only parameters and tags which the
+     *  client is able to handle. @see PutClient(const CMessage&)
+     */
+    void AdaptMessage(CMessage& Message) const;
     unsigned int PutStatus(const CTable& table);
     void PutStatus(const CString& sLine);
     void PutStatusNotice(const CString& sLine);
@@ -362,8 +390,29 @@ class CClient : public CIRCSocket {
     static const std::map<CString, std::function<void(CClient*, bool bVal)>>&
     CoreCaps();
 
+  private:
+    bool IsMessageWanted(const CMessage& Message) const;
+    bool PutAdaptedMessage(CMessage& Msg, const CMessage* pShared,
+                           CString* psSharedLine);
+    /// Writes the data, or queues it behind a playback.
+    void WriteOrQueue(const CString& sData);
+    void ContinuePlayback(bool bFromTimer);
+    void CancelPlayback();
+
+    // Either a playback, or data which was sent during a playback
+    struct SQueuedPlayback {
+        std::unique_ptr<CBufferPlayback> pPlayback;
+        CString sData;
+    };
+    std::deque<SQueuedPlayback> m_dqPlayback;
+    bool m_bInPlayback = false;
+    unsigned int m_uPlaybackLines = 0;
+    unsigned long long m_uPlaybackRunStart = 0;
+    CCron* m_pPlaybackTimer = nullptr;
+
     friend class ClientTest;
     friend class CCoreCaps;
+    friend class CClientPlaybackTimer;
 };
 
 #endif  // !ZNC_CLIENT_H
@@ -165,6 +165,8 @@ class CConfig {
 
     bool Parse(CFile& file, CString& sErrorMsg);
     void Write(CFile& file, unsigned int iIndentation = 0);
+    /// The same text as Write() produces.
+    CString ToString(unsigned int iIndentation = 0) const;
 
   private:
     typedef SCString SubConfigNameSet;
@@ -120,6 +120,8 @@ class CFile {
     bool UnLock();
 
     bool IsOpen() const;
+    /// @return The file descriptor, -1 if the file isn't open.
+    int GetFD() const { return m_iFD; }
     CString GetLongName() const;
     CString GetShortName() const;
     CString GetDir() const;
@@ -109,6 +109,23 @@ class CIRCNetwork : private CCoreTranslationMixin {
     void SetChanPrefixes(const CString& s) { m_sChanPrefixes = s; }
     bool IsChan(const CString& sChan) const;
 
+    /** How the server compares channel names and nicks, see ISUPPORT
+     *  CASEMAPPING. */
+    enum ECaseMapping {
+        CaseMappingAscii,
+        CaseMappingRFC1459,
+        CaseMappingStrictRFC1459
+    };
+    ECaseMapping GetCaseMapping() const { return m_eCaseMapping; }
+    /** Set the case mapping from the value of ISUPPORT CASEMAPPING. Unknown
+     *  mappings are treated as ascii. */
+    void SetCaseMapping(const CString& sCaseMapping);
+    /** Lower the case of a channel name or nick like the server does, names
+     *  which the server considers equal give the same result. */
+    CString CaseFold(const CString& sName) const;
+    /** The lower case version of each byte for the given case mapping. */
+    static const unsigned char* GetCaseFoldTable(ECaseMapping eCaseMapping);
+
     const std::vector<CServer*>& GetServers() const;
     bool HasServers() const { return !m_vServers.empty(); }
     CServer* FindServer(const CString& sName) const;
@@ -232,6 +249,17 @@ class CIRCNetwork : private CCoreTranslationMixin {
     }
 
     void ClearQueryBuffer();
+
+    /// Lines and memory of all channel buffers, kept up to date by them.
+    const CBuffer::SUsage& GetChanBufferUsage() const {
+        return m_ChanBufferUsage;
+    }
+    CBuffer::SUsage& GetChanBufferUsage() { return m_ChanBufferUsage; }
+    /// Same for the query buffers.
+    const CBuffer::SUsage& GetQueryBufferUsage() const {
+        return m_QueryBufferUsage;
+    }
+    CBuffer::SUsage& GetQueryBufferUsage() { return m_QueryBufferUsage; }
     // !Buffers
 
     // la
@@ -257,6 +285,17 @@ class CIRCNetwork : private CCoreTranslationMixin {
     void SetFloodBurst(unsigned short int uFloodBurst) {
         m_uFloodBurst = uFloodBurst;
     }
+    /** The byte based flood protection models the receive queue of the
+     *  server: it can hold FloodRecvQ bytes and is emptied at FloodByteRate
+     *  bytes per second. Lines are held back while they wouldn't fit.
+     *  It is disabled while either of them is 0.
+     */
+    unsigned int GetFloodRecvQ() const { return m_uFloodRecvQ; }
+    unsigned int GetFloodByteRate() const { return m_uFloodByteRate; }
+    void SetFloodRecvQ(unsigned int uBytes) { m_uFloodRecvQ = uBytes; }
+    void SetFloodByteRate(unsigned int uBytesPerSecond) {
+        m_uFloodByteRate = uBytesPerSecond;
+    }
 
     unsigned short int GetJoinDelay() const { return m_uJoinDelay; }
     void SetJoinDelay(unsigned short int uJoinDelay) {
@@ -284,6 +323,9 @@ class CIRCNetwork : private CCoreTranslationMixin {
     bool JoinChan(CChan* pChan);
     bool LoadModule(const CString& sModName, const CString& sArgs,
                     const CString& sNotice, CString& sError);
+    // Removes an entry, another chan/query may take it over
+    void UnindexChan(std::unordered_map<CString, CChan*>::iterator it);
+    void UnindexQuery(std::unordered_map<CString, CQuery*>::iterator it);
 
   protected:
     CString m_sName;
@@ -306,8 +348,16 @@ class CIRCNetwork : private CCoreTranslationMixin {
 
     std::vector<CChan*> m_vChans;
     std::vector<CQuery*> m_vQueries;
+    // Case folded names, for FindChan() and FindQuery()
+    std::unordered_map<CString, CChan*> m_mpChanIndex;
+    std::unordered_map<CString, CQuery*> m_mpQueryIndex;
+    // Whether some names fold to the same key since the last CASEMAPPING
+    // change, only then the index needs to be searched for a replacement
+    bool m_bChanFoldCollisions;
+    bool m_bQueryFoldCollisions;
 
     CString m_sChanPrefixes;
+    ECaseMapping m_eCaseMapping;
 
     bool m_bIRCConnectEnabled;
     bool m_bTrustAllCerts;
@@ -321,10 +371,14 @@ class CIRCNetwork : private CCoreTranslationMixin {
 
     double m_fFloodRate;  ///< Set to -1 to disable protection.
     unsigned short int m_uFloodBurst;
+    unsigned int m_uFloodRecvQ;
+    unsigned int m_uFloodByteRate;
 
     CBuffer m_RawBuffer;
     CBuffer m_MotdBuffer;
     CBuffer m_NoticeBuffer;
+    CBuffer::SUsage m_ChanBufferUsage;
+    CBuffer::SUsage m_QueryBufferUsage;
 
     CIRCNetworkPingTimer* m_pPingTimer;
     CIRCNetworkJoinTimer* m_pJoinTimer;
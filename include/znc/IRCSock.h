@@ -29,6 +29,7 @@ class CChan;
 class CUser;
 class CIRCNetwork;
 class CClient;
+class CIRCFloodTimer;
 // !Forward Declarations
 
 // TODO: This class needs new name
@@ -49,6 +50,32 @@ class CIRCSock : public CIRCSocket {
         NoArg = 3
     } EChanModeArgs;
 
+    /** Classes of lines sent to the server. When flood protection holds
+     *  lines back, a line is only sent once every line of a higher class is
+     *  gone.
+     */
+    typedef enum {
+        /// PING and PONG, losing them gets us disconnected
+        PriorityKeepalive = 0,
+        /// Lines from the user's clients
+        PriorityInteractive = 1,
+        /// Everything else, e.g. from modules or ZNC itself
+        PriorityBulk = 2,
+        PRIORITY_COUNT = 3
+    } ESendPriority;
+
+    /// How long lines of one priority class waited for flood protection.
+    struct SSendQueueStats {
+        /// Lines sent so far
+        unsigned long long uSent = 0;
+        /// Lines which couldn't be sent right away
+        unsigned long long uDelayed = 0;
+        /// Time they waited in total, in milliseconds
+        unsigned long long uTotalDelay = 0;
+        /// The longest wait, in milliseconds
+        unsigned long long uMaxDelay = 0;
+    };
+
     void ReadLine(const CString& sData) override;
     void Connected() override;
     void Disconnected() override;
@@ -98,8 +125,10 @@ class CIRCSock : public CIRCSocket {
      *  pServer->PutIRCRaw(Message.ToString());
      *  \endcode
      */
-    void PutIRC(const CMessage& Message);
-    void PutIRCQuick(const CString& sLine);  //!< Should be used for PONG only
+    void PutIRC(const CMessage& Message,
+                ESendPriority ePriority = PriorityBulk);
+    //! Should be used for PING and PONG only
+    void PutIRCQuick(const CString& sLine);
     void ResetChans();
     void Quit(const CString& sQuitMsg = "");
 
@@ -158,6 +187,14 @@ class CIRCSock : public CIRCSocket {
     // This is true if we are past raw 001
     bool IsAuthed() const { return m_bAuthed; }
     const SCString& GetAcceptedCaps() const { return m_ssAcceptedCaps; }
+    /// @return The number of lines held back by flood protection.
+    size_t GetSendQueueSize() const;
+    size_t GetSendQueueSize(ESendPriority ePriority) const {
+        return m_adqSendQueue[ePriority].size();
+    }
+    const SSendQueueStats& GetSendQueueStats(ESendPriority ePriority) const {
+        return m_aSendQueueStats[ePriority];
+    }
     bool IsCapAccepted(const CString& sCap) {
         return 1 == m_ssAcceptedCaps.count(sCap);
     }
@@ -206,6 +243,11 @@ class CIRCSock : public CIRCSocket {
     void SendAltNick(const CString& sBadNick);
     void SendNextCap();
     void TrySend();
+    /// Adds the lines which flood protection allows by now.
+    void RefillFloodTokens();
+    /// @return Seconds until flood protection allows sending a line of
+    ///         uBytes bytes, 0 if it can be sent right now.
+    double GetFloodDelay(size_t uBytes) const;
 
   protected:
     bool m_bAuthed;
@@ -236,11 +278,32 @@ class CIRCSock : public CIRCSocket {
     static const unsigned long long m_uCTCPFloodTime;
     static const unsigned int m_uCTCPFloodCount;
     MCString m_mISupport;
-    std::deque<CMessage> m_vSendQueue;
-    short int m_iSendsAllowed;
+    struct SQueuedLine {
+        CMessage Message;
+        /// When the line was queued, as returned by CUtils::GetMillTime()
+        unsigned long long uQueued;
+        /// Length on the wire, only known with byte based flood protection
+        size_t uBytes;
+    };
+    std::deque<SQueuedLine> m_adqSendQueue[PRIORITY_COUNT];
+    SSendQueueStats m_aSendQueueStats[PRIORITY_COUNT];
+    // Flood protection is a token bucket: up to m_uFloodBurst lines can be
+    // sent at once, and one more becomes available every m_fFloodRate
+    // seconds.
+    double m_fFloodTokens;
+    unsigned long long m_uFloodRefilled;
     unsigned short int m_uFloodBurst;
     double m_fFloodRate;
     bool m_bFloodProtection;
+    // Byte based flood protection, see CIRCNetwork::GetFloodRecvQ(). This
+    // is the estimate of how many of our bytes the server hasn't processed
+    // yet, it is updated together with m_fFloodTokens.
+    double m_fFloodRecvQ;
+    unsigned int m_uFloodRecvQSize;
+    unsigned int m_uFloodByteRate;
+    bool m_bByteFloodProtection;
+    /// Only exists while lines wait for the next token
+    CIRCFloodTimer* m_pFloodTimer = nullptr;
     unsigned long long m_lastFloodWarned;
     SCString m_ssSupportedTags;
     VCString m_vsSSLError;
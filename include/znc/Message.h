@@ -27,6 +27,9 @@
 #include <znc/ZNCString.h>
 #include <znc/Nick.h>
 #include <sys/time.h>
+#include <functional>
+#include <memory>
+#include <string_view>
 
 class CChan;
 class CClient;
@@ -53,10 +56,18 @@ class CIRCNetwork;
  *
  * For certain events, like a PRIVMSG, convienience commands like GetChan() and
  * GetNick() are available, this is not true for all CMessage extensions.
+ *
+ * A parsed message keeps a reference-counted copy of the raw line, and the
+ * prefix, tags and parameters are stored as views into it. They are only
+ * turned into owned strings when somebody asks for the whole container
+ * (GetNick(), GetParams(), GetTags()) or modifies them. Copies of a message
+ * share the same line. ToString() copies tags which are still views as they
+ * are unless they contain escapes, which are normalized.
  */
 class CMessage {
   public:
     explicit CMessage(const CString& sMessage = "");
+    explicit CMessage(CString&& sMessage);
     CMessage(const CNick& Nick, const CString& sCommand,
              const VCString& vsParams = VCString(),
              const MCString& mssTags = MCString::EmptyMap);
@@ -98,6 +109,10 @@ class CMessage {
     Type GetType() const { return m_eType; }
 
     bool Equals(const CMessage& Other) const;
+    /** Unlike Equals(), checks that ToString() of both messages would return
+     *  exactly the same, without building the strings.
+     */
+    bool Identical(const CMessage& Other) const;
     void Clone(const CMessage& Other);
 
     // ZNC <-> IRC
@@ -111,14 +126,14 @@ class CMessage {
     CChan* GetChan() const { return m_pChan; }
     void SetChan(CChan* pChan) { m_pChan = pChan; }
 
-    CNick& GetNick() { return m_Nick; }
-    const CNick& GetNick() const { return m_Nick; }
-    void SetNick(const CNick& Nick) { m_Nick = Nick; }
+    CNick& GetNick();
+    const CNick& GetNick() const;
+    void SetNick(const CNick& Nick);
 
     const CString& GetCommand() const { return m_sCommand; }
     void SetCommand(const CString& sCommand);
 
-    const VCString& GetParams() const { return m_vsParams; }
+    const VCString& GetParams() const;
 
     /**
      * Get a subset of the message parameters
@@ -147,12 +162,17 @@ class CMessage {
     const timeval& GetTime() const { return m_time; }
     void SetTime(const timeval& ts) { m_time = ts; }
 
-    const MCString& GetTags() const { return m_mssTags; }
-    MCString& GetTags() { return m_mssTags; }
-    void SetTags(const MCString& mssTags) { m_mssTags = mssTags; }
+    const MCString& GetTags() const;
+    MCString& GetTags();
+    void SetTags(const MCString& mssTags);
 
     CString GetTag(const CString& sKey) const;
+    bool HasTag(const CString& sKey) const;
     void SetTag(const CString& sKey, const CString& sValue);
+    /** Removes every tag for which fnKeep() returns false. Unlike going
+     *  through GetTags(), this keeps the tags of a parsed line as views.
+     */
+    void FilterTags(const std::function<bool(const CString& sKey)>& fnKeep);
 
     enum FormatFlags {
         IncludeAll = 0x0,
@@ -162,6 +182,7 @@ class CMessage {
 
     CString ToString(unsigned int uFlags = IncludeAll) const;
     void Parse(const CString& sMessage);
+    void Parse(CString&& sMessage);
 
 // Implicit and explicit conversion to a subclass reference.
 #ifndef SWIG
@@ -203,13 +224,40 @@ class CMessage {
 #endif
 
   private:
+    // Packs messages into its own compact format
+    friend class CBufLine;
+
+    /// Position of a substring inside of m_spLine.
+    struct SLineView {
+        unsigned int uOffset;
+        unsigned int uLength;
+    };
+
     void InitTime();
     void InitType();
-
-    CNick m_Nick;
+    void ParseLine();
+
+    std::string_view GetView(const SLineView& View) const;
+    size_t GetParamCount() const;
+    std::string_view GetParamView(size_t uIdx) const;
+    void MaterializeNick() const;
+    void MaterializeParams() const;
+    void MaterializeTags() const;
+    void ReleaseLine() const;
+
+    mutable std::shared_ptr<const CString> m_spLine;
+    SLineView m_PrefixView = {0, 0};
+    mutable std::vector<SLineView> m_vParamViews;
+    mutable std::vector<std::pair<SLineView, SLineView>> m_vTagViews;
+    // Whether the corresponding field below is still only stored as a view
+    mutable bool m_bNickIsView = false;
+    mutable bool m_bParamsAreViews = false;
+    mutable bool m_bTagsAreViews = false;
+
+    mutable CNick m_Nick;
     CString m_sCommand;
-    VCString m_vsParams;
-    MCString m_mssTags;
+    mutable VCString m_vsParams;
+    mutable MCString m_mssTags;
     timeval m_time;
     CIRCNetwork* m_pNetwork = nullptr;
     CClient* m_pClient = nullptr;
@@ -41,6 +41,7 @@ class CTemplate;
 class CIRCSock;
 class CModule;
 class CModInfo;
+class CFile;
 // !Forward Declarations
 
 #ifdef REQUIRESSL
@@ -275,6 +276,7 @@ class CModInfo {
           m_sWikiPage(""),
           m_sArgsHelpText(""),
           m_bHasArgs(false),
+          m_bThreadAware(false),
           m_fLoader(nullptr) {}
     ~CModInfo() {}
 
@@ -308,6 +310,7 @@ class CModInfo {
     const CString& GetWikiPage() const { return m_sWikiPage; }
     const CString& GetArgsHelpText() const { return m_sArgsHelpText; }
     bool GetHasArgs() const { return m_bHasArgs; }
+    bool IsThreadAware() const { return m_bThreadAware; }
     ModLoader GetLoader() const { return m_fLoader; }
     EModuleType GetDefaultType() const { return m_eDefaultType; }
     // !Getters
@@ -319,6 +322,10 @@ class CModInfo {
     void SetWikiPage(const CString& s) { m_sWikiPage = s; }
     void SetArgsHelpText(const CString& s) { m_sArgsHelpText = s; }
     void SetHasArgs(bool b = false) { m_bHasArgs = b; }
+    /** The module only touches its own user and network, so it can run in
+     *  the event thread of that user. With EventThreads > 1, only such
+     *  modules can be loaded, see CZNC::IsSharded(). */
+    void SetThreadAware(bool b = true) { m_bThreadAware = b; }
     void SetLoader(ModLoader fLoader) { m_fLoader = fLoader; }
     void SetDefaultType(EModuleType eType) { m_eDefaultType = eType; }
     // !Setters
@@ -335,6 +342,7 @@ class CModInfo {
     CString m_sWikiPage;
     CString m_sArgsHelpText;
     bool m_bHasArgs;
+    bool m_bThreadAware;
     ModLoader m_fLoader;
 };
 
@@ -1244,7 +1252,13 @@ class CModule {
     void HandleHelpCommand(const CString& sLine = "");
     // !Command stuff
 
+    /** Read the registry, replaying the journal on top of it. */
     bool LoadRegistry();
+    /** Write the whole registry to disk and empty the journal.
+     *
+     *  SetNV() and DelNV() only append the change to a journal. Call this
+     *  after modifying values through the iterators of FindNV() or BeginNV().
+     */
     bool SaveRegistry() const;
     bool MoveRegistry(const CString& sPath);
     bool SetNV(const CString& sName, const CString& sValue,
@@ -1259,7 +1273,10 @@ class CModule {
     }
     MCString::iterator EndNV() { return m_mssRegistry.end(); }
     MCString::iterator BeginNV() { return m_mssRegistry.begin(); }
-    void DelNV(MCString::iterator it) { m_mssRegistry.erase(it); }
+    void DelNV(MCString::iterator it) {
+        m_mssRegistry.erase(it);
+        m_bRegistryDirty = true;
+    }
     bool ClearNV(bool bWriteToDisk = true);
 
     const CString& GetSavePath() const;
@@ -1271,6 +1288,14 @@ class CModule {
     void SetDescription(const CString& s) { m_sDescription = s; }
     void SetModPath(const CString& s) { m_sModPath = s; }
     void SetArgs(const CString& s) { m_sArgs = s; }
+    /** By default, CModules stops calling a hook on this module once a
+     *  call ended up in the CModule implementation of it, which does
+     *  nothing. Modules which override a hook but sometimes call CModule's
+     *  implementation from it (like modperl and modpython do) need to
+     *  disable this, or they stop getting that hook.
+     *  @param b Whether hooks which aren't overridden may be skipped.
+     */
+    void SetSkipUnusedHooks(bool b) { m_bSkipUnusedHooks = b; }
     // !Setters
 
     // Getters
@@ -1278,6 +1303,7 @@ class CModule {
     const CString& GetDescription() const { return m_sDescription; }
     const CString& GetArgs() const { return m_sArgs; }
     const CString& GetModPath() const { return m_sModPath; }
+    bool GetSkipUnusedHooks() const { return m_bSkipUnusedHooks; }
 
     /** @returns For user modules this returns the user for which this
      *           module was loaded. For global modules this returns nullptr,
@@ -1528,6 +1554,29 @@ class CModule {
         m_mssRegistry;  //!< way to save name/value pairs. Note there is no encryption involved in this
     VWebSubPages m_vSubPages;
     std::map<CString, CModCommand> m_mCommands;
+
+    /// Called by the default implementations of hooks which do nothing.
+    void UnusedHook() { m_bUnusedHookCalled = true; }
+    /// Undoes UnusedHook() for hooks which have work of their own besides
+    /// calling another hook, e.g. for server dependent capabilities.
+    void UsedHook() { m_bUnusedHookCalled = false; }
+
+    bool m_bSkipUnusedHooks;
+    bool m_bUnusedHookCalled;
+    std::vector<bool> m_vbUnusedHooks;  //!< indexed by CModules hook number
+
+    bool AppendRegistryJournal(const CString& sRecord);
+    void CompactRegistry();
+
+    mutable size_t m_uRegistryJournalEntries;
+    //! There are changes which are neither in the journal nor on disk
+    mutable bool m_bRegistryDirty;
+#ifdef HAVE_PTHREAD
+    mutable CModuleJob* m_pRegistryJob = nullptr;
+#endif
+
+    friend class CModules;
+    friend class CRegistryJob;
 };
 
 class CModules : public std::vector<CModule*>, private CCoreTranslationMixin {
@@ -1547,6 +1596,11 @@ class CModules : public std::vector<CModule*>, private CCoreTranslationMixin {
 
     void UnloadAll();
 
+    /** Must be called when modules are added to or removed from this list
+     *  without LoadModule() and UnloadModule().
+     */
+    void ClearHookLists();
+
     bool OnBoot();
     bool OnPreRehash();
     bool OnPostRehash();
@@ -1760,10 +1814,31 @@ class CModules : public std::vector<CModule*>, private CCoreTranslationMixin {
                                 CModInfo& Info, CString& sRetMsg);
     static bool ValidateModuleName(const CString& sModule, CString& sRetMsg);
 
+    /// The modules which override a hook, in load order.
+    struct SHookList {
+        bool bValid = false;
+        size_type uModules = 0;
+        std::vector<CModule*> vpModules;
+    };
+
+    static size_t NewHook();
+    std::vector<CModule*>& GetHookList(size_t uHook) {
+        if (uHook < m_vHookLists.size()) {
+            SHookList& List = m_vHookLists[uHook];
+            // Modules can be added through the vector interface directly, so
+            // don't rely on ClearHookLists() alone
+            if (List.bValid && List.uModules == size()) return List.vpModules;
+        }
+        return BuildHookList(uHook);
+    }
+    std::vector<CModule*>& BuildHookList(size_t uHook);
+    void UnusedHook(size_t uHook, CModule* pModule);
+
   protected:
     CUser* m_pUser;
     CIRCNetwork* m_pNetwork;
     CClient* m_pClient;
+    std::vector<SHookList> m_vHookLists;
 };
 
 #endif  // !ZNC_MODULES_H
@@ -19,6 +19,7 @@
 
 #include <znc/zncconfig.h>
 #include <znc/ZNCString.h>
+#include <bitset>
 #include <vector>
 
 // Forward Decl
@@ -67,14 +68,23 @@ class CNick {
     // !Getters
 
     void Clone(const CNick& SourceNick);
+    /// Keeps the ident and host in the intern pool from now on. Used for
+    /// nicks which are kept around, e.g. in a channel's nick list.
+    void Share();
 
   private:
   protected:
-    CString m_sChanPerms;
+    // One bit per ASCII prefix char, big channels have a CNick per user
+    std::bitset<128> m_Perms;
     CIRCNetwork* m_pNetwork;
+    bool m_bShared;
     CString m_sNick;
     CString m_sIdent;
     CString m_sHost;
+    // Used instead of m_sIdent and m_sHost after Share(), the same hosts show
+    // up in many channels
+    CInternedString m_sSharedIdent;
+    CInternedString m_sSharedHost;
 };
 
 #endif  // !ZNC_NICK_H
@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2004-2026 ZNC, see the NOTICE file for details.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ZNC_PROFILER_H
+#define ZNC_PROFILER_H
+
+#include <znc/zncconfig.h>
+#include <znc/ZNCString.h>
+#include <map>
+#include <vector>
+
+/** Timing statistics of one measured thing.
+ *
+ *  Samples are in microseconds and go into power-of-two buckets, so
+ *  percentiles are approximate: they are the upper bound of the bucket.
+ */
+class CProfileStats {
+  public:
+    static const unsigned int BUCKETS = 24;
+
+    void Add(unsigned long long uMicroseconds);
+
+    // Getters
+    unsigned long long GetCount() const { return m_uCount; }
+    unsigned long long GetTotal() const { return m_uTotal; }
+    unsigned long long GetMax() const { return m_uMax; }
+    unsigned long long GetAverage() const {
+        return m_uCount ? m_uTotal / m_uCount : 0;
+    }
+    unsigned long long GetPercentile(unsigned int uPercent) const;
+    /** @return The number of samples in the bucket. Bucket i holds samples
+     *          below 2^i microseconds, the last one holds all the rest. */
+    unsigned long long GetBucket(unsigned int uBucket) const {
+        return m_auBuckets[uBucket];
+    }
+    // !Getters
+
+  private:
+    unsigned long long m_auBuckets[BUCKETS] = {};
+    unsigned long long m_uCount = 0;
+    unsigned long long m_uTotal = 0;
+    unsigned long long m_uMax = 0;
+};
+
+/** Built-in instrumentation of the main loop.
+ *
+ *  While disabled, every measuring point costs a single check of a global
+ *  flag. Admins can turn it on with the Profile command of *status, the
+ *  results are also available as JSON under /profile of the web interface.
+ */
+class CProfiler {
+  public:
+    enum ETimer {
+        /// Time between the main loop waking up and going to sleep again.
+        LoopIteration,
+        IRCReadLine,
+        ClientReadLine,
+        TIMER_COUNT
+    };
+
+    struct SQueueDepth {
+        CString sName;
+        unsigned long long uTotal;
+        unsigned long long uMax;
+    };
+
+    struct SHookStats {
+        CString sModule;
+        CString sHook;
+        CProfileStats Stats;
+    };
+
+    static bool IsEnabled() { return s_bEnabled; }
+    static void SetEnabled(bool b);
+    static void Reset();
+
+    /// @return Monotonic time in microseconds.
+    static unsigned long long Now();
+    /// @return Seconds since the profiler was enabled or reset.
+    static unsigned long long GetRunningTime();
+
+    static void AddTime(ETimer eTimer, unsigned long long uMicroseconds) {
+        s_aTimers[eTimer].Add(uMicroseconds);
+    }
+    static void AddHookTime(const CString& sModule, const char* szHook,
+                            unsigned long long uMicroseconds);
+
+    static const CProfileStats& GetTimer(ETimer eTimer) {
+        return s_aTimers[eTimer];
+    }
+    static CString GetTimerName(ETimer eTimer);
+    /** @return The hooks which were called, the most expensive ones first.
+     *          Hooks are named by their call in Modules.cpp, so overloads can
+     *          be told apart, e.g. "OnRawMessage(Message)". */
+    static std::vector<SHookStats> GetHookStats();
+    /// Current length of the various queues, summed over all users.
+    static std::vector<SQueueDepth> GetQueueDepths();
+
+    static CString ToJSON();
+
+  private:
+    static bool s_bEnabled;
+    static unsigned long long s_uStartTime;
+    static CProfileStats s_aTimers[TIMER_COUNT];
+    // Module name -> hook call -> stats
+    static std::map<CString, std::map<const char*, CProfileStats>> s_mHooks;
+};
+
+/** Measures the lifetime of this object into one of the timers of
+ *  CProfiler, if it is enabled.
+ */
+class CProfileTimer {
+  public:
+    explicit CProfileTimer(CProfiler::ETimer eTimer)
+        : m_eTimer(eTimer),
+          m_uStart(CProfiler::IsEnabled() ? CProfiler::Now() : 0) {}
+    ~CProfileTimer() {
+        if (m_uStart && CProfiler::IsEnabled()) {
+            CProfiler::AddTime(m_eTimer, CProfiler::Now() - m_uStart);
+        }
+    }
+
+    CProfileTimer(const CProfileTimer&) = delete;
+    CProfileTimer& operator=(const CProfileTimer&) = delete;
+
+  private:
+    CProfiler::ETimer m_eTimer;
+    unsigned long long m_uStart;
+};
+
+/** Measures one call of a module hook. The module name is copied upfront
+ *  since the module may be gone by the time the hook returns.
+ */
+class CProfileHookTimer {
+  public:
+    CProfileHookTimer(const CString& sModule, const char* szHook)
+        : m_szHook(szHook) {
+        if (CProfiler::IsEnabled()) {
+            m_sModule = sModule;
+            m_uStart = CProfiler::Now();
+        }
+    }
+    ~CProfileHookTimer() {
+        if (m_uStart && CProfiler::IsEnabled()) {
+            CProfiler::AddHookTime(m_sModule, m_szHook,
+                                   CProfiler::Now() - m_uStart);
+        }
+    }
+
+    CProfileHookTimer(const CProfileHookTimer&) = delete;
+    CProfileHookTimer& operator=(const CProfileHookTimer&) = delete;
+
+  private:
+    CString m_sModule;
+    const char* m_szHook;
+    unsigned long long m_uStart = 0;
+};
+
+#endif  // !ZNC_PROFILER_H
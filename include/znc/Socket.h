@@ -21,14 +21,22 @@
 #include <znc/Csocket.h>
 #include <znc/Threads.h>
 #include <znc/Translation.h>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <vector>
 
 class CModule;
+class CFile;
+#ifdef HAVE_EPOLL
+struct epoll_event;
+#endif
 
 class CZNCSock : public Csock, protected CCoreTranslationMixin {
   public:
     CZNCSock(int timeout = 60);
     CZNCSock(const CString& sHost, u_short port, int timeout = 60);
-    ~CZNCSock() {}
+    ~CZNCSock();
 
     int ConvertAddress(const struct sockaddr_storage* pAddr, socklen_t iAddrLen,
                        CString& sIP, u_short* piPort) const override;
@@ -40,6 +48,22 @@ class CZNCSock : public Csock, protected CCoreTranslationMixin {
     virtual void SSLCertError(X509* pCert) {}
     bool SNIConfigureClient(CString& sHostname) override;
     CString GetSSLPeerFingerprint(X509* pCert = nullptr) const;
+    /// Like Csocket's, but with an SSL_CTX from CSSLContextCache.
+    bool SSLClientSetup() override;
+    bool SSLServerSetup() override;
+    /** Outgoing connections with an owner try to resume the TLS session of
+     *  the previous connection of the same owner to the same server, if
+     *  the certificate settings are still the same.
+     */
+    void SetSSLSessionOwner(const CString& sOwner) {
+        m_sSSLSessionOwner = sOwner;
+    }
+    /// @return Where the TLS session is cached, empty if it isn't.
+    CString GetSSLSessionKey() const;
+    bool GetSSLSessionTrusted() const { return m_bSSLSessionTrusted; }
+    /// @return Whether the kernel encrypts what this socket sends, see
+    ///         CZNC::SetKernelTLS().
+    bool IsKernelTLS() const;
 #else
     CString GetSSLPeerFingerprint() const { return ""; }
 #endif
@@ -60,6 +84,40 @@ class CZNCSock : public Csock, protected CCoreTranslationMixin {
 
     virtual CString GetRemoteIP() const { return Csock::GetRemoteIP(); }
 
+    /** While enabled, Write() only collects the data. It is sent when the
+     *  current iteration of the main loop is done, so a burst of lines goes
+     *  out with a single write() and, with SSL, in full records.
+     */
+    void SetCoalesceWrites(bool bCoalesce);
+    bool GetCoalesceWrites() const { return m_bCoalesceWrites; }
+    using Csock::Write;
+    bool Write(const char* data, size_t len) override;
+    /// Sends the data which Write() collected so far.
+    void FlushWrite();
+    /// Calls FlushWrite() of every socket which has collected data.
+    static void FlushWrites();
+    /// @return The number of bytes written, but not sent yet.
+    size_t GetPendingWriteSize() {
+        return GetInternalWriteBuffer().size() + m_sCoalescedWrite.size();
+    }
+    /** Asks the kernel to hold back partial packets, see TCP_CORK. Useful
+     *  while more data is known to follow soon. Does nothing where this is
+     *  unsupported.
+     */
+    void SetCork(bool bCork);
+    /** Sends up to uSize bytes from the current position of the file with
+     *  sendfile(), so they don't pass through userspace. That only works
+     *  for plain sockets and kTLS, and only while nothing else is waiting
+     *  to be sent.
+     *  @return The number of bytes sent. The file position is moved past
+     *          them, the rest is up to the caller.
+     */
+    size_t SendFile(CFile& File, size_t uSize);
+    /// @return The bytes sent by SendFile(), GetBytesWritten() misses them.
+    unsigned long long GetFileBytesWritten() const {
+        return m_uFileBytesWritten;
+    }
+
   protected:
     // All existing errno codes seem to be in range 1-300
     enum {
@@ -72,14 +130,73 @@ class CZNCSock : public Csock, protected CCoreTranslationMixin {
     SCString m_ssCertVerificationErrors;
     bool m_bTrustAllCerts = false;
     bool m_bTrustPKI = true;
+    // Whether CheckSSLCert() accepted the server, only such TLS sessions
+    // are cached
+    bool m_bSSLSessionTrusted = false;
+    CString m_sSSLSessionOwner;
+    unsigned long long m_uFileBytesWritten = 0;
+    bool m_bCoalesceWrites = false;
+    bool m_bCorked = false;
+    CString m_sCoalescedWrite;
+    // Sockets with a non-empty m_sCoalescedWrite. Each event thread flushes
+    // its own, see CZNC::IsSharded().
+    static thread_local std::vector<CZNCSock*> s_vPendingWrites;
 };
 
+#ifdef HAVE_LIBSSL
+/** Process-wide cache of TLS contexts and client sessions.
+ *
+ *  Csocket would create a new SSL_CTX for every connection, which means
+ *  reading the certificate, key and DH parameters again for every client and
+ *  the CA store for every IRC connection. It also means that no session can
+ *  be resumed. Instead, one context per set of files and settings is kept
+ *  until the files change or ZNC is rehashed.
+ */
+class CSSLContextCache {
+  public:
+    /// @return A new reference to a server context, nullptr on error.
+    static SSL_CTX* GetServerContext(const CString& sPemFile,
+                                     const CString& sKeyFile,
+                                     const CString& sDHParamFile,
+                                     const CString& sCipher);
+    /// @return A new reference to a client context, nullptr on error.
+    static SSL_CTX* GetClientContext(const CString& sPemFile,
+                                     const CString& sKeyFile,
+                                     const CString& sCipher);
+
+    /// @return A new reference to the cached session, or nullptr.
+    static SSL_SESSION* GetSession(const CString& sKey);
+    /// Takes over the reference to pSession.
+    static void AddSession(const CString& sKey, SSL_SESSION* pSession);
+
+    /// Forgets everything, e.g. on rehash.
+    static void Clear();
+
+  private:
+    struct SContext {
+        SSL_CTX* pCTX;
+        // Files the context was loaded from, and their modification time
+        std::vector<std::pair<CString, time_t>> vFiles;
+    };
+    static SSL_CTX* NewContext(bool bServer, const CString& sCipher);
+    static SSL_CTX* FindContext(const CString& sKey);
+
+    static std::map<CString, SContext> s_mContexts;
+    static std::map<CString, SSL_SESSION*> s_mSessions;
+    // Connections of all event threads share the cache
+    static std::mutex s_mutex;
+};
+#endif
+
 enum EAddrType { ADDR_IPV4ONLY, ADDR_IPV6ONLY, ADDR_ALL };
 
 class CSockManager : public TSocketManager<CZNCSock>,
                      private CCoreTranslationMixin {
   public:
-    CSockManager();
+    /** @param bThreadPool Whether this manager finishes the jobs of
+     *                    CThreadPool. Only the main loop's one may.
+     */
+    explicit CSockManager(bool bThreadPool = true);
     virtual ~CSockManager();
 
     bool ListenHost(u_short iPort, const CString& sSockName,
@@ -183,6 +300,38 @@ class CSockManager : public TSocketManager<CZNCSock>,
 
     unsigned int GetAnonConnectionCount(const CString& sIP) const;
     void DelSockByAddr(Csock* pcSock) override;
+    void DelSock(size_t iPos) override;
+
+    /** How the main loop waits for socket activity. */
+    enum EEventBackend {
+        /** Whatever Csocket was built with, usually poll(). The whole set
+         *  of sockets is handed to the kernel on every iteration. */
+        EventBackendPoll,
+        /** epoll(7). Sockets stay registered between iterations and only
+         *  the ready ones are returned, so idle connections cost nothing
+         *  in the kernel. Csocket still rebuilds its map of all fds on every
+         *  iteration though, so the user space cost of the loop remains
+         *  proportional to the number of sockets. Linux only. */
+        EventBackendEpoll,
+    };
+
+    /** @return false if the backend isn't supported on this system. */
+    bool SetEventBackend(EEventBackend eBackend);
+    bool SetEventBackend(const CString& sBackend);
+    EEventBackend GetEventBackend() const { return m_eEventBackend; }
+    CString GetEventBackendName() const;
+    static VCString GetAvailableEventBackends();
+
+    /** Runs fTask in the thread of this manager's loop, between two
+     *  iterations. Can be called from any thread, the loop wakes up for it.
+     */
+    void Post(std::function<void()> fTask);
+    /// Runs what Post() got so far, see CZNC::Loop().
+    void RunPostedTasks();
+
+  protected:
+    int Select(std::map<cs_sock_t, short>& miiReadyFds,
+               struct timeval* tvtimeout) override;
 
   private:
     void FinishConnect(const CString& sHostname, u_short iPort,
@@ -191,6 +340,27 @@ class CSockManager : public TSocketManager<CZNCSock>,
 
     std::map<Csock*, bool /* deleted */> m_InFlightDnsSockets;
 
+    class CPostMonitorFD;
+    std::mutex m_mutexPosted;
+    std::vector<std::function<void()>> m_vfPosted;
+    // Post() writes to it to wake the loop up
+    int m_iPostPipe[2];
+
+    EEventBackend m_eEventBackend;
+    /// When Select() last returned, if profiling was enabled back then
+    unsigned long long m_uLastWakeUp = 0;
+#ifdef HAVE_EPOLL
+    int EpollSelect(std::map<cs_sock_t, short>& miiReadyFds,
+                    struct timeval* tvtimeout);
+    void CloseEpoll();
+
+    int m_iEpollFD;
+    /// What each fd is currently registered for, as ECT_* flags. Sorted like
+    /// the map from Csocket, see EpollSelect().
+    std::map<cs_sock_t, short> m_miEpollFDs;
+    std::vector<struct epoll_event> m_vEpollEvents;
+#endif
+
 #ifdef HAVE_PTHREAD
     class CThreadMonitorFD;
     friend class CThreadMonitorFD;
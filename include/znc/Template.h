@@ -22,8 +22,10 @@
 #include <iostream>
 #include <list>
 #include <memory>
+#include <vector>
 
 class CTemplate;
+class CCompiledTemplate;
 
 class CTemplateTagHandler {
   public:
@@ -116,6 +118,11 @@ class CTemplateLoopContext {
     CString GetValue(const CString& sName, bool bFromIf = false);
     // !Getters
   private:
+    friend class CTemplate;
+
+    /// Handles the loop specific variables, like __ID__ and __FIRST__.
+    bool GetLoopValue(const CString& sName, CString& sRet);
+
     bool m_bReverse;           //!< Iterate through this loop in reverse order
     bool m_bHasData;           //!< Tells whether this loop has real data or not
     CString m_sName;           //!< The name portion of the <?LOOP name?> tag
@@ -204,6 +211,35 @@ class CTemplate : public MCString {
     const CString& GetFileName() const { return m_sFileName; }
     // !Getters
   private:
+    friend class CCompiledTemplate;
+
+    /// The arguments of a value lookup, e.g. "Name ESC=URL", split up.
+    struct SValueArgs {
+        CString sArgs;
+        CString sName;
+        CString sRest;
+        MCString msArgs;
+    };
+    /// One comparison of an <? IF ?>, together with how it's chained to the
+    /// ones following it.
+    struct SIfExpr {
+        enum EOp { Truth, Equals, Less, LessEq, Greater, GreaterEq };
+        EOp eOp;
+        bool bAnd;
+        bool bNegate;
+        CString sName;
+        SValueArgs Name;
+        CString sValue;
+        long lValue;
+    };
+
+    static SValueArgs ParseValueArgs(const CString& sArgs);
+    static std::vector<SIfExpr> ParseIf(const CString& sArgs);
+    static SIfExpr ParseExpr(const CString& sExpr);
+    CString GetValue(const SValueArgs& Args, bool bFromIf);
+    bool ValidIf(const std::vector<SIfExpr>& vExprs);
+    bool ValidExpr(const SIfExpr& Expr);
+
     CTemplate* m_pParent;
     CString m_sFileName;
     std::list<std::pair<CString, bool>> m_lsbPaths;
@@ -18,6 +18,7 @@
 #define ZNC_TRANSLATION_H
 
 #include <znc/ZNCString.h>
+#include <mutex>
 #include <unordered_map>
 #include <variant>
 
@@ -46,12 +47,14 @@ class CTranslation {
 
   private:
     // Domain is either "znc" or "znc-foo" where foo is a module name
-    const std::locale& LoadTranslation(const CString& sDomain);
+    std::locale LoadTranslation(const CString& sDomain);
     std::unordered_map<CString /* domain */,
                        std::unordered_map<CString /* language */, std::locale>>
         m_Translations;
-    VCString m_sLanguageStack;
     std::unordered_map<CString /* domain */, int> m_miReferences;
+    // Guards the maps, they are shared by all event threads. The language
+    // stack is per thread.
+    std::mutex m_mutex;
 };
 
 struct CLanguageScope {
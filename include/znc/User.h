@@ -66,6 +66,15 @@ class CUser : private CCoreTranslationMixin {
     CConfig ToConfig() const;
     /** Checks password, may upgrade the hash method. */
     bool CheckPass(const CString& sPass);
+    /** Checks a password against the given hash. Unlike CheckPass(), this
+     *  doesn't access any user, so it can be called from other threads.
+     */
+    static bool VerifyPass(const CString& sPass, const CString& sHash,
+                           const CString& sSalt, eHashType eHash);
+    /** @returns Whether checking the password takes long enough that it
+     *           shouldn't block the main loop.
+     */
+    bool IsPassCheckSlow() const;
     bool AddAllowedHost(const CString& sHostMask);
     bool RemAllowedHost(const CString& sHostMask);
     void ClearAllowedHosts();
@@ -163,11 +172,17 @@ class CUser : private CCoreTranslationMixin {
     bool SetLanguage(const CString& s);
 
     void SetBeingDeleted(bool b) { m_bBeingDeleted = b; }
-    void SetTimestampFormat(const CString& s) { m_sTimestampFormat = s; }
+    void SetTimestampFormat(const CString& s) {
+        m_sTimestampFormat = s;
+        m_TimestampFormatter.Set(m_sTimestampFormat, m_sTimezone);
+    }
     void SetTimestampAppend(bool b) { m_bAppendTimestamp = b; }
     void SetTimestampPrepend(bool b) { m_bPrependTimestamp = b; }
     void SetAuthOnlyViaModule(bool b) { m_bAuthOnlyViaModule = b; }
-    void SetTimezone(const CString& s) { m_sTimezone = s; }
+    void SetTimezone(const CString& s) {
+        m_sTimezone = s;
+        m_TimestampFormatter.Set(m_sTimestampFormat, m_sTimezone);
+    }
     void SetJoinTries(unsigned int i) { m_uMaxJoinTries = i; }
     void SetMaxJoins(unsigned int i) { m_uMaxJoins = i; }
     void SetSkinName(const CString& s) { m_sSkinName = s; }
@@ -260,6 +275,8 @@ class CUser : private CCoreTranslationMixin {
     MCString m_mssCTCPReplies;
     CString m_sTimestampFormat;
     CString m_sTimezone;
+    // Both of the above, for AddTimestamp()
+    CTimeFormatter m_TimestampFormatter;
     eHashType m_eHashType;
 
     // Paths
@@ -287,6 +304,10 @@ class CUser : private CCoreTranslationMixin {
     std::vector<CIRCNetwork*> m_vIRCNetworks;
     std::vector<CClient*> m_vClients;
     std::set<CString> m_ssAllowedHosts;
+    // The allowed hosts as wildcards, and those of them which may be CIDR
+    // ranges and need CUtils::CheckCIDR()
+    CWildcardSet m_AllowedHostMatcher{CString::CaseSensitive};
+    VCString m_vsAllowedRanges;
     unsigned int m_uChanBufferSize;
     unsigned int m_uQueryBufferSize;
     unsigned long long m_uBytesRead;
@@ -307,6 +328,7 @@ class CUser : private CCoreTranslationMixin {
     }  // XXX compatibility crap, added in 0.207
     bool LoadModule(const CString& sModName, const CString& sArgs,
                     const CString& sNotice, CString& sError);
+    void UpdateAllowedHostMatcher();
 };
 
 #endif  // !ZNC_USER_H
@@ -20,9 +20,12 @@
 #include <znc/zncconfig.h>
 #include <znc/ZNCString.h>
 #include <assert.h>
+#include <array>
+#include <cstdint>
 #include <cstdio>
 #include <fcntl.h>
 #include <map>
+#include <memory>
 #include <sys/file.h>
 #include <sys/time.h>
 #include <unistd.h>
@@ -134,6 +137,117 @@ class CException {
     EType m_eType;
 };
 
+/** Formats times like CUtils::FormatTime(), for formats which are used over
+ *  and over again.
+ *
+ *  The time zone is loaded and the format is split at its %f specifiers
+ *  only once. The result for the last second is kept, so formatting more
+ *  times of the same second only needs to add the sub-second parts.
+ */
+class CTimeFormatter {
+  public:
+    CTimeFormatter() : CTimeFormatter("", "") {}
+    CTimeFormatter(const CString& sFormat, const CString& sTimezone);
+
+    /// Does nothing if both are the same as before.
+    void Set(const CString& sFormat, const CString& sTimezone);
+
+    CString Format(const timeval& tv) const;
+
+    // Getters
+    const CString& GetFormat() const { return m_sFormat; }
+    const CString& GetTimezone() const { return m_sTimezone; }
+    // !Getters
+
+  private:
+    struct SZone;
+    // A piece of the format without %f, and the number of digits of the %f
+    // which follows it. The last piece has no %f after it.
+    struct SPiece {
+        CString sFormat;
+        int iDigits;
+    };
+
+    CString m_sFormat;
+    CString m_sTimezone;
+    std::shared_ptr<const SZone> m_spZone;
+    std::vector<SPiece> m_vPieces;
+    mutable time_t m_iCachedTime = 0;
+    mutable std::vector<CString> m_vsCached;
+};
+
+/** Matches a string against many wildcards at once, with the same results
+ *  as CString::WildCmp().
+ *
+ *  The masks are compiled into automatons, which follow all masks in a
+ *  single pass over the string, without allocating memory. Masks are
+ *  grouped by their first character if it is a literal one, so only the
+ *  masks which can match the start of the string are followed at all.
+ *
+ *  @code
+ *  CWildcardSet Masks;
+ *  Masks.Add("*!*@*.example.com");
+ *  Masks.Add("nick!*@*");
+ *  Masks.Matches("Nick!ident@host.example.com");  // true
+ *  @endcode
+ */
+class CWildcardSet {
+  public:
+    explicit CWildcardSet(CaseSensitivity cs = CString::CaseInsensitive)
+        : m_eCaseSensitivity(cs) {}
+
+    /// @return The index of the mask, as reported by FindAll().
+    size_t Add(const CString& sMask);
+    void Clear();
+
+    /// @return Whether any of the masks matches.
+    bool Matches(const CString& sString) const;
+    /** Finds all masks which match.
+     *  @param vuIndexes Gets the indexes of the matching masks, ascending.
+     */
+    void FindAll(const CString& sString, std::vector<size_t>& vuIndexes) const;
+
+    // Getters
+    size_t size() const { return m_vsMasks.size(); }
+    bool empty() const { return m_vsMasks.empty(); }
+    const CString& GetMask(size_t uIndex) const { return m_vsMasks[uIndex]; }
+    // !Getters
+
+  private:
+    // One bit per state, i.e. per number of characters of a mask which
+    // matched so far. States after a * stay active on any character.
+    struct SAutomaton {
+        size_t uWords = 0;
+        std::vector<uint64_t> vuStart;
+        std::vector<uint64_t> vuLoop;
+        std::vector<uint64_t> vuFinal;
+        // Per character class, the states which are entered from the
+        // previous state on that class
+        std::vector<uint64_t> vuEnter;
+        // The final state of each mask, and the mask's index
+        std::vector<std::pair<size_t, size_t>> vFinalStates;
+    };
+
+    void Compile() const;
+    bool Run(const SAutomaton& Automaton, const CString& sString,
+             std::vector<size_t>* pvuIndexes) const;
+    unsigned char Fold(unsigned char c) const;
+
+    CaseSensitivity m_eCaseSensitivity;
+    VCString m_vsMasks;
+
+    mutable bool m_bCompiled = false;
+    // Character -> character class
+    mutable std::array<uint16_t, 256> m_auClass{};
+    mutable size_t m_uClasses = 1;
+    // Masks which start with a wildcard, and then per first character
+    mutable SAutomaton m_AnyStart;
+    mutable std::vector<SAutomaton> m_vAutomatons;
+    mutable std::array<int, 256> m_aiAutomaton{};
+    // Reused by Run()
+    mutable std::vector<uint64_t> m_vuState;
+};
+
 
 /** Generate a grid-like or list-like output from a given input.
  *
@@ -650,6 +650,63 @@ template <>
 struct hash<CString> : hash<std::string> {};
 }
 
+/**
+ * @brief A shared, immutable string.
+ *
+ * Equal strings which were interned share a single copy, which saves memory
+ * for values which are repeated a lot, like commands, nicks and hostnames.
+ * Comparing two interned strings is a pointer comparison.
+ *
+ * Strings are reference counted and removed from the table when the last
+ * CInternedString referring to them is destroyed. The table is guarded by
+ * a mutex and the counts are atomic, so they can be used from any thread,
+ * but a single CInternedString must not be changed by two threads at once.
+ * Interning takes the lock and a lookup, so it is meant for strings which
+ * are stored for a while, not for every parsed message.
+ */
+class CInternedString {
+  public:
+    CInternedString() : m_pEntry(nullptr) {}
+    CInternedString(const CString& sValue);
+    CInternedString(const char* szValue) : CInternedString(CString(szValue)) {}
+    CInternedString(const CInternedString& Other);
+    CInternedString(CInternedString&& Other) noexcept
+        : m_pEntry(Other.m_pEntry) {
+        Other.m_pEntry = nullptr;
+    }
+    CInternedString& operator=(CInternedString Other) noexcept {
+        std::swap(m_pEntry, Other.m_pEntry);
+        return *this;
+    }
+    ~CInternedString();
+
+    const CString& Get() const;
+    operator const CString&() const { return Get(); }
+    bool empty() const { return m_pEntry == nullptr; }
+
+    /** Case-insensitive (ASCII) comparison, same as CString::Equals(). */
+    bool Equals(const CInternedString& Other) const;
+
+    bool operator==(const CInternedString& Other) const {
+        return m_pEntry == Other.m_pEntry;
+    }
+    bool operator!=(const CInternedString& Other) const {
+        return m_pEntry != Other.m_pEntry;
+    }
+
+    /** @return The number of distinct strings currently interned. */
+    static size_t GetPoolSize();
+
+  private:
+    struct SEntry;
+    struct SPool;
+    static SPool& GetPool();
+    static SEntry* Intern(const CString& sValue);
+    static void Release(SEntry* pEntry);
+
+    SEntry* m_pEntry;
+};
+
 // Make translateable messages easy to write:
 // t_f("Foo is {1}")(foo)
 class CInlineFormatMessage {
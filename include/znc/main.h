@@ -56,6 +56,8 @@ extern bool ZNC_NO_NEED_TO_DO_ANYTHING_ON_MODULE_CALL_EXITER;
 #define _GLOBALMODULECALL(macFUNC, macUSER, macNETWORK, macCLIENT, macEXITER) \
     do {                                                                      \
         CModules& GMods = CZNC::Get().GetModules();                           \
+        /* Event threads mustn't touch it, see CZNC::IsSharded() */           \
+        if (GMods.empty()) break;                                             \
         CUser* pOldGUser = GMods.GetUser();                                   \
         CIRCNetwork* pOldGNetwork = GMods.GetNetwork();                       \
         CClient* pOldGClient = GMods.GetClient();                             \
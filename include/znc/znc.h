@@ -23,6 +23,9 @@
 #include <znc/Socket.h>
 #include <znc/Listener.h>
 #include <znc/Translation.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
 #include <mutex>
 #include <map>
 #include <list>
@@ -32,6 +35,9 @@ class CUser;
 class CIRCNetwork;
 class CConnectQueueTimer;
 class CConfigWriteTimer;
+class CAuthJob;
+class CConfigWriteJob;
+class CEventThread;
 class CConfig;
 class CFile;
 
@@ -106,14 +112,45 @@ class CZNC : private CCoreTranslationMixin {
                                            TrafficStatsPair& Total);
 
     // Authenticate a user.
-    // The result is passed back via callbacks to CAuthBase.
+    // The result is passed back via callbacks to CAuthBase, possibly after
+    // this function returned, if the password hash is checked in a thread.
     void AuthUser(std::shared_ptr<CAuthBase> AuthClass);
 
+    /** Users can be spread over several threads, each with its own socket
+     *  manager, see IsSharded(). Applies on the next start.
+     */
+    void SetEventThreads(unsigned int i) { m_uiEventThreads = i ? i : 1; }
+    unsigned int GetEventThreads() const { return m_uiEventThreads; }
+    /** @return Whether the users are spread over several event threads.
+     *
+     *  This mode is restricted: it's only used if no global modules are
+     *  loaded and all configured modules are thread-aware, see
+     *  CModInfo::SetThreadAware(). While it's on, other modules can't be
+     *  loaded, users can't be added or deleted, rehashing and UpdateMod are
+     *  refused and the web interface is off.
+     */
+    bool IsSharded() const { return !m_vpEventThreads.empty(); }
+    /// @return Whether this is one of the event threads, see IsSharded().
+    static bool IsInEventThread();
+    /** Runs fTask in the thread which owns pUser. That happens right away
+     *  if it's this thread or if the event threads wait for
+     *  RunExclusively(), later otherwise.
+     */
+    void RunInUserThread(const CUser* pUser, std::function<void()> fTask);
+    /** Runs fTask in the main thread while the event threads wait, so that
+     *  it may touch all users. From an event thread this happens later.
+     */
+    void RunExclusively(std::function<void()> fTask);
+    /** A client which logged in is moved to the thread of its user, where
+     *  CClient::AcceptLogin() is called again.
+     *  @return false if the client is in that thread already.
+     */
+    bool MoveClientToUserThread(CClient* pClient, CUser& User);
+    /// Called by ~CClient(), the client may still be waiting for its move.
+    void ForgetMovingClient(CClient* pClient);
+
     // Setters
-    void SetConfigState(enum ConfigState e) {
-        std::lock_guard<std::mutex> guard(m_mutexConfigState);
-        m_eConfigState = e;
-    }
+    void SetConfigState(enum ConfigState e);
     void SetSkinName(const CString& s) { m_sSkinName = s; }
     void SetStatusPrefix(const CString& s) {
         m_sStatusPrefix = (s.empty()) ? "*" : s;
@@ -125,12 +162,17 @@ class CZNC : private CCoreTranslationMixin {
     }
     void SetProtectWebSessions(bool b) { m_bProtectWebSessions = b; }
     void SetHideVersion(bool b) { m_bHideVersion = b; }
+    /** Lets the kernel encrypt TLS connections where it can (kTLS).
+     *  Applies to connections made after the next rehash.
+     */
+    void SetKernelTLS(bool b) { m_bKernelTLS = b; }
     void SetAuthOnlyViaModule(bool b) { m_bAuthOnlyViaModule = b; }
     void SetConnectDelay(unsigned int i);
     void SetSSLCiphers(const CString& sCiphers) { m_sSSLCiphers = sCiphers; }
     bool SetSSLProtocols(const CString& sProtocols);
     void SetSSLCertFile(const CString& sFile) { m_sSSLCertFile = sFile; }
     void SetConfigWriteDelay(unsigned int i) { m_uiConfigWriteDelay = i; }
+    void SetMaxAuthThreads(unsigned int i) { m_uiMaxAuthThreads = i; }
     // !Setters
 
     // Getters
@@ -138,8 +180,9 @@ class CZNC : private CCoreTranslationMixin {
         std::lock_guard<std::mutex> guard(m_mutexConfigState);
         return m_eConfigState;
     }
-    CSockManager& GetManager() { return m_Manager; }
-    const CSockManager& GetManager() const { return m_Manager; }
+    /// @return The socket manager of the calling thread, see IsSharded().
+    CSockManager& GetManager();
+    const CSockManager& GetManager() const;
     CModules& GetModules() { return *m_pModules; }
     CString GetSkinName() const { return m_sSkinName; }
     const CString& GetStatusPrefix() const { return m_sStatusPrefix; }
@@ -169,6 +212,7 @@ class CZNC : private CCoreTranslationMixin {
     unsigned int GetConnectDelay() const { return m_uiConnectDelay; }
     bool GetProtectWebSessions() const { return m_bProtectWebSessions; }
     bool GetHideVersion() const { return m_bHideVersion; }
+    bool GetKernelTLS() const { return m_bKernelTLS; }
     bool GetAuthOnlyViaModule() const { return m_bAuthOnlyViaModule; }
     CString GetSSLCiphers() const { return m_sSSLCiphers; }
     CString GetSSLProtocols() const { return m_sSSLProtocols; }
@@ -178,6 +222,7 @@ class CZNC : private CCoreTranslationMixin {
     CString GetSSLCertFile() const { return m_sSSLCertFile; }
     static VCString GetAvailableSSLProtocols();
     unsigned int GetConfigWriteDelay() const { return m_uiConfigWriteDelay; }
+    unsigned int GetMaxAuthThreads() const { return m_uiMaxAuthThreads; }
     // !Getters
 
     // Static allocator
@@ -237,14 +282,17 @@ class CZNC : private CCoreTranslationMixin {
     // !MOTD
 
     void AddServerThrottle(CString sName) {
+        std::lock_guard<std::mutex> guard(m_mutexConnectQueue);
         m_sConnectThrottle.AddItem(sName, true);
     }
     bool GetServerThrottle(CString sName) {
+        std::lock_guard<std::mutex> guard(m_mutexConnectQueue);
         bool* b = m_sConnectThrottle.GetItem(sName);
         return (b && *b);
     }
 
     void AddNetworkToQueue(CIRCNetwork* pNetwork);
+    void RemoveNetworkFromQueue(CIRCNetwork* pNetwork);
     std::list<CIRCNetwork*>& GetConnectionQueue() { return m_lpConnectQueue; }
 
     // This creates a CConnectQueueTimer if we haven't got one yet
@@ -279,11 +327,41 @@ class CZNC : private CCoreTranslationMixin {
 
     bool HandleUserDeletion();
     CString MakeConfigHeader();
+    CString MakeConfig();
+    /// Writes the config through a temporary file, returns the new file with
+    /// the lock on it or nullptr. Doesn't touch CZNC, so that it can run in
+    /// a thread.
+    static CFile* WriteConfigFile(const CString& sConfigFile,
+                                  const CString& sConfig);
+    void StartConfigWrite(bool bVerbose);
+    void WaitForConfigWrite();
+    void ConfigWriteDone(CFile* pFile);
     bool AddListener(const CString& sLine, CString& sError);
     bool AddListener(CConfig* pConfig, CString& sError);
     bool CheckSslAndPemFile(bool bSSL, CString& sError);
     bool FinishAddingListener(CListener* pListener, CString& sError);
 
+    void FinishAuth(std::shared_ptr<CAuthBase> AuthClass, CUser& User);
+    void StartAuthJobs();
+    void AuthJobDone(std::shared_ptr<CAuthBase> AuthClass,
+                     const CString& sHash, bool bResult);
+
+    bool CanUseEventThreads(CConfig& config, CString& sReason);
+    CEventThread* FindEventThread(const CUser* pUser) const;
+    std::vector<CSockManager*> GetManagers();
+    void StartEventThreads();
+    void StopEventThreads();
+    void PauseEventThreads();
+    void ResumeEventThreads();
+    void WaitWhilePaused();
+    void MoveClients();
+    class CExclusiveScope;
+
+    friend class CAuthJob;
+    friend class CConfigWriteJob;
+    friend class CConnectQueueTimer;
+    friend class CEventThread;
+
   protected:
     time_t m_TimeStarted;
 
@@ -318,8 +396,10 @@ class CZNC : private CCoreTranslationMixin {
     unsigned int m_uiMaxBufferSize;
     unsigned int m_uDisabledSSLProtocols;
     CModules* m_pModules;
-    unsigned long long m_uBytesRead;
-    unsigned long long m_uBytesWritten;
+    std::atomic<unsigned long long> m_uBytesRead;
+    std::atomic<unsigned long long> m_uBytesWritten;
+    // Guards the connect queue and the server throttle
+    std::mutex m_mutexConnectQueue;
     std::list<CIRCNetwork*> m_lpConnectQueue;
     CConnectQueueTimer* m_pConnectQueueTimer;
     unsigned int m_uiConnectPaused;
@@ -327,10 +407,30 @@ class CZNC : private CCoreTranslationMixin {
     TCacheMap<CString> m_sConnectThrottle;
     bool m_bProtectWebSessions;
     bool m_bHideVersion;
+    bool m_bKernelTLS;
     bool m_bAuthOnlyViaModule;
     CTranslationDomainRefHolder m_Translation;
     unsigned int m_uiConfigWriteDelay;
     CConfigWriteTimer* m_pConfigTimer;
+    // The config write running in the thread pool
+    CConfigWriteJob* m_pConfigWriteJob;
+    // Logins waiting for a free slot to check the password in a thread
+    std::list<std::shared_ptr<CAuthBase>> m_lpAuthQueue;
+    unsigned int m_uiMaxAuthThreads;
+    unsigned int m_uiRunningAuthJobs;
+    unsigned int m_uiEventThreads;
+    std::vector<CEventThread*> m_vpEventThreads;
+    std::map<const CUser*, CEventThread*> m_mpUserThreads;
+    bool m_bEventThreadsRunning;
+    // Logged in clients which the main loop hands to their user's thread
+    std::vector<std::pair<CClient*, CUser*>> m_vMovingClients;
+    // Guards m_bPausing and m_uiPausedThreads
+    std::mutex m_mutexPause;
+    std::condition_variable m_condPause;
+    bool m_bPausing;
+    unsigned int m_uiPausedThreads;
+    // Only touched by the main thread, PauseEventThreads() nests
+    unsigned int m_uiPauseDepth;
 };
 
 #endif  // !ZNC_H
@@ -278,6 +278,7 @@ template <>
 void TModInfo<CChanAttach>(CModInfo& Info) {
     Info.AddType(CModInfo::UserModule);
     Info.SetWikiPage("autoattach");
+    Info.SetThreadAware();
     Info.SetHasArgs(true);
     Info.SetArgsHelpText(Info.t_s(
         "List of channel masks and channel masks with ! before them."));
@@ -128,7 +128,7 @@ class CAutoCycleMod : public CModule {
         if (Channel.GetNickCount() != 1) return;
 
         // Is that person us and we don't have op?
-        const CNick& pNick = Channel.GetNicks().begin()->second;
+        const CNick& pNick = Channel.GetNickMap().begin()->second;
         if (!pNick.HasPerm(CChan::Op) &&
             pNick.NickEquals(GetNetwork()->GetCurNick())) {
             Channel.Cycle();
@@ -225,6 +225,7 @@ class CAutoCycleMod : public CModule {
 template <>
 void TModInfo<CAutoCycleMod>(CModInfo& Info) {
     Info.SetWikiPage("autocycle");
+    Info.SetThreadAware();
     Info.SetHasArgs(true);
     Info.SetArgsHelpText(Info.t_s(
         "List of channel masks and channel masks with ! before them."));
@@ -61,22 +61,11 @@ class CAutoOpUser {
     const CString& GetUserKey() const { return m_sUserKey; }
 
     bool ChannelMatches(const CString& sChan) const {
-        for (const CString& s : m_ssChans) {
-            if (sChan.AsLower().WildCmp(s, CString::CaseInsensitive)) {
-                return true;
-            }
-        }
-
-        return false;
+        return m_ChanMatcher.Matches(sChan);
     }
 
-    bool HostMatches(const CString& sHostmask) {
-        for (const CString& s : m_ssHostmasks) {
-            if (sHostmask.WildCmp(s, CString::CaseInsensitive)) {
-                return true;
-            }
-        }
-        return false;
+    bool HostMatches(const CString& sHostmask) const {
+        return m_HostmaskMatcher.Matches(sHostmask);
     }
 
     CString GetHostmasks() const {
@@ -94,6 +83,7 @@ class CAutoOpUser {
         for (const CString& s : vsHostmasks) {
             m_ssHostmasks.erase(s);
         }
+        UpdateMatchers();
 
         return m_ssHostmasks.empty();
     }
@@ -105,6 +95,7 @@ class CAutoOpUser {
         for (const CString& s : vsHostmasks) {
             m_ssHostmasks.insert(s);
         }
+        UpdateMatchers();
     }
 
     void DelChans(const CString& sChans) {
@@ -114,6 +105,7 @@ class CAutoOpUser {
         for (const CString& sChan : vsChans) {
             m_ssChans.erase(sChan.AsLower());
         }
+        UpdateMatchers();
     }
 
     void AddChans(const CString& sChans) {
@@ -123,6 +115,7 @@ class CAutoOpUser {
         for (const CString& sChan : vsChans) {
             m_ssChans.insert(sChan.AsLower());
         }
+        UpdateMatchers();
     }
 
     CString ToString() const {
@@ -136,16 +129,31 @@ class CAutoOpUser {
         sLine.Token(1, false, "\t").Trim_n().Split(",", m_ssHostmasks);
         m_sUserKey = sLine.Token(2, false, "\t");
         sLine.Token(3, false, "\t").Split(" ", m_ssChans);
+        UpdateMatchers();
 
         return !m_sUserKey.empty();
     }
 
   private:
+    void UpdateMatchers() {
+        m_HostmaskMatcher.Clear();
+        for (const CString& s : m_ssHostmasks) {
+            m_HostmaskMatcher.Add(s);
+        }
+        m_ChanMatcher.Clear();
+        for (const CString& s : m_ssChans) {
+            m_ChanMatcher.Add(s);
+        }
+    }
+
   protected:
     CString m_sUsername;
     CString m_sUserKey;
     set<CString> m_ssHostmasks;
     set<CString> m_ssChans;
+    // The two sets above, compiled for matching
+    CWildcardSet m_HostmaskMatcher;
+    CWildcardSet m_ChanMatcher;
 };
 
 class CAutoOpMod : public CModule {
@@ -246,7 +254,7 @@ class CAutoOpMod : public CModule {
     void OnOp2(const CNick* pOpNick, const CNick& Nick, CChan& Channel,
                bool bNoChange) override {
         if (Nick.GetNick() == GetNetwork()->GetIRCNick().GetNick()) {
-            const map<CString, CNick>& msNicks = Channel.GetNicks();
+            const CNickMap& msNicks = Channel.GetNickMap();
 
             for (const auto& it : msNicks) {
                 if (!it.second.HasPerm(CChan::Op)) {
@@ -497,13 +505,14 @@ class CAutoOpMod : public CModule {
         bool bValid = false;
         bool bMatchedHost = false;
         CAutoOpUser* pUser = nullptr;
+        const CString sHostmask = Nick.GetHostMask();
 
         for (const auto& it : m_msUsers) {
             pUser = it.second;
 
             // First verify that the person who challenged us matches a user's
             // host
-            if (pUser->HostMatches(Nick.GetHostMask())) {
+            if (pUser->HostMatches(sHostmask)) {
                 const vector<CChan*>& Chans = GetNetwork()->GetChans();
                 bMatchedHost = true;
 
@@ -566,8 +575,9 @@ class CAutoOpMod : public CModule {
         CString sChallenge = itQueue->second;
         m_msQueue.erase(itQueue);
 
+        const CString sHostmask = Nick.GetHostMask();
         for (const auto& it : m_msUsers) {
-            if (it.second->HostMatches(Nick.GetHostMask())) {
+            if (it.second->HostMatches(sHostmask)) {
                 if (sResponse ==
                     CString(it.second->GetUserKey() + "::" + sChallenge)
                         .MD5()) {
@@ -88,6 +88,7 @@ class CAutoReplyMod : public CModule {
 template <>
 void TModInfo<CAutoReplyMod>(CModInfo& Info) {
     Info.SetWikiPage("autoreply");
+    Info.SetThreadAware();
     Info.AddType(CModInfo::NetworkModule);
     Info.SetHasArgs(true);
     Info.SetArgsHelpText(Info.t_s(
@@ -30,6 +30,7 @@ class CAutoVoiceUser {
     CAutoVoiceUser(const CString& sUsername, const CString& sHostmask,
                    const CString& sChannels)
         : m_sUsername(sUsername), m_sHostmask(sHostmask) {
+        m_HostmaskMatcher.Add(m_sHostmask);
         AddChans(sChannels);
     }
 
@@ -39,17 +40,11 @@ class CAutoVoiceUser {
     const CString& GetHostmask() const { return m_sHostmask; }
 
     bool ChannelMatches(const CString& sChan) const {
-        for (const CString& s : m_ssChans) {
-            if (sChan.AsLower().WildCmp(s, CString::CaseInsensitive)) {
-                return true;
-            }
-        }
-
-        return false;
+        return m_ChanMatcher.Matches(sChan);
     }
 
-    bool HostMatches(const CString& sHostmask) {
-        return sHostmask.WildCmp(m_sHostmask, CString::CaseInsensitive);
+    bool HostMatches(const CString& sHostmask) const {
+        return m_HostmaskMatcher.Matches(sHostmask);
     }
 
     CString GetChannels() const {
@@ -73,6 +68,7 @@ class CAutoVoiceUser {
         for (const CString& sChan : vsChans) {
             m_ssChans.erase(sChan.AsLower());
         }
+        UpdateChanMatcher();
     }
 
     void AddChans(const CString& sChans) {
@@ -82,6 +78,7 @@ class CAutoVoiceUser {
         for (const CString& sChan : vsChans) {
             m_ssChans.insert(sChan.AsLower());
         }
+        UpdateChanMatcher();
     }
 
     CString ToString() const {
@@ -102,15 +99,27 @@ class CAutoVoiceUser {
         m_sUsername = sLine.Token(0, false, "\t");
         m_sHostmask = sLine.Token(1, false, "\t");
         sLine.Token(2, false, "\t").Split(" ", m_ssChans);
+        m_HostmaskMatcher.Clear();
+        m_HostmaskMatcher.Add(m_sHostmask);
+        UpdateChanMatcher();
 
         return !m_sHostmask.empty();
     }
 
   private:
+    void UpdateChanMatcher() {
+        m_ChanMatcher.Clear();
+        for (const CString& s : m_ssChans) {
+            m_ChanMatcher.Add(s);
+        }
+    }
+
   protected:
     CString m_sUsername;
     CString m_sHostmask;
     set<CString> m_ssChans;
+    CWildcardSet m_HostmaskMatcher;
+    CWildcardSet m_ChanMatcher;
 };
 
 class CAutoVoiceMod : public CModule {
@@ -171,9 +180,10 @@ class CAutoVoiceMod : public CModule {
     void OnJoin(const CNick& Nick, CChan& Channel) override {
         // If we have ops in this chan
         if (Channel.HasPerm(CChan::Op) || Channel.HasPerm(CChan::HalfOp)) {
+            const CString sHostmask = Nick.GetHostMask();
             for (const auto& it : m_msUsers) {
                 // and the nick who joined is a valid user
-                if (it.second->HostMatches(Nick.GetHostMask()) &&
+                if (it.second->HostMatches(sHostmask) &&
                     it.second->ChannelMatches(Channel.GetName())) {
                     PutIRC("MODE " + Channel.GetName() + " +v " +
                            Nick.GetNick());
@@ -186,7 +196,7 @@ class CAutoVoiceMod : public CModule {
     void OnOp2(const CNick* pOpNick, const CNick& Nick, CChan& Channel,
                bool bNoChange) override {
         if (Nick.NickEquals(GetNetwork()->GetNick())) {
-            const map<CString, CNick>& msNicks = Channel.GetNicks();
+            const CNickMap& msNicks = Channel.GetNickMap();
 
             for (const auto& it : msNicks) {
                 if (!it.second.HasPerm(CChan::Voice)) {
@@ -108,6 +108,7 @@ class CBuffExtras : public CModule {
 template <>
 void TModInfo<CBuffExtras>(CModInfo& Info) {
     Info.SetWikiPage("buffextras");
+    Info.SetThreadAware();
     Info.AddType(CModInfo::NetworkModule);
 }
 
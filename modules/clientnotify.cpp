@@ -218,6 +218,7 @@ class CClientNotifyMod : public CModule {
 template <>
 void TModInfo<CClientNotifyMod>(CModInfo& Info) {
     Info.SetWikiPage("clientnotify");
+    Info.SetThreadAware();
 }
 
 USERMODULEDEFS(CClientNotifyMod,
@@ -143,6 +143,8 @@ class CAdminMod : public CModule {
                 {"BindHost", str},
                 {"FloodRate", number},
                 {"FloodBurst", integer},
+                {"FloodRecvQ", integer},
+                {"FloodByteRate", integer},
                 {"JoinDelay", integer},
 #ifdef HAVE_ICU
                 {"Encoding", str},
@@ -636,6 +638,11 @@ class CAdminMod : public CModule {
             PutModule("FloodRate = " + CString(pNetwork->GetFloodRate()));
         } else if (sVar.Equals("floodburst")) {
             PutModule("FloodBurst = " + CString(pNetwork->GetFloodBurst()));
+        } else if (sVar.Equals("floodrecvq")) {
+            PutModule("FloodRecvQ = " + CString(pNetwork->GetFloodRecvQ()));
+        } else if (sVar.Equals("floodbyterate")) {
+            PutModule("FloodByteRate = " +
+                      CString(pNetwork->GetFloodByteRate()));
         } else if (sVar.Equals("joindelay")) {
             PutModule("JoinDelay = " + CString(pNetwork->GetJoinDelay()));
 #ifdef HAVE_ICU
@@ -713,6 +720,13 @@ class CAdminMod : public CModule {
         } else if (sVar.Equals("floodburst")) {
             pNetwork->SetFloodBurst(sValue.ToUShort());
             PutModule("FloodBurst = " + CString(pNetwork->GetFloodBurst()));
+        } else if (sVar.Equals("floodrecvq")) {
+            pNetwork->SetFloodRecvQ(sValue.ToUInt());
+            PutModule("FloodRecvQ = " + CString(pNetwork->GetFloodRecvQ()));
+        } else if (sVar.Equals("floodbyterate")) {
+            pNetwork->SetFloodByteRate(sValue.ToUInt());
+            PutModule("FloodByteRate = " +
+                      CString(pNetwork->GetFloodByteRate()));
         } else if (sVar.Equals("joindelay")) {
             pNetwork->SetJoinDelay(sValue.ToUShort());
             PutModule("JoinDelay = " + CString(pNetwork->GetJoinDelay()));
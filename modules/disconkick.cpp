@@ -38,6 +38,7 @@ class CKickClientOnIRCDisconnect : public CModule {
 template <>
 void TModInfo<CKickClientOnIRCDisconnect>(CModInfo& Info) {
     Info.SetWikiPage("disconkick");
+    Info.SetThreadAware();
 }
 
 USERMODULEDEFS(
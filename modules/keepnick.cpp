@@ -219,6 +219,7 @@ void CKeepNickTimer::RunJob() { m_pMod->KeepNick(); }
 template <>
 void TModInfo<CKeepNickMod>(CModInfo& Info) {
     Info.SetWikiPage("keepnick");
+    Info.SetThreadAware();
 }
 
 NETWORKMODULEDEFS(CKeepNickMod, t_s("Keeps trying for your primary nick"))
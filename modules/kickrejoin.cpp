@@ -126,6 +126,7 @@ class CRejoinMod : public CModule {
 template <>
 void TModInfo<CRejoinMod>(CModInfo& Info) {
     Info.SetWikiPage("kickrejoin");
+    Info.SetThreadAware();
     Info.SetHasArgs(true);
     Info.SetArgsHelpText(Info.t_s(
         "You might enter the number of seconds to wait before rejoining."));
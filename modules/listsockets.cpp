@@ -113,6 +113,7 @@ class CListSockets : public CModule {
                 Row["State"] = GetSocketState(pSocket);
                 Row["SSL"] =
                     pSocket->GetSSL() ? t_s("Yes", "ssl") : t_s("No", "ssl");
+                Row["KernelTLS"] = GetKernelTLS(pSocket);
                 Row["Local"] = GetLocalHost(pSocket, true);
                 Row["Remote"] = GetRemoteHost(pSocket, true);
                 Row["In"] = CString::ToByteStr(pSocket->GetBytesRead());
@@ -151,6 +152,16 @@ class CListSockets : public CModule {
         return t_s("UNKNOWN");
     }
 
+    CString GetKernelTLS(const Csock* pSocket) {
+#ifdef HAVE_LIBSSL
+        // CZNC's manager only has CZNCSock
+        if (static_cast<const CZNCSock*>(pSocket)->IsKernelTLS()) {
+            return t_s("Yes", "ssl");
+        }
+#endif
+        return t_s("No", "ssl");
+    }
+
     CString GetCreatedTime(const Csock* pSocket) {
         unsigned long long iStartTime = pSocket->GetStartTime();
         timeval tv;
@@ -215,6 +226,7 @@ class CListSockets : public CModule {
         Table.AddColumn(t_s("State"));
 #ifdef HAVE_LIBSSL
         Table.AddColumn(t_s("SSL"));
+        Table.AddColumn(t_s("kTLS"));
 #endif
         Table.AddColumn(t_s("Local"));
         Table.AddColumn(t_s("Remote"));
@@ -234,6 +246,7 @@ class CListSockets : public CModule {
             Table.SetCell(t_s("SSL"), pSocket->GetSSL()
                                                    ? t_s("Yes", "ssl")
                                                    : t_s("No", "ssl"));
+            Table.SetCell(t_s("kTLS"), GetKernelTLS(pSocket));
 #endif
 
             Table.SetCell(t_s("Local"),
@@ -21,8 +21,12 @@
 #include <znc/IRCNetwork.h>
 #include <znc/Chan.h>
 #include <znc/Server.h>
+#include <znc/Threads.h>
 #include <time.h>
 #include <algorithm>
+#include <list>
+#include <memory>
+#include <thread>
 
 using std::vector;
 
@@ -50,6 +54,166 @@ class CLogRule {
     bool m_bEnabled;
 };
 
+// Writes log files from a background thread, so that a slow disk never blocks
+// the IRC connections. Lines are collected per file and written out with a
+// single write() once a second or when enough data piled up. Recently used
+// files are kept open between flushes. The thread is only started by the first
+// line, since modules are loaded before ZNC forks into the background and the
+// thread wouldn't survive that.
+class CLogWriter {
+  public:
+    enum EFsync {
+        // Leave it to the kernel
+        FSYNC_NEVER,
+        // Before a file is closed, e.g. on rotation or unload
+        FSYNC_CLOSE,
+        // After every flush
+        FSYNC_FLUSH
+    };
+
+    CLogWriter() : m_eFsync(FSYNC_NEVER), m_uDirMode(0700) {}
+    ~CLogWriter() { Stop(); }
+
+    CLogWriter(const CLogWriter&) = delete;
+    CLogWriter& operator=(const CLogWriter&) = delete;
+
+    void SetOptions(EFsync eFsync, mode_t uDirMode) {
+        m_eFsync = eFsync;
+        m_uDirMode = uDirMode;
+    }
+
+    // Flushes everything and closes all files
+    void Stop() {
+        if (!m_Thread.joinable()) return;
+        {
+            CMutexLocker lock(m_Mutex);
+            m_bDone = true;
+        }
+        m_Cond.notify_one();
+        m_Thread.join();
+    }
+
+    void Write(const CString& sPath, const CString& sLine) {
+        if (!m_Thread.joinable()) {
+            m_Thread = std::thread([this] { Run(); });
+        }
+        CMutexLocker lock(m_Mutex);
+        m_msPending[sPath] += sLine;
+        m_uPendingBytes += sLine.length();
+        if (m_uPendingBytes >= FLUSH_BYTES) m_Cond.notify_one();
+    }
+
+    // Called when the file name of a window changed, e.g. at midnight
+    void Rotate(const CString& sOldPath) {
+        CMutexLocker lock(m_Mutex);
+        m_ssRotated.insert(sOldPath);
+    }
+
+  private:
+    static const size_t FLUSH_BYTES = 64 * 1024;
+    static const size_t MAX_OPEN_FILES = 64;
+
+    void Run() {
+        const std::chrono::seconds FlushInterval(1);
+        CMutexLocker lock(m_Mutex);
+
+        while (true) {
+            m_Cond.wait(lock,
+                        [this] { return m_bDone || !m_msPending.empty(); });
+            m_Cond.wait_for(lock, FlushInterval, [this] {
+                return m_bDone || m_uPendingBytes >= FLUSH_BYTES;
+            });
+
+            std::map<CString, CString> msPending;
+            std::set<CString> ssRotated;
+            msPending.swap(m_msPending);
+            ssRotated.swap(m_ssRotated);
+            m_uPendingBytes = 0;
+            bool bDone = m_bDone;
+
+            lock.unlock();
+            Flush(msPending, ssRotated);
+            if (bDone) break;
+            lock.lock();
+        }
+
+        while (!m_lOpen.empty()) {
+            CloseFile(m_lOpen.begin()->first);
+        }
+    }
+
+    void Flush(const std::map<CString, CString>& msPending,
+               const std::set<CString>& ssRotated) {
+        for (const auto& it : msPending) {
+            CFile* pFile = OpenFile(it.first);
+            if (!pFile) continue;
+            if (pFile->Write(it.second) != (ssize_t)it.second.length()) {
+                DEBUG("Could not write log file [" << it.first
+                                                   << "]: " << strerror(errno));
+            }
+            if (m_eFsync == FSYNC_FLUSH) pFile->Sync();
+        }
+
+        for (const CString& sPath : ssRotated) {
+            CloseFile(sPath);
+        }
+    }
+
+    CFile* OpenFile(const CString& sPath) {
+        auto it = m_mOpen.find(sPath);
+        if (it != m_mOpen.end()) {
+            m_lOpen.splice(m_lOpen.begin(), m_lOpen, it->second);
+            return m_lOpen.front().second.get();
+        }
+
+        if (m_lOpen.size() >= MAX_OPEN_FILES) {
+            CloseFile(m_lOpen.back().first);
+        }
+
+        std::unique_ptr<CFile> pFile(new CFile(sPath));
+        CString sLogDir = pFile->GetDir();
+        if (!CFile::Exists(sLogDir)) CDir::MakeDir(sLogDir, m_uDirMode);
+        if (!pFile->Open(O_WRONLY | O_APPEND | O_CREAT)) {
+            DEBUG("Could not open log file [" << sPath
+                                              << "]: " << strerror(errno));
+            return nullptr;
+        }
+
+        m_lOpen.emplace_front(sPath, std::move(pFile));
+        m_mOpen[sPath] = m_lOpen.begin();
+        return m_lOpen.front().second.get();
+    }
+
+    void CloseFile(const CString& sPath) {
+        auto it = m_mOpen.find(sPath);
+        if (it == m_mOpen.end()) return;
+
+        CFile& File = *it->second->second;
+        if (m_eFsync == FSYNC_CLOSE) File.Sync();
+        File.Close();
+        m_lOpen.erase(it->second);
+        m_mOpen.erase(it);
+    }
+
+    // Only accessed by the main thread until the thread is started
+    EFsync m_eFsync;
+    mode_t m_uDirMode;
+    std::thread m_Thread;
+
+    // Protected by m_Mutex
+    CMutex m_Mutex;
+    CConditionVariable m_Cond;
+    bool m_bDone = false;
+    std::map<CString, CString> m_msPending;
+    std::set<CString> m_ssRotated;
+    size_t m_uPendingBytes = 0;
+
+    // Only accessed by the writer thread, most recently used first
+    typedef std::list<std::pair<CString, std::unique_ptr<CFile>>> LOpenFiles;
+    LOpenFiles m_lOpen;
+    std::unordered_map<CString, LOpenFiles::iterator> m_mOpen;
+};
+
 class CLogMod : public CModule {
   public:
     MODCONSTRUCTOR(CLogMod) {
@@ -131,8 +295,18 @@ class CLogMod : public CModule {
 
     CString m_sLogPath;
     CString m_sTimestamp;
+    // The two above with the user's time zone, see PutLog()
+    CTimeFormatter m_PathFormatter;
+    CTimeFormatter m_TimestampFormatter;
     bool m_bSanitize;
     vector<CLogRule> m_vRules;
+    struct SWindow {
+        CString sPath;
+        time_t tLastWrite;
+    };
+    // user/network/window -> file which was last written for it
+    std::unordered_map<CString, SWindow> m_mWindows;
+    CLogWriter m_Writer;
 };
 
 void CLogMod::SetRulesCmd(const CString& sLine) {
@@ -274,8 +448,12 @@ void CLogMod::PutLog(const CString& sLine,
     timeval curtime;
 
     gettimeofday(&curtime, nullptr);
+    // The user may have changed the time zone since the last line
+    const CString sTimezone = GetUser()->GetTimezone();
+    m_PathFormatter.Set(m_sLogPath, sTimezone);
+    m_TimestampFormatter.Set(m_sTimestamp, sTimezone);
     // Generate file name
-    sPath = CUtils::FormatTime(curtime, m_sLogPath, GetUser()->GetTimezone());
+    sPath = m_PathFormatter.Format(curtime);
     if (sPath.empty()) {
         DEBUG("Could not format log path [" << sPath << "]");
         return;
@@ -283,12 +461,14 @@ void CLogMod::PutLog(const CString& sLine,
 
     // TODO: Properly handle IRC case mapping
     // $WINDOW has to be handled last, since it can contain %
-    sPath.Replace("$USER",
-                  CString((GetUser() ? GetUser()->GetUsername() : "UNKNOWN")));
-    sPath.Replace("$NETWORK",
-                  CString((GetNetwork() ? GetNetwork()->GetName() : "znc")));
-    sPath.Replace("$WINDOW", CString(sWindow.Replace_n("/", "-")
-                                         .Replace_n("\\", "-")).AsLower());
+    const CString sUser = GetUser() ? GetUser()->GetUsername() : "UNKNOWN";
+    const CString sNetwork = GetNetwork() ? GetNetwork()->GetName() : "znc";
+    const CString sWindowName =
+        sWindow.Replace_n("/", "-").Replace_n("\\", "-").AsLower();
+    const CString sWindowKey = sUser + "/" + sNetwork + "/" + sWindowName;
+    sPath.Replace("$USER", sUser);
+    sPath.Replace("$NETWORK", sNetwork);
+    sPath.Replace("$WINDOW", sWindowName);
 
     // Check if it's allowed to write in this specific path
     sPath = CDir::CheckPathPrefix(GetSavePath(), sPath);
@@ -297,18 +477,32 @@ void CLogMod::PutLog(const CString& sLine,
         return;
     }
 
-    CFile LogFile(sPath);
-    CString sLogDir = LogFile.GetDir();
-    struct stat ModDirInfo;
-    CFile::GetInfo(GetSavePath(), ModDirInfo);
-    if (!CFile::Exists(sLogDir)) CDir::MakeDir(sLogDir, ModDirInfo.st_mode);
-    if (LogFile.Open(O_WRONLY | O_APPEND | O_CREAT)) {
-        LogFile.Write(CUtils::FormatTime(curtime, m_sTimestamp,
-                                         GetUser()->GetTimezone()) +
-                      " " + (m_bSanitize ? sLine.StripControls_n() : sLine) +
-                      "\n");
-    } else
-        DEBUG("Could not open log file [" << sPath << "]: " << strerror(errno));
+    // The file name usually contains the date, close the old file once it
+    // changes
+    SWindow& Window = m_mWindows[sWindowKey];
+    if (Window.sPath != sPath) {
+        if (!Window.sPath.empty()) {
+            // The date changed since this window was last written. Windows
+            // which weren't written since then won't use their file again.
+            const time_t tRotated = Window.tLastWrite;
+            for (auto it = m_mWindows.begin(); it != m_mWindows.end();) {
+                if (it->first != sWindowKey &&
+                    it->second.tLastWrite <= tRotated) {
+                    m_Writer.Rotate(it->second.sPath);
+                    it = m_mWindows.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            m_Writer.Rotate(Window.sPath);
+        }
+        Window.sPath = sPath;
+    }
+    Window.tLastWrite = curtime.tv_sec;
+
+    m_Writer.Write(sPath, m_TimestampFormatter.Format(curtime) + " " +
+                              (m_bSanitize ? sLine.StripControls_n() : sLine) +
+                              "\n");
 }
 
 void CLogMod::PutLog(const CString& sLine, const CChan& Channel) {
@@ -334,16 +528,34 @@ bool CLogMod::OnLoad(const CString& sArgs, CString& sMessage) {
     sArgs.QuoteSplit(vsArgs);
 
     bool bReadingTimestamp = false;
+    bool bReadingFsync = false;
     bool bHaveLogPath = false;
+    CLogWriter::EFsync eFsync = CLogWriter::FSYNC_NEVER;
 
     for (CString& sArg : vsArgs) {
         if (bReadingTimestamp) {
             m_sTimestamp = sArg;
             bReadingTimestamp = false;
+        } else if (bReadingFsync) {
+            if (sArg.Equals("never")) {
+                eFsync = CLogWriter::FSYNC_NEVER;
+            } else if (sArg.Equals("close")) {
+                eFsync = CLogWriter::FSYNC_CLOSE;
+            } else if (sArg.Equals("flush")) {
+                eFsync = CLogWriter::FSYNC_FLUSH;
+            } else {
+                sMessage = t_f(
+                    "Invalid fsync policy [{1}]. Use one of: never, close, "
+                    "flush")(sArg);
+                return false;
+            }
+            bReadingFsync = false;
         } else if (sArg.Equals("-sanitize")) {
             m_bSanitize = true;
         } else if (sArg.Equals("-timestamp")) {
             bReadingTimestamp = true;
+        } else if (sArg.Equals("-fsync")) {
+            bReadingFsync = true;
         } else {
             // Only one arg may be LogPath
             if (bHaveLogPath) {
@@ -401,6 +613,10 @@ bool CLogMod::OnLoad(const CString& sArgs, CString& sMessage) {
         sMessage = t_f("Invalid log path [{1}]")(m_sLogPath);
         return false;
     } else {
+        struct stat ModDirInfo;
+        CFile::GetInfo(GetSavePath(), ModDirInfo);
+        m_Writer.SetOptions(eFsync, ModDirInfo.st_mode);
+
         sMessage = t_f("Logging to [{1}]. Using timestamp format '{2}'")(
             m_sLogPath, m_sTimestamp);
         return true;
@@ -610,7 +826,8 @@ void TModInfo<CLogMod>(CModInfo& Info) {
     Info.AddType(CModInfo::GlobalModule);
     Info.SetHasArgs(true);
     Info.SetArgsHelpText(
-        Info.t_s("[-sanitize] Optional path where to store logs."));
+        Info.t_s("[-sanitize] [-fsync never|close|flush] Optional path where "
+                 "to store logs."));
     Info.SetWikiPage("log");
 }
 
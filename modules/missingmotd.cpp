@@ -30,6 +30,7 @@ class CMissingMotd : public CModule {
 template <>
 void TModInfo<CMissingMotd>(CModInfo& Info) {
     Info.SetWikiPage("missingmotd");
+    Info.SetThreadAware();
     Info.SetHasArgs(false);
 }
 
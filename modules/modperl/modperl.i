@@ -163,6 +163,7 @@ class MCString : public std::map<CString, CString> {};
 %include "znc/Message.h"
 %include "znc/Modules.h"
 %include "znc/Nick.h"
+%ignore CNickMap;
 %include "znc/Chan.h"
 %include "znc/User.h"
 %include "znc/IRCNetwork.h"
@@ -222,11 +223,13 @@ class MCString : public std::map<CString, CString> {};
 %extend CModules {
 	void push_back(CModule* p) {
 		$self->push_back(p);
+		$self->ClearHookLists();
 	}
 	bool removeModule(CModule* p) {
 		for (CModules::iterator i = $self->begin(); $self->end() != i; ++i) {
 			if (*i == p) {
 				$self->erase(i);
+				$self->ClearHookLists();
 				return true;
 			}
 		}
@@ -248,7 +251,7 @@ class MCString : public std::map<CString, CString> {};
 
 %extend CChan {
 	std::map<CString, CNick> GetNicks_() {
-		return $self->GetNicks();
+		return $self->GetNickMap().ToMap();
 	}
 }
 
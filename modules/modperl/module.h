@@ -32,6 +32,8 @@ class ZNC_EXPORT_LIB_EXPORT CPerlModule : public CModule {
                 SV* perlObj)
         : CModule(nullptr, pUser, pNetwork, sModName, sDataPath, eType) {
         m_perlObj = newSVsv(perlObj);
+        // Hooks which perl doesn't handle end up in CModule
+        SetSkipUnusedHooks(false);
     }
     SV* GetPerlObj() { return sv_2mortal(newSVsv(m_perlObj)); }
 
@@ -163,6 +163,7 @@ class MCString : public std::map<CString, CString> {};
 %include "znc/Message.h"
 %include "znc/Modules.h"
 %include "znc/Nick.h"
+%ignore CNickMap;
 %include "znc/Chan.h"
 %include "znc/User.h"
 %include "znc/IRCNetwork.h"
@@ -252,6 +253,7 @@ class CPyRetBool {
 		for (CModules::iterator i = $self->begin(); $self->end() != i; ++i) {
 			if (*i == p) {
 				$self->erase(i);
+				$self->ClearHookLists();
 				return true;
 			}
 		}
@@ -297,7 +299,7 @@ class CPyRetBool {
 		return "<CChan " + $self->GetName() + ">";
 	}
 	std::map<CString, CNick> GetNicks_() {
-		return $self->GetNicks();
+		return $self->GetNickMap().ToMap();
 	}
 };
 
@@ -40,6 +40,8 @@ class ZNC_EXPORT_LIB_EXPORT CPyModule : public CModule {
         m_pyObj = pyObj;
         Py_INCREF(pyObj);
         m_pModPython = pModPython;
+        // Hooks which python doesn't handle end up in CModule
+        SetSkipUnusedHooks(false);
     }
     PyObject* GetPyObj() {  // borrows
         return m_pyObj;
@@ -23,7 +23,6 @@
 #include <tcl.h>
 
 using std::vector;
-using std::map;
 
 #define STDVAR (ClientData cd, Tcl_Interp * irp, int argc, const char* argv[])
 
@@ -366,8 +365,8 @@ class CModTcl : public CModule {
             return TCL_ERROR;
         }
 
-        const map<CString, CNick>& msNicks = pChannel->GetNicks();
-        for (map<CString, CNick>::const_iterator it = msNicks.begin();
+        const CNickMap& msNicks = pChannel->GetNickMap();
+        for (CNickMap::const_iterator it = msNicks.begin();
              it != msNicks.end(); ++it) {
             const CNick& Nick = it->second;
             l[0] = (Nick.GetNick()).c_str();
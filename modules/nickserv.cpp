@@ -142,6 +142,7 @@ class CNickServ : public CModule {
 template <>
 void TModInfo<CNickServ>(CModInfo& Info) {
     Info.SetWikiPage("nickserv");
+    Info.SetThreadAware();
     Info.SetHasArgs(true);
     Info.SetArgsHelpText(Info.t_s("Please enter your nickserv password."));
 }
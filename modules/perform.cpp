@@ -185,6 +185,7 @@ template <>
 void TModInfo<CPerform>(CModInfo& Info) {
     Info.AddType(CModInfo::UserModule);
     Info.SetWikiPage("perform");
+    Info.SetThreadAware();
 }
 
 NETWORKMODULEDEFS(
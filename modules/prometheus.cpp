@@ -0,0 +1,301 @@
+/*
+ * Copyright (C) 2004-2026 ZNC, see the NOTICE file for details.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <znc/IRCNetwork.h>
+#include <znc/IRCSock.h>
+#include <znc/Profiler.h>
+#include <znc/User.h>
+#include <znc/znc.h>
+
+// One metric family in the OpenMetrics text format. Samples of a family have
+// to be written together, so they are collected here first.
+class CMetricFamily {
+  public:
+    CMetricFamily(const CString& sName, const CString& sType,
+                  const CString& sHelp, const CString& sUnit = "")
+        : m_sName(sName), m_sType(sType), m_sHelp(sHelp), m_sUnit(sUnit) {}
+
+    void Add(const CString& sLabels, unsigned long long uValue) {
+        Add(sLabels, CString(uValue));
+    }
+
+    void Add(const CString& sLabels, const CString& sValue) {
+        AddSample(m_sType == "counter" ? "_total" : "", sLabels, sValue);
+    }
+
+    void AddHistogram(const CString& sLabels, const CProfileStats& Stats) {
+        unsigned long long uCount = 0;
+        for (unsigned int i = 0; i < CProfileStats::BUCKETS; ++i) {
+            uCount += Stats.GetBucket(i);
+            CString sLe = i + 1 < CProfileStats::BUCKETS
+                              ? Seconds(1ULL << i)
+                              : CString("+Inf");
+            AddSample("_bucket", Join(sLabels, Label("le", sLe)),
+                      CString(uCount));
+        }
+        AddSample("_count", sLabels, CString(Stats.GetCount()));
+        AddSample("_sum", sLabels, Seconds(Stats.GetTotal()));
+    }
+
+    CString ToString() const {
+        CString sRet = "# TYPE " + m_sName + " " + m_sType + "\n";
+        if (!m_sUnit.empty()) {
+            sRet += "# UNIT " + m_sName + " " + m_sUnit + "\n";
+        }
+        sRet += "# HELP " + m_sName + " " + m_sHelp + "\n";
+        return sRet + m_sSamples;
+    }
+
+    static CString Label(const CString& sName, const CString& sValue) {
+        CString sEscaped;
+        for (char c : sValue) {
+            if (c == '\\' || c == '"') {
+                sEscaped += '\\';
+                sEscaped += c;
+            } else if (c == '\n') {
+                sEscaped += "\\n";
+            } else {
+                sEscaped += c;
+            }
+        }
+        return sName + "=\"" + sEscaped + "\"";
+    }
+
+    static CString Join(const CString& sLabels, const CString& sLabel) {
+        if (sLabels.empty()) return sLabel;
+        return sLabels + "," + sLabel;
+    }
+
+    static CString Seconds(unsigned long long uMicroseconds) {
+        return CString(uMicroseconds / 1000000.0, 6);
+    }
+
+  private:
+    void AddSample(const CString& sSuffix, const CString& sLabels,
+                   const CString& sValue) {
+        m_sSamples += m_sName + sSuffix;
+        if (!sLabels.empty()) m_sSamples += "{" + sLabels + "}";
+        m_sSamples += " " + sValue + "\n";
+    }
+
+    CString m_sName;
+    CString m_sType;
+    CString m_sHelp;
+    CString m_sUnit;
+    CString m_sSamples;
+};
+
+class CPrometheusMod : public CModule {
+  public:
+    MODCONSTRUCTOR(CPrometheusMod) {}
+
+    bool WebRequiresAdmin() override { return true; }
+
+    bool OnWebRequest(CWebSock& WebSock, const CString& sPageName,
+                      CTemplate& Tmpl) override {
+        if (sPageName != "index" && sPageName != "metrics") {
+            return false;
+        }
+
+        CString sMetrics = GetMetrics();
+        WebSock.PrintHeader(
+            sMetrics.length(),
+            "application/openmetrics-text; version=1.0.0; charset=utf-8");
+        WebSock.Write(sMetrics);
+        WebSock.Close(Csock::CLT_AFTERWRITE);
+        return false;
+    }
+
+    void OnClientLogin() override { m_uClientLogins++; }
+    void OnIRCConnected() override { m_uIRCConnects++; }
+    void OnIRCDisconnected() override { m_uIRCDisconnects++; }
+
+  private:
+    CString GetMetrics() const {
+        using F = CMetricFamily;
+        F UserRead("znc_user_read_bytes", "counter",
+                   "Bytes received from the IRC servers and clients of a user",
+                   "bytes");
+        F UserWritten("znc_user_written_bytes", "counter",
+                      "Bytes sent to the IRC servers and clients of a user",
+                      "bytes");
+        F UserClients("znc_user_clients", "gauge",
+                      "Clients connected to a user");
+        F NetworkRead("znc_network_read_bytes", "counter",
+                      "Bytes received from the IRC server", "bytes");
+        F NetworkWritten("znc_network_written_bytes", "counter",
+                         "Bytes sent to the IRC server", "bytes");
+        F NetworkClients("znc_network_clients", "gauge",
+                         "Clients connected to a network");
+        F NetworkConnected("znc_network_connected", "gauge",
+                           "Whether the network is connected to IRC");
+        F SendQueue("znc_network_send_queue", "gauge",
+                    "Lines held back by flood protection");
+        F BufferLines("znc_buffer_lines", "gauge",
+                      "Lines in the channel and query buffers");
+        F BufferMemory("znc_buffer_memory_bytes", "gauge",
+                       "Estimated memory used by the channel and query "
+                       "buffers",
+                       "bytes");
+
+        // Everything here is a counter or a running total which ZNC keeps
+        // anyway, so a scrape doesn't look at channels, queries or buffer
+        // lines. Unlike CZNC::GetTrafficStats() it doesn't search the whole
+        // socket list either.
+        for (const auto& it : CZNC::Get().GetUserMap()) {
+            const CUser* pUser = it.second;
+            const CString sUserLabels =
+                F::Label("user", pUser->GetUsername());
+
+            // Sockets add their bytes to the user or network only when they
+            // are closed, the open ones are added here
+            unsigned long long uUserRead = pUser->BytesRead();
+            unsigned long long uUserWritten = pUser->BytesWritten();
+            size_t uClients = pUser->GetUserClients().size();
+            for (const CClient* pClient : pUser->GetUserClients()) {
+                uUserRead += pClient->GetBytesRead();
+                uUserWritten += pClient->GetBytesWritten();
+            }
+
+            for (const CIRCNetwork* pNetwork : pUser->GetNetworks()) {
+                const CString sNetworkLabels = F::Join(
+                    sUserLabels, F::Label("network", pNetwork->GetName()));
+
+                unsigned long long uRead = pNetwork->BytesRead();
+                unsigned long long uWritten = pNetwork->BytesWritten();
+                size_t auSendQueue[CIRCSock::PRIORITY_COUNT] = {};
+                const CIRCSock* pIRCSock = pNetwork->GetIRCSock();
+                if (pIRCSock) {
+                    uRead += pIRCSock->GetBytesRead();
+                    uWritten += pIRCSock->GetBytesWritten();
+                    // CUser::BytesRead() includes the network, but not the
+                    // sockets which are still open
+                    uUserRead += pIRCSock->GetBytesRead();
+                    uUserWritten += pIRCSock->GetBytesWritten();
+                    for (int i = 0; i < CIRCSock::PRIORITY_COUNT; ++i) {
+                        auSendQueue[i] = pIRCSock->GetSendQueueSize(
+                            (CIRCSock::ESendPriority)i);
+                    }
+                }
+                for (const CClient* pClient : pNetwork->GetClients()) {
+                    uUserRead += pClient->GetBytesRead();
+                    uUserWritten += pClient->GetBytesWritten();
+                }
+                uClients += pNetwork->GetClients().size();
+
+                NetworkRead.Add(sNetworkLabels, uRead);
+                NetworkWritten.Add(sNetworkLabels, uWritten);
+                NetworkClients.Add(sNetworkLabels,
+                                   pNetwork->GetClients().size());
+                NetworkConnected.Add(sNetworkLabels,
+                                     pNetwork->IsIRCConnected() ? 1 : 0);
+                // Indexed by CIRCSock::ESendPriority
+                const char* aszClasses[] = {"keepalive", "interactive",
+                                            "bulk"};
+                for (int i = 0; i < CIRCSock::PRIORITY_COUNT; ++i) {
+                    SendQueue.Add(F::Join(sNetworkLabels,
+                                          F::Label("class", aszClasses[i])),
+                                  auSendQueue[i]);
+                }
+
+                const CString sChannel =
+                    F::Join(sNetworkLabels, F::Label("type", "channel"));
+                const CString sQuery =
+                    F::Join(sNetworkLabels, F::Label("type", "query"));
+                const CBuffer::SUsage& ChanUsage =
+                    pNetwork->GetChanBufferUsage();
+                const CBuffer::SUsage& QueryUsage =
+                    pNetwork->GetQueryBufferUsage();
+                BufferLines.Add(sChannel, ChanUsage.uLines);
+                BufferLines.Add(sQuery, QueryUsage.uLines);
+                BufferMemory.Add(sChannel, ChanUsage.uMemory);
+                BufferMemory.Add(sQuery, QueryUsage.uMemory);
+            }
+
+            UserRead.Add(sUserLabels, uUserRead);
+            UserWritten.Add(sUserLabels, uUserWritten);
+            UserClients.Add(sUserLabels, uClients);
+        }
+
+        F ConnectQueue("znc_connect_queue", "gauge",
+                       "Networks waiting to connect to IRC");
+        ConnectQueue.Add("", CZNC::Get().GetConnectionQueue().size());
+
+        F ClientLogins("znc_client_logins", "counter",
+                       "Client logins since this module was loaded");
+        ClientLogins.Add("", m_uClientLogins);
+        F IRCConnects("znc_irc_connects", "counter",
+                      "IRC connections since this module was loaded");
+        IRCConnects.Add("", m_uIRCConnects);
+        F IRCDisconnects("znc_irc_disconnects", "counter",
+                         "IRC disconnections since this module was loaded");
+        IRCDisconnects.Add("", m_uIRCDisconnects);
+
+        // The rest only has data while the profiler is enabled, see the
+        // Profile command of *status
+        F ProfilerEnabled("znc_profiler_enabled", "gauge",
+                          "Whether the profiler is enabled");
+        ProfilerEnabled.Add("", CProfiler::IsEnabled() ? 1 : 0);
+
+        F LoopTime("znc_loop_iteration_seconds", "histogram",
+                   "Time spent in one iteration of the main loop", "seconds");
+        LoopTime.AddHistogram("",
+                              CProfiler::GetTimer(CProfiler::LoopIteration));
+        F ReadLineTime("znc_readline_seconds", "histogram",
+                       "Time spent handling one line", "seconds");
+        ReadLineTime.AddHistogram(
+            F::Label("source", "irc"),
+            CProfiler::GetTimer(CProfiler::IRCReadLine));
+        ReadLineTime.AddHistogram(
+            F::Label("source", "client"),
+            CProfiler::GetTimer(CProfiler::ClientReadLine));
+
+        F HookCalls("znc_module_hook_calls", "counter",
+                    "Calls of a module hook");
+        F HookTime("znc_module_hook_seconds", "counter",
+                   "Time spent in a module hook", "seconds");
+        for (const CProfiler::SHookStats& Hook : CProfiler::GetHookStats()) {
+            const CString sLabels = F::Join(F::Label("module", Hook.sModule),
+                                            F::Label("hook", Hook.sHook));
+            HookCalls.Add(sLabels, Hook.Stats.GetCount());
+            HookTime.Add(sLabels, F::Seconds(Hook.Stats.GetTotal()));
+        }
+
+        CString sRet;
+        for (const F* pFamily :
+             {&UserRead, &UserWritten, &UserClients, &NetworkRead,
+              &NetworkWritten, &NetworkClients, &NetworkConnected, &SendQueue,
+              &BufferLines, &BufferMemory, &ConnectQueue, &ClientLogins,
+              &IRCConnects, &IRCDisconnects, &ProfilerEnabled, &LoopTime,
+              &ReadLineTime, &HookCalls, &HookTime}) {
+            sRet += pFamily->ToString();
+        }
+        return sRet + "# EOF\n";
+    }
+
+    unsigned long long m_uClientLogins = 0;
+    unsigned long long m_uIRCConnects = 0;
+    unsigned long long m_uIRCDisconnects = 0;
+};
+
+template <>
+void TModInfo<CPrometheusMod>(CModInfo& Info) {
+    Info.SetWikiPage("prometheus");
+}
+
+GLOBALMODULEDEFS(CPrometheusMod,
+                 t_s("Exports statistics for Prometheus under "
+                     "/mods/global/prometheus/metrics"))
@@ -343,6 +343,7 @@ class CSASLMod : public CModule {
 template <>
 void TModInfo<CSASLMod>(CModInfo& Info) {
     Info.SetWikiPage("sasl");
+    Info.SetThreadAware();
 }
 
 NETWORKMODULEDEFS(CSASLMod, t_s("Adds support for sasl authentication "
@@ -243,6 +243,7 @@ void CSimpleAwayJob::RunJob() { ((CSimpleAway*)GetModule())->SetAway(false); }
 template <>
 void TModInfo<CSimpleAway>(CModInfo& Info) {
     Info.SetWikiPage("simple_away");
+    Info.SetThreadAware();
     Info.SetHasArgs(true);
     Info.SetArgsHelpText(
         Info.t_s("You might enter up to 3 arguments, like -notimer awaymessage "
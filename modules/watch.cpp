@@ -70,34 +70,22 @@ class CWatchEntry {
     }
     virtual ~CWatchEntry() {}
 
-    bool IsMatch(const CNick& Nick, const CString& sText,
-                 const CString& sSource, const CIRCNetwork* pNetwork) {
+    /// The host mask is checked by CWatcherMod::Process(), for all entries
+    /// at once.
+    bool IsMatch(const CString& sText, const CString& sSource,
+                 const CIRCNetwork* pNetwork) {
         if (IsDisabled()) {
             return false;
         }
 
-        bool bGoodSource = true;
-
         if (!sSource.empty() && !m_vsSources.empty()) {
-            bGoodSource = false;
-
-            for (unsigned int a = 0; a < m_vsSources.size(); a++) {
-                const CWatchSource& WatchSource = m_vsSources[a];
-
-                if (sSource.WildCmp(WatchSource.GetSource(),
-                                    CString::CaseInsensitive)) {
-                    if (WatchSource.IsNegated()) {
-                        return false;
-                    } else {
-                        bGoodSource = true;
-                    }
-                }
+            // A negated source wins over all others
+            if (m_NegatedSources.Matches(sSource) ||
+                !m_Sources.Matches(sSource)) {
+                return false;
             }
         }
 
-        if (!bGoodSource) return false;
-        if (!Nick.GetHostMask().WildCmp(m_sHostMask, CString::CaseInsensitive))
-            return false;
         return (sText.WildCmp(pNetwork->ExpandString(m_sPattern),
                               CString::CaseInsensitive));
     }
@@ -150,12 +138,16 @@ class CWatchEntry {
         sSources.Split(" ", vsSources, false);
 
         m_vsSources.clear();
+        m_Sources.Clear();
+        m_NegatedSources.Clear();
 
         for (it = vsSources.begin(); it != vsSources.end(); ++it) {
             if (it->at(0) == '!' && it->size() > 1) {
                 m_vsSources.push_back(CWatchSource(it->substr(1), true));
+                m_NegatedSources.Add(it->substr(1));
             } else {
                 m_vsSources.push_back(CWatchSource(*it, false));
+                m_Sources.Add(*it);
             }
         }
     }
@@ -169,6 +161,8 @@ class CWatchEntry {
     bool m_bDetachedClientOnly;
     bool m_bDetachedChannelOnly;
     vector<CWatchSource> m_vsSources;
+    CWildcardSet m_Sources;
+    CWildcardSet m_NegatedSources;
 };
 
 class CWatcherMod : public CModule {
@@ -233,6 +227,8 @@ class CWatcherMod : public CModule {
             m_lsWatchers.push_back(WatchEntry);
         }
 
+        UpdateHostMasks();
+
         if (bWarn)
             sMessage = t_s("WARNING: malformed entry found while loading");
         
@@ -338,8 +334,16 @@ class CWatcherMod : public CModule {
         CIRCNetwork* pNetwork = GetNetwork();
         CChan* pChannel = pNetwork->FindChan(sSource);
 
+        // Only the entries whose host mask matches are looked at
+        m_HostMasks.FindAll(Nick.GetHostMask(), m_vuMatches);
+        auto itMatch = m_vuMatches.begin();
+        size_t uIdx = 0;
+
         for (list<CWatchEntry>::iterator it = m_lsWatchers.begin();
-             it != m_lsWatchers.end(); ++it) {
+             it != m_lsWatchers.end() && itMatch != m_vuMatches.end();
+             ++it, ++uIdx) {
+            if (*itMatch != uIdx) continue;
+            ++itMatch;
             CWatchEntry& WatchEntry = *it;
 
             if (pNetwork->IsUserAttached() &&
@@ -352,7 +356,7 @@ class CWatcherMod : public CModule {
                 continue;
             }
 
-            if (WatchEntry.IsMatch(Nick, sMessage, sSource, pNetwork) &&
+            if (WatchEntry.IsMatch(sMessage, sSource, pNetwork) &&
                 sHandledTargets.count(WatchEntry.GetTarget()) < 1) {
                 if (pNetwork->IsUserAttached()) {
                     pNetwork->PutUser(":" + WatchEntry.GetTarget() +
@@ -665,7 +669,16 @@ class CWatcherMod : public CModule {
         Save();
     }
 
+    void UpdateHostMasks() {
+        m_HostMasks.Clear();
+        for (const CWatchEntry& WatchEntry : m_lsWatchers) {
+            m_HostMasks.Add(WatchEntry.GetHostMask());
+        }
+    }
+
+    // Every change of the entries ends up here
     void Save() {
+        UpdateHostMasks();
         ClearNV(false);
         for (list<CWatchEntry>::iterator it = m_lsWatchers.begin();
              it != m_lsWatchers.end(); ++it) {
@@ -690,6 +703,9 @@ class CWatcherMod : public CModule {
     }
 
     list<CWatchEntry> m_lsWatchers;
+    // The host masks of m_lsWatchers, in the same order
+    CWildcardSet m_HostMasks;
+    vector<size_t> m_vuMatches;
 };
 
 template <>
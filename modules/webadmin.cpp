@@ -978,6 +978,8 @@ class CWebAdminMod : public CModule {
                 CString(CIRCSock::IsFloodProtected(pNetwork->GetFloodRate()));
             Tmpl["FloodRate"] = CString(pNetwork->GetFloodRate());
             Tmpl["FloodBurst"] = CString(pNetwork->GetFloodBurst());
+            Tmpl["FloodRecvQ"] = CString(pNetwork->GetFloodRecvQ());
+            Tmpl["FloodByteRate"] = CString(pNetwork->GetFloodByteRate());
 
             Tmpl["JoinDelay"] = CString(pNetwork->GetJoinDelay());
 
@@ -1124,6 +1126,8 @@ class CWebAdminMod : public CModule {
         } else {
             pNetwork->SetFloodRate(-1);
         }
+        pNetwork->SetFloodRecvQ(WebSock.GetParam("floodrecvq").ToUInt());
+        pNetwork->SetFloodByteRate(WebSock.GetParam("floodbyterate").ToUInt());
 
         pNetwork->SetJoinDelay(WebSock.GetParam("joindelay").ToUShort());
 
@@ -17,32 +17,183 @@
 #include <znc/Buffer.h>
 #include <znc/znc.h>
 #include <znc/User.h>
+#include <algorithm>
 #include <time.h>
 
+namespace {
+enum {
+    RECORD_COLON = 0x1,
+};
+
+void AppendLength(CString& sRecord, size_t uLen) {
+    // 7 bits per byte, the high bit means "more bytes follow"
+    while (uLen >= 0x80) {
+        sRecord += static_cast<char>((uLen & 0x7f) | 0x80);
+        uLen >>= 7;
+    }
+    sRecord += static_cast<char>(uLen);
+}
+
+void AppendField(CString& sRecord, const CString& sField) {
+    AppendLength(sRecord, sField.length());
+    sRecord += sField;
+}
+
+class CRecordReader {
+  public:
+    explicit CRecordReader(const CString& sRecord)
+        : m_p(sRecord.data()), m_end(sRecord.data() + sRecord.size()) {}
+
+    char ReadByte() { return m_p < m_end ? *m_p++ : 0; }
+
+    size_t ReadLength() {
+        size_t uLen = 0;
+        for (unsigned int uShift = 0; m_p < m_end; uShift += 7) {
+            unsigned char c = *m_p++;
+            uLen |= static_cast<size_t>(c & 0x7f) << uShift;
+            if (!(c & 0x80)) break;
+        }
+        return uLen;
+    }
+
+    CString ReadField() {
+        size_t uLen = std::min<size_t>(ReadLength(), m_end - m_p);
+        CString sField(m_p, uLen);
+        m_p += uLen;
+        return sField;
+    }
+
+  private:
+    const char* m_p;
+    const char* m_end;
+};
+
+CString SerializeTags(const MCString& mssTags) {
+    CString sTags;
+    for (const auto& it : mssTags) {
+        if (!sTags.empty()) {
+            sTags += ";";
+        }
+        sTags += it.first;
+        if (!it.second.empty()) {
+            sTags += "=" + it.second.Escape_n(CString::EMSGTAG);
+        }
+    }
+    return sTags;
+}
+
+void ParseTags(const CString& sTags, MCString& mssTags) {
+    if (sTags.empty()) return;
+    VCString vsTags;
+    sTags.Split(";", vsTags, true);
+    for (const CString& sTag : vsTags) {
+        CString sValue = sTag.Token(1, true, "=");
+        mssTags[sTag.Token(0, false, "=")] =
+            sValue.Escape(CString::EMSGTAG, CString::EASCII);
+    }
+}
+}  // namespace
+
 CBufLine::CBufLine(const CMessage& Format, const CString& sText)
-    : m_Message(Format), m_sText(sText) {}
+    : m_sText(sText), m_time(Format.GetTime()) {
+    SetMessage(Format);
+}
 
 CBufLine::CBufLine(const CString& sFormat, const CString& sText,
                    const timeval* ts, const MCString& mssTags)
     : m_sText(sText) {
-    m_Message.Parse(sFormat);
-    m_Message.SetTags(mssTags);
+    CMessage Message(sFormat);
+    Message.SetTags(mssTags);
+    SetMessage(Message);
 
     if (ts == nullptr)
         UpdateTime();
     else
-        m_Message.SetTime(*ts);
+        m_time = *ts;
 }
 
 CBufLine::~CBufLine() {}
 
 void CBufLine::UpdateTime() {
-    m_Message.SetTime(CUtils::GetTime());
+    m_time = CUtils::GetTime();
+}
+
+void CBufLine::SetMessage(const CMessage& Message) {
+    const CNick& Nick = Message.GetNick();
+    const VCString& vsParams = Message.GetParams();
+
+    CString sRecord;
+    sRecord += static_cast<char>(Message.m_bColon ? RECORD_COLON : 0);
+    // Tags are stored escaped, the same way as they are sent to clients
+    AppendField(sRecord, SerializeTags(Message.GetTags()));
+    AppendLength(sRecord, vsParams.size());
+    for (const CString& sParam : vsParams) {
+        AppendField(sRecord, sParam);
+    }
+    sRecord.shrink_to_fit();
+
+    m_sCommand = Message.GetCommand();
+    m_sNick = Nick.GetNick();
+    m_sIdent = Nick.GetIdent();
+    m_sHost = Nick.GetHost();
+    m_sRecord = std::move(sRecord);
+}
+
+CMessage CBufLine::GetMessage() const {
+    CRecordReader Reader(m_sRecord);
+    bool bColon = Reader.ReadByte() & RECORD_COLON;
+    CNick Nick;
+    Nick.SetNick(m_sNick);
+    Nick.SetIdent(m_sIdent);
+    Nick.SetHost(m_sHost);
+
+    // This constructor stores everything as owned values, so they can be
+    // filled in directly
+    CMessage Message(Nick, m_sCommand);
+    ParseTags(Reader.ReadField(), Message.m_mssTags);
+    Message.m_vsParams.resize(Reader.ReadLength());
+    for (CString& sParam : Message.m_vsParams) {
+        sParam = Reader.ReadField();
+    }
+    Message.m_bColon = bColon;
+    Message.m_time = m_time;
+    Message.InitType();
+
+    return Message;
+}
+
+bool CBufLine::Equals(const CMessage& Format) const {
+    return GetMessage().Equals(Format);
+}
+
+void CBufLine::SetFormat(const CString& sFormat) {
+    CMessage Message(sFormat);
+    Message.SetTags(GetTags());
+    SetMessage(Message);
+}
+
+void CBufLine::SetTags(const MCString& mssTags) {
+    CMessage Message = GetMessage();
+    Message.SetTags(mssTags);
+    SetMessage(Message);
+}
+
+CString CBufLine::GetFormat() const {
+    return GetMessage().ToString(CMessage::ExcludeTags);
+}
+
+MCString CBufLine::GetTags() const {
+    // The tags come right after the flags, the rest needn't be unpacked
+    CRecordReader Reader(m_sRecord);
+    Reader.ReadByte();
+    MCString mssTags;
+    ParseTags(Reader.ReadField(), mssTags);
+    return mssTags;
 }
 
 CMessage CBufLine::ToMessage(const CClient& Client,
                              const MCString& mssParams) const {
-    CMessage Line = m_Message;
+    CMessage Line = GetMessage();
 
     CString sSender = Line.GetNick().GetNickMask();
     Line.SetNick(CNick(CString::NamedFormat(sSender, mssParams)));
@@ -68,6 +219,7 @@ CMessage CBufLine::ToMessage(const CClient& Client,
 CString CBufLine::GetLine(const CClient& Client,
                           const MCString& mssParams) const {
     CMessage Line = ToMessage(Client, mssParams);
+    CString sTime = Line.GetTag("time");
 
     // Note: Discard all tags (except the time tag, conditionally) to
     // keep the same behavior as ZNC versions 1.6 and earlier had. See
@@ -75,9 +227,8 @@ CString CBufLine::GetLine(const CClient& Client,
     Line.SetTags(MCString::EmptyMap);
 
     if (Client.HasServerTime()) {
-        CString sTime = m_Message.GetTag("time");
         if (sTime.empty()) {
-            sTime = CUtils::FormatServerTime(m_Message.GetTime());
+            sTime = CUtils::FormatServerTime(m_time);
         }
         Line.SetTag("time", sTime);
     }
@@ -87,7 +238,72 @@ CString CBufLine::GetLine(const CClient& Client,
 
 CBuffer::CBuffer(unsigned int uLineCount) : m_uLineCount(uLineCount) {}
 
-CBuffer::~CBuffer() {}
+CBuffer::CBuffer(const CBuffer& Other)
+    : m_uLineCount(Other.m_uLineCount),
+      m_vLines(Other.m_vLines),
+      m_uFirst(Other.m_uFirst),
+      m_uLineMemory(Other.m_uLineMemory),
+      m_spRendered(Other.m_spRendered),
+      m_wpSnapshot(Other.m_wpSnapshot) {}
+
+CBuffer::CBuffer(CBuffer&& Other)
+    : m_uLineCount(Other.m_uLineCount),
+      m_vLines(std::move(Other.m_vLines)),
+      m_uFirst(Other.m_uFirst),
+      m_uLineMemory(Other.m_uLineMemory),
+      m_spRendered(std::move(Other.m_spRendered)),
+      m_wpSnapshot(std::move(Other.m_wpSnapshot)) {
+    Other.Clear();
+}
+
+CBuffer& CBuffer::operator=(const CBuffer& Other) {
+    if (this != &Other) {
+        m_uLineCount = Other.m_uLineCount;
+        m_vLines = Other.m_vLines;
+        m_uFirst = Other.m_uFirst;
+        m_uLineMemory = Other.m_uLineMemory;
+        m_spRendered = Other.m_spRendered;
+        m_wpSnapshot = Other.m_wpSnapshot;
+        UpdateUsage();
+    }
+    return *this;
+}
+
+CBuffer& CBuffer::operator=(CBuffer&& Other) {
+    if (this != &Other) {
+        m_uLineCount = Other.m_uLineCount;
+        m_vLines = std::move(Other.m_vLines);
+        m_uFirst = Other.m_uFirst;
+        m_uLineMemory = Other.m_uLineMemory;
+        m_spRendered = std::move(Other.m_spRendered);
+        m_wpSnapshot = std::move(Other.m_wpSnapshot);
+        UpdateUsage();
+        Other.Clear();
+    }
+    return *this;
+}
+
+CBuffer::~CBuffer() { SetUsage(nullptr); }
+
+void CBuffer::SetUsage(SUsage* pUsage) {
+    if (m_pUsage) {
+        m_pUsage->uLines -= m_Counted.uLines;
+        m_pUsage->uMemory -= m_Counted.uMemory;
+    }
+    m_pUsage = pUsage;
+    m_Counted = SUsage();
+    UpdateUsage();
+}
+
+void CBuffer::UpdateUsage() {
+    if (!m_pUsage) return;
+    SUsage Now;
+    Now.uLines = Size();
+    Now.uMemory = GetMemoryUsage();
+    m_pUsage->uLines += Now.uLines - m_Counted.uLines;
+    m_pUsage->uMemory += Now.uMemory - m_Counted.uMemory;
+    m_Counted = Now;
+}
 
 CBuffer::size_type CBuffer::AddLine(const CMessage& Format,
                                     const CString& sText) {
@@ -95,21 +311,44 @@ CBuffer::size_type CBuffer::AddLine(const CMessage& Format,
         return 0;
     }
 
-    while (size() >= m_uLineCount) {
-        erase(begin());
+    m_spRendered.reset();
+    m_wpSnapshot.reset();
+
+    if (m_vLines.size() >= m_uLineCount) {
+        // The buffer is full, replace the oldest line
+        m_uLineMemory -= At(0).GetMemoryUsage();
+        At(0) = CBufLine(Format, sText);
+        m_uLineMemory += At(0).GetMemoryUsage();
+        m_uFirst = (m_uFirst + 1) % m_vLines.size();
+        UpdateUsage();
+        return m_vLines.size();
     }
 
-    push_back(CBufLine(Format, sText));
-    return size();
+    if (m_vLines.size() == m_vLines.capacity()) {
+        // Don't let the vector grow past the line count
+        m_vLines.reserve(std::min<size_type>(
+            std::max<size_type>(m_vLines.capacity() * 2, 16), m_uLineCount));
+    }
+    m_vLines.push_back(CBufLine(Format, sText));
+    m_uLineMemory += m_vLines.back().GetMemoryUsage();
+    UpdateUsage();
+    return m_vLines.size();
 }
 
 CBuffer::size_type CBuffer::UpdateLine(const CString& sCommand,
                                        const CMessage& Format,
                                        const CString& sText) {
-    for (CBufLine& Line : *this) {
-        if (Line.GetCommand().Equals(sCommand)) {
+    CInternedString sInternedCommand = sCommand;
+    for (size_type uIdx = 0; uIdx < m_vLines.size(); ++uIdx) {
+        CBufLine& Line = At(uIdx);
+        if (Line.CommandEquals(sInternedCommand)) {
+            m_spRendered.reset();
+            m_wpSnapshot.reset();
+            m_uLineMemory -= Line.GetMemoryUsage();
             Line = CBufLine(Format, sText);
-            return size();
+            m_uLineMemory += Line.GetMemoryUsage();
+            UpdateUsage();
+            return m_vLines.size();
         }
     }
 
@@ -118,9 +357,9 @@ CBuffer::size_type CBuffer::UpdateLine(const CString& sCommand,
 
 CBuffer::size_type CBuffer::UpdateExactLine(const CMessage& Format,
                                             const CString& sText) {
-    for (CBufLine& Line : *this) {
+    for (const CBufLine& Line : m_vLines) {
         if (Line.Equals(Format)) {
-            return size();
+            return m_vLines.size();
         }
     }
 
@@ -150,12 +389,99 @@ CBuffer::size_type CBuffer::UpdateExactLine(const CString& sFormat,
 }
 
 const CBufLine& CBuffer::GetBufLine(unsigned int uIdx) const {
-    return (*this)[uIdx];
+    return At(uIdx);
 }
 
 CString CBuffer::GetLine(size_type uIdx, const CClient& Client,
                          const MCString& msParams) const {
-    return (*this)[uIdx].GetLine(Client, msParams);
+    return At(uIdx).GetLine(Client, msParams);
+}
+
+CString CBuffer::GetRenderProfile(const CClient& Client,
+                                  const MCString& msParams) {
+    CString sProfile;
+    if (Client.HasServerTime()) {
+        sProfile = "servertime";
+    } else {
+        const CUser* pUser = Client.GetUser();
+        sProfile = pUser->GetTimestampFormat() + "\n" +
+                   CString(pUser->GetTimestampAppend()) + " " +
+                   CString(pUser->GetTimestampPrepend()) + "\n" +
+                   pUser->GetTimezone();
+    }
+
+    for (const auto& it : msParams) {
+        sProfile += "\n" + it.first + "=" + it.second;
+    }
+
+    return sProfile;
+}
+
+const CMessage& CBuffer::ToMessage(size_type uIdx, const CClient& Client,
+                                   const MCString& msParams) const {
+    return ToMessage(uIdx, Client, msParams, GetRenderProfile(Client, msParams));
+}
+
+const CMessage& CBuffer::ToMessage(size_type uIdx, const CClient& Client,
+                                   const MCString& msParams,
+                                   const CString& sProfile) const {
+    if (!m_spRendered) {
+        m_spRendered = std::make_shared<std::deque<SRendered>>();
+    }
+
+    // There are only a few profiles, and usually the first one matches
+    std::deque<SRendered>& dqRendered = *m_spRendered;
+    auto it = std::find_if(
+        dqRendered.begin(), dqRendered.end(),
+        [&](const SRendered& Rendered) { return Rendered.sProfile == sProfile; });
+    if (it == dqRendered.end()) {
+        if (dqRendered.size() >= RENDER_PROFILES) {
+            // Forget the least recently used one
+            dqRendered.pop_back();
+        }
+        dqRendered.emplace_front();
+        dqRendered.front().sProfile = sProfile;
+        dqRendered.front().vpMessages.resize(m_vLines.size());
+    } else if (it != dqRendered.begin()) {
+        std::rotate(dqRendered.begin(), it, it + 1);
+    }
+
+    std::unique_ptr<CMessage>& pMessage = dqRendered.front().vpMessages[uIdx];
+    if (!pMessage) {
+        pMessage.reset(new CMessage(At(uIdx).ToMessage(Client, msParams)));
+    }
+
+    return *pMessage;
+}
+
+std::shared_ptr<const CBuffer> CBuffer::GetSnapshot() const {
+    std::shared_ptr<const CBuffer> spSnapshot = m_wpSnapshot.lock();
+    if (!spSnapshot) {
+        std::shared_ptr<CBuffer> spCopy = std::make_shared<CBuffer>(*this);
+        // Lines rendered on the copy go away with it
+        spCopy->m_spRendered.reset();
+        spSnapshot = spCopy;
+        m_wpSnapshot = spSnapshot;
+    }
+    return spSnapshot;
+}
+
+void CBuffer::Clear() {
+    // Give the memory back, the buffer may stay empty for a long time
+    std::vector<CBufLine>().swap(m_vLines);
+    m_uFirst = 0;
+    m_uLineMemory = 0;
+    m_spRendered.reset();
+    m_wpSnapshot.reset();
+    UpdateUsage();
+}
+
+void CBuffer::Linearize() {
+    if (m_uFirst != 0) {
+        std::rotate(m_vLines.begin(), m_vLines.begin() + m_uFirst,
+                    m_vLines.end());
+        m_uFirst = 0;
+    }
 }
 
 bool CBuffer::SetLineCount(unsigned int u, bool bForce) {
@@ -164,10 +490,21 @@ bool CBuffer::SetLineCount(unsigned int u, bool bForce) {
     }
 
     m_uLineCount = u;
+    m_spRendered.reset();
+    m_wpSnapshot.reset();
+
+    // New lines are appended at the end again when the buffer isn't full
+    Linearize();
 
     // We may need to shrink the buffer if the allowed size got smaller
-    while (size() > m_uLineCount) {
-        erase(begin());
+    if (m_vLines.size() > m_uLineCount) {
+        auto itEnd = m_vLines.begin() + (m_vLines.size() - m_uLineCount);
+        for (auto it = m_vLines.begin(); it != itEnd; ++it) {
+            m_uLineMemory -= it->GetMemoryUsage();
+        }
+        m_vLines.erase(m_vLines.begin(), itEnd);
+        m_vLines.shrink_to_fit();
+        UpdateUsage();
     }
 
     return true;
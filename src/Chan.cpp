@@ -21,11 +21,147 @@
 #include <znc/Config.h>
 #include <znc/znc.h>
 #include <znc/Message.h>
+#include <stdexcept>
 
 using std::set;
 using std::vector;
 using std::map;
 
+CNickMap::const_iterator CNickMap::find(const CString& sNick) const {
+    if (m_vSlots.empty()) return end();
+
+    size_t uSlot = FindSlot(sNick, Hash(sNick));
+    if (!m_vSlots[uSlot].uHash) return end();
+
+    return const_iterator(m_vSlots.data() + uSlot,
+                          m_vSlots.data() + m_vSlots.size());
+}
+
+const CNick& CNickMap::at(const CString& sNick) const {
+    const CNick* pNick = Find(sNick);
+    if (!pNick) throw std::out_of_range("CNickMap::at");
+    return *pNick;
+}
+
+map<CString, CNick> CNickMap::ToMap() const {
+    map<CString, CNick> msNicks;
+    for (const SSlot& Slot : m_vSlots) {
+        if (Slot.uHash) msNicks[Slot.Nick.GetNick()] = Slot.Nick;
+    }
+    return msNicks;
+}
+
+CNick* CNickMap::Find(const CString& sNick) {
+    if (m_vSlots.empty()) return nullptr;
+
+    SSlot& Slot = m_vSlots[FindSlot(sNick, Hash(sNick))];
+    return Slot.uHash ? &Slot.Nick : nullptr;
+}
+
+const CNick* CNickMap::Find(const CString& sNick) const {
+    return const_cast<CNickMap*>(this)->Find(sNick);
+}
+
+CNick& CNickMap::Insert(const CNick& Nick) {
+    // Keep the load factor below 3/4
+    if ((m_uSize + 1) * 4 > m_vSlots.size() * 3) {
+        Rehash(m_vSlots.empty() ? 8 : m_vSlots.size() * 2);
+    }
+
+    unsigned int uHash = Hash(Nick.GetNick());
+    SSlot& Slot = m_vSlots[FindSlot(Nick.GetNick(), uHash)];
+    if (!Slot.uHash) {
+        Slot.uHash = uHash;
+        m_uSize++;
+    }
+    Slot.Nick = Nick;
+    Slot.Nick.Share();
+
+    return Slot.Nick;
+}
+
+bool CNickMap::Erase(const CString& sNick) {
+    if (m_vSlots.empty()) return false;
+
+    const size_t uMask = m_vSlots.size() - 1;
+    size_t uHole = FindSlot(sNick, Hash(sNick));
+    if (!m_vSlots[uHole].uHash) return false;
+
+    // Linear probing without tombstones: move back the following entries
+    // which can't be found anymore once the hole is there
+    for (size_t uSlot = (uHole + 1) & uMask; m_vSlots[uSlot].uHash;
+         uSlot = (uSlot + 1) & uMask) {
+        size_t uHome = m_vSlots[uSlot].uHash & uMask;
+        if (((uSlot - uHome) & uMask) >= ((uSlot - uHole) & uMask)) {
+            m_vSlots[uHole] = m_vSlots[uSlot];
+            uHole = uSlot;
+        }
+    }
+
+    m_vSlots[uHole] = SSlot();
+    m_uSize--;
+
+    return true;
+}
+
+void CNickMap::Clear() {
+    std::vector<SSlot>().swap(m_vSlots);
+    m_uSize = 0;
+}
+
+void CNickMap::SetCaseFold(const unsigned char* puCaseFold) {
+    if (m_puCaseFold == puCaseFold) return;
+
+    m_puCaseFold = puCaseFold;
+    // Nicks which were different before may be equal now, the last one wins
+    Rehash(m_vSlots.size());
+}
+
+unsigned int CNickMap::Hash(const CString& sNick) const {
+    // FNV-1a
+    unsigned int uHash = 2166136261u;
+    for (unsigned char c : sNick) {
+        uHash ^= m_puCaseFold[c];
+        uHash *= 16777619u;
+    }
+    return uHash ? uHash : 1;
+}
+
+bool CNickMap::NickEquals(const CString& sNick1,
+                          const CString& sNick2) const {
+    if (sNick1.length() != sNick2.length()) return false;
+
+    for (size_t i = 0; i < sNick1.length(); ++i) {
+        if (m_puCaseFold[(unsigned char)sNick1[i]] !=
+            m_puCaseFold[(unsigned char)sNick2[i]]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t CNickMap::FindSlot(const CString& sNick, unsigned int uHash) const {
+    const size_t uMask = m_vSlots.size() - 1;
+
+    for (size_t uSlot = uHash & uMask;; uSlot = (uSlot + 1) & uMask) {
+        const SSlot& Slot = m_vSlots[uSlot];
+        if (!Slot.uHash ||
+            (Slot.uHash == uHash && NickEquals(Slot.Nick.GetNick(), sNick))) {
+            return uSlot;
+        }
+    }
+}
+
+void CNickMap::Rehash(size_t uSlots) {
+    std::vector<SSlot> vOldSlots(uSlots);
+    vOldSlots.swap(m_vSlots);
+    m_uSize = 0;
+
+    for (const SSlot& Slot : vOldSlots) {
+        if (Slot.uHash) Insert(Slot.Nick);
+    }
+}
+
 CChan::CChan(const CString& sName, CIRCNetwork* pNetwork, bool bInConfig,
              CConfig* pConfig)
     : m_bDetached(false),
@@ -46,7 +182,9 @@ CChan::CChan(const CString& sName, CIRCNetwork* pNetwork, bool bInConfig,
       m_Nick(),
       m_uJoinTries(0),
       m_sDefaultModes(""),
+      m_Nicks(CIRCNetwork::GetCaseFoldTable(pNetwork->GetCaseMapping())),
       m_msNicks(),
+      m_bNicksCopied(false),
       m_Buffer(),
       m_bModeKnown(false),
       m_mcsModes() {
@@ -55,6 +193,7 @@ CChan::CChan(const CString& sName, CIRCNetwork* pNetwork, bool bInConfig,
     }
 
     m_Nick.SetNetwork(m_pNetwork);
+    m_Buffer.SetUsage(&m_pNetwork->GetChanBufferUsage());
     m_Buffer.SetLineCount(m_pNetwork->GetUser()->GetChanBufferSize(), true);
 
     if (pConfig) {
@@ -192,8 +331,9 @@ void CChan::AttachUser(CClient* pClient) {
         else
             pThisClient = pTarget;
 
-        for (map<CString, CNick>::iterator a = m_msNicks.begin();
-             a != m_msNicks.end(); ++a) {
+        size_t uLeft = m_Nicks.size();
+        for (CNickMap::const_iterator a = m_Nicks.begin(); a != m_Nicks.end();
+             ++a) {
             if (pThisClient->HasNamesx()) {
                 sPerm = a->second.GetPermStr();
             } else {
@@ -213,7 +353,7 @@ void CChan::AttachUser(CClient* pClient) {
 
             sLine += sPerm + sNick;
 
-            if (sLine.size() >= 490 || a == (--m_msNicks.end())) {
+            if (sLine.size() >= 490 || --uLeft == 0) {
                 m_pNetwork->PutUser(sLine, pThisClient);
                 sLine = sPre;
             } else {
@@ -532,7 +672,10 @@ CString CChan::GetModeArg(CString& sArgs) const {
     return sRet;
 }
 
-void CChan::ClearNicks() { m_msNicks.clear(); }
+void CChan::ClearNicks() {
+    m_Nicks.Clear();
+    ClearNicksCopy();
+}
 
 int CChan::AddNicks(const CString& sNicks) {
     int iRet = 0;
@@ -570,11 +713,11 @@ bool CChan::AddNick(const CString& sNick) {
     // Get the nick
     sTmp = sTmp.Token(0, false, "!");
 
-    CNick tmpNick(sTmp);
     CNick* pNick = FindNick(sTmp);
     if (!pNick) {
-        pNick = &tmpNick;
-        pNick->SetNetwork(m_pNetwork);
+        CNick Nick(sTmp);
+        Nick.SetNetwork(m_pNetwork);
+        pNick = &m_Nicks.Insert(Nick);
     }
 
     if (!sIdent.empty()) pNick->SetIdent(sIdent);
@@ -590,15 +733,13 @@ bool CChan::AddNick(const CString& sNick) {
         }
     }
 
-    m_msNicks[pNick->GetNick()] = *pNick;
-
     return true;
 }
 
 map<char, unsigned int> CChan::GetPermCounts() const {
     map<char, unsigned int> mRet;
 
-    for (const auto& it : m_msNicks) {
+    for (const auto& it : m_Nicks) {
         CString sPerms = it.second.GetPermStr();
 
         for (unsigned int p = 0; p < sPerms.size(); p++) {
@@ -610,134 +751,213 @@ map<char, unsigned int> CChan::GetPermCounts() const {
 }
 
 bool CChan::RemNick(const CString& sNick) {
-    map<CString, CNick>::iterator it;
+    ClearNicksCopy();
+    return m_Nicks.Erase(sNick);
+}
 
-    it = m_msNicks.find(sNick);
-    if (it == m_msNicks.end()) {
+bool CChan::ChangeNick(const CString& sOldNick, const CString& sNewNick) {
+    CNick* pNick = m_Nicks.Find(sOldNick);
+
+    if (!pNick) {
         return false;
     }
 
-    m_msNicks.erase(it);
+    // Rename this nick, it belongs to a different slot now
+    CNick Nick = *pNick;
+    Nick.SetNick(sNewNick);
+    m_Nicks.Erase(sOldNick);
+    m_Nicks.Insert(Nick);
+    ClearNicksCopy();
 
     return true;
 }
 
-bool CChan::ChangeNick(const CString& sOldNick, const CString& sNewNick) {
-    map<CString, CNick>::iterator it = m_msNicks.find(sOldNick);
+void CChan::UpdateCaseMapping() {
+    m_Nicks.SetCaseFold(
+        CIRCNetwork::GetCaseFoldTable(m_pNetwork->GetCaseMapping()));
+    ClearNicksCopy();
+}
+
+const CNick* CChan::FindNick(const CString& sNick) const {
+    return m_Nicks.Find(sNick);
+}
+
+CNick* CChan::FindNick(const CString& sNick) {
+    // The caller may change the nick
+    ClearNicksCopy();
+    return m_Nicks.Find(sNick);
+}
+
+const map<CString, CNick>& CChan::GetNicks() const {
+    if (!m_bNicksCopied) {
+        m_msNicks = m_Nicks.ToMap();
+        m_bNicksCopied = true;
+    }
+    return m_msNicks;
+}
+
+void CChan::ClearNicksCopy() {
+    if (m_bNicksCopied) {
+        m_msNicks.clear();
+        m_bNicksCopied = false;
+    }
+}
+
+namespace {
+// Plays back a channel buffer to one client, see CChan::SendBuffer()
+class CChanPlayback : public CBufferPlayback, private CCoreTranslationMixin {
+  public:
+    CChanPlayback(const CString& sChan, std::shared_ptr<const CBuffer> spBuffer)
+        : m_sChan(sChan), m_spBuffer(std::move(spBuffer)) {}
 
-    if (it == m_msNicks.end()) {
+    bool Play(CClient& Client) override;
+    void Cancel(CClient& Client) override;
+
+  private:
+    CString m_sChan;
+    std::shared_ptr<const CBuffer> m_spBuffer;
+    bool m_bStarted = false;
+    // The network OnChanBufferStarting() was called for
+    CIRCNetwork* m_pNetwork = nullptr;
+    // The client's settings when the playback started, see
+    // CBuffer::GetRenderProfile()
+    CString m_sProfile;
+    bool m_bBatch = false;
+    CString m_sBatchName;
+    size_t m_uIdx = 0;
+};
+
+bool CChanPlayback::Play(CClient& Client) {
+    CIRCNetwork* pNetwork = Client.GetNetwork();
+    CChan* pChan = pNetwork ? pNetwork->FindChan(m_sChan) : nullptr;
+
+    if (!pChan) {
+        // The channel is gone
+        Cancel(Client);
         return false;
     }
 
-    // Rename this nick
-    it->second.SetNick(sNewNick);
+    if (!m_bStarted) {
+        m_bStarted = true;
+        m_pNetwork = pNetwork;
+        m_sProfile = CBuffer::GetRenderProfile(Client);
 
-    // Insert a new element into the map then erase the old one, do this to
-    // change the key to the new nick
-    m_msNicks[sNewNick] = it->second;
-    m_msNicks.erase(it);
+        bool bSkipStatusMsg = Client.HasServerTime();
+        NETWORKMODULECALL(OnChanBufferStarting(*pChan, Client),
+                          pNetwork->GetUser(), pNetwork, nullptr,
+                          &bSkipStatusMsg);
 
-    return true;
-}
+        if (!bSkipStatusMsg) {
+            pNetwork->PutUser(":***!znc@znc.in PRIVMSG " + pChan->GetName() +
+                                  " :" + t_s("Buffer Playback..."),
+                              &Client);
+        }
 
-const CNick* CChan::FindNick(const CString& sNick) const {
-    map<CString, CNick>::const_iterator it = m_msNicks.find(sNick);
-    return (it != m_msNicks.end()) ? &it->second : nullptr;
+        m_bBatch = Client.HasBatch();
+        m_sBatchName = pChan->GetName().MD5();
+
+        if (m_bBatch) {
+            pNetwork->PutUser(":znc.in BATCH +" + m_sBatchName +
+                                  " znc.in/playback " + pChan->GetName(),
+                              &Client);
+        }
+
+        return true;
+    }
+
+    if (m_uIdx < m_spBuffer->Size()) {
+        CMessage Message = m_spBuffer->ToMessage(
+            m_uIdx++, Client, MCString::EmptyMap, m_sProfile);
+        Message.SetChan(pChan);
+        Message.SetNetwork(pNetwork);
+        Message.SetClient(&Client);
+        if (m_bBatch) {
+            Message.SetTag("batch", m_sBatchName);
+        }
+        bool bNotShowThisLine = false;
+        NETWORKMODULECALL(OnChanBufferPlayMessage(Message),
+                          pNetwork->GetUser(), pNetwork, nullptr,
+                          &bNotShowThisLine);
+        if (!bNotShowThisLine) {
+            pNetwork->PutUser(Message, &Client);
+        }
+
+        return true;
+    }
+
+    bool bSkipStatusMsg = Client.HasServerTime();
+    NETWORKMODULECALL(OnChanBufferEnding(*pChan, Client), pNetwork->GetUser(),
+                      pNetwork, nullptr, &bSkipStatusMsg);
+    if (!bSkipStatusMsg) {
+        pNetwork->PutUser(":***!znc@znc.in PRIVMSG " + pChan->GetName() +
+                              " :" + t_s("Playback Complete."),
+                          &Client);
+    }
+
+    if (m_bBatch) {
+        pNetwork->PutUser(":znc.in BATCH -" + m_sBatchName, &Client);
+    }
+
+    return false;
 }
 
-CNick* CChan::FindNick(const CString& sNick) {
-    map<CString, CNick>::iterator it = m_msNicks.find(sNick);
-    return (it != m_msNicks.end()) ? &it->second : nullptr;
+void CChanPlayback::Cancel(CClient& Client) {
+    // Modules which saw OnChanBufferStarting() expect OnChanBufferEnding().
+    // If the client was moved to another network, the old one may be gone
+    // already.
+    CIRCNetwork* pNetwork = Client.GetNetwork();
+    CChan* pChan = m_bStarted && pNetwork == m_pNetwork
+                       ? pNetwork->FindChan(m_sChan)
+                       : nullptr;
+    if (pChan) {
+        // The playback wasn't complete, so there is no status message
+        bool bSkipStatusMsg = true;
+        NETWORKMODULECALL(OnChanBufferEnding(*pChan, Client),
+                          pNetwork->GetUser(), pNetwork, nullptr,
+                          &bSkipStatusMsg);
+    }
+
+    // Don't leave the client with an unterminated batch
+    if (m_bBatch) {
+        Client.PutClient(":znc.in BATCH -" + m_sBatchName);
+        m_bBatch = false;
+    }
 }
+}  // namespace
 
 void CChan::SendBuffer(CClient* pClient) {
-    SendBuffer(pClient, m_Buffer);
     if (AutoClearChanBuffer()) {
+        // The buffer is about to be cleared anyway, so give its lines to the
+        // playback instead of copying them
+        QueueBuffer(pClient, std::make_shared<CBuffer>(std::move(m_Buffer)));
         ClearBuffer();
+    } else {
+        SendBuffer(pClient, m_Buffer);
     }
 }
 
 void CChan::SendBuffer(CClient* pClient, const CBuffer& Buffer) {
+    if (!Buffer.IsEmpty()) {
+        // Shared by all clients which attach before the buffer changes
+        QueueBuffer(pClient, Buffer.GetSnapshot());
+    }
+}
+
+void CChan::QueueBuffer(CClient* pClient,
+                        std::shared_ptr<const CBuffer> spBuffer) {
     if (m_pNetwork && m_pNetwork->IsUserAttached()) {
-        // in the event that pClient is nullptr, need to send this to all
-        // clients for the user I'm presuming here that pClient is listed
-        // inside vClients thus vClients at this point can't be empty.
-        //
-        // This loop has to be cycled twice to maintain the existing behavior
-        // which is
-        // 1. OnChanBufferStarting
-        // 2. OnChanBufferPlayLine
-        // 3. ClearBuffer() if not keeping the buffer
-        // 4. OnChanBufferEnding
-        //
-        // With the exception of ClearBuffer(), this needs to happen per
-        // client, and if pClient is not nullptr, the loops break after the
-        // first iteration.
-        //
-        // Rework this if you like ...
-        if (!Buffer.IsEmpty()) {
+        // In the event that pClient is nullptr, need to send this to all
+        // clients for the user. Each client plays the buffer back on its own
+        // pace, see CClient::QueuePlayback(). If the buffer gets changed
+        // meanwhile, the playback still sends the lines which were there
+        // when it started.
+        if (!spBuffer->IsEmpty()) {
             const vector<CClient*>& vClients = m_pNetwork->GetClients();
             for (CClient* pEachClient : vClients) {
                 CClient* pUseClient = (pClient ? pClient : pEachClient);
 
-                bool bWasPlaybackActive = pUseClient->IsPlaybackActive();
-                pUseClient->SetPlaybackActive(true);
-
-                bool bSkipStatusMsg = pUseClient->HasServerTime();
-                NETWORKMODULECALL(OnChanBufferStarting(*this, *pUseClient),
-                                  m_pNetwork->GetUser(), m_pNetwork, nullptr,
-                                  &bSkipStatusMsg);
-
-                if (!bSkipStatusMsg) {
-                    m_pNetwork->PutUser(":***!znc@znc.in PRIVMSG " + GetName() +
-                                            " :" + t_s("Buffer Playback..."),
-                                        pUseClient);
-                }
-
-                bool bBatch = pUseClient->HasBatch();
-                CString sBatchName = GetName().MD5();
-
-                if (bBatch) {
-                    m_pNetwork->PutUser(":znc.in BATCH +" + sBatchName +
-                                            " znc.in/playback " + GetName(),
-                                        pUseClient);
-                }
-
-                size_t uSize = Buffer.Size();
-                for (size_t uIdx = 0; uIdx < uSize; uIdx++) {
-                    const CBufLine& BufLine = Buffer.GetBufLine(uIdx);
-                    CMessage Message =
-                        BufLine.ToMessage(*pUseClient, MCString::EmptyMap);
-                    Message.SetChan(this);
-                    Message.SetNetwork(m_pNetwork);
-                    Message.SetClient(pUseClient);
-                    if (bBatch) {
-                        Message.SetTag("batch", sBatchName);
-                    }
-                    bool bNotShowThisLine = false;
-                    NETWORKMODULECALL(OnChanBufferPlayMessage(Message),
-                                      m_pNetwork->GetUser(), m_pNetwork,
-                                      nullptr, &bNotShowThisLine);
-                    if (bNotShowThisLine) continue;
-                    m_pNetwork->PutUser(Message, pUseClient);
-                }
-
-                bSkipStatusMsg = pUseClient->HasServerTime();
-                NETWORKMODULECALL(OnChanBufferEnding(*this, *pUseClient),
-                                  m_pNetwork->GetUser(), m_pNetwork, nullptr,
-                                  &bSkipStatusMsg);
-                if (!bSkipStatusMsg) {
-                    m_pNetwork->PutUser(":***!znc@znc.in PRIVMSG " + GetName() +
-                                            " :" + t_s("Playback Complete."),
-                                        pUseClient);
-                }
-
-                if (bBatch) {
-                    m_pNetwork->PutUser(":znc.in BATCH -" + sBatchName,
-                                        pUseClient);
-                }
-
-                pUseClient->SetPlaybackActive(bWasPlaybackActive);
+                pUseClient->QueuePlayback(std::unique_ptr<CBufferPlayback>(
+                    new CChanPlayback(GetName(), spBuffer)));
 
                 if (pClient) break;
             }
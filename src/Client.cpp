@@ -20,11 +20,33 @@
 #include <znc/User.h>
 #include <znc/IRCNetwork.h>
 #include <znc/Query.h>
+#include <znc/Buffer.h>
+#include <znc/Profiler.h>
+#include <algorithm>
 
 using std::set;
 using std::map;
 using std::vector;
 
+// Buffer playback is spread over several iterations of the main loop: at most
+// this many lines are sent per interval...
+static const unsigned int PLAYBACK_LINES_PER_RUN = 500;
+static const unsigned int PLAYBACK_INTERVAL_MS = 20;
+// ...and only while the client reads them
+static const size_t PLAYBACK_MAX_WRITE_BUFFER = 64 * 1024;
+
+class CClientPlaybackTimer : public CCron {
+    CClient* m_pClient;
+
+  public:
+    CClientPlaybackTimer(CClient* pClient) : m_pClient(pClient) {
+        StartMaxCycles(PLAYBACK_INTERVAL_MS / 1000.0, 0);
+    }
+    CClientPlaybackTimer(const CClientPlaybackTimer&) = delete;
+    CClientPlaybackTimer& operator=(const CClientPlaybackTimer&) = delete;
+    void RunJob() override { m_pClient->ContinuePlayback(true); }
+};
+
 #define CALLMOD(MOD, CLIENT, USER, NETWORK, FUNC)                             \
     {                                                                         \
         CModule* pModule = nullptr;                                           \
@@ -115,6 +137,8 @@ CClient::CClient()
     // RFC says a line can have 512 chars max, but we are
     // a little more gentle ;)
     SetMaxBufferThreshold(1024);
+    // Playback and replies to e.g. NAMES are many lines at once
+    SetCoalesceWrites(true);
 }
 
 CClient::~CClient() {
@@ -122,6 +146,7 @@ CClient::~CClient() {
         CClientAuth* pAuth = (CClientAuth*)&(*m_spAuth);
         pAuth->Invalidate();
     }
+    CZNC::Get().ForgetMovingClient(this);
     if (m_pUser != nullptr) {
         m_pUser->AddBytesRead(GetBytesRead());
         m_pUser->AddBytesWritten(GetBytesWritten());
@@ -142,11 +167,13 @@ void CClient::SendRequiredPasswordNotice() {
 }
 
 void CClient::ReadLine(const CString& sData) {
+    CProfileTimer ProfileTimer(CProfiler::ClientReadLine);
     CLanguageScope user_lang(GetUser() ? GetUser()->GetLanguage() : "");
     CString sLine = sData;
 
-    sLine.Replace("\n", "");
-    sLine.Replace("\r", "");
+    sLine.erase(std::remove_if(sLine.begin(), sLine.end(),
+                               [](char c) { return c == '\r' || c == '\n'; }),
+                sLine.end());
 
     DEBUG("(" << GetFullName() << ") CLI -> ZNC ["
         << CDebug::Filter(sLine) << "]");
@@ -160,7 +187,7 @@ void CClient::ReadLine(const CString& sData) {
     }
     if (bReturn) return;
 
-    CMessage Message(sLine);
+    CMessage Message(std::move(sLine));
     Message.SetClient(this);
 
     if (IsAttached()) {
@@ -283,6 +310,8 @@ void CClient::SetNick(const CString& s) { m_sNick = s; }
 
 void CClient::SetNetwork(CIRCNetwork* pNetwork, bool bDisconnect,
                          bool bReconnect) {
+    CancelPlayback();
+
     if (m_pNetwork) {
         m_pNetwork->ClientDisconnected(this);
 
@@ -443,9 +472,11 @@ void CAuthBase::RefuseLogin(const CString& sReason) {
     // login. Use sReason because there are other reasons than "wrong
     // password" for a login to be rejected (e.g. fail2ban).
     if (pUser) {
-        pUser->PutStatusNotice(t_f(
+        CString sNotice = t_f(
             "A client from {1} attempted to login as you, but was rejected: "
-            "{2}")(GetRemoteIP(), sReason));
+            "{2}")(GetRemoteIP(), sReason);
+        CZNC::Get().RunInUserThread(
+            pUser, [=]() { pUser->PutStatusNotice(sNotice); });
     }
 
     GLOBALMODULECALL(OnFailedLogin(GetUsername(), GetRemoteIP()), NOTHING);
@@ -472,6 +503,9 @@ void CClientAuth::AcceptedLogin(CUser& User) {
 }
 
 void CClient::AcceptLogin(CUser& User) {
+    // It's called again in the user's thread
+    if (CZNC::Get().MoveClientToUserThread(this, User)) return;
+
     m_sPass = "";
     m_pUser = &User;
     m_sSASLMechanism = "";
@@ -571,7 +605,7 @@ void CClient::PutIRCStripping(CMessage Message) {
         if (!pSock->HasMessageTagCap()) {
             Message.SetTags({});
         }
-        pSock->PutIRC(Message);
+        pSock->PutIRC(Message, CIRCSock::PriorityInteractive);
     }
 }
 
@@ -587,7 +621,7 @@ void CClient::PutClient(const CString& sLine) {
     PutClient(CMessage(sLine));
 }
 
-bool CClient::PutClient(const CMessage& Message) {
+bool CClient::IsMessageWanted(const CMessage& Message) const {
     switch (Message.GetType()) {
         case CMessage::Type::Away:
             if (!m_bAwayNotify) return false;
@@ -609,8 +643,10 @@ bool CClient::PutClient(const CMessage& Message) {
             break;
     }
 
-    CMessage Msg(Message);
+    return true;
+}
 
+void CClient::AdaptMessage(CMessage& Msg) const {
     const CIRCSock* pIRCSock = GetIRCSock();
     if (pIRCSock) {
         if (Msg.GetType() == CMessage::Type::Numeric) {
@@ -672,23 +708,43 @@ bool CClient::PutClient(const CMessage& Message) {
         }
     }
 
-    MCString mssNewTags;
-    MCString& mssTags = m_bMessageTagCap ? Msg.GetTags() : mssNewTags;
-
     if (!m_bMessageTagCap) {
-        for (const auto& it : Msg.GetTags()) {
-            if (IsTagEnabled(it.first)) {
-                mssTags[it.first] = it.second;
-            }
-        }
+        Msg.FilterTags(
+            [this](const CString& sTag) { return IsTagEnabled(sTag); });
     }
 
-    if (HasServerTime()) {
+    if (HasServerTime() && !Msg.HasTag("time")) {
         // If the server didn't set the time tag, manually set it
-        mssTags.emplace("time", CUtils::FormatServerTime(Msg.GetTime()));
+        Msg.SetTag("time", CUtils::FormatServerTime(Msg.GetTime()));
     }
+}
 
-    Msg.SetTags(mssTags);
+bool CClient::HasSameMessageFormat(const CClient& Other) const {
+    // Everything AdaptMessage() depends on
+    return m_bMessageTagCap == Other.m_bMessageTagCap &&
+           m_bServerTime == Other.m_bServerTime &&
+           m_bExtendedJoin == Other.m_bExtendedJoin &&
+           m_bNamesx == Other.m_bNamesx && m_bUHNames == Other.m_bUHNames &&
+           (m_bMessageTagCap || m_ssSupportedTags == Other.m_ssSupportedTags);
+}
+
+bool CClient::PutClient(const CMessage& Message) {
+    if (!IsMessageWanted(Message)) return false;
+
+    CMessage Msg(Message);
+    AdaptMessage(Msg);
+    return PutAdaptedMessage(Msg, nullptr, nullptr);
+}
+
+bool CClient::PutClientAdapted(const CMessage& Adapted, CString& sLine) {
+    if (!IsMessageWanted(Adapted)) return false;
+
+    CMessage Msg(Adapted);
+    return PutAdaptedMessage(Msg, &Adapted, &sLine);
+}
+
+bool CClient::PutAdaptedMessage(CMessage& Msg, const CMessage* pShared,
+                                CString* psSharedLine) {
     Msg.SetClient(this);
     Msg.SetNetwork(m_pNetwork);
 
@@ -697,6 +753,10 @@ bool CClient::PutClient(const CMessage& Message) {
                       &bReturn);
     if (bReturn) return false;
 
+    if (pShared && Msg.Identical(*pShared)) {
+        if (psSharedLine->empty()) *psSharedLine = pShared->ToString();
+        return PutClientRaw(*psSharedLine);
+    }
     return PutClientRaw(Msg.ToString());
 }
 
@@ -709,10 +769,107 @@ bool CClient::PutClientRaw(const CString& sLine) {
 
     DEBUG("(" << GetFullName() << ") ZNC -> CLI ["
         << CDebug::Filter(sCopy) << "]");
-    Write(sCopy + "\r\n");
+    WriteOrQueue(sCopy + "\r\n");
     return true;
 }
 
+void CClient::WriteOrQueue(const CString& sData) {
+    if (m_dqPlayback.empty() || m_bInPlayback) {
+        Write(sData);
+    } else if (!m_dqPlayback.back().pPlayback) {
+        m_dqPlayback.back().sData += sData;
+    } else {
+        m_dqPlayback.push_back({nullptr, sData});
+    }
+}
+
+void CClient::QueuePlayback(std::unique_ptr<CBufferPlayback> pPlayback) {
+    m_dqPlayback.push_back({std::move(pPlayback), ""});
+    ContinuePlayback(false);
+}
+
+void CClient::ContinuePlayback(bool bFromTimer) {
+    // A module may start another playback while this one is running, that
+    // one just waits in the queue
+    if (m_bInPlayback) return;
+
+    unsigned long long uNow = CUtils::GetMillTime();
+    if (bFromTimer || uNow - m_uPlaybackRunStart >= PLAYBACK_INTERVAL_MS) {
+        m_uPlaybackRunStart = uNow;
+        m_uPlaybackLines = 0;
+    }
+
+    m_bInPlayback = true;
+    CIRCNetwork* pNetwork = m_pNetwork;
+
+    while (!m_dqPlayback.empty() &&
+           m_uPlaybackLines < PLAYBACK_LINES_PER_RUN &&
+           GetPendingWriteSize() < PLAYBACK_MAX_WRITE_BUFFER) {
+        // Modules may change the queue from Play()
+        SQueuedPlayback Item = std::move(m_dqPlayback.front());
+        m_dqPlayback.pop_front();
+
+        if (!Item.pPlayback) {
+            Write(Item.sData);
+            continue;
+        }
+
+        bool bWasPlaybackActive = IsPlaybackActive();
+        SetPlaybackActive(true);
+        bool bMore = Item.pPlayback->Play(*this);
+        SetPlaybackActive(bWasPlaybackActive);
+        m_uPlaybackLines++;
+
+        if (m_pNetwork != pNetwork) {
+            // The client was moved to another network by a module
+            Item.pPlayback->Cancel(*this);
+            break;
+        }
+
+        if (bMore) {
+            m_dqPlayback.push_front(std::move(Item));
+        }
+    }
+
+    m_bInPlayback = false;
+
+    // More of the playback follows soon, so only full packets are sent until
+    // it is done
+    SetCork(!m_dqPlayback.empty());
+
+    if (m_dqPlayback.empty()) {
+        if (m_pPlaybackTimer) {
+            m_pPlaybackTimer->Stop();
+            m_pPlaybackTimer = nullptr;
+        }
+    } else if (!m_pPlaybackTimer) {
+        m_pPlaybackTimer = new CClientPlaybackTimer(this);
+        AddCron(m_pPlaybackTimer);
+    }
+}
+
+void CClient::CancelPlayback() {
+    std::deque<SQueuedPlayback> dqPlayback;
+    dqPlayback.swap(m_dqPlayback);
+
+    bool bWasInPlayback = m_bInPlayback;
+    m_bInPlayback = true;
+    for (SQueuedPlayback& Item : dqPlayback) {
+        if (Item.pPlayback) {
+            Item.pPlayback->Cancel(*this);
+        } else {
+            Write(Item.sData);
+        }
+    }
+    m_bInPlayback = bWasInPlayback;
+    SetCork(false);
+
+    if (m_pPlaybackTimer) {
+        m_pPlaybackTimer->Stop();
+        m_pPlaybackTimer = nullptr;
+    }
+}
+
 void CClient::PutStatusNotice(const CString& sLine) {
     PutModNotice("status", sLine);
 }
@@ -737,10 +894,10 @@ void CClient::PutModNotice(const CString& sModule, const CString& sLine) {
                      ((sModule.empty()) ? "status" : sModule) +
                      "@znc.in NOTICE "
               << GetNick() << " :" << sLine << "]");
-    Write(":" + m_pUser->GetStatusPrefix() +
-          ((sModule.empty()) ? "status" : sModule) + "!" +
-          ((sModule.empty()) ? "status" : sModule) + "@znc.in NOTICE " +
-          GetNick() + " :" + sLine + "\r\n");
+    WriteOrQueue(":" + m_pUser->GetStatusPrefix() +
+                 ((sModule.empty()) ? "status" : sModule) + "!" +
+                 ((sModule.empty()) ? "status" : sModule) + "@znc.in NOTICE " +
+                 GetNick() + " :" + sLine + "\r\n");
 }
 
 void CClient::PutModule(const CString& sModule, const CString& sLine) {
@@ -758,10 +915,10 @@ void CClient::PutModule(const CString& sModule, const CString& sLine) {
     VCString vsLines;
     sLine.Split("\n", vsLines);
     for (const CString& s : vsLines) {
-        Write(":" + m_pUser->GetStatusPrefix() +
-              ((sModule.empty()) ? "status" : sModule) + "!" +
-              ((sModule.empty()) ? "status" : sModule) + "@znc.in PRIVMSG " +
-              GetNick() + " :" + s + "\r\n");
+        WriteOrQueue(":" + m_pUser->GetStatusPrefix() +
+                     ((sModule.empty()) ? "status" : sModule) + "!" +
+                     ((sModule.empty()) ? "status" : sModule) +
+                     "@znc.in PRIVMSG " + GetNick() + " :" + s + "\r\n");
     }
 }
 
@@ -19,14 +19,30 @@
 #include <znc/FileUtils.h>
 #include <znc/IRCNetwork.h>
 #include <znc/IRCSock.h>
+#include <znc/Profiler.h>
 #include <znc/Query.h>
 #include <znc/Server.h>
 #include <znc/User.h>
+#include <algorithm>
 
 using std::map;
 using std::set;
 using std::vector;
 
+// Commands which look at other users or at global state
+static bool IsExclusiveCommand(const CString& sLine) {
+    static const SCString ssAlways = {
+        "saveconfig", "listusers", "listallusernetworks", "setmotd",
+        "addmotd",    "clearmotd", "broadcast",           "shutdown",
+        "restart",    "traffic",   "profile",             "listports",
+        "addport",    "delport"};
+    static const SCString ssWithUser = {"listclients", "listchans",
+                                        "listnetworks"};
+    CString sCommand = sLine.Token(0).AsLower();
+    return ssAlways.count(sCommand) ||
+           (ssWithUser.count(sCommand) && !sLine.Token(1).empty());
+}
+
 void CClient::UserCommand(CString& sLine) {
     if (!m_pUser) {
         return;
@@ -36,6 +52,23 @@ void CClient::UserCommand(CString& sLine) {
         return;
     }
 
+    if (CZNC::IsInEventThread() && IsExclusiveCommand(sLine)) {
+        // Run it again in the main thread while the others wait, see
+        // CZNC::IsSharded()
+        CUser* pUser = m_pUser;
+        CClient* pClient = this;
+        CString sCommandLine = sLine;
+        CZNC::Get().RunExclusively([=]() mutable {
+            // The client may be gone meanwhile
+            vector<CClient*> vClients = pUser->GetAllClients();
+            if (std::find(vClients.begin(), vClients.end(), pClient) !=
+                vClients.end()) {
+                pClient->UserCommand(sCommandLine);
+            }
+        });
+        return;
+    }
+
     bool bReturn = false;
     NETWORKMODULECALL(OnStatusCommand(sLine), m_pUser, m_pNetwork, this,
                       &bReturn);
@@ -71,11 +104,21 @@ void CClient::UserCommand(CString& sLine) {
             return;
         }
 
-        const map<CString, CNick>& msNicks = pChan->GetNicks();
+        // Sorted by nick, for the table
+        const CNickMap& Nicks = pChan->GetNickMap();
+        vector<const CNick*> vpNicks;
+        vpNicks.reserve(Nicks.size());
+        for (const auto& it : Nicks) {
+            vpNicks.push_back(&it.second);
+        }
+        std::sort(vpNicks.begin(), vpNicks.end(),
+                  [](const CNick* pA, const CNick* pB) {
+                      return pA->GetNick() < pB->GetNick();
+                  });
         CIRCSock* pIRCSock = m_pNetwork->GetIRCSock();
         const CString& sPerms = (pIRCSock) ? pIRCSock->GetPerms() : "";
 
-        if (msNicks.empty()) {
+        if (vpNicks.empty()) {
             PutStatus(t_f("No nicks on [{1}]")(sChan));
             return;
         }
@@ -92,20 +135,20 @@ void CClient::UserCommand(CString& sLine) {
         Table.AddColumn(t_s("Ident"));
         Table.AddColumn(t_s("Host"));
 
-        for (const auto& it : msNicks) {
+        for (const CNick* pNick : vpNicks) {
             Table.AddRow();
 
             for (unsigned int b = 0; b < sPerms.size(); b++) {
-                if (it.second.HasPerm(sPerms[b])) {
+                if (pNick->HasPerm(sPerms[b])) {
                     CString sPerm;
                     sPerm += sPerms[b];
                     Table.SetCell(sPerm, sPerm);
                 }
             }
 
-            Table.SetCell(t_s("Nick"), it.second.GetNick());
-            Table.SetCell(t_s("Ident"), it.second.GetIdent());
-            Table.SetCell(t_s("Host"), it.second.GetHost());
+            Table.SetCell(t_s("Nick"), pNick->GetNick());
+            Table.SetCell(t_s("Ident"), pNick->GetIdent());
+            Table.SetCell(t_s("Host"), pNick->GetHost());
         }
 
         PutStatus(Table);
@@ -702,6 +745,10 @@ void CClient::UserCommand(CString& sLine) {
             PutStatus(t_s("Access denied."));
             return;
         }
+        if (CZNC::Get().IsSharded()) {
+            PutStatus(t_s("Not possible while ZNC runs several event threads"));
+            return;
+        }
 
         CString sOldUser = sLine.Token(1);
         CString sOldNetwork = sLine.Token(2);
@@ -1338,6 +1385,10 @@ void CClient::UserCommand(CString& sLine) {
             PutStatus(t_s("Usage: UpdateMod <module>"));
             return;
         }
+        if (CZNC::Get().IsSharded()) {
+            PutStatus(t_s("Not possible while ZNC runs several event threads"));
+            return;
+        }
 
         PutStatus(t_f("Reloading {1} everywhere")(sMod));
         if (CZNC::Get().UpdateModule(sMod)) {
@@ -1622,6 +1673,103 @@ void CClient::UserCommand(CString& sLine) {
                       CString::ToByteStr(Total.first + Total.second));
 
         PutStatus(Table);
+    } else if (m_pUser->IsAdmin() && sCommand.Equals("PROFILE")) {
+        CString sAction = sLine.Token(1);
+        if (sAction.Equals("ON")) {
+            // The counters aren't shared between threads
+            if (CZNC::Get().IsSharded()) {
+                PutStatus(
+                    t_s("Not possible while ZNC runs several event threads"));
+                return;
+            }
+            CProfiler::SetEnabled(true);
+            PutStatus(t_s("Profiling enabled"));
+            return;
+        } else if (sAction.Equals("OFF")) {
+            CProfiler::SetEnabled(false);
+            PutStatus(t_s("Profiling disabled"));
+            return;
+        } else if (sAction.Equals("RESET")) {
+            CProfiler::Reset();
+            PutStatus(t_s("Profiling data cleared"));
+            return;
+        } else if (!sAction.empty()) {
+            PutStatus(t_s("Usage: Profile [on|off|reset]"));
+            return;
+        }
+
+        if (CProfiler::IsEnabled()) {
+            PutStatus(t_f("Profiling for {1} seconds")(
+                CProfiler::GetRunningTime()));
+        } else {
+            PutStatus(t_s("Profiling is disabled, these are old results"));
+        }
+
+        CTable Timers;
+        Timers.AddColumn(t_s("Timer", "profilecmd"));
+        Timers.AddColumn(t_s("Count", "profilecmd"));
+        Timers.AddColumn(t_s("Avg (us)", "profilecmd"));
+        Timers.AddColumn(t_s("p99 (us)", "profilecmd"));
+        Timers.AddColumn(t_s("Max (us)", "profilecmd"));
+        Timers.AddColumn(t_s("Total (ms)", "profilecmd"));
+        for (int i = 0; i < CProfiler::TIMER_COUNT; ++i) {
+            CProfiler::ETimer eTimer = CProfiler::ETimer(i);
+            const CProfileStats& Stats = CProfiler::GetTimer(eTimer);
+            Timers.AddRow();
+            Timers.SetCell(t_s("Timer", "profilecmd"),
+                           CProfiler::GetTimerName(eTimer));
+            Timers.SetCell(t_s("Count", "profilecmd"),
+                           CString(Stats.GetCount()));
+            Timers.SetCell(t_s("Avg (us)", "profilecmd"),
+                           CString(Stats.GetAverage()));
+            Timers.SetCell(t_s("p99 (us)", "profilecmd"),
+                           CString(Stats.GetPercentile(99)));
+            Timers.SetCell(t_s("Max (us)", "profilecmd"),
+                           CString(Stats.GetMax()));
+            Timers.SetCell(t_s("Total (ms)", "profilecmd"),
+                           CString(Stats.GetTotal() / 1000));
+        }
+        PutStatus(Timers);
+
+        // Only the most expensive ones, the web interface has all of them
+        vector<CProfiler::SHookStats> vHooks = CProfiler::GetHookStats();
+        if (vHooks.size() > 10) vHooks.resize(10);
+        if (!vHooks.empty()) {
+            CTable Hooks;
+            Hooks.AddColumn(t_s("Module", "profilecmd"));
+            Hooks.AddColumn(t_s("Hook", "profilecmd"));
+            Hooks.AddColumn(t_s("Count", "profilecmd"));
+            Hooks.AddColumn(t_s("Avg (us)", "profilecmd"));
+            Hooks.AddColumn(t_s("Max (us)", "profilecmd"));
+            Hooks.AddColumn(t_s("Total (ms)", "profilecmd"));
+            for (const CProfiler::SHookStats& Hook : vHooks) {
+                Hooks.AddRow();
+                Hooks.SetCell(t_s("Module", "profilecmd"), Hook.sModule);
+                Hooks.SetCell(t_s("Hook", "profilecmd"), Hook.sHook);
+                Hooks.SetCell(t_s("Count", "profilecmd"),
+                              CString(Hook.Stats.GetCount()));
+                Hooks.SetCell(t_s("Avg (us)", "profilecmd"),
+                              CString(Hook.Stats.GetAverage()));
+                Hooks.SetCell(t_s("Max (us)", "profilecmd"),
+                              CString(Hook.Stats.GetMax()));
+                Hooks.SetCell(t_s("Total (ms)", "profilecmd"),
+                              CString(Hook.Stats.GetTotal() / 1000));
+            }
+            PutStatus(Hooks);
+        }
+
+        CTable Queues;
+        Queues.AddColumn(t_s("Queue", "profilecmd"));
+        Queues.AddColumn(t_s("Total", "profilecmd"));
+        Queues.AddColumn(t_s("Max", "profilecmd"));
+        for (const CProfiler::SQueueDepth& Queue :
+             CProfiler::GetQueueDepths()) {
+            Queues.AddRow();
+            Queues.SetCell(t_s("Queue", "profilecmd"), Queue.sName);
+            Queues.SetCell(t_s("Total", "profilecmd"), CString(Queue.uTotal));
+            Queues.SetCell(t_s("Max", "profilecmd"), CString(Queue.uMax));
+        }
+        PutStatus(Queues);
     } else if (sCommand.Equals("UPTIME")) {
         PutStatus(t_f("Running for {1}")(CZNC::Get().GetUptime()));
     } else if (m_pUser->IsAdmin() &&
@@ -2067,6 +2215,10 @@ void CClient::HelpUser(const CString& sFilter) {
         AddCommandHelp("Traffic", "",
                        t_s("Show basic traffic stats for all ZNC users",
                            "helpcmd|Traffic|desc"));
+        AddCommandHelp(
+            "Profile", t_s("[on|off|reset]", "helpcmd|Profile|args"),
+            t_s("Show where ZNC spends its time, or control the profiler",
+                "helpcmd|Profile|desc"));
         AddCommandHelp("Broadcast", t_s("[message]", "helpcmd|Broadcast|args"),
                        t_s("Broadcast a message to all ZNC users",
                            "helpcmd|Broadcast|desc"));
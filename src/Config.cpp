@@ -175,7 +175,12 @@ bool CConfig::Parse(CFile& file, CString& sErrorMsg) {
 }
 
 void CConfig::Write(CFile& File, unsigned int iIndentation) {
+    File.Write(ToString(iIndentation));
+}
+
+CString CConfig::ToString(unsigned int iIndentation) const {
     CString sIndentation = CString(iIndentation, '\t');
+    CString sRet;
 
     auto SingleLine = [](const CString& s) {
         return s.Replace_n("\r", "").Replace_n("\n", "");
@@ -183,20 +188,21 @@ void CConfig::Write(CFile& File, unsigned int iIndentation) {
 
     for (const auto& it : m_ConfigEntries) {
         for (const CString& sValue : it.second) {
-            File.Write(SingleLine(sIndentation + it.first + " = " + sValue) +
-                       "\n");
+            sRet += SingleLine(sIndentation + it.first + " = " + sValue) + "\n";
         }
     }
 
     for (const auto& it : m_SubConfigs) {
         for (const auto& it2 : it.second) {
-            File.Write("\n");
+            sRet += "\n";
 
-            File.Write(SingleLine(sIndentation + "<" + it.first + " " +
-                                  it2.first + ">") +
-                       "\n");
-            it2.second.m_pSubConfig->Write(File, iIndentation + 1);
-            File.Write(SingleLine(sIndentation + "</" + it.first + ">") + "\n");
+            sRet += SingleLine(sIndentation + "<" + it.first + " " +
+                               it2.first + ">") +
+                    "\n";
+            sRet += it2.second.m_pSubConfig->ToString(iIndentation + 1);
+            sRet += SingleLine(sIndentation + "</" + it.first + ">") + "\n";
         }
     }
+
+    return sRet;
 }
@@ -17,6 +17,7 @@
 #include <znc/HTTPSock.h>
 #include <znc/FileUtils.h>
 #include <znc/znc.h>
+#include <sys/stat.h>
 #include <iomanip>
 
 #ifdef HAVE_ZLIB
@@ -28,6 +29,12 @@ using std::set;
 
 #define MAX_POST_SIZE 1024 * 1024
 
+// Static files up to this size are kept in memory, bigger ones are read from
+// disk for every request
+#define MAX_CACHED_FILE_SIZE 1024 * 1024
+// If the cached files get bigger than this, the cache is emptied
+#define MAX_FILE_CACHE_SIZE 32 * 1024 * 1024
+
 CHTTPSock::CHTTPSock(CModule* pMod, const CString& sURIPrefix)
     : CHTTPSock(pMod, sURIPrefix, "", 0) {
     Init();
@@ -259,7 +266,8 @@ void CHTTPSock::GetPage() {
 }
 
 #ifdef HAVE_ZLIB
-static bool InitZlibStream(z_stream* zStrm, const char* buf) {
+static bool InitZlibStream(z_stream* zStrm, const char* buf,
+                           int iLevel = Z_DEFAULT_COMPRESSION) {
     memset(zStrm, 0, sizeof(z_stream));
     zStrm->next_in = (Bytef*)buf;
 
@@ -268,10 +276,122 @@ static bool InitZlibStream(z_stream* zStrm, const char* buf) {
     const int WINDOW_BITS = 15 + 16;
     const int MEMLEVEL = 8;
 
-    return (deflateInit2(zStrm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, WINDOW_BITS,
-                         MEMLEVEL, Z_DEFAULT_STRATEGY) == Z_OK);
+    return (deflateInit2(zStrm, iLevel, Z_DEFLATED, WINDOW_BITS, MEMLEVEL,
+                         Z_DEFAULT_STRATEGY) == Z_OK);
 }
+
+static bool GzipString(const CString& sData, CString& sRet) {
+    z_stream zStrm;
+
+    // This is done once per file, so it's worth to compress well
+    if (!InitZlibStream(&zStrm, sData.data(), Z_BEST_COMPRESSION)) {
+        return false;
+    }
+
+    zStrm.avail_in = sData.size();
+    sRet.resize(deflateBound(&zStrm, sData.size()));
+    zStrm.next_out = (Bytef*)&sRet[0];
+    zStrm.avail_out = sRet.size();
+
+    int zStatus = deflate(&zStrm, Z_FINISH);
+    sRet.resize(sRet.size() - zStrm.avail_out);
+    deflateEnd(&zStrm);
+
+    return zStatus == Z_STREAM_END;
+}
+#endif
+
+namespace {
+// A static file which PrintFile() serves from memory until it changes on disk
+struct SStaticFile {
+    time_t iMTime;
+    off_t iSize;
+    ino_t uInode;
+    CString sData;
+    // Strong ETag, derived from the content
+    CString sETag;
+#ifdef HAVE_ZLIB
+    bool bGzipDone = false;
+    // Empty if the file doesn't get smaller by compressing it
+    CString sGzipped;
 #endif
+};
+}  // namespace
+
+static std::shared_ptr<SStaticFile> GetStaticFile(const CString& sPath) {
+    // Files are only served from the main thread
+    static map<CString, std::shared_ptr<SStaticFile>> mCache;
+    static size_t uCacheSize = 0;
+
+    auto it = mCache.find(sPath);
+    struct stat st;
+
+    if (stat(sPath.c_str(), &st) != 0 || !S_ISREG(st.st_mode) ||
+        st.st_size > MAX_CACHED_FILE_SIZE) {
+        if (it != mCache.end()) {
+            uCacheSize -= it->second->iSize;
+            mCache.erase(it);
+        }
+        return nullptr;
+    }
+
+    if (it != mCache.end()) {
+        const SStaticFile& Cached = *it->second;
+        if (Cached.iMTime == st.st_mtime && Cached.iSize == st.st_size &&
+            Cached.uInode == st.st_ino) {
+            return it->second;
+        }
+
+        uCacheSize -= Cached.iSize;
+        mCache.erase(it);
+    }
+
+    std::shared_ptr<SStaticFile> spFile = std::make_shared<SStaticFile>();
+    CFile File(sPath);
+
+    if (!File.Open() ||
+        !File.ReadFile(spFile->sData, MAX_CACHED_FILE_SIZE + 1) ||
+        (off_t)spFile->sData.size() != st.st_size) {
+        // Probably it's being written right now
+        return nullptr;
+    }
+
+    spFile->iMTime = st.st_mtime;
+    spFile->iSize = st.st_size;
+    spFile->uInode = st.st_ino;
+    spFile->sETag = spFile->sData.SHA256().Left(32);
+
+    if (uCacheSize + spFile->iSize > MAX_FILE_CACHE_SIZE) {
+        DEBUG("Static file cache is full, emptying it");
+        mCache.clear();
+        uCacheSize = 0;
+    }
+
+    uCacheSize += spFile->iSize;
+    mCache[sPath] = spFile;
+
+    return spFile;
+}
+
+// Whether the ETag matches any of the tags in an If-None-Match header
+static bool ETagMatches(const CString& sIfNoneMatch, const CString& sETag) {
+    VCString vsTags;
+    sIfNoneMatch.Split(",", vsTags, false, "", "", false, true);
+
+    for (CString& sTag : vsTags) {
+        if (sTag == "*") {
+            return true;
+        }
+
+        sTag.TrimPrefix("W/");
+        sTag.Trim("\\\"'");
+        if (sTag.Equals(sETag, CString::CaseSensitive)) {
+            return true;
+        }
+    }
+
+    return false;
+}
 
 void CHTTPSock::PrintPage(const CString& sPage) {
 #ifdef HAVE_ZLIB
@@ -367,25 +487,71 @@ bool CHTTPSock::PrintFile(const CString& sFileName, CString sContentType) {
     }
 
     const time_t iMTime = File.GetMTime();
+    std::shared_ptr<SStaticFile> spCached = GetStaticFile(sFilePath);
+    const CString* psBody = nullptr;
     bool bNotModified = false;
     CString sETag;
+#ifdef HAVE_ZLIB
+    const bool bCompressible =
+        sContentType.StartsWith("text/") || sFileName.EndsWith(".js");
+    bool bGzip = m_bAcceptGzip && bCompressible;
+#endif
 
-    if (iMTime > 0 && !m_bHTTP10Client) {
+    if (spCached) {
+        sETag = spCached->sETag;
+        psBody = &spCached->sData;
+
+#ifdef HAVE_ZLIB
+        if (bGzip) {
+            if (!spCached->bGzipDone) {
+                spCached->bGzipDone = true;
+                if (!GzipString(spCached->sData, spCached->sGzipped) ||
+                    spCached->sGzipped.size() >= spCached->sData.size()) {
+                    spCached->sGzipped.clear();
+                }
+            }
+
+            if (spCached->sGzipped.empty()) {
+                bGzip = false;
+            } else {
+                // Different representations need different strong ETags
+                sETag += "-gzip";
+                psBody = &spCached->sGzipped;
+            }
+        }
+#endif
+    } else {
         sETag = "-" + CString(iMTime);  // lighttpd style ETag
+    }
 
+    if (iMTime > 0 && !m_bHTTP10Client) {
         AddHeader("Last-Modified", GetDate(iMTime));
         AddHeader("ETag", "\"" + sETag + "\"");
         AddHeader("Cache-Control", "public");
+#ifdef HAVE_ZLIB
+        if (bCompressible) {
+            AddHeader("Vary", "Accept-Encoding");
+        }
+#endif
 
         if (!m_sIfNoneMatch.empty()) {
-            m_sIfNoneMatch.Trim("\\\"'");
-            bNotModified =
-                (m_sIfNoneMatch.Equals(sETag, CString::CaseSensitive));
+            bNotModified = ETagMatches(m_sIfNoneMatch, sETag);
         }
+    } else {
+        sETag.clear();
     }
 
     if (bNotModified) {
         PrintHeader(0, sContentType, 304, "Not Modified");
+    } else if (psBody) {
+#ifdef HAVE_ZLIB
+        if (bGzip) {
+            DEBUG("- Sending cached gzip-compressed.");
+            AddHeader("Content-Encoding", "gzip");
+        }
+#endif
+        PrintHeader(psBody->size(), sContentType);
+        Write(*psBody);
     } else {
         off_t iSize = File.GetSize();
 
@@ -398,9 +564,6 @@ bool CHTTPSock::PrintFile(const CString& sFileName, CString sContentType) {
         }
 
 #ifdef HAVE_ZLIB
-        bool bGzip = m_bAcceptGzip && (sContentType.StartsWith("text/") ||
-                                       sFileName.EndsWith(".js"));
-
         if (bGzip) {
             DEBUG("- Sending gzip-compressed.");
             AddHeader("Content-Encoding", "gzip");
@@ -426,9 +589,10 @@ bool CHTTPSock::PrintFile(const CString& sFileName, CString sContentType) {
 
 void CHTTPSock::WriteFileUncompressed(CFile& File) {
     char szBuf[4096];
-    off_t iLen = 0;
     ssize_t i = 0;
     off_t iSize = File.GetSize();
+    // Without SSL or with kTLS, the kernel can take it from here
+    off_t iLen = SendFile(File, iSize);
 
     // while we haven't reached iSize and read() succeeds...
     while (iLen < iSize && (i = File.Read(szBuf, sizeof(szBuf))) > 0) {
@@ -143,7 +143,12 @@ CIRCNetwork::CIRCNetwork(CUser* pUser, const CString& sName)
       m_pIRCSock(nullptr),
       m_vChans(),
       m_vQueries(),
+      m_mpChanIndex(),
+      m_mpQueryIndex(),
+      m_bChanFoldCollisions(false),
+      m_bQueryFoldCollisions(false),
       m_sChanPrefixes(""),
+      m_eCaseMapping(CaseMappingAscii),
       m_bIRCConnectEnabled(true),
       m_bTrustAllCerts(false),
       m_bTrustPKI(true),
@@ -154,6 +159,8 @@ CIRCNetwork::CIRCNetwork(CUser* pUser, const CString& sName)
       m_bIRCAway(false),
       m_fFloodRate(2),
       m_uFloodBurst(9),
+      m_uFloodRecvQ(0),
+      m_uFloodByteRate(0),
       m_RawBuffer(),
       m_MotdBuffer(),
       m_NoticeBuffer(),
@@ -192,6 +199,8 @@ void CIRCNetwork::Clone(const CIRCNetwork& Network, bool bCloneName) {
 
     m_fFloodRate = Network.GetFloodRate();
     m_uFloodBurst = Network.GetFloodBurst();
+    m_uFloodRecvQ = Network.GetFloodRecvQ();
+    m_uFloodByteRate = Network.GetFloodByteRate();
     m_uJoinDelay = Network.GetJoinDelay();
 
     SetNick(Network.GetNick());
@@ -320,19 +329,22 @@ CIRCNetwork::~CIRCNetwork() {
         delete pChan;
     }
     m_vChans.clear();
+    m_mpChanIndex.clear();
 
     // Delete Queries
     for (CQuery* pQuery : m_vQueries) {
         delete pQuery;
     }
     m_vQueries.clear();
+    m_mpQueryIndex.clear();
+
+    // Make sure we are not in the connection queue. The connect timer reads
+    // our user while we are in there.
+    CZNC::Get().RemoveNetworkFromQueue(this);
 
     CUser* pUser = GetUser();
     SetUser(nullptr);
 
-    // Make sure we are not in the connection queue
-    CZNC::Get().GetConnectionQueue().remove(this);
-
     CZNC::Get().GetManager().DelCronByAddr(m_pPingTimer);
     CZNC::Get().GetManager().DelCronByAddr(m_pJoinTimer);
 
@@ -396,6 +408,10 @@ bool CIRCNetwork::ParseConfig(CConfig* pConfig, CString& sError,
             {"floodburst", &CIRCNetwork::SetFloodBurst},
             {"joindelay", &CIRCNetwork::SetJoinDelay},
         };
+        TOption<unsigned int> UIntOptions[] = {
+            {"floodrecvq", &CIRCNetwork::SetFloodRecvQ},
+            {"floodbyterate", &CIRCNetwork::SetFloodByteRate},
+        };
 
         for (const auto& Option : StringOptions) {
             CString sValue;
@@ -421,6 +437,12 @@ bool CIRCNetwork::ParseConfig(CConfig* pConfig, CString& sError,
                 (this->*Option.pSetter)(value);
         }
 
+        for (const auto& Option : UIntOptions) {
+            unsigned int value;
+            if (pConfig->FindUIntEntry(Option.name, value))
+                (this->*Option.pSetter)(value);
+        }
+
         pConfig->FindStringVector("loadmodule", vsList);
         for (const CString& sValue : vsList) {
             CString sModName = sValue.Token(0);
@@ -591,6 +613,10 @@ CConfig CIRCNetwork::ToConfig() const {
     config.AddKeyValuePair("TrustPKI", CString(GetTrustPKI()));
     config.AddKeyValuePair("FloodRate", CString(GetFloodRate()));
     config.AddKeyValuePair("FloodBurst", CString(GetFloodBurst()));
+    if (GetFloodRecvQ() || GetFloodByteRate()) {
+        config.AddKeyValuePair("FloodRecvQ", CString(GetFloodRecvQ()));
+        config.AddKeyValuePair("FloodByteRate", CString(GetFloodByteRate()));
+    }
     config.AddKeyValuePair("JoinDelay", CString(GetJoinDelay()));
     config.AddKeyValuePair("Encoding", m_sEncoding);
 
@@ -728,6 +754,7 @@ void CIRCNetwork::ClientConnected(CClient* pClient) {
     }
     if (bClearQuery) {
         m_vQueries.clear();
+        m_mpQueryIndex.clear();
     }
 
     uSize = m_NoticeBuffer.Size();
@@ -760,6 +787,16 @@ void CIRCNetwork::ClientDisconnected(CClient* pClient) {
     if (it != m_vClients.end()) {
         m_vClients.erase(it);
     }
+
+    if (m_vClients.empty()) {
+        // Nobody is left to share the rendered lines with
+        for (const CChan* pChan : m_vChans) {
+            pChan->GetBuffer().ClearRenderCache();
+        }
+        for (const CQuery* pQuery : m_vQueries) {
+            pQuery->GetBuffer().ClearRenderCache();
+        }
+    }
 }
 
 CUser* CIRCNetwork::GetUser() const { return m_pUser; }
@@ -824,18 +861,49 @@ bool CIRCNetwork::PutUser(const CString& sLine, CClient* pClient,
 
 bool CIRCNetwork::PutUser(const CMessage& Message, CClient* pClient,
                           CClient* pSkipClient) {
-    for (CClient* pEachClient : m_vClients) {
-        if ((!pClient || pClient == pEachClient) &&
-            pSkipClient != pEachClient) {
-            pEachClient->PutClient(Message);
-
-            if (pClient) {
-                return true;
+    if (pClient || m_vClients.size() < 2) {
+        for (CClient* pEachClient : m_vClients) {
+            if ((!pClient || pClient == pEachClient) &&
+                pSkipClient != pEachClient) {
+                pEachClient->PutClient(Message);
+
+                if (pClient) {
+                    return true;
+                }
             }
         }
+
+        return (pClient == nullptr);
     }
 
-    return (pClient == nullptr);
+    // Clients with the same capabilities get the same line, so adapt and
+    // serialize the message only once per distinct set of them
+    struct SVariant {
+        const CClient* pClient;
+        CMessage Msg;
+        CString sLine;
+    };
+    vector<SVariant> vVariants;
+    vVariants.reserve(m_vClients.size());
+
+    for (CClient* pEachClient : m_vClients) {
+        if (pSkipClient == pEachClient) continue;
+
+        auto it = std::find_if(vVariants.begin(), vVariants.end(),
+                               [&](const SVariant& Variant) {
+                                   return Variant.pClient->HasSameMessageFormat(
+                                       *pEachClient);
+                               });
+        if (it == vVariants.end()) {
+            vVariants.push_back({pEachClient, Message, ""});
+            it = vVariants.end() - 1;
+            pEachClient->AdaptMessage(it->Msg);
+        }
+
+        pEachClient->PutClientAdapted(it->Msg, it->sLine);
+    }
+
+    return true;
 }
 
 bool CIRCNetwork::PutStatus(const CString& sLine, CClient* pClient,
@@ -881,13 +949,12 @@ CChan* CIRCNetwork::FindChan(CString sName) const {
         sName.TrimLeft(GetIRCSock()->GetISupport("STATUSMSG", ""));
     }
 
-    for (CChan* pChan : m_vChans) {
-        if (sName.Equals(pChan->GetName())) {
-            return pChan;
-        }
+    auto it = m_mpChanIndex.find(CaseFold(sName));
+    if (it == m_mpChanIndex.end()) {
+        return nullptr;
     }
 
-    return nullptr;
+    return it->second;
 }
 
 std::vector<CChan*> CIRCNetwork::FindChans(const CString& sWild) const {
@@ -905,11 +972,9 @@ bool CIRCNetwork::AddChan(CChan* pChan) {
         return false;
     }
 
-    for (CChan* pEachChan : m_vChans) {
-        if (pEachChan->GetName().Equals(pChan->GetName())) {
-            delete pChan;
-            return false;
-        }
+    if (!m_mpChanIndex.emplace(CaseFold(pChan->GetName()), pChan).second) {
+        delete pChan;
+        return false;
     }
 
     m_vChans.push_back(pChan);
@@ -917,26 +982,44 @@ bool CIRCNetwork::AddChan(CChan* pChan) {
 }
 
 bool CIRCNetwork::AddChan(const CString& sName, bool bInConfig) {
-    if (sName.empty() || FindChan(sName)) {
+    if (sName.empty()) {
         return false;
     }
 
-    CChan* pChan = new CChan(sName, this, bInConfig);
-    m_vChans.push_back(pChan);
-    return true;
+    // CChan normalizes the name, e.g. adds a missing # and drops the key
+    return AddChan(new CChan(sName, this, bInConfig));
 }
 
 bool CIRCNetwork::DelChan(const CString& sName) {
-    for (vector<CChan*>::iterator a = m_vChans.begin(); a != m_vChans.end();
-         ++a) {
-        if (sName.Equals((*a)->GetName())) {
-            delete *a;
-            m_vChans.erase(a);
-            return true;
-        }
+    auto it = m_mpChanIndex.find(CaseFold(sName));
+    if (it == m_mpChanIndex.end()) {
+        return false;
     }
 
-    return false;
+    CChan* pChan = it->second;
+    m_vChans.erase(std::find(m_vChans.begin(), m_vChans.end(), pChan));
+    UnindexChan(it);
+    delete pChan;
+    return true;
+}
+
+void CIRCNetwork::UnindexChan(
+    std::unordered_map<CString, CChan*>::iterator it) {
+    if (!m_bChanFoldCollisions) {
+        m_mpChanIndex.erase(it);
+        return;
+    }
+
+    const CString sKey = it->first;
+    m_mpChanIndex.erase(it);
+
+    // Since a CASEMAPPING change, another channel may fold to the same name
+    for (CChan* pOther : m_vChans) {
+        if (CaseFold(pOther->GetName()) == sKey) {
+            m_mpChanIndex.emplace(sKey, pOther);
+            break;
+        }
+    }
 }
 
 bool CIRCNetwork::MoveChan(const CString& sChan, unsigned int uIndex,
@@ -946,39 +1029,34 @@ bool CIRCNetwork::MoveChan(const CString& sChan, unsigned int uIndex,
         return false;
     }
 
-    auto it = m_vChans.begin();
-    for (; it != m_vChans.end(); ++it)
-        if ((*it)->GetName().Equals(sChan)) break;
-    if (it == m_vChans.end()) {
+    auto it = m_mpChanIndex.find(CaseFold(sChan));
+    if (it == m_mpChanIndex.end()) {
         sError = t_f("You are not on {1}")(sChan);
         return false;
     }
 
-    const auto pChan = *it;
-    m_vChans.erase(it);
+    const auto pChan = it->second;
+    m_vChans.erase(std::find(m_vChans.begin(), m_vChans.end(), pChan));
     m_vChans.insert(m_vChans.begin() + uIndex, pChan);
     return true;
 }
 
 bool CIRCNetwork::SwapChans(const CString& sChan1, const CString& sChan2,
                             CString& sError) {
-    auto it1 = m_vChans.begin();
-    for (; it1 != m_vChans.end(); ++it1)
-        if ((*it1)->GetName().Equals(sChan1)) break;
-    if (it1 == m_vChans.end()) {
+    auto it1 = m_mpChanIndex.find(CaseFold(sChan1));
+    if (it1 == m_mpChanIndex.end()) {
         sError = t_f("You are not on {1}")(sChan1);
         return false;
     }
 
-    auto it2 = m_vChans.begin();
-    for (; it2 != m_vChans.end(); ++it2)
-        if ((*it2)->GetName().Equals(sChan2)) break;
-    if (it2 == m_vChans.end()) {
+    auto it2 = m_mpChanIndex.find(CaseFold(sChan2));
+    if (it2 == m_mpChanIndex.end()) {
         sError = t_f("You are not on {1}")(sChan2);
         return false;
     }
 
-    std::swap(*it1, *it2);
+    std::swap(*std::find(m_vChans.begin(), m_vChans.end(), it1->second),
+              *std::find(m_vChans.begin(), m_vChans.end(), it2->second));
     return true;
 }
 
@@ -1075,18 +1153,81 @@ bool CIRCNetwork::IsChan(const CString& sChan) const {
     return GetChanPrefixes().find(sChan[0]) != CString::npos;
 }
 
+void CIRCNetwork::SetCaseMapping(const CString& sCaseMapping) {
+    ECaseMapping eCaseMapping = CaseMappingAscii;
+    if (sCaseMapping.Equals("rfc1459")) {
+        eCaseMapping = CaseMappingRFC1459;
+    } else if (sCaseMapping.Equals("strict-rfc1459")) {
+        eCaseMapping = CaseMappingStrictRFC1459;
+    }
+
+    if (eCaseMapping == m_eCaseMapping) return;
+    m_eCaseMapping = eCaseMapping;
+
+    // Names which were different before may be equal now, the first one wins
+    m_mpChanIndex.clear();
+    m_bChanFoldCollisions = false;
+    for (CChan* pChan : m_vChans) {
+        if (!m_mpChanIndex.emplace(CaseFold(pChan->GetName()), pChan).second) {
+            m_bChanFoldCollisions = true;
+        }
+    }
+    m_mpQueryIndex.clear();
+    m_bQueryFoldCollisions = false;
+    for (CQuery* pQuery : m_vQueries) {
+        if (!m_mpQueryIndex.emplace(CaseFold(pQuery->GetName()), pQuery)
+                 .second) {
+            m_bQueryFoldCollisions = true;
+        }
+    }
+
+    for (CChan* pChan : m_vChans) {
+        pChan->UpdateCaseMapping();
+    }
+}
+
+CString CIRCNetwork::CaseFold(const CString& sName) const {
+    const unsigned char* puCaseFold = GetCaseFoldTable(m_eCaseMapping);
+    CString sRet = sName;
+    for (char& c : sRet) {
+        c = puCaseFold[(unsigned char)c];
+    }
+    return sRet;
+}
+
+const unsigned char* CIRCNetwork::GetCaseFoldTable(ECaseMapping eCaseMapping) {
+    struct SCaseFoldTables {
+        unsigned char aauTables[3][256];
+
+        SCaseFoldTables() {
+            for (unsigned int c = 0; c < 256; ++c) {
+                unsigned char uLower = c;
+                if (c >= 'A' && c <= 'Z') uLower = c - 'A' + 'a';
+                aauTables[CaseMappingAscii][c] = uLower;
+                // {}| are the lower case versions of []\, rfc1459 adds ^ for ~
+                if (c >= '[' && c <= ']') uLower = c - '[' + '{';
+                aauTables[CaseMappingStrictRFC1459][c] = uLower;
+                if (c == '~') uLower = '^';
+                aauTables[CaseMappingRFC1459][c] = uLower;
+            }
+        }
+    };
+    static const SCaseFoldTables Tables;
+
+    return Tables.aauTables[eCaseMapping];
+}
+
 // Queries
 
 const vector<CQuery*>& CIRCNetwork::GetQueries() const { return m_vQueries; }
 
 CQuery* CIRCNetwork::FindQuery(const CString& sName) const {
-    for (CQuery* pQuery : m_vQueries) {
-        if (sName.Equals(pQuery->GetName())) {
-            return pQuery;
-        }
+    auto it = m_mpQueryIndex.find(CaseFold(sName));
+    if (it == m_mpQueryIndex.end()) {
+        return nullptr;
     }
 
-    return nullptr;
+    return it->second;
 }
 
 std::vector<CQuery*> CIRCNetwork::FindQueries(const CString& sWild) const {
@@ -1109,11 +1250,17 @@ CQuery* CIRCNetwork::AddQuery(const CString& sName) {
     if (!pQuery) {
         pQuery = new CQuery(sName, this);
         m_vQueries.push_back(pQuery);
+        m_mpQueryIndex[CaseFold(pQuery->GetName())] = pQuery;
 
         if (m_pUser->MaxQueryBuffers() > 0) {
             while (m_vQueries.size() > m_pUser->MaxQueryBuffers()) {
-                delete *m_vQueries.begin();
+                CQuery* pOldest = *m_vQueries.begin();
                 m_vQueries.erase(m_vQueries.begin());
+                auto it = m_mpQueryIndex.find(CaseFold(pOldest->GetName()));
+                if (it != m_mpQueryIndex.end() && it->second == pOldest) {
+                    UnindexQuery(it);
+                }
+                delete pOldest;
             }
         }
     }
@@ -1122,16 +1269,35 @@ CQuery* CIRCNetwork::AddQuery(const CString& sName) {
 }
 
 bool CIRCNetwork::DelQuery(const CString& sName) {
-    for (vector<CQuery*>::iterator a = m_vQueries.begin();
-         a != m_vQueries.end(); ++a) {
-        if (sName.Equals((*a)->GetName())) {
-            delete *a;
-            m_vQueries.erase(a);
-            return true;
-        }
+    auto it = m_mpQueryIndex.find(CaseFold(sName));
+    if (it == m_mpQueryIndex.end()) {
+        return false;
     }
 
-    return false;
+    CQuery* pQuery = it->second;
+    m_vQueries.erase(std::find(m_vQueries.begin(), m_vQueries.end(), pQuery));
+    UnindexQuery(it);
+    delete pQuery;
+    return true;
+}
+
+void CIRCNetwork::UnindexQuery(
+    std::unordered_map<CString, CQuery*>::iterator it) {
+    if (!m_bQueryFoldCollisions) {
+        m_mpQueryIndex.erase(it);
+        return;
+    }
+
+    const CString sKey = it->first;
+    m_mpQueryIndex.erase(it);
+
+    // Since a CASEMAPPING change, another query may fold to the same name
+    for (CQuery* pOther : m_vQueries) {
+        if (CaseFold(pOther->GetName()) == sKey) {
+            m_mpQueryIndex.emplace(sKey, pOther);
+            break;
+        }
+    }
 }
 
 // Server list
@@ -1346,6 +1512,9 @@ bool CIRCNetwork::Connect() {
     pIRCSock->SetSSLTrustedPeerFingerprints(m_ssTrustedFingerprints);
     pIRCSock->SetTrustAllCerts(GetTrustAllCerts());
     pIRCSock->SetTrustPKI(GetTrustPKI());
+#ifdef HAVE_LIBSSL
+    pIRCSock->SetSSLSessionOwner(m_pUser->GetUsername() + "/" + m_sName);
+#endif
 
     DEBUG("Connecting user/network [" << m_pUser->GetUsername() << "/"
                                       << m_sName << "]");
@@ -20,8 +20,10 @@
 #include <znc/IRCNetwork.h>
 #include <znc/Server.h>
 #include <znc/Query.h>
+#include <znc/Profiler.h>
 #include <znc/ZNCDebug.h>
 #include <time.h>
+#include <algorithm>
 
 using std::set;
 using std::vector;
@@ -39,19 +41,20 @@ const unsigned int CIRCSock::m_uCTCPFloodCount = 5;
 // TODO move this constant to CIRCNetwork?
 static const double FLOOD_MINIMAL_RATE = 0.3;
 
+// Wakes the socket up when flood protection allows the next line to be sent
 class CIRCFloodTimer : public CCron {
     CIRCSock* m_pSock;
 
   public:
-    CIRCFloodTimer(CIRCSock* pSock) : m_pSock(pSock) {
-        StartMaxCycles(m_pSock->m_fFloodRate, 0);
+    CIRCFloodTimer(CIRCSock* pSock, double fDelay) : m_pSock(pSock) {
+        SetName("CIRCFloodTimer");
+        StartMaxCycles(fDelay, 1);
     }
     CIRCFloodTimer(const CIRCFloodTimer&) = delete;
     CIRCFloodTimer& operator=(const CIRCFloodTimer&) = delete;
     void RunJob() override {
-        if (m_pSock->m_iSendsAllowed < m_pSock->m_uFloodBurst) {
-            m_pSock->m_iSendsAllowed++;
-        }
+        // This timer is done, TrySend() schedules the next one if needed
+        m_pSock->m_pFloodTimer = nullptr;
         m_pSock->TrySend();
     }
 };
@@ -85,11 +88,15 @@ CIRCSock::CIRCSock(CIRCNetwork* pNetwork)
       m_lastCTCP(0),
       m_uNumCTCP(0),
       m_mISupport(),
-      m_vSendQueue(),
-      m_iSendsAllowed(pNetwork->GetFloodBurst()),
+      m_fFloodTokens(pNetwork->GetFloodBurst()),
+      m_uFloodRefilled(CUtils::GetMillTime()),
       m_uFloodBurst(pNetwork->GetFloodBurst()),
       m_fFloodRate(pNetwork->GetFloodRate()),
       m_bFloodProtection(IsFloodProtected(pNetwork->GetFloodRate())),
+      m_fFloodRecvQ(0),
+      m_uFloodRecvQSize(pNetwork->GetFloodRecvQ()),
+      m_uFloodByteRate(pNetwork->GetFloodByteRate()),
+      m_bByteFloodProtection(m_uFloodRecvQSize > 0 && m_uFloodByteRate > 0),
       m_lastFloodWarned(0) {
     EnableReadLine();
     m_Nick.SetIdent(m_pNetwork->GetIdent());
@@ -112,9 +119,6 @@ CIRCSock::CIRCSock(CIRCNetwork* pNetwork)
     // RFC says a line can have 512 chars max + 512 chars for message tags, but
     // we don't care ;)
     SetMaxBufferThreshold(2048);
-    if (m_bFloodProtection) {
-        AddCron(new CIRCFloodTimer(this));
-    }
 }
 
 CIRCSock::~CIRCSock() {
@@ -156,10 +160,12 @@ void CIRCSock::Quit(const CString& sQuitMsg) {
 }
 
 void CIRCSock::ReadLine(const CString& sData) {
+    CProfileTimer ProfileTimer(CProfiler::IRCReadLine);
     CString sLine = sData;
 
-    sLine.Replace("\n", "");
-    sLine.Replace("\r", "");
+    sLine.erase(std::remove_if(sLine.begin(), sLine.end(),
+                               [](char c) { return c == '\r' || c == '\n'; }),
+                sLine.end());
 
     DEBUG("(" << m_pNetwork->GetUser()->GetUsername() << "/"
               << m_pNetwork->GetName() << ") IRC -> ZNC [" << sLine << "]");
@@ -168,7 +174,7 @@ void CIRCSock::ReadLine(const CString& sData) {
     IRCSOCKMODULECALL(OnRaw(sLine), &bReturn);
     if (bReturn) return;
 
-    CMessage Message(sLine);
+    CMessage Message(std::move(sLine));
     Message.SetNetwork(m_pNetwork);
 
     IRCSOCKMODULECALL(OnRawMessage(Message), &bReturn);
@@ -1391,45 +1397,105 @@ void CIRCSock::PutIRC(const CString& sLine) {
     PutIRC(CMessage(sLine));
 }
 
-void CIRCSock::PutIRC(const CMessage& Message) {
-    // Only print if the line won't get sent immediately (same condition as in
-    // TrySend()!)
-    if (m_bFloodProtection && m_iSendsAllowed <= 0) {
+void CIRCSock::PutIRC(const CMessage& Message, ESendPriority ePriority) {
+    size_t uBytes =
+        m_bByteFloodProtection ? Message.ToString().length() + 2 : 0;
+    // Only print if the line won't get sent immediately
+    RefillFloodTokens();
+    if (GetSendQueueSize() > 0 || GetFloodDelay(uBytes) > 0) {
         DEBUG("(" << m_pNetwork->GetUser()->GetUsername() << "/"
                   << m_pNetwork->GetName() << ") ZNC -> IRC ["
                   << CDebug::Filter(Message.ToString()) << "] (queued)");
+        m_aSendQueueStats[ePriority].uDelayed++;
     }
-    m_vSendQueue.push_back(Message);
+    m_adqSendQueue[ePriority].push_back(
+        {Message, CUtils::GetMillTime(), uBytes});
     TrySend();
 }
 
 void CIRCSock::PutIRCQuick(const CString& sLine) {
-    // Only print if the line won't get sent immediately (same condition as in
-    // TrySend()!)
-    if (m_bFloodProtection && m_iSendsAllowed <= 0) {
-        DEBUG("(" << m_pNetwork->GetUser()->GetUsername() << "/"
-                  << m_pNetwork->GetName() << ") ZNC -> IRC ["
-                  << CDebug::Filter(sLine) << "] (queued to front)");
+    PutIRC(CMessage(sLine), PriorityKeepalive);
+}
+
+size_t CIRCSock::GetSendQueueSize() const {
+    size_t uSize = 0;
+    for (const auto& dqQueue : m_adqSendQueue) {
+        uSize += dqQueue.size();
     }
-    m_vSendQueue.emplace_front(sLine);
-    TrySend();
+    return uSize;
+}
+
+void CIRCSock::RefillFloodTokens() {
+    unsigned long long uNow = CUtils::GetMillTime();
+    if (uNow > m_uFloodRefilled) {
+        double fSeconds = (uNow - m_uFloodRefilled) / 1000.0;
+        if (m_bFloodProtection) {
+            m_fFloodTokens += fSeconds / m_fFloodRate;
+            m_fFloodTokens = std::min<double>(m_fFloodTokens, m_uFloodBurst);
+        }
+        if (m_bByteFloodProtection) {
+            m_fFloodRecvQ -= fSeconds * m_uFloodByteRate;
+            m_fFloodRecvQ = std::max(m_fFloodRecvQ, 0.0);
+        }
+    }
+    m_uFloodRefilled = uNow;
+}
+
+double CIRCSock::GetFloodDelay(size_t uBytes) const {
+    double fDelay = 0;
+    if (m_bFloodProtection && m_fFloodTokens < 1) {
+        fDelay = (1 - m_fFloodTokens) * m_fFloodRate;
+    }
+    if (m_bByteFloodProtection) {
+        // A line longer than the whole RecvQ has to go once it is empty
+        double fExcess = m_fFloodRecvQ +
+                         std::min<double>(uBytes, m_uFloodRecvQSize) -
+                         m_uFloodRecvQSize;
+        if (fExcess > 0) {
+            fDelay = std::max(fDelay, fExcess / m_uFloodByteRate);
+        }
+    }
+    return fDelay;
 }
 
 void CIRCSock::TrySend() {
-    // This condition must be the same as in PutIRC() and PutIRCQuick()!
-    while (!m_vSendQueue.empty() &&
-           (!m_bFloodProtection || m_iSendsAllowed > 0)) {
-        m_iSendsAllowed--;
-        CMessage& Message = m_vSendQueue.front();
+    RefillFloodTokens();
 
-        if (!m_bMessageTagCap) {
-            MCString mssTags;
-            for (const auto& it : Message.GetTags()) {
-                if (IsTagEnabled(it.first)) {
-                    mssTags[it.first] = it.second;
-                }
+    while (true) {
+        int iPriority = 0;
+        while (iPriority < PRIORITY_COUNT &&
+               m_adqSendQueue[iPriority].empty()) {
+            iPriority++;
+        }
+        if (iPriority == PRIORITY_COUNT) break;
+
+        std::deque<SQueuedLine>& dqQueue = m_adqSendQueue[iPriority];
+        double fDelay = GetFloodDelay(dqQueue.front().uBytes);
+        if (fDelay > 0) {
+            if (!m_pFloodTimer) {
+                // Wake up exactly when the line can be sent
+                m_pFloodTimer = new CIRCFloodTimer(this, fDelay + 0.001);
+                AddCron(m_pFloodTimer);
             }
-            Message.SetTags(mssTags);
+            break;
+        }
+
+        // Take the line out first, modules may send more lines from the hook
+        CMessage Message = std::move(dqQueue.front().Message);
+        unsigned long long uDelay =
+            m_uFloodRefilled - dqQueue.front().uQueued;
+        dqQueue.pop_front();
+
+        if (m_bFloodProtection) m_fFloodTokens--;
+
+        SSendQueueStats& Stats = m_aSendQueueStats[iPriority];
+        Stats.uSent++;
+        Stats.uTotalDelay += uDelay;
+        Stats.uMaxDelay = std::max(Stats.uMaxDelay, uDelay);
+
+        if (!m_bMessageTagCap) {
+            Message.FilterTags(
+                [this](const CString& sTag) { return IsTagEnabled(sTag); });
         }
         Message.SetNetwork(m_pNetwork);
 
@@ -1439,16 +1505,16 @@ void CIRCSock::TrySend() {
         if (!bSkip) {
             PutIRCRaw(Message.ToString());
         }
-        m_vSendQueue.pop_front();
 
-        if (m_vSendQueue.size() * m_fFloodRate > 600) {
+        size_t uQueued = GetSendQueueSize();
+        if (uQueued * m_fFloodRate > 600) {
             unsigned long long now = CUtils::GetMillTime();
             // Warn no more often than once every 2 minutes
             if (now > m_lastFloodWarned + 2 * 60'000) {
                 m_lastFloodWarned = now;
                 this->GetNetwork()->PutStatus(
                     t_f("Warning: flood protection is delaying your messages "
-                        "by {1} seconds")(m_vSendQueue.size() * m_fFloodRate));
+                        "by {1} seconds")(uQueued * m_fFloodRate));
             }
         }
     }
@@ -1463,6 +1529,11 @@ void CIRCSock::PutIRCRaw(const CString& sLine) {
                   << m_pNetwork->GetName() << ") ZNC -> IRC ["
                   << CDebug::Filter(sCopy) << "]");
         Write(sCopy + "\r\n");
+        if (m_bByteFloodProtection) {
+            // Lines sent from outside of the queue take up RecvQ as well
+            RefillFloodTokens();
+            m_fFloodRecvQ += sCopy.length() + 2;
+        }
     }
 }
 
@@ -1633,6 +1704,8 @@ void CIRCSock::ParseISupport(const CMessage& Message) {
             }
         } else if (sName.Equals("CHANTYPES")) {
             m_pNetwork->SetChanPrefixes(sValue);
+        } else if (sName.Equals("CASEMAPPING")) {
+            m_pNetwork->SetCaseMapping(sValue);
         } else if (sName.Equals("NICKLEN")) {
             unsigned int uMax = sValue.ToUInt();
 
@@ -14,16 +14,28 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include <string_view>
 
 #include <znc/Message.h>
 #include <znc/Utils.h>
 
+namespace {
+CString ToCString(std::string_view sv) {
+    return CString(sv.data(), sv.size());
+}
+}  // namespace
+
 CMessage::CMessage(const CString& sMessage) {
     Parse(sMessage);
     InitTime();
 }
 
+CMessage::CMessage(CString&& sMessage) {
+    Parse(std::move(sMessage));
+    InitTime();
+}
+
 CMessage::CMessage(const CNick& Nick, const CString& sCommand,
                    const VCString& vsParams, const MCString& mssTags)
     : m_Nick(Nick),
@@ -34,9 +46,66 @@ CMessage::CMessage(const CNick& Nick, const CString& sCommand,
 }
 
 bool CMessage::Equals(const CMessage& Other) const {
-    return m_Nick.NickEquals(Other.GetNick().GetNick()) &&
-           m_sCommand.Equals(Other.GetCommand()) &&
-           m_vsParams == Other.GetParams();
+    if (!GetNick().NickEquals(Other.GetNick().GetNick()) ||
+        !m_sCommand.Equals(Other.GetCommand())) {
+        return false;
+    }
+    size_t uParams = GetParamCount();
+    if (uParams != Other.GetParamCount()) {
+        return false;
+    }
+    for (size_t i = 0; i < uParams; ++i) {
+        if (GetParamView(i) != Other.GetParamView(i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CMessage::Identical(const CMessage& Other) const {
+    if (m_sCommand != Other.m_sCommand || m_bColon != Other.m_bColon) {
+        return false;
+    }
+    size_t uParams = GetParamCount();
+    if (uParams != Other.GetParamCount()) {
+        return false;
+    }
+    for (size_t i = 0; i < uParams; ++i) {
+        if (GetParamView(i) != Other.GetParamView(i)) {
+            return false;
+        }
+    }
+
+    // Copies of a parsed message still share its line, so the common case
+    // doesn't need to parse anything
+    bool bSameLine = m_spLine && m_spLine == Other.m_spLine;
+    if (!bSameLine || !m_bNickIsView || !Other.m_bNickIsView ||
+        m_PrefixView.uOffset != Other.m_PrefixView.uOffset ||
+        m_PrefixView.uLength != Other.m_PrefixView.uLength) {
+        const CNick& Nick = GetNick();
+        const CNick& OtherNick = Other.GetNick();
+        if (Nick.GetNick() != OtherNick.GetNick() ||
+            Nick.GetIdent() != OtherNick.GetIdent() ||
+            Nick.GetHost() != OtherNick.GetHost()) {
+            return false;
+        }
+    }
+
+    bSameLine = m_spLine && m_spLine == Other.m_spLine;
+    if (bSameLine && m_bTagsAreViews && Other.m_bTagsAreViews &&
+        m_vTagViews.size() == Other.m_vTagViews.size() &&
+        std::equal(m_vTagViews.begin(), m_vTagViews.end(),
+                   Other.m_vTagViews.begin(),
+                   [](const std::pair<SLineView, SLineView>& a,
+                      const std::pair<SLineView, SLineView>& b) {
+                       return a.first.uOffset == b.first.uOffset &&
+                              a.first.uLength == b.first.uLength &&
+                              a.second.uOffset == b.second.uOffset &&
+                              a.second.uLength == b.second.uLength;
+                   })) {
+        return true;
+    }
+    return GetTags() == Other.GetTags();
 }
 
 void CMessage::Clone(const CMessage& Message) {
@@ -45,35 +114,62 @@ void CMessage::Clone(const CMessage& Message) {
     }
 }
 
+CNick& CMessage::GetNick() {
+    MaterializeNick();
+    return m_Nick;
+}
+
+const CNick& CMessage::GetNick() const {
+    MaterializeNick();
+    return m_Nick;
+}
+
+void CMessage::SetNick(const CNick& Nick) {
+    m_Nick = Nick;
+    m_bNickIsView = false;
+    ReleaseLine();
+}
+
 void CMessage::SetCommand(const CString& sCommand) {
     m_sCommand = sCommand;
     InitType();
 }
 
+const VCString& CMessage::GetParams() const {
+    MaterializeParams();
+    return m_vsParams;
+}
+
 CString CMessage::GetParamsColon(unsigned int uIdx, unsigned int uLen) const {
-    if (m_vsParams.empty() || uLen == 0 || uIdx >= m_vsParams.size()) {
+    size_t uParams = GetParamCount();
+    if (uParams == 0 || uLen == 0 || uIdx >= uParams) {
         return "";
     }
-    if (uLen > m_vsParams.size() - uIdx - 1) {
-        uLen = m_vsParams.size() - uIdx;
+    if (uLen > uParams - uIdx - 1) {
+        uLen = uParams - uIdx;
     }
-    VCString vsParams;
-    unsigned uParams = m_vsParams.size();
+    CString sRet;
     for (unsigned int i = uIdx; i < uIdx + uLen; ++i) {
-        CString sParam = m_vsParams[i];
+        std::string_view svParam = GetParamView(i);
+        if (i != uIdx) {
+            sRet += " ";
+        }
         if (i == uParams - 1 &&
-            (m_bColon || sParam.empty() || sParam.StartsWith(":") ||
-             sParam.Contains(" "))) {
-            sParam = ":" + sParam;
+            (m_bColon || svParam.empty() || svParam.front() == ':' ||
+             svParam.find(' ') != std::string_view::npos)) {
+            sRet += ":";
         }
-        vsParams.push_back(sParam);
+        sRet.append(svParam.data(), svParam.size());
     }
-    return CString(" ").Join(vsParams.begin(), vsParams.end());
+    return sRet;
 }
 
 void CMessage::SetParams(const VCString& vsParams) {
     m_vsParams = vsParams;
+    m_bParamsAreViews = false;
+    m_vParamViews.clear();
     m_bColon = false;
+    ReleaseLine();
 
     if (m_eType == Type::Text || m_eType == Type::Notice ||
         m_eType == Type::Action || m_eType == Type::CTCP) {
@@ -83,7 +179,10 @@ void CMessage::SetParams(const VCString& vsParams) {
 
 void CMessage::SetParams(VCString&& vsParams) {
     m_vsParams = std::move(vsParams);
+    m_bParamsAreViews = false;
+    m_vParamViews.clear();
     m_bColon = false;
+    ReleaseLine();
 
     if (m_eType == Type::Text || m_eType == Type::Notice ||
         m_eType == Type::Action || m_eType == Type::CTCP) {
@@ -92,13 +191,14 @@ void CMessage::SetParams(VCString&& vsParams) {
 }
 
 CString CMessage::GetParam(unsigned int uIdx) const {
-    if (uIdx >= m_vsParams.size()) {
+    if (uIdx >= GetParamCount()) {
         return "";
     }
-    return m_vsParams[uIdx];
+    return ToCString(GetParamView(uIdx));
 }
 
 void CMessage::SetParam(unsigned int uIdx, const CString& sParam) {
+    MaterializeParams();
     if (uIdx >= m_vsParams.size()) {
         m_vsParams.resize(uIdx + 1);
     }
@@ -110,7 +210,38 @@ void CMessage::SetParam(unsigned int uIdx, const CString& sParam) {
     }
 }
 
+const MCString& CMessage::GetTags() const {
+    MaterializeTags();
+    return m_mssTags;
+}
+
+MCString& CMessage::GetTags() {
+    MaterializeTags();
+    return m_mssTags;
+}
+
+void CMessage::SetTags(const MCString& mssTags) {
+    m_mssTags = mssTags;
+    m_bTagsAreViews = false;
+    m_vTagViews.clear();
+    ReleaseLine();
+}
+
 CString CMessage::GetTag(const CString& sKey) const {
+    if (m_bTagsAreViews) {
+        // Later duplicates of a key override earlier ones
+        for (auto it = m_vTagViews.rbegin(); it != m_vTagViews.rend(); ++it) {
+            if (GetView(it->first) == sKey) {
+                std::string_view svValue = GetView(it->second);
+                if (svValue.find('\\') == std::string_view::npos) {
+                    return ToCString(svValue);
+                }
+                return ToCString(svValue).Escape(CString::EMSGTAG,
+                                                 CString::EASCII);
+            }
+        }
+        return "";
+    }
     MCString::const_iterator it = m_mssTags.find(sKey);
     if (it != m_mssTags.end()) {
         return it->second;
@@ -118,30 +249,107 @@ CString CMessage::GetTag(const CString& sKey) const {
     return "";
 }
 
+bool CMessage::HasTag(const CString& sKey) const {
+    if (m_bTagsAreViews) {
+        for (const auto& Tag : m_vTagViews) {
+            if (GetView(Tag.first) == sKey) return true;
+        }
+        return false;
+    }
+    return m_mssTags.count(sKey) != 0;
+}
+
 void CMessage::SetTag(const CString& sKey, const CString& sValue) {
+    MaterializeTags();
     m_mssTags[sKey] = sValue;
 }
 
+void CMessage::FilterTags(
+    const std::function<bool(const CString& sKey)>& fnKeep) {
+    if (m_bTagsAreViews) {
+        m_vTagViews.erase(
+            std::remove_if(m_vTagViews.begin(), m_vTagViews.end(),
+                           [&](const std::pair<SLineView, SLineView>& Tag) {
+                               return !fnKeep(ToCString(GetView(Tag.first)));
+                           }),
+            m_vTagViews.end());
+        if (m_vTagViews.empty()) {
+            m_bTagsAreViews = false;
+            ReleaseLine();
+        }
+        return;
+    }
+    for (auto it = m_mssTags.begin(); it != m_mssTags.end();) {
+        if (fnKeep(it->first)) {
+            ++it;
+        } else {
+            it = m_mssTags.erase(it);
+        }
+    }
+}
+
 CString CMessage::ToString(unsigned int uFlags) const {
     CString sMessage;
 
     // <tags>
-    if (!(uFlags & ExcludeTags) && !m_mssTags.empty()) {
+    if (!(uFlags & ExcludeTags) &&
+        (m_bTagsAreViews ? !m_vTagViews.empty() : !m_mssTags.empty())) {
         CString sTags;
-        for (const auto& it : m_mssTags) {
-            if (!sTags.empty()) {
-                sTags += ";";
+        if (m_bTagsAreViews) {
+            // Values without a backslash are the same escaped or not, so they
+            // are copied as they are. Others are unescaped and escaped again,
+            // since the line may use escapes which Escape() wouldn't produce.
+            // The order and handling of duplicates is the same as for
+            // GetTags().
+            std::vector<const std::pair<SLineView, SLineView>*> vpTags;
+            vpTags.reserve(m_vTagViews.size());
+            for (const auto& Tag : m_vTagViews) vpTags.push_back(&Tag);
+            std::stable_sort(vpTags.begin(), vpTags.end(),
+                             [&](const std::pair<SLineView, SLineView>* a,
+                                 const std::pair<SLineView, SLineView>* b) {
+                                 return GetView(a->first) < GetView(b->first);
+                             });
+            for (size_t i = 0; i < vpTags.size(); ++i) {
+                std::string_view svKey = GetView(vpTags[i]->first);
+                // The last one of duplicate keys wins
+                if (i + 1 < vpTags.size() &&
+                    svKey == GetView(vpTags[i + 1]->first)) {
+                    continue;
+                }
+                if (!sTags.empty()) {
+                    sTags += ";";
+                }
+                sTags.append(svKey.data(), svKey.size());
+                std::string_view svValue = GetView(vpTags[i]->second);
+                if (svValue.find('\\') == std::string_view::npos) {
+                    if (!svValue.empty()) {
+                        sTags += "=";
+                        sTags.append(svValue.data(), svValue.size());
+                    }
+                } else {
+                    CString sValue = ToCString(svValue).Escape(
+                        CString::EMSGTAG, CString::EASCII);
+                    if (!sValue.empty()) {
+                        sTags += "=" + sValue.Escape_n(CString::EMSGTAG);
+                    }
+                }
+            }
+        } else {
+            for (const auto& it : m_mssTags) {
+                if (!sTags.empty()) {
+                    sTags += ";";
+                }
+                sTags += it.first;
+                if (!it.second.empty())
+                    sTags += "=" + it.second.Escape_n(CString::EMSGTAG);
             }
-            sTags += it.first;
-            if (!it.second.empty())
-                sTags += "=" + it.second.Escape_n(CString::EMSGTAG);
         }
         sMessage = "@" + sTags;
     }
 
     // <prefix>
     if (!(uFlags & ExcludePrefix)) {
-        CString sPrefix = m_Nick.GetHostMask();
+        CString sPrefix = GetNick().GetHostMask();
         if (!sPrefix.empty()) {
             if (!sMessage.empty()) {
                 sMessage += " ";
@@ -159,7 +367,7 @@ CString CMessage::ToString(unsigned int uFlags) const {
     }
 
     // <params>
-    if (!m_vsParams.empty()) {
+    if (GetParamCount() != 0) {
         if (!sMessage.empty()) {
             sMessage += " ";
         }
@@ -170,13 +378,31 @@ CString CMessage::ToString(unsigned int uFlags) const {
 }
 
 void CMessage::Parse(const CString& sMessage) {
-    const char* begin = sMessage.c_str();
-    const char* const end = begin + sMessage.size();
+    m_spLine = sMessage.empty() ? nullptr
+                                : std::make_shared<const CString>(sMessage);
+    ParseLine();
+}
+
+void CMessage::Parse(CString&& sMessage) {
+    m_spLine = sMessage.empty()
+                   ? nullptr
+                   : std::make_shared<const CString>(std::move(sMessage));
+    ParseLine();
+}
+
+void CMessage::ParseLine() {
+    const char* const start = m_spLine ? m_spLine->c_str() : "";
+    const char* begin = start;
+    const char* const end = begin + (m_spLine ? m_spLine->size() : 0);
+    auto to_view = [&](const char* p, size_t len) {
+        return SLineView{static_cast<unsigned int>(p - start),
+                         static_cast<unsigned int>(len)};
+    };
     auto next_word = [&]() {
         // Find the end of the first word
         const char* p = begin;
         while (p < end && *p != ' ') ++p;
-        std::string_view result(begin, p - begin);
+        SLineView result = to_view(begin, p - begin);
         begin = p;
         // Prepare for the following word
         while (begin < end && *begin == ' ') ++begin;
@@ -185,28 +411,29 @@ void CMessage::Parse(const CString& sMessage) {
 
     // <tags>
     m_mssTags.clear();
+    m_vTagViews.clear();
     if (begin < end && *begin == '@') {
-        std::string_view svTags = next_word().substr(1);
-        std::vector<std::string_view> vsTags;
-        // Split by ';'
+        ++begin;
+        SLineView Tags = next_word();
+        const char* p = start + Tags.uOffset;
+        const char* const tags_end = p + Tags.uLength;
+        // Split by ';', then save key and value
         while (true) {
-            auto delim = svTags.find_first_of(';');
-            if (delim == std::string_view::npos) {
-                vsTags.push_back(svTags);
-                break;
+            const char* tag_end = p;
+            while (tag_end < tags_end && *tag_end != ';') ++tag_end;
+            const char* delim = p;
+            while (delim < tag_end && *delim != '=') ++delim;
+            SLineView Key = to_view(p, delim - p);
+            SLineView Value = to_view(delim, 0);
+            if (delim < tag_end) {
+                Value = to_view(delim + 1, tag_end - delim - 1);
             }
-            vsTags.push_back(svTags.substr(0, delim));
-            svTags = svTags.substr(delim + 1);
-        }
-        // Save key and value
-        for (std::string_view svTag : vsTags) {
-            auto delim = svTag.find_first_of('=');
-            CString sKey = std::string(delim == std::string_view::npos ? svTag : svTag.substr(0, delim));
-            CString sValue = delim == std::string_view::npos ? std::string() : std::string(svTag.substr(delim + 1));
-            m_mssTags[sKey] =
-                sValue.Escape(CString::EMSGTAG, CString::CString::EASCII);
+            m_vTagViews.emplace_back(Key, Value);
+            if (tag_end == tags_end) break;
+            p = tag_end + 1;
         }
     }
+    m_bTagsAreViews = !m_vTagViews.empty();
 
     //  <message>  ::= [':' <prefix> <SPACE> ] <command> <params> <crlf>
     //  <prefix>   ::= <servername> | <nick> [ '!' <user> ] [ '@' <host> ]
@@ -219,34 +446,95 @@ void CMessage::Parse(const CString& sMessage) {
     //                   NUL or CR or LF>
 
     // <prefix>
+    m_bNickIsView = false;
     if (begin < end && *begin == ':') {
-        m_Nick.Parse(std::string(next_word().substr(1)));
+        ++begin;
+        m_PrefixView = next_word();
+        // An empty prefix leaves m_Nick untouched, see CNick::Parse()
+        m_bNickIsView = m_PrefixView.uLength != 0;
     }
 
     // <command>
-    m_sCommand = std::string(next_word());
+    SLineView Command = next_word();
+    m_sCommand.assign(start + Command.uOffset, Command.uLength);
 
     // <params>
     m_bColon = false;
     m_vsParams.clear();
+    m_vParamViews.clear();
     while (begin < end) {
         m_bColon = *begin == ':';
         if (m_bColon) {
             ++begin;
-            m_vsParams.push_back(std::string(begin, end - begin));
+            m_vParamViews.push_back(to_view(begin, end - begin));
             begin = end;
         } else {
-            m_vsParams.push_back(std::string(next_word()));
+            m_vParamViews.push_back(next_word());
         }
     }
+    m_bParamsAreViews = !m_vParamViews.empty();
 
+    ReleaseLine();
     InitType();
 }
 
+std::string_view CMessage::GetView(const SLineView& View) const {
+    return std::string_view(m_spLine->data() + View.uOffset, View.uLength);
+}
+
+size_t CMessage::GetParamCount() const {
+    return m_bParamsAreViews ? m_vParamViews.size() : m_vsParams.size();
+}
+
+std::string_view CMessage::GetParamView(size_t uIdx) const {
+    if (m_bParamsAreViews) {
+        return GetView(m_vParamViews[uIdx]);
+    }
+    return m_vsParams[uIdx];
+}
+
+void CMessage::MaterializeNick() const {
+    if (!m_bNickIsView) return;
+    m_Nick.Parse(ToCString(GetView(m_PrefixView)));
+    m_bNickIsView = false;
+    ReleaseLine();
+}
+
+void CMessage::MaterializeParams() const {
+    if (!m_bParamsAreViews) return;
+    m_vsParams.clear();
+    m_vsParams.reserve(m_vParamViews.size());
+    for (const SLineView& View : m_vParamViews) {
+        m_vsParams.push_back(ToCString(GetView(View)));
+    }
+    m_bParamsAreViews = false;
+    ReleaseLine();
+}
+
+void CMessage::MaterializeTags() const {
+    if (!m_bTagsAreViews) return;
+    m_mssTags.clear();
+    for (const auto& Tag : m_vTagViews) {
+        CString sValue = ToCString(GetView(Tag.second));
+        m_mssTags[ToCString(GetView(Tag.first))] =
+            sValue.Escape(CString::EMSGTAG, CString::EASCII);
+    }
+    m_bTagsAreViews = false;
+    ReleaseLine();
+}
+
+void CMessage::ReleaseLine() const {
+    // Once everything was copied out, there is no need to keep the line alive
+    if (m_spLine && !m_bNickIsView && !m_bParamsAreViews && !m_bTagsAreViews) {
+        m_spLine.reset();
+        m_vParamViews.clear();
+        m_vTagViews.clear();
+    }
+}
+
 void CMessage::InitTime() {
-    auto it = m_mssTags.find("time");
-    if (it != m_mssTags.end()) {
-        m_time = CUtils::ParseServerTime(it->second);
+    if (HasTag("time")) {
+        m_time = CUtils::ParseServerTime(GetTag("time"));
         return;
     }
 
@@ -307,20 +595,20 @@ void CMessage::InitType() {
 
 VCString CMessage::GetParamsSplit(unsigned int uIdx, unsigned int uLen) const {
     VCString splitParams;
-    const VCString &params = GetParams();
+    size_t uParams = GetParamCount();
 
-    if (params.empty() || uLen == 0 || uIdx >= params.size()) {
+    if (uParams == 0 || uLen == 0 || uIdx >= uParams) {
         return splitParams;
     }
 
-    if (uLen > params.size() - uIdx - 1) {
-        uLen = params.size() - uIdx;
+    if (uLen > uParams - uIdx - 1) {
+        uLen = uParams - uIdx;
     }
 
-    VCString::const_iterator startIt = params.begin() + uIdx;
-    VCString::const_iterator endIt = startIt + uLen;
-
-    splitParams.assign(startIt, endIt);
+    splitParams.reserve(uLen);
+    for (unsigned int i = uIdx; i < uIdx + uLen; ++i) {
+        splitParams.push_back(ToCString(GetParamView(i)));
+    }
 
     return splitParams;
 }
@@ -16,6 +16,7 @@
 
 #include <znc/IRCSock.h>
 #include <znc/Modules.h>
+#include <znc/Profiler.h>
 #include <znc/FileUtils.h>
 #include <znc/Template.h>
 #include <znc/User.h>
@@ -24,6 +25,8 @@
 #include <znc/WebModules.h>
 #include <znc/znc.h>
 #include <dlfcn.h>
+#include <algorithm>
+#include <atomic>
 
 using std::map;
 using std::set;
@@ -36,67 +39,99 @@ bool ZNC_NO_NEED_TO_DO_ANYTHING_ON_MODULE_CALL_EXITER;
 #warning "your crap box doesn't define RTLD_LOCAL !?"
 #endif
 
-#define MODUNLOADCHK(func)                              \
-    for (CModule * pMod : *this) {                      \
-        try {                                           \
-            CClient* pOldClient = pMod->GetClient();    \
-            pMod->SetClient(m_pClient);                 \
-            CUser* pOldUser = nullptr;                  \
-            if (m_pUser) {                              \
-                pOldUser = pMod->GetUser();             \
-                pMod->SetUser(m_pUser);                 \
-            }                                           \
-            CIRCNetwork* pNetwork = nullptr;            \
-            if (m_pNetwork) {                           \
-                pNetwork = pMod->GetNetwork();          \
-                pMod->SetNetwork(m_pNetwork);           \
-            }                                           \
-            pMod->func;                                 \
-            if (m_pUser) pMod->SetUser(pOldUser);       \
-            if (m_pNetwork) pMod->SetNetwork(pNetwork); \
-            pMod->SetClient(pOldClient);                \
-        } catch (const CModule::EModException& e) {     \
-            if (e == CModule::UNLOAD) {                 \
-                UnloadModule(pMod->GetModName());       \
-            }                                           \
-        }                                               \
-    }
-
-#define MODHALTCHK(func)                                \
-    bool bHaltCore = false;                             \
-    for (CModule * pMod : *this) {                      \
-        try {                                           \
-            CModule::EModRet e = CModule::CONTINUE;     \
-            CClient* pOldClient = pMod->GetClient();    \
-            pMod->SetClient(m_pClient);                 \
-            CUser* pOldUser = nullptr;                  \
-            if (m_pUser) {                              \
-                pOldUser = pMod->GetUser();             \
-                pMod->SetUser(m_pUser);                 \
-            }                                           \
-            CIRCNetwork* pNetwork = nullptr;            \
-            if (m_pNetwork) {                           \
-                pNetwork = pMod->GetNetwork();          \
-                pMod->SetNetwork(m_pNetwork);           \
-            }                                           \
-            e = pMod->func;                             \
-            if (m_pUser) pMod->SetUser(pOldUser);       \
-            if (m_pNetwork) pMod->SetNetwork(pNetwork); \
-            pMod->SetClient(pOldClient);                \
-            if (e == CModule::HALTMODS) {               \
-                break;                                  \
-            } else if (e == CModule::HALTCORE) {        \
-                bHaltCore = true;                       \
-            } else if (e == CModule::HALT) {            \
-                bHaltCore = true;                       \
-                break;                                  \
-            }                                           \
-        } catch (const CModule::EModException& e) {     \
-            if (e == CModule::UNLOAD) {                 \
-                UnloadModule(pMod->GetModName());       \
-            }                                           \
-        }                                               \
-    }                                                   \
+// Only the modules which override a hook are called. Each hook gets its own
+// list, which shrinks whenever a module turns out to use the default
+// implementation. Modules may be unloaded in between, so the list is looked up
+// again after every call.
+#define MODUNLOADCHK(func)                                              \
+    static const size_t uHook = NewHook();                              \
+    for (size_t uIdx = 0; uIdx < GetHookList(uHook).size();) {          \
+        CModule* pMod = GetHookList(uHook)[uIdx];                       \
+        bool bOldUnused = pMod->m_bUnusedHookCalled;                    \
+        try {                                                           \
+            CClient* pOldClient = pMod->GetClient();                    \
+            pMod->SetClient(m_pClient);                                 \
+            CUser* pOldUser = nullptr;                                  \
+            if (m_pUser) {                                              \
+                pOldUser = pMod->GetUser();                             \
+                pMod->SetUser(m_pUser);                                 \
+            }                                                           \
+            CIRCNetwork* pNetwork = nullptr;                            \
+            if (m_pNetwork) {                                           \
+                pNetwork = pMod->GetNetwork();                          \
+                pMod->SetNetwork(m_pNetwork);                           \
+            }                                                           \
+            pMod->m_bUnusedHookCalled = false;                          \
+            {                                                           \
+                CProfileHookTimer Timer(pMod->GetModName(), #func);     \
+                pMod->func;                                             \
+            }                                                           \
+            bool bUnused = pMod->m_bUnusedHookCalled;                   \
+            pMod->m_bUnusedHookCalled = bOldUnused;                     \
+            if (m_pUser) pMod->SetUser(pOldUser);                       \
+            if (m_pNetwork) pMod->SetNetwork(pNetwork);                 \
+            pMod->SetClient(pOldClient);                                \
+            if (bUnused) UnusedHook(uHook, pMod);                       \
+        } catch (const CModule::EModException& e) {                     \
+            pMod->m_bUnusedHookCalled = bOldUnused;                     \
+            if (e == CModule::UNLOAD) {                                 \
+                UnloadModule(pMod->GetModName());                       \
+            }                                                           \
+        }                                                               \
+        const vector<CModule*>& vpHookModules = GetHookList(uHook);     \
+        if (uIdx < vpHookModules.size() && vpHookModules[uIdx] == pMod) \
+            ++uIdx;                                                     \
+    }
+
+#define MODHALTCHK(func)                                                \
+    bool bHaltCore = false;                                             \
+    static const size_t uHook = NewHook();                              \
+    for (size_t uIdx = 0; uIdx < GetHookList(uHook).size();) {          \
+        CModule* pMod = GetHookList(uHook)[uIdx];                       \
+        bool bOldUnused = pMod->m_bUnusedHookCalled;                    \
+        try {                                                           \
+            CModule::EModRet e = CModule::CONTINUE;                     \
+            CClient* pOldClient = pMod->GetClient();                    \
+            pMod->SetClient(m_pClient);                                 \
+            CUser* pOldUser = nullptr;                                  \
+            if (m_pUser) {                                              \
+                pOldUser = pMod->GetUser();                             \
+                pMod->SetUser(m_pUser);                                 \
+            }                                                           \
+            CIRCNetwork* pNetwork = nullptr;                            \
+            if (m_pNetwork) {                                           \
+                pNetwork = pMod->GetNetwork();                          \
+                pMod->SetNetwork(m_pNetwork);                           \
+            }                                                           \
+            pMod->m_bUnusedHookCalled = false;                          \
+            {                                                           \
+                CProfileHookTimer Timer(pMod->GetModName(), #func);     \
+                e = pMod->func;                                         \
+            }                                                           \
+            bool bUnused = pMod->m_bUnusedHookCalled;                   \
+            pMod->m_bUnusedHookCalled = bOldUnused;                     \
+            if (m_pUser) pMod->SetUser(pOldUser);                       \
+            if (m_pNetwork) pMod->SetNetwork(pNetwork);                 \
+            pMod->SetClient(pOldClient);                                \
+            if (bUnused) UnusedHook(uHook, pMod);                       \
+            if (e == CModule::HALTMODS) {                               \
+                break;                                                  \
+            } else if (e == CModule::HALTCORE) {                        \
+                bHaltCore = true;                                       \
+            } else if (e == CModule::HALT) {                            \
+                bHaltCore = true;                                       \
+                break;                                                  \
+            }                                                           \
+        } catch (const CModule::EModException& e) {                     \
+            pMod->m_bUnusedHookCalled = bOldUnused;                     \
+            if (e == CModule::UNLOAD) {                                 \
+                UnloadModule(pMod->GetModName());                       \
+            }                                                           \
+        }                                                               \
+        const vector<CModule*>& vpHookModules = GetHookList(uHook);     \
+        if (uIdx < vpHookModules.size() && vpHookModules[uIdx] == pMod) \
+            ++uIdx;                                                     \
+    }                                                                   \
     return bHaltCore;
 
 /////////////////// Timer ///////////////////
@@ -149,7 +184,12 @@ CModule::CModule(ModHandle pDLL, CUser* pUser, CIRCNetwork* pNetwork,
       m_Translation("znc-" + sModName),
       m_mssRegistry(),
       m_vSubPages(),
-      m_mCommands() {
+      m_mCommands(),
+      m_bSkipUnusedHooks(true),
+      m_bUnusedHookCalled(false),
+      m_vbUnusedHooks(),
+      m_uRegistryJournalEntries(0),
+      m_bRegistryDirty(false) {
     if (m_pNetwork) {
         m_sSavePath = m_pNetwork->GetNetworkPath() + "/moddata/" + m_sModName;
     } else if (m_pUser) {
@@ -259,20 +299,180 @@ CString CModule::GetWebFilesPath() {
     }
 }
 
+// The journal is merged into .registry once it has more entries than this and
+// than the registry itself
+static const size_t REGISTRY_JOURNAL_MAX = 1024;
+
+// Replace the registry file so that after a crash either the old or the new
+// version is there, never a truncated one
+static bool WriteRegistry(const MCString& mssRegistry, const CString& sPath) {
+    if (mssRegistry.empty()) {
+        return !CFile::Exists(sPath) || CFile::Delete(sPath);
+    }
+
+    const CString sTmpPath = sPath + ".tmp";
+    if (mssRegistry.WriteToDisk(sTmpPath, 0600) != MCString::MCS_SUCCESS) {
+        return false;
+    }
+
+    CFile File(sTmpPath);
+    if (!File.Open(O_RDONLY) || !File.Sync()) {
+        return false;
+    }
+    File.Close();
+
+    return CFile::Move(sTmpPath, sPath, true);
+}
+
+#ifdef HAVE_PTHREAD
+class CRegistryJob : public CModuleJob {
+  public:
+    CRegistryJob(CModule* pModule, const MCString& mssRegistry,
+                 const CString& sPath)
+        : CModuleJob(pModule, "registry", "Compacts the registry journal"),
+          m_mssRegistry(mssRegistry),
+          m_sPath(sPath) {}
+    ~CRegistryJob() override { m_pModule->m_pRegistryJob = nullptr; }
+
+    void runThread() override {
+        if (WriteRegistry(m_mssRegistry, m_sPath)) {
+            CFile::Delete(m_sPath + ".journal.old");
+        }
+    }
+
+    void runMain() override {}
+
+  private:
+    const MCString m_mssRegistry;
+    const CString m_sPath;
+};
+#endif
+
 bool CModule::LoadRegistry() {
+#ifdef HAVE_PTHREAD
+    if (m_pRegistryJob) CThreadPool::Get().cancelJob(m_pRegistryJob);
+#endif
+    m_uRegistryJournalEntries = 0;
+    m_bRegistryDirty = false;
+
     // CString sPrefix = (m_pUser) ? m_pUser->GetUsername() : ".global";
-    return (m_mssRegistry.ReadFromDisk(GetSavePath() + "/.registry") ==
-            MCString::MCS_SUCCESS);
+    const CString sPath = GetSavePath() + "/.registry";
+    bool bRet =
+        (m_mssRegistry.ReadFromDisk(sPath) == MCString::MCS_SUCCESS);
+
+    // .journal.old is only left over if ZNC stopped while compacting it.
+    // Replaying a journal on top of a registry which already contains it
+    // gives the same result, so it doesn't matter how far that got.
+    bool bCompact = false;
+    const VCString vsJournals = {sPath + ".journal.old", sPath + ".journal"};
+    for (const CString& sJournal : vsJournals) {
+        CFile File(sJournal);
+        if (!File.Open(O_RDONLY)) continue;
+        bRet = true;
+
+        CString sLine;
+        while (File.ReadLine(sLine)) {
+            // The last record may be incomplete if ZNC crashed while
+            // writing it
+            if (!sLine.TrimSuffix("\n")) {
+                bCompact = true;
+                break;
+            }
+
+            CString sKey = sLine.Token(1);
+            m_mssRegistry.Decode(sKey);
+            if (sLine.StartsWith("+ ")) {
+                CString sValue = sLine.Token(2);
+                m_mssRegistry[sKey] = m_mssRegistry.Decode(sValue);
+            } else if (sLine.StartsWith("- ")) {
+                m_mssRegistry.erase(sKey);
+            }
+            m_uRegistryJournalEntries++;
+        }
+
+        if (sJournal.EndsWith(".old")) bCompact = true;
+    }
+
+    // Start over with a clean journal, appending to a torn one would garble
+    // the next record
+    if (bCompact) SaveRegistry();
+
+    return bRet;
 }
 
 bool CModule::SaveRegistry() const {
+#ifdef HAVE_PTHREAD
+    // Whatever it would write is outdated
+    if (m_pRegistryJob) CThreadPool::Get().cancelJob(m_pRegistryJob);
+#endif
+
     // CString sPrefix = (m_pUser) ? m_pUser->GetUsername() : ".global";
-    return (m_mssRegistry.WriteToDisk(GetSavePath() + "/.registry", 0600) ==
-            MCString::MCS_SUCCESS);
+    const CString sPath = GetSavePath() + "/.registry";
+    if (!WriteRegistry(m_mssRegistry, sPath)) {
+        return false;
+    }
+
+    CFile::Delete(sPath + ".journal.old");
+    CFile::Delete(sPath + ".journal");
+    m_uRegistryJournalEntries = 0;
+    m_bRegistryDirty = false;
+
+    return true;
+}
+
+bool CModule::AppendRegistryJournal(const CString& sRecord) {
+    // The journal is only valid on top of what is on disk
+    if (m_bRegistryDirty) {
+        return SaveRegistry();
+    }
+
+    // Opened for every record, keeping it open would take a file descriptor
+    // for every loaded module
+    CFile Journal(GetSavePath() + "/.registry.journal");
+    if (!Journal.Open(O_WRONLY | O_APPEND | O_CREAT, 0600)) {
+        m_bRegistryDirty = true;
+        return false;
+    }
+
+    if (Journal.Write(sRecord) != (ssize_t)sRecord.length()) {
+        // Rewrite everything next time, this record may be torn
+        m_bRegistryDirty = true;
+        return false;
+    }
+
+    if (++m_uRegistryJournalEntries > REGISTRY_JOURNAL_MAX &&
+        m_uRegistryJournalEntries > m_mssRegistry.size()) {
+        CompactRegistry();
+    }
+
+    return true;
+}
+
+void CModule::CompactRegistry() {
+#ifdef HAVE_PTHREAD
+    if (m_pRegistryJob) return;
+
+    // New changes go to a fresh journal while the old one is merged into
+    // .registry in a thread
+    const CString sPath = GetSavePath() + "/.registry";
+    if (CFile::Exists(sPath + ".journal.old") ||
+        !CFile::Move(sPath + ".journal", sPath + ".journal.old")) {
+        SaveRegistry();
+        return;
+    }
+    m_uRegistryJournalEntries = 0;
+
+    m_pRegistryJob = new CRegistryJob(this, m_mssRegistry, sPath);
+    AddJob(m_pRegistryJob);
+#else
+    SaveRegistry();
+#endif
 }
 
 bool CModule::MoveRegistry(const CString& sPath) {
     if (m_sSavePath != sPath) {
+        // Get everything into .registry, the journal isn't copied
+        SaveRegistry();
         CFile fOldNVFile = CFile(m_sSavePath + "/.registry");
         if (!fOldNVFile.Exists()) {
             return false;
@@ -290,11 +490,20 @@ bool CModule::MoveRegistry(const CString& sPath) {
 bool CModule::SetNV(const CString& sName, const CString& sValue,
                     bool bWriteToDisk) {
     m_mssRegistry[sName] = sValue;
-    if (bWriteToDisk) {
-        return SaveRegistry();
+    if (!bWriteToDisk) {
+        m_bRegistryDirty = true;
+        return true;
     }
 
-    return true;
+    // Like WriteToDisk(), which skips these
+    if (sName.empty()) {
+        return true;
+    }
+
+    CString sKey = sName;
+    CString sVal = sValue;
+    return AppendRegistryJournal("+ " + m_mssRegistry.Encode(sKey) + " " +
+                                 m_mssRegistry.Encode(sVal) + "\n");
 }
 
 CString CModule::GetNV(const CString& sName) const {
@@ -316,11 +525,13 @@ bool CModule::DelNV(const CString& sName, bool bWriteToDisk) {
         return false;
     }
 
-    if (bWriteToDisk) {
-        return SaveRegistry();
+    if (!bWriteToDisk) {
+        m_bRegistryDirty = true;
+        return true;
     }
 
-    return true;
+    CString sKey = sName;
+    return AppendRegistryJournal("- " + m_mssRegistry.Encode(sKey) + "\n");
 }
 
 bool CModule::ClearNV(bool bWriteToDisk) {
@@ -329,6 +540,7 @@ bool CModule::ClearNV(bool bWriteToDisk) {
     if (bWriteToDisk) {
         return SaveRegistry();
     }
+    m_bRegistryDirty = true;
     return true;
 }
 
@@ -498,8 +710,16 @@ void CModule::ListSockets() {
 CModuleJob::~CModuleJob() { m_pModule->UnlinkJob(this); }
 
 void CModule::AddJob(CModuleJob* pJob) {
-    CThreadPool::Get().addJob(pJob);
     m_sJobs.insert(pJob);
+    // Jobs are finished by the main thread, which must not touch the users
+    // of the event threads. There the job runs right away instead.
+    if (m_pUser && CZNC::Get().IsSharded()) {
+        pJob->runThread();
+        pJob->runMain();
+        delete pJob;
+        return;
+    }
+    CThreadPool::Get().addJob(pJob);
 }
 
 void CModule::CancelJob(CModuleJob* pJob) {
@@ -629,11 +849,12 @@ bool CModule::OnLoad(const CString& sArgs, CString& sMessage) {
     return true;
 }
 bool CModule::OnBoot() { return true; }
-void CModule::OnPreRehash() {}
-void CModule::OnPostRehash() {}
-void CModule::OnIRCDisconnected() {}
+void CModule::OnPreRehash() { UnusedHook(); }
+void CModule::OnPostRehash() { UnusedHook(); }
+void CModule::OnIRCDisconnected() { UnusedHook(); }
 void CModule::InternalServerDependentCapsOnIRCDisconnected() {
     OnIRCDisconnected();
+    UsedHook();
     for (const auto& [sName, pCap] : m_mServerDependentCaps) {
         GetNetwork()->NotifyClientsAboutServerDependentCap(sName, false);
         for (CClient* pClient : GetNetwork()->GetClients()) {
@@ -641,9 +862,10 @@ void CModule::InternalServerDependentCapsOnIRCDisconnected() {
         }
     }
 }
-void CModule::OnIRCConnected() {}
+void CModule::OnIRCConnected() { UnusedHook(); }
 void CModule::InternalServerDependentCapsOnIRCConnected() {
     OnIRCConnected();
+    UsedHook();
     for (const auto& [sName, pCap] : m_mServerDependentCaps) {
         if (GetNetwork()->IsServerCapAccepted(sName)) {
             GetNetwork()->NotifyClientsAboutServerDependentCap(sName, true);
@@ -651,15 +873,20 @@ void CModule::InternalServerDependentCapsOnIRCConnected() {
     }
 }
 CModule::EModRet CModule::OnIRCConnecting(CIRCSock* IRCSock) {
+    UnusedHook();
     return CONTINUE;
 }
-void CModule::OnIRCConnectionError(CIRCSock* IRCSock) {}
+void CModule::OnIRCConnectionError(CIRCSock* IRCSock) { UnusedHook(); }
 CModule::EModRet CModule::OnIRCRegistration(CString& sPass, CString& sNick,
                                             CString& sIdent,
                                             CString& sRealName) {
+    UnusedHook();
+    return CONTINUE;
+}
+CModule::EModRet CModule::OnBroadcast(CString& sMessage) {
+    UnusedHook();
     return CONTINUE;
 }
-CModule::EModRet CModule::OnBroadcast(CString& sMessage) { return CONTINUE; }
 
 void CModule::OnChanPermission3(const CNick* pOpNick, const CNick& Nick,
                                 CChan& Channel, char cMode,
@@ -699,31 +926,53 @@ void CModule::OnMode2(const CNick* pOpNick, CChan& Channel, char uMode,
 
 void CModule::OnChanPermission(const CNick& pOpNick, const CNick& Nick,
                                CChan& Channel, unsigned char uMode, bool bAdded,
-                               bool bNoChange) {}
+                               bool bNoChange) {
+    UnusedHook();
+}
 void CModule::OnOp(const CNick& pOpNick, const CNick& Nick, CChan& Channel,
-                   bool bNoChange) {}
+                   bool bNoChange) {
+    UnusedHook();
+}
 void CModule::OnDeop(const CNick& pOpNick, const CNick& Nick, CChan& Channel,
-                     bool bNoChange) {}
+                     bool bNoChange) {
+    UnusedHook();
+}
 void CModule::OnVoice(const CNick& pOpNick, const CNick& Nick, CChan& Channel,
-                      bool bNoChange) {}
+                      bool bNoChange) {
+    UnusedHook();
+}
 void CModule::OnDevoice(const CNick& pOpNick, const CNick& Nick, CChan& Channel,
-                        bool bNoChange) {}
+                        bool bNoChange) {
+    UnusedHook();
+}
 void CModule::OnRawMode(const CNick& pOpNick, CChan& Channel,
-                        const CString& sModes, const CString& sArgs) {}
+                        const CString& sModes, const CString& sArgs) {
+    UnusedHook();
+}
 void CModule::OnMode(const CNick& pOpNick, CChan& Channel, char uMode,
-                     const CString& sArg, bool bAdded, bool bNoChange) {}
+                     const CString& sArg, bool bAdded, bool bNoChange) {
+    UnusedHook();
+}
 
-CModule::EModRet CModule::OnRaw(CString& sLine) { return CONTINUE; }
-CModule::EModRet CModule::OnRawMessage(CMessage& Message) { return CONTINUE; }
+CModule::EModRet CModule::OnRaw(CString& sLine) {
+    UnusedHook();
+    return CONTINUE;
+}
+CModule::EModRet CModule::OnRawMessage(CMessage& Message) {
+    UnusedHook();
+    return CONTINUE;
+}
 CModule::EModRet CModule::OnNumericMessage(CNumericMessage& Message) {
+    UnusedHook();
     return CONTINUE;
 }
 
 CModule::EModRet CModule::OnStatusCommand(CString& sCommand) {
+    UnusedHook();
     return CONTINUE;
 }
-void CModule::OnModNotice(const CString& sMessage) {}
-void CModule::OnModCTCP(const CString& sMessage) {}
+void CModule::OnModNotice(const CString& sMessage) { UnusedHook(); }
+void CModule::OnModCTCP(const CString& sMessage) { UnusedHook(); }
 
 void CModule::OnModCommand(const CString& sCommand) { HandleCommand(sCommand); }
 void CModule::OnUnknownModCommand(const CString& sLine) {
@@ -737,55 +986,73 @@ void CModule::OnUnknownModCommand(const CString& sLine) {
 }
 
 void CModule::OnQuit(const CNick& Nick, const CString& sMessage,
-                     const vector<CChan*>& vChans) {}
+                     const vector<CChan*>& vChans) {
+    UnusedHook();
+}
 void CModule::OnQuitMessage(CQuitMessage& Message,
                             const vector<CChan*>& vChans) {
     OnQuit(Message.GetNick(), Message.GetReason(), vChans);
 }
 void CModule::OnNick(const CNick& Nick, const CString& sNewNick,
-                     const vector<CChan*>& vChans) {}
+                     const vector<CChan*>& vChans) {
+    UnusedHook();
+}
 void CModule::OnNickMessage(CNickMessage& Message,
                             const vector<CChan*>& vChans) {
     OnNick(Message.GetNick(), Message.GetNewNick(), vChans);
 }
 void CModule::OnKick(const CNick& Nick, const CString& sKickedNick,
-                     CChan& Channel, const CString& sMessage) {}
+                     CChan& Channel, const CString& sMessage) {
+    UnusedHook();
+}
 void CModule::OnKickMessage(CKickMessage& Message) {
     OnKick(Message.GetNick(), Message.GetKickedNick(), *Message.GetChan(),
            Message.GetReason());
 }
-CModule::EModRet CModule::OnJoining(CChan& Channel) { return CONTINUE; }
-void CModule::OnJoin(const CNick& Nick, CChan& Channel) {}
+CModule::EModRet CModule::OnJoining(CChan& Channel) {
+    UnusedHook();
+    return CONTINUE;
+}
+void CModule::OnJoin(const CNick& Nick, CChan& Channel) { UnusedHook(); }
 void CModule::OnJoinMessage(CJoinMessage& Message) {
     OnJoin(Message.GetNick(), *Message.GetChan());
 }
 void CModule::OnPart(const CNick& Nick, CChan& Channel,
-                     const CString& sMessage) {}
+                     const CString& sMessage) {
+    UnusedHook();
+}
 void CModule::OnPartMessage(CPartMessage& Message) {
     OnPart(Message.GetNick(), *Message.GetChan(), Message.GetReason());
 }
 CModule::EModRet CModule::OnInvite(const CNick& Nick, const CString& sChan) {
+    UnusedHook();
     return CONTINUE;
 }
 
 CModule::EModRet CModule::OnChanBufferStarting(CChan& Chan, CClient& Client) {
+    UnusedHook();
     return CONTINUE;
 }
 CModule::EModRet CModule::OnChanBufferEnding(CChan& Chan, CClient& Client) {
+    UnusedHook();
     return CONTINUE;
 }
 CModule::EModRet CModule::OnChanBufferPlayLine(CChan& Chan, CClient& Client,
                                                CString& sLine) {
+    UnusedHook();
     return CONTINUE;
 }
 CModule::EModRet CModule::OnPrivBufferStarting(CQuery& Query, CClient& Client) {
+    UnusedHook();
     return CONTINUE;
 }
 CModule::EModRet CModule::OnPrivBufferEnding(CQuery& Query, CClient& Client) {
+    UnusedHook();
     return CONTINUE;
 }
 CModule::EModRet CModule::OnPrivBufferPlayLine(CClient& Client,
                                                CString& sLine) {
+    UnusedHook();
     return CONTINUE;
 }
 
@@ -820,13 +1087,18 @@ CModule::EModRet CModule::OnPrivBufferPlayMessage(CMessage& Message) {
     return ret;
 }
 
-void CModule::OnClientLogin() {}
-void CModule::OnClientDisconnect() {}
-CModule::EModRet CModule::OnUserRaw(CString& sLine) { return CONTINUE; }
+void CModule::OnClientLogin() { UnusedHook(); }
+void CModule::OnClientDisconnect() { UnusedHook(); }
+CModule::EModRet CModule::OnUserRaw(CString& sLine) {
+    UnusedHook();
+    return CONTINUE;
+}
 CModule::EModRet CModule::OnUserRawMessage(CMessage& Message) {
+    UnusedHook();
     return CONTINUE;
 }
 CModule::EModRet CModule::OnUserCTCPReply(CString& sTarget, CString& sMessage) {
+    UnusedHook();
     return CONTINUE;
 }
 CModule::EModRet CModule::OnUserCTCPReplyMessage(CCTCPMessage& Message) {
@@ -838,6 +1110,7 @@ CModule::EModRet CModule::OnUserCTCPReplyMessage(CCTCPMessage& Message) {
     return ret;
 }
 CModule::EModRet CModule::OnUserCTCP(CString& sTarget, CString& sMessage) {
+    UnusedHook();
     return CONTINUE;
 }
 CModule::EModRet CModule::OnUserCTCPMessage(CCTCPMessage& Message) {
@@ -849,6 +1122,7 @@ CModule::EModRet CModule::OnUserCTCPMessage(CCTCPMessage& Message) {
     return ret;
 }
 CModule::EModRet CModule::OnUserAction(CString& sTarget, CString& sMessage) {
+    UnusedHook();
     return CONTINUE;
 }
 CModule::EModRet CModule::OnUserActionMessage(CActionMessage& Message) {
@@ -860,6 +1134,7 @@ CModule::EModRet CModule::OnUserActionMessage(CActionMessage& Message) {
     return ret;
 }
 CModule::EModRet CModule::OnUserMsg(CString& sTarget, CString& sMessage) {
+    UnusedHook();
     return CONTINUE;
 }
 CModule::EModRet CModule::OnUserTextMessage(CTextMessage& Message) {
@@ -871,6 +1146,7 @@ CModule::EModRet CModule::OnUserTextMessage(CTextMessage& Message) {
     return ret;
 }
 CModule::EModRet CModule::OnUserNotice(CString& sTarget, CString& sMessage) {
+    UnusedHook();
     return CONTINUE;
 }
 CModule::EModRet CModule::OnUserNoticeMessage(CNoticeMessage& Message) {
@@ -882,18 +1158,23 @@ CModule::EModRet CModule::OnUserNoticeMessage(CNoticeMessage& Message) {
     return ret;
 }
 CModule::EModRet CModule::OnUserTagMessage(CTargetMessage& Message) {
+    UnusedHook();
     return CONTINUE;
 }
 CModule::EModRet CModule::OnPrivTagMessage(CTargetMessage& Message) {
+    UnusedHook();
     return CONTINUE;
 }
 CModule::EModRet CModule::OnChanTagMessage(CTargetMessage& Message) {
+    UnusedHook();
     return CONTINUE;
 }
 CModule::EModRet CModule::OnInviteMessage(CInviteMessage& Message) {
+    UnusedHook();
     return CONTINUE;
 }
 CModule::EModRet CModule::OnUserJoin(CString& sChannel, CString& sKey) {
+    UnusedHook();
     return CONTINUE;
 }
 CModule::EModRet CModule::OnUserJoinMessage(CJoinMessage& Message) {
@@ -905,6 +1186,7 @@ CModule::EModRet CModule::OnUserJoinMessage(CJoinMessage& Message) {
     return ret;
 }
 CModule::EModRet CModule::OnUserPart(CString& sChannel, CString& sMessage) {
+    UnusedHook();
     return CONTINUE;
 }
 CModule::EModRet CModule::OnUserPartMessage(CPartMessage& Message) {
@@ -916,6 +1198,7 @@ CModule::EModRet CModule::OnUserPartMessage(CPartMessage& Message) {
     return ret;
 }
 CModule::EModRet CModule::OnUserTopic(CString& sChannel, CString& sTopic) {
+    UnusedHook();
     return CONTINUE;
 }
 CModule::EModRet CModule::OnUserTopicMessage(CTopicMessage& Message) {
@@ -927,9 +1210,13 @@ CModule::EModRet CModule::OnUserTopicMessage(CTopicMessage& Message) {
     return ret;
 }
 CModule::EModRet CModule::OnUserTopicRequest(CString& sChannel) {
+    UnusedHook();
+    return CONTINUE;
+}
+CModule::EModRet CModule::OnUserQuit(CString& sMessage) {
+    UnusedHook();
     return CONTINUE;
 }
-CModule::EModRet CModule::OnUserQuit(CString& sMessage) { return CONTINUE; }
 CModule::EModRet CModule::OnUserQuitMessage(CQuitMessage& Message) {
     CString sReason = Message.GetReason();
     EModRet ret = OnUserQuit(sReason);
@@ -938,6 +1225,7 @@ CModule::EModRet CModule::OnUserQuitMessage(CQuitMessage& Message) {
 }
 
 CModule::EModRet CModule::OnCTCPReply(CNick& Nick, CString& sMessage) {
+    UnusedHook();
     return CONTINUE;
 }
 CModule::EModRet CModule::OnCTCPReplyMessage(CCTCPMessage& Message) {
@@ -947,6 +1235,7 @@ CModule::EModRet CModule::OnCTCPReplyMessage(CCTCPMessage& Message) {
     return ret;
 }
 CModule::EModRet CModule::OnPrivCTCP(CNick& Nick, CString& sMessage) {
+    UnusedHook();
     return CONTINUE;
 }
 CModule::EModRet CModule::OnPrivCTCPMessage(CCTCPMessage& Message) {
@@ -957,6 +1246,7 @@ CModule::EModRet CModule::OnPrivCTCPMessage(CCTCPMessage& Message) {
 }
 CModule::EModRet CModule::OnChanCTCP(CNick& Nick, CChan& Channel,
                                      CString& sMessage) {
+    UnusedHook();
     return CONTINUE;
 }
 CModule::EModRet CModule::OnChanCTCPMessage(CCTCPMessage& Message) {
@@ -966,6 +1256,7 @@ CModule::EModRet CModule::OnChanCTCPMessage(CCTCPMessage& Message) {
     return ret;
 }
 CModule::EModRet CModule::OnPrivAction(CNick& Nick, CString& sMessage) {
+    UnusedHook();
     return CONTINUE;
 }
 CModule::EModRet CModule::OnPrivActionMessage(CActionMessage& Message) {
@@ -976,6 +1267,7 @@ CModule::EModRet CModule::OnPrivActionMessage(CActionMessage& Message) {
 }
 CModule::EModRet CModule::OnChanAction(CNick& Nick, CChan& Channel,
                                        CString& sMessage) {
+    UnusedHook();
     return CONTINUE;
 }
 CModule::EModRet CModule::OnChanActionMessage(CActionMessage& Message) {
@@ -985,6 +1277,7 @@ CModule::EModRet CModule::OnChanActionMessage(CActionMessage& Message) {
     return ret;
 }
 CModule::EModRet CModule::OnPrivMsg(CNick& Nick, CString& sMessage) {
+    UnusedHook();
     return CONTINUE;
 }
 CModule::EModRet CModule::OnPrivTextMessage(CTextMessage& Message) {
@@ -995,6 +1288,7 @@ CModule::EModRet CModule::OnPrivTextMessage(CTextMessage& Message) {
 }
 CModule::EModRet CModule::OnChanMsg(CNick& Nick, CChan& Channel,
                                     CString& sMessage) {
+    UnusedHook();
     return CONTINUE;
 }
 CModule::EModRet CModule::OnChanTextMessage(CTextMessage& Message) {
@@ -1004,6 +1298,7 @@ CModule::EModRet CModule::OnChanTextMessage(CTextMessage& Message) {
     return ret;
 }
 CModule::EModRet CModule::OnPrivNotice(CNick& Nick, CString& sMessage) {
+    UnusedHook();
     return CONTINUE;
 }
 CModule::EModRet CModule::OnPrivNoticeMessage(CNoticeMessage& Message) {
@@ -1014,6 +1309,7 @@ CModule::EModRet CModule::OnPrivNoticeMessage(CNoticeMessage& Message) {
 }
 CModule::EModRet CModule::OnChanNotice(CNick& Nick, CChan& Channel,
                                        CString& sMessage) {
+    UnusedHook();
     return CONTINUE;
 }
 CModule::EModRet CModule::OnChanNoticeMessage(CNoticeMessage& Message) {
@@ -1024,6 +1320,7 @@ CModule::EModRet CModule::OnChanNoticeMessage(CNoticeMessage& Message) {
 }
 CModule::EModRet CModule::OnTopic(CNick& Nick, CChan& Channel,
                                   CString& sTopic) {
+    UnusedHook();
     return CONTINUE;
 }
 CModule::EModRet CModule::OnTopicMessage(CTopicMessage& Message) {
@@ -1032,29 +1329,41 @@ CModule::EModRet CModule::OnTopicMessage(CTopicMessage& Message) {
     Message.SetTopic(sTopic);
     return ret;
 }
-CModule::EModRet CModule::OnTimerAutoJoin(CChan& Channel) { return CONTINUE; }
+CModule::EModRet CModule::OnTimerAutoJoin(CChan& Channel) {
+    UnusedHook();
+    return CONTINUE;
+}
 CModule::EModRet CModule::OnAddNetwork(CIRCNetwork& Network,
                                        CString& sErrorRet) {
+    UnusedHook();
     return CONTINUE;
 }
 CModule::EModRet CModule::OnDeleteNetwork(CIRCNetwork& Network) {
+    UnusedHook();
     return CONTINUE;
 }
 
 CModule::EModRet CModule::OnSendToClient(CString& sLine, CClient& Client) {
+    UnusedHook();
     return CONTINUE;
 }
 CModule::EModRet CModule::OnSendToClientMessage(CMessage& Message) {
+    UnusedHook();
     return CONTINUE;
 }
 
-CModule::EModRet CModule::OnSendToIRC(CString& sLine) { return CONTINUE; }
+CModule::EModRet CModule::OnSendToIRC(CString& sLine) {
+    UnusedHook();
+    return CONTINUE;
+}
 CModule::EModRet CModule::OnSendToIRCMessage(CMessage& Message) {
+    UnusedHook();
     return CONTINUE;
 }
-void CModule::OnClientAttached() {}
+void CModule::OnClientAttached() { UnusedHook(); }
 void CModule::InternalServerDependentCapsOnClientAttached() {
     OnClientAttached();
+    UsedHook();
     if (!GetNetwork()) return;
     for (const auto& [sName, pCap] : m_mServerDependentCaps) {
         if (GetNetwork()->IsServerCapAccepted(sName)) {
@@ -1062,9 +1371,10 @@ void CModule::InternalServerDependentCapsOnClientAttached() {
         }
     }
 }
-void CModule::OnClientDetached() {}
+void CModule::OnClientDetached() { UnusedHook(); }
 void CModule::InternalServerDependentCapsOnClientDetached() {
     OnClientDetached();
+    UsedHook();
     for (const auto& [sName, pCap] : m_mServerDependentCaps) {
         GetClient()->NotifyServerDependentCap(sName, false, "");
         pCap->OnClientChangedSupport(GetClient(), false);
@@ -1089,10 +1399,13 @@ bool CModule::InternalServerDependentCapsOnServerCap302Available(const CString&
     }
     return true;
 }
-void CModule::OnServerCapResult(const CString& sCap, bool bSuccess) {}
+void CModule::OnServerCapResult(const CString& sCap, bool bSuccess) {
+    UnusedHook();
+}
 void CModule::InternalServerDependentCapsOnServerCapResult(const CString& sCap,
                                                            bool bSuccess) {
     OnServerCapResult(sCap, bSuccess);
+    UsedHook();
     auto it = m_mServerDependentCaps.find(sCap);
     if (it == m_mServerDependentCaps.end()) return;
     it->second->OnServerChangedSupport(GetNetwork(), bSuccess);
@@ -1157,23 +1470,36 @@ bool CModule::PutModNotice(const CString& sLine) {
 // Global Module //
 ///////////////////
 CModule::EModRet CModule::OnAddUser(CUser& User, CString& sErrorRet) {
+    UnusedHook();
+    return CONTINUE;
+}
+CModule::EModRet CModule::OnDeleteUser(CUser& User) {
+    UnusedHook();
     return CONTINUE;
 }
-CModule::EModRet CModule::OnDeleteUser(CUser& User) { return CONTINUE; }
 void CModule::OnClientConnect(CZNCSock* pClient, const CString& sHost,
-                              unsigned short uPort) {}
+                              unsigned short uPort) {
+    UnusedHook();
+}
 CModule::EModRet CModule::OnLoginAttempt(std::shared_ptr<CAuthBase> Auth) {
+    UnusedHook();
     return CONTINUE;
 }
 void CModule::OnFailedLogin(const CString& sUsername,
-                            const CString& sRemoteIP) {}
+                            const CString& sRemoteIP) {
+    UnusedHook();
+}
 CModule::EModRet CModule::OnUnknownUserRaw(CClient* pClient, CString& sLine) {
+    UnusedHook();
     return CONTINUE;
 }
 CModule::EModRet CModule::OnUnknownUserRawMessage(CMessage& Message) {
+    UnusedHook();
     return CONTINUE;
 }
-void CModule::OnClientCapLs(CClient* pClient, SCString& ssCaps) {}
+void CModule::OnClientCapLs(CClient* pClient, SCString& ssCaps) {
+    UnusedHook();
+}
 void CModule::InternalServerDependentCapsOnClientCapLs(CClient* pClient, SCString& ssCaps) {
     for (const auto& [sName, pCap] : m_mServerDependentCaps) {
         if (GetNetwork() && GetNetwork()->IsServerCapAccepted(sName)) {
@@ -1191,6 +1517,7 @@ void CModule::InternalServerDependentCapsOnClientCapLs(CClient* pClient, SCStrin
         }
     }
     OnClientCapLs(pClient, ssCaps);
+    UsedHook();
 }
 bool CModule::IsClientCapSupported(CClient* pClient, const CString& sCap,
                                    bool bState) { return false; }
@@ -1203,12 +1530,15 @@ bool CModule::InternalServerDependentCapsIsClientCapSupported(
     return GetNetwork() && GetNetwork()->IsServerCapAccepted(sCap);
 }
 void CModule::OnClientCapRequest(CClient* pClient, const CString& sCap,
-                                 bool bState) {}
+                                 bool bState) {
+    UnusedHook();
+}
 
 void CModule::InternalServerDependentCapsOnClientCapRequest(CClient* pClient,
                                                             const CString& sCap,
                                                             bool bState) {
     OnClientCapRequest(pClient, sCap, bState);
+    UsedHook();
     auto it = m_mServerDependentCaps.find(sCap);
     if (it == m_mServerDependentCaps.end()) return;
     it->second->OnClientChangedSupport(pClient, bState);
@@ -1216,35 +1546,44 @@ void CModule::InternalServerDependentCapsOnClientCapRequest(CClient* pClient,
 
 CModule::EModRet CModule::OnClientSASLAuthenticate(
     const CString& sMechanism, const CString& sBuffer) {
+    UnusedHook();
     return CONTINUE;
 }
 
 CModule::EModRet CModule::OnClientSASLServerInitialChallenge(
     const CString& sMechanism, CString& sResponse) {
+    UnusedHook();
     return CONTINUE;
 }
 
-void CModule::OnClientGetSASLMechanisms(SCString& ssMechanisms) {}
+void CModule::OnClientGetSASLMechanisms(SCString& ssMechanisms) {
+    UnusedHook();
+}
 
-void CModule::OnClientSASLAborted() {}
+void CModule::OnClientSASLAborted() { UnusedHook(); }
 
 CModule::EModRet CModule::OnModuleLoading(const CString& sModName,
                                           const CString& sArgs,
                                           CModInfo::EModuleType eType,
                                           bool& bSuccess, CString& sRetMsg) {
+    UnusedHook();
     return CONTINUE;
 }
 CModule::EModRet CModule::OnModuleUnloading(CModule* pModule, bool& bSuccess,
                                             CString& sRetMsg) {
+    UnusedHook();
     return CONTINUE;
 }
 CModule::EModRet CModule::OnGetModInfo(CModInfo& ModInfo,
                                        const CString& sModule, bool& bSuccess,
                                        CString& sRetMsg) {
+    UnusedHook();
     return CONTINUE;
 }
 void CModule::OnGetAvailableMods(set<CModInfo>& ssMods,
-                                 CModInfo::EModuleType eType) {}
+                                 CModInfo::EModuleType eType) {
+    UnusedHook();
+}
 void CModule::AddServerDependentCapability(const CString& sName,
                                            std::unique_ptr<CCapability> pCap) {
     pCap->SetModule(this);
@@ -1252,7 +1591,10 @@ void CModule::AddServerDependentCapability(const CString& sName,
 }
 
 CModules::CModules()
-    : m_pUser(nullptr), m_pNetwork(nullptr), m_pClient(nullptr) {}
+    : m_pUser(nullptr),
+      m_pNetwork(nullptr),
+      m_pClient(nullptr),
+      m_vHookLists() {}
 
 CModules::~CModules() { UnloadAll(); }
 
@@ -1264,6 +1606,51 @@ void CModules::UnloadAll() {
     }
 }
 
+void CModules::ClearHookLists() {
+    for (SHookList& List : m_vHookLists) {
+        List.bValid = false;
+    }
+}
+
+size_t CModules::NewHook() {
+    // Hooks may be called for the first time by several event threads at once
+    static std::atomic<size_t> uHooks(0);
+    return uHooks++;
+}
+
+vector<CModule*>& CModules::BuildHookList(size_t uHook) {
+    if (uHook >= m_vHookLists.size()) {
+        m_vHookLists.resize(uHook + 1);
+    }
+
+    SHookList& List = m_vHookLists[uHook];
+    List.vpModules.clear();
+    for (CModule* pMod : *this) {
+        const vector<bool>& vbUnused = pMod->m_vbUnusedHooks;
+        if (uHook >= vbUnused.size() || !vbUnused[uHook]) {
+            List.vpModules.push_back(pMod);
+        }
+    }
+    List.bValid = true;
+    List.uModules = size();
+
+    return List.vpModules;
+}
+
+void CModules::UnusedHook(size_t uHook, CModule* pModule) {
+    if (!pModule->GetSkipUnusedHooks()) return;
+
+    vector<bool>& vbUnused = pModule->m_vbUnusedHooks;
+    if (uHook >= vbUnused.size()) {
+        vbUnused.resize(uHook + 1);
+    }
+    vbUnused[uHook] = true;
+
+    vector<CModule*>& vpModules = GetHookList(uHook);
+    vpModules.erase(std::remove(vpModules.begin(), vpModules.end(), pModule),
+                    vpModules.end());
+}
+
 bool CModules::OnBoot() {
     for (CModule* pMod : *this) {
         try {
@@ -1905,6 +2292,16 @@ bool CModules::LoadModule(const CString& sModule, const CString& sArgs,
         return false;
     }
 
+    // Global modules would be called from all event threads at once
+    if (CZNC::Get().IsSharded() &&
+        (eType == CModInfo::GlobalModule || !Info.IsThreadAware())) {
+        dlclose(p);
+        sRetMsg = t_f(
+            "Module {1} can't be loaded while ZNC runs several event "
+            "threads.")(sModule);
+        return false;
+    }
+
     CModule* pModule =
         Info.GetLoader()(p, pUser, pNetwork, sModule, sDataPath, eType);
     pModule->SetDescription(Info.GetDescription());
@@ -1971,6 +2368,7 @@ bool CModules::UnloadModule(const CString& sModule, CString& sRetMsg) {
                 break;
             }
         }
+        ClearHookLists();
 
         dlclose(p);
         sRetMsg = t_f("Module {1} unloaded.")(sMod);
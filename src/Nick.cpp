@@ -20,21 +20,15 @@
 #include <znc/IRCNetwork.h>
 
 using std::vector;
-using std::map;
 
-CNick::CNick()
-    : m_sChanPerms(""),
-      m_pNetwork(nullptr),
-      m_sNick(""),
-      m_sIdent(""),
-      m_sHost("") {}
+CNick::CNick() : m_Perms(), m_pNetwork(nullptr), m_bShared(false) {}
 
 CNick::CNick(const CString& sNick) : CNick() { Parse(sNick); }
 
 CNick::~CNick() {}
 
 void CNick::Reset() {
-    m_sChanPerms.clear();
+    m_Perms.reset();
     m_pNetwork = nullptr;
 }
 
@@ -52,12 +46,13 @@ void CNick::Parse(const CString& sNickMask) {
 
     m_sNick =
         sNickMask.substr((sNickMask[0] == ':'), uPos - (sNickMask[0] == ':'));
-    m_sHost = sNickMask.substr(uPos + 1);
+    CString sHost = sNickMask.substr(uPos + 1);
 
-    if ((uPos = m_sHost.find('@')) != CString::npos) {
-        m_sIdent = m_sHost.substr(0, uPos);
-        m_sHost = m_sHost.substr(uPos + 1);
+    if ((uPos = sHost.find('@')) != CString::npos) {
+        SetIdent(sHost.substr(0, uPos));
+        sHost = sHost.substr(uPos + 1);
     }
+    SetHost(sHost);
 }
 
 size_t CNick::GetCommonChans(vector<CChan*>& vRetChans,
@@ -67,13 +62,8 @@ size_t CNick::GetCommonChans(vector<CChan*>& vRetChans,
     const vector<CChan*>& vChans = pNetwork->GetChans();
 
     for (CChan* pChan : vChans) {
-        const map<CString, CNick>& msNicks = pChan->GetNicks();
-
-        for (const auto& it : msNicks) {
-            if (it.first.Equals(m_sNick)) {
-                vRetChans.push_back(pChan);
-                continue;
-            }
+        if (pChan->FindNick(m_sNick)) {
+            vRetChans.push_back(pChan);
         }
     }
 
@@ -88,30 +78,43 @@ bool CNick::NickEquals(const CString& nickname) const {
 
 void CNick::SetNetwork(CIRCNetwork* pNetwork) { m_pNetwork = pNetwork; }
 void CNick::SetNick(const CString& s) { m_sNick = s; }
-void CNick::SetIdent(const CString& s) { m_sIdent = s; }
-void CNick::SetHost(const CString& s) { m_sHost = s; }
+void CNick::SetIdent(const CString& s) {
+    if (m_bShared) {
+        m_sSharedIdent = s;
+    } else {
+        m_sIdent = s;
+    }
+}
+void CNick::SetHost(const CString& s) {
+    if (m_bShared) {
+        m_sSharedHost = s;
+    } else {
+        m_sHost = s;
+    }
+}
 
 bool CNick::HasPerm(char cPerm) const {
-    return (cPerm && m_sChanPerms.find(cPerm) != CString::npos);
+    unsigned char uPerm = cPerm;
+    return (uPerm && uPerm < m_Perms.size() && m_Perms.test(uPerm));
 }
 
 bool CNick::AddPerm(char cPerm) {
-    if (!cPerm || HasPerm(cPerm)) {
+    unsigned char uPerm = cPerm;
+    if (!uPerm || uPerm >= m_Perms.size() || m_Perms.test(uPerm)) {
         return false;
     }
 
-    m_sChanPerms.append(1, cPerm);
+    m_Perms.set(uPerm);
 
     return true;
 }
 
 bool CNick::RemPerm(char cPerm) {
-    CString::size_type uPos = m_sChanPerms.find(cPerm);
-    if (uPos == CString::npos) {
+    if (!HasPerm(cPerm)) {
         return false;
     }
 
-    m_sChanPerms.erase(uPos, 1);
+    m_Perms.reset((unsigned char)cPerm);
 
     return true;
 }
@@ -146,14 +149,20 @@ CString CNick::GetPermStr() const {
     return sRet;
 }
 const CString& CNick::GetNick() const { return m_sNick; }
-const CString& CNick::GetIdent() const { return m_sIdent; }
-const CString& CNick::GetHost() const { return m_sHost; }
+const CString& CNick::GetIdent() const {
+    return m_bShared ? m_sSharedIdent.Get() : m_sIdent;
+}
+const CString& CNick::GetHost() const {
+    return m_bShared ? m_sSharedHost.Get() : m_sHost;
+}
 CString CNick::GetNickMask() const {
     CString sRet = m_sNick;
+    const CString& sIdent = GetIdent();
+    const CString& sHost = GetHost();
 
-    if (!m_sHost.empty()) {
-        if (!m_sIdent.empty()) sRet += "!" + m_sIdent;
-        sRet += "@" + m_sHost;
+    if (!sHost.empty()) {
+        if (!sIdent.empty()) sRet += "!" + sIdent;
+        sRet += "@" + sHost;
     }
 
     return sRet;
@@ -161,13 +170,15 @@ CString CNick::GetNickMask() const {
 
 CString CNick::GetHostMask() const {
     CString sRet = m_sNick;
+    const CString& sIdent = GetIdent();
+    const CString& sHost = GetHost();
 
-    if (!m_sIdent.empty()) {
-        sRet += "!" + m_sIdent;
+    if (!sIdent.empty()) {
+        sRet += "!" + sIdent;
     }
 
-    if (!m_sHost.empty()) {
-        sRet += "@" + m_sHost;
+    if (!sHost.empty()) {
+        sRet += "@" + sHost;
     }
 
     return (sRet);
@@ -178,6 +189,16 @@ void CNick::Clone(const CNick& SourceNick) {
     SetIdent(SourceNick.GetIdent());
     SetHost(SourceNick.GetHost());
 
-    m_sChanPerms = SourceNick.m_sChanPerms;
+    m_Perms = SourceNick.m_Perms;
     m_pNetwork = SourceNick.m_pNetwork;
 }
+
+void CNick::Share() {
+    if (m_bShared) return;
+
+    m_sSharedIdent = m_sIdent;
+    m_sSharedHost = m_sHost;
+    CString().swap(m_sIdent);
+    CString().swap(m_sHost);
+    m_bShared = true;
+}
@@ -0,0 +1,215 @@
+/*
+ * Copyright (C) 2004-2026 ZNC, see the NOTICE file for details.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <znc/Profiler.h>
+#include <znc/Client.h>
+#include <znc/IRCNetwork.h>
+#include <znc/IRCSock.h>
+#include <znc/User.h>
+#include <znc/znc.h>
+#include <algorithm>
+#include <chrono>
+
+using std::map;
+using std::vector;
+
+bool CProfiler::s_bEnabled = false;
+unsigned long long CProfiler::s_uStartTime = 0;
+CProfileStats CProfiler::s_aTimers[CProfiler::TIMER_COUNT];
+map<CString, map<const char*, CProfileStats>> CProfiler::s_mHooks;
+
+void CProfileStats::Add(unsigned long long uMicroseconds) {
+    unsigned int uBucket = 0;
+    while (uBucket < BUCKETS - 1 && (1ULL << uBucket) <= uMicroseconds) {
+        uBucket++;
+    }
+    m_auBuckets[uBucket]++;
+    m_uCount++;
+    m_uTotal += uMicroseconds;
+    m_uMax = std::max(m_uMax, uMicroseconds);
+}
+
+unsigned long long CProfileStats::GetPercentile(unsigned int uPercent) const {
+    if (m_uCount == 0) return 0;
+    // The rank of the wanted sample, rounded up
+    unsigned long long uRank = (m_uCount * uPercent + 99) / 100;
+    unsigned long long uSeen = 0;
+    for (unsigned int uBucket = 0; uBucket < BUCKETS - 1; ++uBucket) {
+        uSeen += m_auBuckets[uBucket];
+        if (uSeen >= uRank) {
+            return std::min(1ULL << uBucket, m_uMax);
+        }
+    }
+    return m_uMax;
+}
+
+void CProfiler::SetEnabled(bool b) {
+    if (b && !s_bEnabled) {
+        Reset();
+    }
+    s_bEnabled = b;
+}
+
+void CProfiler::Reset() {
+    for (CProfileStats& Stats : s_aTimers) {
+        Stats = CProfileStats();
+    }
+    s_mHooks.clear();
+    s_uStartTime = Now();
+}
+
+unsigned long long CProfiler::Now() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+unsigned long long CProfiler::GetRunningTime() {
+    return (Now() - s_uStartTime) / 1000000;
+}
+
+void CProfiler::AddHookTime(const CString& sModule, const char* szHook,
+                            unsigned long long uMicroseconds) {
+    s_mHooks[sModule][szHook].Add(uMicroseconds);
+}
+
+CString CProfiler::GetTimerName(ETimer eTimer) {
+    switch (eTimer) {
+        case LoopIteration:
+            return "LoopIteration";
+        case IRCReadLine:
+            return "IRCReadLine";
+        case ClientReadLine:
+            return "ClientReadLine";
+        case TIMER_COUNT:
+            break;
+    }
+    return "";
+}
+
+vector<CProfiler::SHookStats> CProfiler::GetHookStats() {
+    vector<SHookStats> vHooks;
+    for (const auto& itModule : s_mHooks) {
+        for (const auto& itHook : itModule.second) {
+            vHooks.push_back({itModule.first, itHook.first, itHook.second});
+        }
+    }
+    std::stable_sort(vHooks.begin(), vHooks.end(),
+                     [](const SHookStats& a, const SHookStats& b) {
+                         return a.Stats.GetTotal() > b.Stats.GetTotal();
+                     });
+    return vHooks;
+}
+
+vector<CProfiler::SQueueDepth> CProfiler::GetQueueDepths() {
+    SQueueDepth ConnectQueue{"ConnectQueue", 0, 0};
+    SQueueDepth IRCSendQueue{"IRCSendQueue", 0, 0};
+    SQueueDepth IRCWriteBuffer{"IRCWriteBuffer", 0, 0};
+    SQueueDepth ClientWriteBuffer{"ClientWriteBuffer", 0, 0};
+    SQueueDepth ClientPlayback{"ClientPlayback", 0, 0};
+
+    auto Count = [](SQueueDepth& Queue, unsigned long long uDepth) {
+        Queue.uTotal += uDepth;
+        Queue.uMax = std::max(Queue.uMax, uDepth);
+    };
+
+    Count(ConnectQueue, CZNC::Get().GetConnectionQueue().size());
+
+    for (const auto& it : CZNC::Get().GetUserMap()) {
+        for (CIRCNetwork* pNetwork : it.second->GetNetworks()) {
+            CIRCSock* pIRCSock = pNetwork->GetIRCSock();
+            if (pIRCSock) {
+                Count(IRCSendQueue, pIRCSock->GetSendQueueSize());
+                Count(IRCWriteBuffer,
+                      pIRCSock->GetInternalWriteBuffer().size());
+            }
+        }
+        for (CClient* pClient : it.second->GetAllClients()) {
+            Count(ClientWriteBuffer, pClient->GetPendingWriteSize());
+            Count(ClientPlayback, pClient->GetPlaybackQueueSize());
+        }
+    }
+
+    return {ConnectQueue, IRCSendQueue, IRCWriteBuffer, ClientWriteBuffer,
+            ClientPlayback};
+}
+
+static CString JSONString(const CString& s) {
+    CString sRet = "\"";
+    for (unsigned char c : s) {
+        if (c == '"' || c == '\\') {
+            sRet += '\\';
+            sRet += c;
+        } else if (c < 0x20) {
+            char szBuf[8];
+            snprintf(szBuf, sizeof(szBuf), "\\u%04x", c);
+            sRet += szBuf;
+        } else {
+            sRet += c;
+        }
+    }
+    return sRet + "\"";
+}
+
+static CString JSONStats(const CProfileStats& Stats) {
+    CString sBuckets;
+    for (unsigned int i = 0; i < CProfileStats::BUCKETS; ++i) {
+        if (i) sBuckets += ",";
+        sBuckets += CString(Stats.GetBucket(i));
+    }
+    return "{\"count\":" + CString(Stats.GetCount()) +
+           ",\"total_us\":" + CString(Stats.GetTotal()) +
+           ",\"avg_us\":" + CString(Stats.GetAverage()) +
+           ",\"max_us\":" + CString(Stats.GetMax()) +
+           ",\"p50_us\":" + CString(Stats.GetPercentile(50)) +
+           ",\"p90_us\":" + CString(Stats.GetPercentile(90)) +
+           ",\"p99_us\":" + CString(Stats.GetPercentile(99)) +
+           ",\"buckets\":[" + sBuckets + "]}";
+}
+
+CString CProfiler::ToJSON() {
+    CString sRet = "{\"enabled\":" + CString(IsEnabled() ? "true" : "false");
+    sRet += ",\"seconds\":" + CString(IsEnabled() ? GetRunningTime() : 0);
+
+    sRet += ",\"timers\":{";
+    for (int i = 0; i < TIMER_COUNT; ++i) {
+        if (i) sRet += ",";
+        sRet += JSONString(GetTimerName(ETimer(i))) + ":" +
+                JSONStats(GetTimer(ETimer(i)));
+    }
+
+    sRet += "},\"hooks\":[";
+    bool bFirst = true;
+    for (const SHookStats& Hook : GetHookStats()) {
+        if (!bFirst) sRet += ",";
+        bFirst = false;
+        sRet += "{\"module\":" + JSONString(Hook.sModule) +
+                ",\"hook\":" + JSONString(Hook.sHook) +
+                ",\"stats\":" + JSONStats(Hook.Stats) + "}";
+    }
+
+    sRet += "],\"queues\":{";
+    bFirst = true;
+    for (const SQueueDepth& Queue : GetQueueDepths()) {
+        if (!bFirst) sRet += ",";
+        bFirst = false;
+        sRet += JSONString(Queue.sName) + ":{\"total\":" +
+                CString(Queue.uTotal) + ",\"max\":" + CString(Queue.uMax) +
+                "}";
+    }
+
+    return sRet + "}}";
+}
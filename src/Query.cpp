@@ -23,6 +23,7 @@ using std::vector;
 
 CQuery::CQuery(const CString& sName, CIRCNetwork* pNetwork)
     : m_sName(sName), m_pNetwork(pNetwork), m_Buffer() {
+    m_Buffer.SetUsage(&m_pNetwork->GetQueryBufferUsage());
     SetBufferCount(m_pNetwork->GetUser()->GetQueryBufferSize(), true);
 }
 
@@ -32,7 +33,9 @@ void CQuery::SendBuffer(CClient* pClient) { SendBuffer(pClient, m_Buffer); }
 
 void CQuery::SendBuffer(CClient* pClient, const CBuffer& Buffer) {
     if (m_pNetwork && m_pNetwork->IsUserAttached()) {
-        // Based on CChan::SendBuffer()
+        // Based on CChan::SendBuffer(). Queries are small and can be deleted
+        // right after this, so they are played back all at once. The output
+        // still waits behind any channel playback in progress.
         if (!Buffer.IsEmpty()) {
             const vector<CClient*>& vClients = m_pNetwork->GetClients();
             for (CClient* pEachClient : vClients) {
@@ -57,10 +60,12 @@ void CQuery::SendBuffer(CClient* pClient, const CBuffer& Buffer) {
                                         pUseClient);
                 }
 
+                const CString sProfile =
+                    CBuffer::GetRenderProfile(*pUseClient, msParams);
                 size_t uSize = Buffer.Size();
                 for (size_t uIdx = 0; uIdx < uSize; uIdx++) {
-                    const CBufLine& BufLine = Buffer.GetBufLine(uIdx);
-                    CMessage Message = BufLine.ToMessage(*pUseClient, msParams);
+                    CMessage Message = Buffer.ToMessage(uIdx, *pUseClient,
+                                                        msParams, sProfile);
                     if (!pUseClient->HasEchoMessage() &&
                         !pUseClient->HasSelfMessage()) {
                         if (Message.GetNick().NickEquals(
@@ -94,6 +99,9 @@ void CQuery::SendBuffer(CClient* pClient, const CBuffer& Buffer) {
 
                 if (pClient) break;
             }
+
+            // The rendered lines were only needed for the clients above
+            Buffer.ClearRenderCache();
         }
     }
 }
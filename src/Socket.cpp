@@ -14,19 +14,35 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include <random>
 
 #include <znc/Socket.h>
+#include <znc/FileUtils.h>
 #include <znc/User.h>
 #include <znc/IRCNetwork.h>
 #include <znc/SSLVerifyHost.h>
+#include <znc/Profiler.h>
 #include <znc/znc.h>
 #include <signal.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#endif
 
 #ifdef HAVE_ICU
 #include <unicode/ucnv_cb.h>
 #endif
 
+#ifdef HAVE_LIBSSL
+#include <openssl/pem.h>
+#endif
+
 #ifdef HAVE_LIBSSL
 // Copypasted from
 // https://wiki.mozilla.org/Security/Server_Side_TLS#Intermediate_compatibility_.28default.29
@@ -69,6 +85,101 @@ CZNCSock::CZNCSock(const CString& sHost, u_short port, int timeout)
 #endif
 }
 
+CZNCSock::~CZNCSock() {
+    // Don't lose what was written just before the socket got deleted
+    FlushWrite();
+}
+
+thread_local std::vector<CZNCSock*> CZNCSock::s_vPendingWrites;
+
+void CZNCSock::SetCoalesceWrites(bool bCoalesce) {
+    if (!bCoalesce) FlushWrite();
+    m_bCoalesceWrites = bCoalesce;
+}
+
+bool CZNCSock::Write(const char* data, size_t len) {
+    if (!m_bCoalesceWrites) {
+        return Csock::Write(data, len);
+    }
+    if (m_sCoalescedWrite.empty()) {
+        s_vPendingWrites.push_back(this);
+    }
+    m_sCoalescedWrite.append(data, len);
+    return true;
+}
+
+void CZNCSock::FlushWrite() {
+    if (m_sCoalescedWrite.empty()) return;
+    s_vPendingWrites.erase(std::remove(s_vPendingWrites.begin(),
+                                       s_vPendingWrites.end(), this),
+                           s_vPendingWrites.end());
+    CString sData;
+    sData.swap(m_sCoalescedWrite);
+    Csock::Write(sData.data(), sData.length());
+}
+
+void CZNCSock::FlushWrites() {
+    std::vector<CZNCSock*> vSocks;
+    vSocks.swap(s_vPendingWrites);
+    for (CZNCSock* pSock : vSocks) {
+        CString sData;
+        sData.swap(pSock->m_sCoalescedWrite);
+        pSock->Csock::Write(sData.data(), sData.length());
+    }
+}
+
+void CZNCSock::SetCork(bool bCork) {
+#ifdef TCP_CORK
+    if (bCork == m_bCorked) return;
+    int iCork = bCork;
+    // Fails for unix sockets, they don't need it anyway
+    setsockopt(GetWSock(), IPPROTO_TCP, TCP_CORK, &iCork, sizeof(iCork));
+    m_bCorked = bCork;
+#endif
+}
+
+size_t CZNCSock::SendFile(CFile& File, size_t uSize) {
+    // Whatever was written before must go out first
+    if (!IsConnected() || !m_sCoalescedWrite.empty() ||
+        !GetInternalWriteBuffer().empty()) {
+        return 0;
+    }
+#ifdef HAVE_LIBSSL
+    if (GetSSL() && !IsKernelTLS()) return 0;
+#endif
+
+    size_t uSent = 0;
+#ifdef __linux__
+    off_t iOffset = lseek(File.GetFD(), 0, SEEK_CUR);
+    if (iOffset < 0) return 0;
+    const off_t iStart = iOffset;
+
+    while (uSent < uSize) {
+        ssize_t iRet;
+#if defined(HAVE_LIBSSL) && defined(SSL_OP_ENABLE_KTLS)
+        if (GetSSL()) {
+            iRet = SSL_sendfile(GetSSLObject(), File.GetFD(), iOffset,
+                                uSize - uSent, 0);
+            if (iRet > 0) iOffset += iRet;
+        } else
+#endif
+        {
+            iRet = sendfile(GetWSock(), File.GetFD(), &iOffset, uSize - uSent);
+        }
+        // The socket buffer is full, the rest goes the normal way
+        if (iRet <= 0) break;
+        uSent += iRet;
+    }
+#ifdef HAVE_LIBSSL
+    ERR_clear_error();
+#endif
+
+    File.Seek(iStart + uSent);
+    m_uFileBytesWritten += uSent;
+#endif
+    return uSent;
+}
+
 unsigned int CSockManager::GetAnonConnectionCount(const CString& sIP) const {
     unsigned int ret = 0;
 
@@ -106,6 +217,16 @@ void CZNCSock::SSLHandShakeFinished() {
     X509* pCert = GetX509();
     if (!CheckSSLCert(pCert)) {
         Close();
+    } else if (GetType() == ETConn::OUTBOUND) {
+        m_bSSLSessionTrusted = true;
+        // With TLS 1.3 the session only arrives later, see
+        // ZNC_NewSessionCB()
+        SSL_SESSION* pSession = SSL_get1_session(GetSSLObject());
+        if (pSession && SSL_SESSION_is_resumable(pSession)) {
+            CSSLContextCache::AddSession(GetSSLSessionKey(), pSession);
+        } else {
+            SSL_SESSION_free(pSession);
+        }
     }
     X509_free(pCert);
 }
@@ -177,6 +298,297 @@ CString CZNCSock::GetSSLPeerFingerprint(X509* pCert) const {
     return CString(reinterpret_cast<const char*>(buf), sizeof buf)
         .Escape_n(CString::EASCII, CString::EHEXCOLON);
 }
+
+bool CZNCSock::IsKernelTLS() const {
+#ifdef SSL_OP_ENABLE_KTLS
+    SSL* pSSL = GetSSLObject();
+    return pSSL && BIO_get_ktls_send(SSL_get_wbio(pSSL));
+#else
+    return false;
+#endif
+}
+
+CString CZNCSock::GetSSLSessionKey() const {
+    if (m_sSSLSessionOwner.empty()) return "";
+    // A session skips the certificate checks, so it must not be used once
+    // something about them changed
+    CString sKey = m_sSSLSessionOwner + "\n" + GetHostName() + ":" +
+                   CString(GetPort()) + "\n" + m_sHostToVerifySSL + "\n" +
+                   CString(m_bTrustAllCerts) + CString(m_bTrustPKI) + "\n" +
+                   GetPemLocation() + "\n";
+    for (const CString& sFP : m_ssTrustedFingerprints) {
+        sKey += sFP + " ";
+    }
+    return sKey;
+}
+
+static CZNCSock* GetSockFromSSL(SSL* pSSL) {
+    Csock* pSock = static_cast<Csock*>(SSL_get_ex_data(pSSL, GetCsockSSLIdx()));
+    return dynamic_cast<CZNCSock*>(pSock);
+}
+
+// The same as Csocket's callback, which isn't accessible from here
+static int ZNC_CertVerifyCB(int iPreVerify, X509_STORE_CTX* pStoreCTX) {
+    SSL* pSSL = static_cast<SSL*>(X509_STORE_CTX_get_ex_data(
+        pStoreCTX, SSL_get_ex_data_X509_STORE_CTX_idx()));
+    CZNCSock* pSock = pSSL ? GetSockFromSSL(pSSL) : nullptr;
+    if (!pSock) return iPreVerify;
+    return pSock->VerifyPeerCertificate(iPreVerify, pStoreCTX);
+}
+
+static int ZNC_NewSessionCB(SSL* pSSL, SSL_SESSION* pSession) {
+    CZNCSock* pSock = GetSockFromSSL(pSSL);
+    if (!pSock) return 0;
+    CString sKey = pSock->GetSSLSessionKey();
+    // Sessions from before the certificate was checked are useless anyway
+    if (sKey.empty() || !pSock->GetSSLSessionTrusted()) return 0;
+    CSSLContextCache::AddSession(sKey, pSession);
+    return 1;
+}
+
+bool CZNCSock::SSLServerSetup() {
+    SSL_CTX* pCTX = nullptr;
+    // Password protected keys need Csocket's callback
+    if (GetPemPass().empty()) {
+        pCTX = CSSLContextCache::GetServerContext(
+            GetPemLocation(), GetKeyLocation(), GetDHParamLocation(),
+            GetCipher());
+    }
+    if (!pCTX) return Csock::SSLServerSetup();
+
+    SetSSL(true);
+    SetSSLObject(nullptr, true);
+    SetCTXObject(pCTX, true);
+    SSL* pSSL = SSL_new(pCTX);
+    if (!pSSL) return false;
+    SetSSLObject(pSSL, true);
+    SSL_set_rfd(pSSL, GetRSock());
+    SSL_set_wfd(pSSL, GetWSock());
+    SSL_set_ex_data(pSSL, GetCsockSSLIdx(), static_cast<Csock*>(this));
+    if (GetRequireClientCertFlags()) {
+        SSL_set_verify(pSSL, GetRequireClientCertFlags(), ZNC_CertVerifyCB);
+    }
+    SSLFinishSetup(pSSL);
+    return true;
+}
+
+bool CZNCSock::SSLClientSetup() {
+    SSL_CTX* pCTX = nullptr;
+    if (GetPemPass().empty()) {
+        pCTX = CSSLContextCache::GetClientContext(
+            GetPemLocation(), GetKeyLocation(), GetCipher());
+    }
+    if (!pCTX) return Csock::SSLClientSetup();
+
+    SetSSL(true);
+    SetSSLObject(nullptr, true);
+    SetCTXObject(pCTX, true);
+    SSL* pSSL = SSL_new(pCTX);
+    if (!pSSL) return false;
+    SetSSLObject(pSSL, true);
+    SSL_set_rfd(pSSL, GetRSock());
+    SSL_set_wfd(pSSL, GetWSock());
+    SSL_set_verify(pSSL, SSL_VERIFY_PEER, ZNC_CertVerifyCB);
+    SSL_set_ex_data(pSSL, GetCsockSSLIdx(), static_cast<Csock*>(this));
+
+    CString sSNIHostname;
+    if (SNIConfigureClient(sSNIHostname)) {
+        SSL_set_tlsext_host_name(pSSL, sSNIHostname.c_str());
+    }
+
+    m_bSSLSessionTrusted = false;
+    SSL_SESSION* pSession = CSSLContextCache::GetSession(GetSSLSessionKey());
+    if (pSession) {
+        SSL_set_session(pSSL, pSession);
+        SSL_SESSION_free(pSession);
+    }
+
+    SSLFinishSetup(pSSL);
+    return true;
+}
+
+std::map<CString, CSSLContextCache::SContext> CSSLContextCache::s_mContexts;
+std::map<CString, SSL_SESSION*> CSSLContextCache::s_mSessions;
+std::mutex CSSLContextCache::s_mutex;
+
+SSL_CTX* CSSLContextCache::NewContext(bool bServer, const CString& sCipher) {
+    SSL_CTX* pCTX =
+        SSL_CTX_new(bServer ? TLS_server_method() : TLS_client_method());
+    if (!pCTX) return nullptr;
+
+    // The same as CZNCSock sets up for Csocket
+    long lOptions = SSL_OP_NO_COMPRESSION | SSL_OP_CIPHER_SERVER_PREFERENCE;
+    unsigned int uDisabled = CZNC::Get().GetDisabledSSLProtocols();
+    if (uDisabled & Csock::EDP_SSLv3) lOptions |= SSL_OP_NO_SSLv3;
+    if (uDisabled & Csock::EDP_TLSv1) lOptions |= SSL_OP_NO_TLSv1;
+    if (uDisabled & Csock::EDP_TLSv1_1) lOptions |= SSL_OP_NO_TLSv1_1;
+    if (uDisabled & Csock::EDP_TLSv1_2) lOptions |= SSL_OP_NO_TLSv1_2;
+#ifdef SSL_OP_ENABLE_KTLS
+    // OpenSSL falls back to encrypting by itself if the kernel or the
+    // negotiated cipher doesn't support it
+    if (CZNC::Get().GetKernelTLS()) lOptions |= SSL_OP_ENABLE_KTLS;
+#endif
+    SSL_CTX_set_options(pCTX, lOptions);
+    SSL_CTX_set_mode(pCTX, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+    if (!sCipher.empty() &&
+        SSL_CTX_set_cipher_list(pCTX, sCipher.c_str()) != 1) {
+        SSL_CTX_free(pCTX);
+        return nullptr;
+    }
+    return pCTX;
+}
+
+SSL_CTX* CSSLContextCache::FindContext(const CString& sKey) {
+    auto it = s_mContexts.find(sKey);
+    if (it == s_mContexts.end()) return nullptr;
+    for (const auto& File : it->second.vFiles) {
+        if (CFile::GetMTime(File.first) != File.second) {
+            DEBUG("SSL: " << File.first << " changed, reloading");
+            SSL_CTX_free(it->second.pCTX);
+            s_mContexts.erase(it);
+            return nullptr;
+        }
+    }
+    SSL_CTX_up_ref(it->second.pCTX);
+    return it->second.pCTX;
+}
+
+SSL_CTX* CSSLContextCache::GetServerContext(const CString& sPemFile,
+                                            const CString& sKeyFile,
+                                            const CString& sDHParamFile,
+                                            const CString& sCipher) {
+    if (sPemFile.empty()) return nullptr;
+    const CString sKey = "server\n" + sPemFile + "\n" + sKeyFile + "\n" +
+                         sDHParamFile + "\n" + sCipher;
+    std::lock_guard<std::mutex> guard(s_mutex);
+    SSL_CTX* pCTX = FindContext(sKey);
+    if (pCTX) return pCTX;
+
+    pCTX = NewContext(true, sCipher);
+    if (!pCTX) return nullptr;
+    const CString& sPrivKey = sKeyFile.empty() ? sPemFile : sKeyFile;
+    if (SSL_CTX_use_certificate_chain_file(pCTX, sPemFile.c_str()) != 1 ||
+        SSL_CTX_use_PrivateKey_file(pCTX, sPrivKey.c_str(),
+                                    SSL_FILETYPE_PEM) != 1 ||
+        SSL_CTX_check_private_key(pCTX) != 1) {
+        DEBUG("SSL: Can't load " << sPemFile << ", leaving it to Csocket");
+        ERR_clear_error();
+        SSL_CTX_free(pCTX);
+        return nullptr;
+    }
+
+    // Like Csocket, look for DH parameters in the pem file by default
+    const CString& sDHFile = sDHParamFile.empty() ? sPemFile : sDHParamFile;
+    BIO* pBIO = BIO_new_file(sDHFile.c_str(), "r");
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    EVP_PKEY* pDH = pBIO ? PEM_read_bio_Parameters(pBIO, nullptr) : nullptr;
+    if (!pDH || SSL_CTX_set0_tmp_dh_pkey(pCTX, pDH) != 1) {
+        EVP_PKEY_free(pDH);
+        SSL_CTX_set_dh_auto(pCTX, 1);
+    }
+#else
+    DH* pDH =
+        pBIO ? PEM_read_bio_DHparams(pBIO, nullptr, nullptr, nullptr) : nullptr;
+    if (pDH) {
+        SSL_CTX_set_tmp_dh(pCTX, pDH);
+        DH_free(pDH);
+    }
+#endif
+    BIO_free(pBIO);
+    ERR_clear_error();
+
+    // Clients which reconnect, e.g. phones waking up, can resume with a
+    // ticket or from the session cache instead of a full handshake
+    SSL_CTX_set_session_id_context(
+        pCTX, reinterpret_cast<const unsigned char*>("ZNC"), 3);
+    SSL_CTX_set_session_cache_mode(pCTX, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_set_timeout(pCTX, 24 * 60 * 60);
+
+    SContext& Context = s_mContexts[sKey];
+    Context.pCTX = pCTX;
+    for (const CString& sFile : {sPemFile, sKeyFile, sDHParamFile}) {
+        if (!sFile.empty()) {
+            Context.vFiles.emplace_back(sFile, CFile::GetMTime(sFile));
+        }
+    }
+    SSL_CTX_up_ref(pCTX);
+    return pCTX;
+}
+
+SSL_CTX* CSSLContextCache::GetClientContext(const CString& sPemFile,
+                                            const CString& sKeyFile,
+                                            const CString& sCipher) {
+    const CString sKey =
+        "client\n" + sPemFile + "\n" + sKeyFile + "\n" + sCipher;
+    std::lock_guard<std::mutex> guard(s_mutex);
+    SSL_CTX* pCTX = FindContext(sKey);
+    if (pCTX) return pCTX;
+
+    pCTX = NewContext(false, sCipher);
+    if (!pCTX) return nullptr;
+    // Reading the system's CA store is the expensive part
+    SSL_CTX_set_default_verify_paths(pCTX);
+    if (!sPemFile.empty()) {
+        const CString& sPrivKey = sKeyFile.empty() ? sPemFile : sKeyFile;
+        if (SSL_CTX_use_certificate_chain_file(pCTX, sPemFile.c_str()) !=
+                1 ||
+            SSL_CTX_use_PrivateKey_file(pCTX, sPrivKey.c_str(),
+                                        SSL_FILETYPE_PEM) != 1) {
+            DEBUG("SSL: Can't load " << sPemFile
+                                     << ", leaving it to Csocket");
+            ERR_clear_error();
+            SSL_CTX_free(pCTX);
+            return nullptr;
+        }
+    }
+    // Sessions are only kept outside of OpenSSL, see AddSession()
+    SSL_CTX_set_session_cache_mode(
+        pCTX, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(pCTX, ZNC_NewSessionCB);
+
+    SContext& Context = s_mContexts[sKey];
+    Context.pCTX = pCTX;
+    for (const CString& sFile : {sPemFile, sKeyFile}) {
+        if (!sFile.empty()) {
+            Context.vFiles.emplace_back(sFile, CFile::GetMTime(sFile));
+        }
+    }
+    SSL_CTX_up_ref(pCTX);
+    return pCTX;
+}
+
+SSL_SESSION* CSSLContextCache::GetSession(const CString& sKey) {
+    if (sKey.empty()) return nullptr;
+    std::lock_guard<std::mutex> guard(s_mutex);
+    auto it = s_mSessions.find(sKey);
+    if (it == s_mSessions.end()) return nullptr;
+    SSL_SESSION_up_ref(it->second);
+    return it->second;
+}
+
+void CSSLContextCache::AddSession(const CString& sKey,
+                                  SSL_SESSION* pSession) {
+    if (sKey.empty()) {
+        SSL_SESSION_free(pSession);
+        return;
+    }
+    std::lock_guard<std::mutex> guard(s_mutex);
+    SSL_SESSION*& pCached = s_mSessions[sKey];
+    SSL_SESSION_free(pCached);
+    pCached = pSession;
+}
+
+void CSSLContextCache::Clear() {
+    std::lock_guard<std::mutex> guard(s_mutex);
+    for (auto& it : s_mContexts) {
+        SSL_CTX_free(it.second.pCTX);
+    }
+    s_mContexts.clear();
+    for (auto& it : s_mSessions) {
+        SSL_SESSION_free(it.second);
+    }
+    s_mSessions.clear();
+}
 #endif
 
 void CZNCSock::SetEncoding(const CString& sEncoding) {
@@ -199,6 +611,22 @@ class CSockManager::CThreadMonitorFD : public CSMonitorFD {
 };
 #endif
 
+class CSockManager::CPostMonitorFD : public CSMonitorFD {
+  public:
+    CPostMonitorFD(int iFD) : m_iFD(iFD) { Add(iFD, ECT_Read); }
+
+    bool FDsThatTriggered(const std::map<int, short>& miiReadyFds) override {
+        // This only wakes the loop up, its owner runs the tasks afterwards
+        char buf[64];
+        while (read(m_iFD, buf, sizeof(buf)) > 0) {
+        }
+        return true;
+    }
+
+  private:
+    int m_iFD;
+};
+
 #ifdef HAVE_THREADED_DNS
 void CSockManager::CDNSJob::runThread() {
     int iCount = 0;
@@ -232,6 +660,17 @@ void CSockManager::CDNSJob::runMain() {
         // just for case. Maybe to call freeaddrinfo()?
         this->aiResult = nullptr;
     }
+    // The socket may belong to an event thread, see CZNC::IsSharded()
+    if (pManager != &CZNC::Get().GetManager()) {
+        CSockManager* pTarget = pManager;
+        TDNSTask* pTask = task;
+        bool bIsBind = bBind;
+        addrinfo* aiRes = aiResult;
+        pManager->Post([=]() {
+            pTarget->SetTDNSThreadFinished(pTask, bIsBind, aiRes);
+        });
+        return;
+    }
     pManager->SetTDNSThreadFinished(this->task, this->bBind, this->aiResult);
 }
 
@@ -385,13 +824,258 @@ void CSockManager::SetTDNSThreadFinished(TDNSTask* task, bool bBind,
 }
 #endif /* HAVE_THREADED_DNS */
 
-CSockManager::CSockManager() {
+CSockManager::CSockManager(bool bThreadPool)
+    : m_mutexPosted(),
+      m_vfPosted(),
+      m_iPostPipe{-1, -1},
+      m_eEventBackend(EventBackendPoll)
+#ifdef HAVE_EPOLL
+      ,
+      m_iEpollFD(-1),
+      m_miEpollFDs(),
+      m_vEpollEvents()
+#endif
+{
 #ifdef HAVE_PTHREAD
-    MonitorFD(new CThreadMonitorFD());
+    if (bThreadPool) MonitorFD(new CThreadMonitorFD());
+#endif
+    if (pipe(m_iPostPipe)) {
+        DEBUG("Can't open pipe for posting to the loop: " << strerror(errno));
+        exit(1);
+    }
+    fcntl(m_iPostPipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(m_iPostPipe[1], F_SETFL, O_NONBLOCK);
+    MonitorFD(new CPostMonitorFD(m_iPostPipe[0]));
+}
+
+CSockManager::~CSockManager() {
+#ifdef HAVE_EPOLL
+    CloseEpoll();
+#endif
+    close(m_iPostPipe[0]);
+    close(m_iPostPipe[1]);
+}
+
+void CSockManager::Post(std::function<void()> fTask) {
+    bool bWakeUp;
+    {
+        std::lock_guard<std::mutex> guard(m_mutexPosted);
+        // Otherwise the loop is going to run them anyway
+        bWakeUp = m_vfPosted.empty();
+        m_vfPosted.push_back(std::move(fTask));
+    }
+    if (bWakeUp) {
+        char c = 0;
+        // If the pipe is full, the loop is already awake
+        ssize_t r = write(m_iPostPipe[1], &c, 1);
+        (void)r;
+    }
+}
+
+void CSockManager::RunPostedTasks() {
+    std::vector<std::function<void()>> vfTasks;
+    {
+        std::lock_guard<std::mutex> guard(m_mutexPosted);
+        vfTasks.swap(m_vfPosted);
+    }
+    for (const std::function<void()>& fTask : vfTasks) {
+        fTask();
+    }
+}
+
+bool CSockManager::SetEventBackend(EEventBackend eBackend) {
+    switch (eBackend) {
+        case EventBackendPoll:
+#ifdef HAVE_EPOLL
+            CloseEpoll();
 #endif
+            m_eEventBackend = eBackend;
+            return true;
+        case EventBackendEpoll:
+#ifdef HAVE_EPOLL
+            // The epoll fd itself is created on first use, so that it
+            // isn't shared with the parent when znc forks into background
+            m_eEventBackend = eBackend;
+            return true;
+#else
+            return false;
+#endif
+    }
+    return false;
 }
 
-CSockManager::~CSockManager() {}
+bool CSockManager::SetEventBackend(const CString& sBackend) {
+    if (sBackend.Equals("poll")) return SetEventBackend(EventBackendPoll);
+    if (sBackend.Equals("epoll")) return SetEventBackend(EventBackendEpoll);
+    return false;
+}
+
+CString CSockManager::GetEventBackendName() const {
+    switch (m_eEventBackend) {
+        case EventBackendPoll:
+            return "poll";
+        case EventBackendEpoll:
+            return "epoll";
+    }
+    return "";
+}
+
+VCString CSockManager::GetAvailableEventBackends() {
+    VCString vsBackends = {"poll"};
+#ifdef HAVE_EPOLL
+    vsBackends.push_back("epoll");
+#endif
+    return vsBackends;
+}
+
+void CSockManager::DelSock(size_t iPos) {
+#ifdef HAVE_EPOLL
+    if (m_iEpollFD >= 0 && iPos < size()) {
+        // The fd is about to be closed, which removes it from the epoll set.
+        // Forget it here too: its number can be reused by the next socket,
+        // which then must be registered anew.
+        Csock* pSock = (*this)[iPos];
+        m_miEpollFDs.erase(pSock->GetRSock());
+        m_miEpollFDs.erase(pSock->GetWSock());
+    }
+#endif
+    TSocketManager<CZNCSock>::DelSock(iPos);
+}
+
+int CSockManager::Select(std::map<cs_sock_t, short>& miiReadyFds,
+                         struct timeval* tvtimeout) {
+    // Everything since the previous wakeup was spent handling what it
+    // brought, that's how long a new event had to wait at worst
+    if (m_uLastWakeUp && CProfiler::IsEnabled()) {
+        CProfiler::AddTime(CProfiler::LoopIteration,
+                           CProfiler::Now() - m_uLastWakeUp);
+    }
+
+    int iRet;
+#ifdef HAVE_EPOLL
+    if (m_eEventBackend == EventBackendEpoll) {
+        iRet = EpollSelect(miiReadyFds, tvtimeout);
+    } else
+#endif
+    {
+        iRet = TSocketManager<CZNCSock>::Select(miiReadyFds, tvtimeout);
+    }
+
+    m_uLastWakeUp = CProfiler::IsEnabled() ? CProfiler::Now() : 0;
+    return iRet;
+}
+
+#ifdef HAVE_EPOLL
+void CSockManager::CloseEpoll() {
+    if (m_iEpollFD >= 0) {
+        close(m_iEpollFD);
+        m_iEpollFD = -1;
+    }
+    m_miEpollFDs.clear();
+    m_vEpollEvents.clear();
+}
+
+int CSockManager::EpollSelect(std::map<cs_sock_t, short>& miiReadyFds,
+                              struct timeval* tvtimeout) {
+    if (m_iEpollFD < 0) {
+        m_iEpollFD = epoll_create1(EPOLL_CLOEXEC);
+        if (m_iEpollFD < 0) {
+            CUtils::PrintError("Can't create epoll instance: " +
+                               CString(strerror(errno)) +
+                               ", falling back to poll");
+            m_eEventBackend = EventBackendPoll;
+            return TSocketManager<CZNCSock>::Select(miiReadyFds, tvtimeout);
+        }
+    }
+
+    // Csocket builds the map of every fd it's interested in before calling
+    // Select(), AssignFDs() only adds the fds of CSMonitorFD, e.g. the
+    // thread pool's pipe. Fds stay registered between iterations, epoll_ctl()
+    // is only called for the ones which appeared, disappeared or started or
+    // stopped waiting for writes. Both maps are sorted by fd, so finding
+    // those takes a single pass.
+    //
+    // Note that this pass, like the map Csocket rebuilds, is still
+    // O(all sockets) per iteration. Only the kernel side is O(ready sockets);
+    // the user space side would need Csocket to keep its fd map around.
+    AssignFDs(miiReadyFds, tvtimeout);
+
+    auto itReg = m_miEpollFDs.begin();
+    for (const auto& it : miiReadyFds) {
+        while (itReg != m_miEpollFDs.end() && itReg->first < it.first) {
+            // Fails harmlessly if the fd was already closed
+            epoll_ctl(m_iEpollFD, EPOLL_CTL_DEL, itReg->first, nullptr);
+            itReg = m_miEpollFDs.erase(itReg);
+        }
+
+        bool bRegistered =
+            itReg != m_miEpollFDs.end() && itReg->first == it.first;
+        if (bRegistered && itReg->second == it.second) {
+            ++itReg;
+            continue;
+        }
+
+        struct epoll_event ev = {};
+        if (it.second & ECT_Read) ev.events |= EPOLLIN;
+        if (it.second & ECT_Write) ev.events |= EPOLLOUT;
+        ev.data.fd = it.first;
+
+        int iOp = bRegistered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+        int iRet = epoll_ctl(m_iEpollFD, iOp, it.first, &ev);
+        if (iRet < 0 && errno == ENOENT) {
+            // Closed and reopened under the same number behind our back
+            iRet = epoll_ctl(m_iEpollFD, EPOLL_CTL_ADD, it.first, &ev);
+        } else if (iRet < 0 && errno == EEXIST) {
+            // Survived from a socket which was swapped rather than closed
+            iRet = epoll_ctl(m_iEpollFD, EPOLL_CTL_MOD, it.first, &ev);
+        }
+
+        if (iRet < 0) {
+            DEBUG("epoll_ctl(" << it.first << ") failed: " << strerror(errno));
+            if (bRegistered) itReg = m_miEpollFDs.erase(itReg);
+        } else if (bRegistered) {
+            itReg->second = it.second;
+            ++itReg;
+        } else {
+            m_miEpollFDs.emplace_hint(itReg, it.first, it.second);
+        }
+    }
+    while (itReg != m_miEpollFDs.end()) {
+        epoll_ctl(m_iEpollFD, EPOLL_CTL_DEL, itReg->first, nullptr);
+        itReg = m_miEpollFDs.erase(itReg);
+    }
+
+    int iTimeoutMS = -1;
+    if (tvtimeout) {
+        iTimeoutMS = tvtimeout->tv_sec * 1000 + (tvtimeout->tv_usec + 999) / 1000;
+    }
+
+    // Level triggered: Csocket reads at most one buffer per wakeup, with edge
+    // triggering the rest of the data would never be reported. Anything which
+    // doesn't fit into m_vEpollEvents is reported next time too.
+    m_vEpollEvents.resize(std::max<size_t>(
+        1, std::min<size_t>(m_miEpollFDs.size(), 1024)));
+    int iRet = epoll_wait(m_iEpollFD, m_vEpollEvents.data(),
+                          m_vEpollEvents.size(), iTimeoutMS);
+    int iErrno = errno;
+
+    miiReadyFds.clear();
+    for (int i = 0; i < iRet; ++i) {
+        const struct epoll_event& ev = m_vEpollEvents[i];
+        short iEvents = 0;
+        // Same as what Csocket does with poll(): errors are noticed by
+        // trying to read
+        if (ev.events & (EPOLLIN | EPOLLERR | EPOLLHUP)) iEvents |= ECT_Read;
+        if (ev.events & EPOLLOUT) iEvents |= ECT_Write;
+        miiReadyFds[ev.data.fd] |= iEvents;
+    }
+
+    CheckFDs(miiReadyFds);
+
+    errno = iErrno;
+    return iRet;
+}
+#endif
 
 void CSockManager::Connect(const CString& sHostname, u_short iPort,
                            const CString& sSockName, int iTimeout, bool bSSL,
@@ -18,7 +18,9 @@
 #include <znc/FileUtils.h>
 #include <znc/ZNCDebug.h>
 #include <znc/Translation.h>
+#include <sys/stat.h>
 #include <algorithm>
+#include <memory>
 
 using std::stringstream;
 using std::vector;
@@ -61,29 +63,40 @@ CString CTemplateLoopContext::GetValue(const CString& sName, bool bFromIf) {
         return "";
     }
 
+    CString sRet;
+    if (GetLoopValue(sName, sRet)) {
+        return sRet;
+    }
+
+    return pTemplate->GetValue(sName, bFromIf);
+}
+
+bool CTemplateLoopContext::GetLoopValue(const CString& sName, CString& sRet) {
     if (sName.Equals("__ID__")) {
-        return CString(GetRowIndex() + 1);
+        sRet = CString(GetRowIndex() + 1);
     } else if (sName.Equals("__COUNT__")) {
-        return CString(GetRowCount());
+        sRet = CString(GetRowCount());
     } else if (sName.Equals("__ODD__")) {
-        return ((GetRowIndex() % 2) ? "" : "1");
+        sRet = ((GetRowIndex() % 2) ? "" : "1");
     } else if (sName.Equals("__EVEN__")) {
-        return ((GetRowIndex() % 2) ? "1" : "");
+        sRet = ((GetRowIndex() % 2) ? "1" : "");
     } else if (sName.Equals("__FIRST__")) {
-        return ((GetRowIndex() == 0) ? "1" : "");
+        sRet = ((GetRowIndex() == 0) ? "1" : "");
     } else if (sName.Equals("__LAST__")) {
-        return ((GetRowIndex() == m_pvRows->size() - 1) ? "1" : "");
+        sRet = ((GetRowIndex() == m_pvRows->size() - 1) ? "1" : "");
     } else if (sName.Equals("__OUTER__")) {
-        return ((GetRowIndex() == 0 || GetRowIndex() == m_pvRows->size() - 1)
+        sRet = ((GetRowIndex() == 0 || GetRowIndex() == m_pvRows->size() - 1)
                     ? "1"
                     : "");
     } else if (sName.Equals("__INNER__")) {
-        return ((GetRowIndex() == 0 || GetRowIndex() == m_pvRows->size() - 1)
+        sRet = ((GetRowIndex() == 0 || GetRowIndex() == m_pvRows->size() - 1)
                     ? ""
                     : "1");
+    } else {
+        return false;
     }
 
-    return pTemplate->GetValue(sName, bFromIf);
+    return true;
 }
 
 CTemplate::~CTemplate() {
@@ -288,26 +301,335 @@ bool CTemplate::PrintString(CString& sRet) {
 
 bool CTemplate::Print(ostream& oOut) { return Print(m_sFileName, oOut); }
 
+/// A template file, split into text and tags once and cached until the file
+/// changes. CTemplate::Print() walks over it without touching the file.
+class CCompiledTemplate {
+  public:
+    enum EAction {
+        ActionOther,
+        ActionInc,
+        ActionSetOption,
+        ActionAddRow,
+        ActionSet,
+        ActionJoin,
+        ActionSetBlock,
+        ActionEndSetBlock,
+        ActionExpand,
+        ActionVar,
+        ActionLT,
+        ActionGT,
+        ActionContinue,
+        ActionBreak,
+        ActionExit,
+        ActionDebug,
+        ActionLoop,
+        ActionIf,
+        ActionRem,
+        ActionI18N,
+        ActionFormat,
+        ActionPlural,
+        ActionEndIf,
+        ActionEndRem,
+        ActionEndLoop,
+        ActionElse,
+    };
+
+    struct SItem {
+        enum EType {
+            Text,
+            Tag,
+            // A tag which contains another "<?"
+            Malformed,
+            // A "<?" without "?>" on the same line
+            Unterminated,
+        };
+        EType eType = Text;
+        CString sText;
+
+        EAction eAction = ActionOther;
+        CString sAction;
+        CString sArgs;
+        // Offsets in the file of the "<?" and after the "?>"
+        unsigned long uStart = 0;
+        unsigned long uEnd = 0;
+        // Where a LOOP starting here continues on every row
+        unsigned long uLoopPos = 0;
+
+        // The arguments, as far as they can be parsed in advance
+        CTemplate::SValueArgs Value;
+        std::vector<CTemplate::SIfExpr> vIf;
+        VCString vsArgs;
+        bool bFlag = false;
+    };
+
+    struct SLine {
+        unsigned long uOffset = 0;
+        CString sRaw;
+        std::vector<SItem> vItems;
+    };
+
+    static std::shared_ptr<const CCompiledTemplate> Get(
+        const CString& sFileName);
+
+    const std::vector<SLine>& GetLines() const { return m_vLines; }
+    /** Finds where to continue after jumping to @p uPos in the file. That's
+     *  either the start of line @p uNextLine, or @p pResume which is the
+     *  rest of a line followed by @p uNextLine.
+     */
+    void Seek(unsigned long uPos, size_t& uNextLine,
+              const SLine*& pResume) const;
+
+  private:
+    static SLine CompileLine(const CString& sLine, unsigned long uOffset,
+                             const CString& sFileName, unsigned int uLineNum);
+    static void CompileTag(SItem& Item);
+
+    std::vector<SLine> m_vLines;
+    // Lines, which are entered in the middle by a LOOP
+    mutable std::map<unsigned long, SLine> m_mPartialLines;
+    CString m_sFileName;
+    time_t m_tMTime = 0;
+    off_t m_uSize = 0;
+    ino_t m_uInode = 0;
+};
+
+std::shared_ptr<const CCompiledTemplate> CCompiledTemplate::Get(
+    const CString& sFileName) {
+    // Templates are only rendered in the main thread
+    static map<CString, std::shared_ptr<const CCompiledTemplate>> mCache;
+
+    struct stat st;
+    if (stat(sFileName.c_str(), &st) != 0) {
+        mCache.erase(sFileName);
+        return nullptr;
+    }
+
+    auto it = mCache.find(sFileName);
+    if (it != mCache.end() && it->second->m_tMTime == st.st_mtime &&
+        it->second->m_uSize == st.st_size &&
+        it->second->m_uInode == st.st_ino) {
+        return it->second;
+    }
+
+    CFile File(sFileName);
+    if (!File.Open()) {
+        mCache.erase(sFileName);
+        return nullptr;
+    }
+
+    std::shared_ptr<CCompiledTemplate> spCode =
+        std::make_shared<CCompiledTemplate>();
+    spCode->m_sFileName = sFileName;
+    spCode->m_tMTime = st.st_mtime;
+    spCode->m_uSize = st.st_size;
+    spCode->m_uInode = st.st_ino;
+
+    CString sLine;
+    unsigned long uOffset = 0;
+    while (File.ReadLine(sLine)) {
+        spCode->m_vLines.push_back(CompileLine(sLine, uOffset, sFileName,
+                                               spCode->m_vLines.size() + 1));
+        uOffset += sLine.size();
+    }
+
+    mCache[sFileName] = spCode;
+    return spCode;
+}
+
+CCompiledTemplate::SLine CCompiledTemplate::CompileLine(
+    const CString& sLine, unsigned long uOffset, const CString& sFileName,
+    unsigned int uLineNum) {
+    SLine Line;
+    Line.uOffset = uOffset;
+    Line.sRaw = sLine;
+
+    CString::size_type uPos = 0;
+    while (true) {
+        CString::size_type iPos = sLine.find("<?", uPos);
+
+        if (iPos == CString::npos) {
+            break;
+        }
+
+        SItem Text;
+        Text.sText = sLine.substr(uPos, iPos - uPos);
+        Line.vItems.push_back(std::move(Text));
+        uPos = iPos + 2;
+
+        CString::size_type iPos2 = sLine.find("?>", uPos);
+        SItem Item;
+        Item.uStart = uOffset + iPos;
+
+        // Make sure our tmpl tag is ended properly
+        if (iPos2 == CString::npos) {
+            Item.eType = SItem::Unterminated;
+            Item.sText = sLine.substr(uPos);
+            Line.vItems.push_back(std::move(Item));
+            return Line;
+        }
+
+        CString sMid = CString(sLine.substr(uPos, iPos2 - uPos)).Trim_n();
+
+        // Make sure we don't have a nested tag
+        if (sMid.Contains("<?")) {
+            DEBUG("Malformed tag on line " + CString(uLineNum) + " of [" +
+                  sFileName + "]");
+            DEBUG("--------------- [" + sLine.substr(uPos) + "]");
+            Item.eType = SItem::Malformed;
+            Line.vItems.push_back(std::move(Item));
+            continue;
+        }
+
+        uPos = iPos2 + 2;
+        Item.eType = SItem::Tag;
+        Item.uEnd = uOffset + uPos;
+        Item.uLoopPos = Item.uEnd;
+        for (CString::size_type t = uPos; t < sLine.size(); t++) {
+            char c = sLine[t];
+            if (c == '\r' || c == '\n') {
+                Item.uLoopPos++;
+            } else {
+                break;
+            }
+        }
+        Item.sAction = sMid.Token(0);
+        Item.sArgs = sMid.Token(1, true);
+        CompileTag(Item);
+        Line.vItems.push_back(std::move(Item));
+    }
+
+    SItem Text;
+    Text.sText = sLine.substr(uPos);
+    Line.vItems.push_back(std::move(Text));
+
+    return Line;
+}
+
+void CCompiledTemplate::CompileTag(SItem& Item) {
+    static const std::pair<const char*, EAction> aActions[] = {
+        {"INC", ActionInc},
+        {"SETOPTION", ActionSetOption},
+        {"ADDROW", ActionAddRow},
+        {"SET", ActionSet},
+        {"JOIN", ActionJoin},
+        {"SETBLOCK", ActionSetBlock},
+        {"ENDSETBLOCK", ActionEndSetBlock},
+        {"EXPAND", ActionExpand},
+        {"VAR", ActionVar},
+        {"LT", ActionLT},
+        {"GT", ActionGT},
+        {"CONTINUE", ActionContinue},
+        {"BREAK", ActionBreak},
+        {"EXIT", ActionExit},
+        {"DEBUG", ActionDebug},
+        {"LOOP", ActionLoop},
+        {"IF", ActionIf},
+        {"REM", ActionRem},
+        {"I18N", ActionI18N},
+        {"FORMAT", ActionFormat},
+        {"PLURAL", ActionPlural},
+        {"ENDIF", ActionEndIf},
+        {"ENDREM", ActionEndRem},
+        {"ENDLOOP", ActionEndLoop},
+        {"ELSE", ActionElse},
+    };
+
+    for (const auto& Action : aActions) {
+        if (Item.sAction.Equals(Action.first)) {
+            Item.eAction = Action.second;
+            break;
+        }
+    }
+
+    const CString& sArgs = Item.sArgs;
+    switch (Item.eAction) {
+        case ActionVar:
+            Item.Value = CTemplate::ParseValueArgs(sArgs);
+            break;
+        case ActionIf:
+            Item.vIf = CTemplate::ParseIf(sArgs);
+            break;
+        case ActionElse: {
+            CString sArg = sArgs.Token(0);
+            // bFlag: whether this is a plain ELSE
+            Item.bFlag = sArg.empty();
+            if (sArg.Equals("IF")) {
+                Item.vIf = CTemplate::ParseIf(sArgs.Token(1, true));
+            }
+            break;
+        }
+        case ActionJoin:
+            sArgs.QuoteSplit(Item.vsArgs);
+            break;
+        case ActionFormat:
+        case ActionPlural: {
+            CString sRest = sArgs;
+            // bFlag: whether the first argument is the context
+            Item.bFlag = sRest.TrimPrefix("CTX=");
+            sRest.QuoteSplit(Item.vsArgs);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void CCompiledTemplate::Seek(unsigned long uPos, size_t& uNextLine,
+                             const SLine*& pResume) const {
+    pResume = nullptr;
+
+    auto it = std::upper_bound(
+        m_vLines.begin(), m_vLines.end(), uPos,
+        [](unsigned long u, const SLine& Line) { return u < Line.uOffset; });
+    uNextLine = it - m_vLines.begin();
+
+    if (it == m_vLines.begin()) {
+        return;
+    }
+
+    const SLine& Line = *(it - 1);
+    if (Line.uOffset == uPos) {
+        uNextLine--;
+        return;
+    }
+    if (uPos >= Line.uOffset + Line.sRaw.size()) {
+        return;
+    }
+
+    auto itPartial = m_mPartialLines.find(uPos);
+    if (itPartial == m_mPartialLines.end()) {
+        itPartial =
+            m_mPartialLines
+                .emplace(uPos, CompileLine(Line.sRaw.substr(uPos - Line.uOffset),
+                                           uPos, m_sFileName, uNextLine))
+                .first;
+    }
+    pResume = &itPartial->second;
+}
+
 bool CTemplate::Print(const CString& sFileName, ostream& oOut) {
     if (sFileName.empty()) {
         DEBUG("Empty filename in CTemplate::Print()");
         return false;
     }
 
-    CFile File(sFileName);
+    std::shared_ptr<const CCompiledTemplate> spCode =
+        CCompiledTemplate::Get(sFileName);
 
-    if (!File.Open()) {
+    if (!spCode) {
         DEBUG("Unable to open file [" + sFileName + "] in CTemplate::Print()");
         return false;
     }
 
-    CString sLine;
+    typedef CCompiledTemplate::SItem SItem;
+    typedef CCompiledTemplate::SLine SLine;
+    const vector<SLine>& vLines = spCode->GetLines();
+    size_t uNextLine = 0;
+    const SLine* pResume = nullptr;
+
     CString sSetBlockVar;
     bool bValidLastIf = false;
     bool bInSetBlock = false;
-    unsigned long uFilePos = 0;
-    unsigned long uCurPos = 0;
-    unsigned int uLineNum = 0;
     unsigned int uNestedIfs = 0;
     unsigned int uSkip = 0;
     bool bLoopCont = false;
@@ -318,67 +640,56 @@ bool CTemplate::Print(const CString& sFileName, ostream& oOut) {
     // a module can INC'lude Footer.tmpl from core
     CString sI18N;
 
-    while (File.ReadLine(sLine)) {
+    while (pResume || uNextLine < vLines.size()) {
+        const SLine& Line = pResume ? *pResume : vLines[uNextLine++];
+        pResume = nullptr;
         CString sOutput;
         bool bFoundATag = false;
         bool bTmplLoopHasData = false;
-        uLineNum++;
-        CString::size_type iPos = 0;
-        uCurPos = uFilePos;
-        CString::size_type uLineSize = sLine.size();
-        bool bBroke = false;
-
-        while (1) {
-            iPos = sLine.find("<?");
 
-            if (iPos == CString::npos) {
-                break;
+        for (const SItem& Item : Line.vItems) {
+            if (Item.eType == SItem::Text) {
+                if (!uSkip) {
+                    sOutput += Item.sText;
+                }
+                continue;
             }
 
-            uCurPos += iPos;
             bFoundATag = true;
 
-            if (!uSkip) {
-                sOutput += sLine.substr(0, iPos);
-            }
-
-            sLine = sLine.substr(iPos + 2);
-
-            CString::size_type iPos2 = sLine.find("?>");
-
-            // Make sure our tmpl tag is ended properly
-            if (iPos2 == CString::npos) {
+            if (Item.eType == SItem::Unterminated) {
                 DEBUG("Template tag not ended properly in file [" + sFileName +
-                      "] [<?" + sLine + "]");
+                      "] [<?" + Item.sText + "]");
                 return false;
+            } else if (Item.eType == SItem::Malformed) {
+                continue;
             }
 
-            uCurPos += iPos2 + 4;
+            const CString& sAction = Item.sAction;
+            const CString& sArgs = Item.sArgs;
+            const CCompiledTemplate::EAction eAction = Item.eAction;
+            bool bNotFound = false;
+            bool bLineDone = false;
 
-            CString sMid = CString(sLine.substr(0, iPos2)).Trim_n();
-
-            // Make sure we don't have a nested tag
-            if (!sMid.Contains("<?")) {
-                sLine = sLine.substr(iPos2 + 2);
-                CString sAction = sMid.Token(0);
-                CString sArgs = sMid.Token(1, true);
-                bool bNotFound = false;
-
-                // If we're breaking or continuing from within a loop, skip all
-                // tags that aren't ENDLOOP
-                if ((bLoopCont || bLoopBreak) && !sAction.Equals("ENDLOOP")) {
-                    continue;
-                }
+            // If we're breaking or continuing from within a loop, skip all
+            // tags that aren't ENDLOOP
+            if ((bLoopCont || bLoopBreak) &&
+                eAction != CCompiledTemplate::ActionEndLoop) {
+                continue;
+            }
 
-                if (!uSkip) {
-                    if (sAction.Equals("INC")) {
+            if (!uSkip) {
+                switch (eAction) {
+                    case CCompiledTemplate::ActionInc:
                         if (!Print(ExpandFile(sArgs, true), oOut)) {
                             DEBUG("Unable to print INC'd file [" + sArgs + "]");
                             return false;
                         }
-                    } else if (sAction.Equals("SETOPTION")) {
+                        break;
+                    case CCompiledTemplate::ActionSetOption:
                         m_spOptions->Parse(sArgs);
-                    } else if (sAction.Equals("ADDROW")) {
+                        break;
+                    case CCompiledTemplate::ActionAddRow: {
                         CString sLoopName = sArgs.Token(0);
                         MCString msRow;
 
@@ -389,15 +700,17 @@ bool CTemplate::Print(const CString& sFileName, ostream& oOut) {
                                 NewRow[it.first] = it.second;
                             }
                         }
-                    } else if (sAction.Equals("SET")) {
+                        break;
+                    }
+                    case CCompiledTemplate::ActionSet: {
                         CString sName = sArgs.Token(0);
                         CString sValue = sArgs.Token(1, true);
 
                         (*this)[sName] = sValue;
-                    } else if (sAction.Equals("JOIN")) {
-                        VCString vsArgs;
-                        // sArgs.Split(" ", vsArgs, false, "\"", "\"");
-                        sArgs.QuoteSplit(vsArgs);
+                        break;
+                    }
+                    case CCompiledTemplate::ActionJoin: {
+                        const VCString& vsArgs = Item.vsArgs;
 
                         if (vsArgs.size() > 1) {
                             CString sDelim = vsArgs[0];
@@ -422,63 +735,68 @@ bool CTemplate::Print(const CString& sFileName, ostream& oOut) {
                                 }
                             }
                         }
-                    } else if (sAction.Equals("SETBLOCK")) {
+                        break;
+                    }
+                    case CCompiledTemplate::ActionSetBlock:
                         sSetBlockVar = sArgs;
                         bInSetBlock = true;
-                    } else if (sAction.Equals("ENDSETBLOCK")) {
+                        break;
+                    case CCompiledTemplate::ActionEndSetBlock: {
                         CString sName = sSetBlockVar.Token(0);
                         (*this)[sName] += sOutput;
                         sOutput = "";
                         bInSetBlock = false;
                         sSetBlockVar = "";
-                    } else if (sAction.Equals("EXPAND")) {
+                        break;
+                    }
+                    case CCompiledTemplate::ActionExpand:
                         sOutput += ExpandFile(sArgs, true);
-                    } else if (sAction.Equals("VAR")) {
-                        sOutput += GetValue(sArgs);
-                    } else if (sAction.Equals("LT")) {
+                        break;
+                    case CCompiledTemplate::ActionVar:
+                        sOutput += GetValue(Item.Value, false);
+                        break;
+                    case CCompiledTemplate::ActionLT:
                         sOutput += "<?";
-                    } else if (sAction.Equals("GT")) {
+                        break;
+                    case CCompiledTemplate::ActionGT:
                         sOutput += "?>";
-                    } else if (sAction.Equals("CONTINUE")) {
-                        CTemplateLoopContext* pContext = GetCurLoopContext();
-
-                        if (pContext) {
+                        break;
+                    case CCompiledTemplate::ActionContinue:
+                        if (GetCurLoopContext()) {
                             uSkip++;
                             bLoopCont = true;
-
-                            break;
+                            bLineDone = true;
                         } else {
                             DEBUG("[" + sFileName + ":" +
-                                  CString(uCurPos - iPos2 - 4) +
+                                  CString(Item.uStart) +
                                   "] <? CONTINUE ?> must be used inside of a "
                                   "loop!");
                         }
-                    } else if (sAction.Equals("BREAK")) {
+                        break;
+                    case CCompiledTemplate::ActionBreak:
                         // break from loop
-                        CTemplateLoopContext* pContext = GetCurLoopContext();
-
-                        if (pContext) {
+                        if (GetCurLoopContext()) {
                             uSkip++;
                             bLoopBreak = true;
-
-                            break;
+                            bLineDone = true;
                         } else {
                             DEBUG(
-                                "[" + sFileName + ":" +
-                                CString(uCurPos - iPos2 - 4) +
+                                "[" + sFileName + ":" + CString(Item.uStart) +
                                 "] <? BREAK ?> must be used inside of a loop!");
                         }
-                    } else if (sAction.Equals("EXIT")) {
+                        break;
+                    case CCompiledTemplate::ActionExit:
                         bExit = true;
-                    } else if (sAction.Equals("DEBUG")) {
+                        break;
+                    case CCompiledTemplate::ActionDebug:
                         DEBUG("CTemplate DEBUG [" + sFileName + "@" +
-                              CString(uCurPos - iPos2 - 4) + "b] -> [" + sArgs +
-                              "]");
-                    } else if (sAction.Equals("LOOP")) {
+                              CString(Item.uStart) + "b] -> [" + sArgs + "]");
+                        break;
+                    case CCompiledTemplate::ActionLoop: {
                         CTemplateLoopContext* pContext = GetCurLoopContext();
 
                         if (!pContext ||
-                            pContext->GetFilePosition() != uCurPos) {
+                            pContext->GetFilePosition() != Item.uEnd) {
                             // we are at a brand new loop (be it new or a first
                             // pass at an inner loop)
 
@@ -513,22 +831,8 @@ bool CTemplate::Print(const CString& sFileName, ostream& oOut) {
                             if (pvLoop) {
                                 // If we found data for this loop, add it to our
                                 // context vector
-                                // unsigned long uBeforeLoopTag = uCurPos -
-                                // iPos2 - 4;
-                                unsigned long uAfterLoopTag = uCurPos;
-
-                                for (CString::size_type t = 0; t < sLine.size();
-                                     t++) {
-                                    char c = sLine[t];
-                                    if (c == '\r' || c == '\n') {
-                                        uAfterLoopTag++;
-                                    } else {
-                                        break;
-                                    }
-                                }
-
                                 m_vLoopContexts.push_back(
-                                    new CTemplateLoopContext(uAfterLoopTag,
+                                    new CTemplateLoopContext(Item.uLoopPos,
                                                              sLoopName,
                                                              bReverse, pvLoop));
                             } else {
@@ -537,26 +841,27 @@ bool CTemplate::Print(const CString& sFileName, ostream& oOut) {
                                 uSkip++;
                             }
                         }
-                    } else if (sAction.Equals("IF")) {
-                        if (ValidIf(sArgs)) {
+                        break;
+                    }
+                    case CCompiledTemplate::ActionIf:
+                        if (ValidIf(Item.vIf)) {
                             uNestedIfs++;
                             bValidLastIf = true;
                         } else {
                             uSkip++;
                             bValidLastIf = false;
                         }
-                    } else if (sAction.Equals("REM")) {
+                        break;
+                    case CCompiledTemplate::ActionRem:
                         uSkip++;
-                    } else if (sAction.Equals("I18N")) {
+                        break;
+                    case CCompiledTemplate::ActionI18N:
                         sI18N = sArgs;
-                    } else if (sAction.Equals("FORMAT") ||
-                               sAction.Equals("PLURAL")) {
-                        bool bHaveContext = false;
-                        if (sArgs.TrimPrefix("CTX=")) {
-                            bHaveContext = true;
-                        }
-                        VCString vsArgs;
-                        sArgs.QuoteSplit(vsArgs);
+                        break;
+                    case CCompiledTemplate::ActionFormat:
+                    case CCompiledTemplate::ActionPlural: {
+                        bool bHaveContext = Item.bFlag;
+                        const VCString& vsArgs = Item.vsArgs;
                         CString sEnglish, sContext;
                         size_type idx = 0;
                         if (bHaveContext && vsArgs.size() > idx) {
@@ -568,7 +873,7 @@ bool CTemplate::Print(const CString& sFileName, ostream& oOut) {
                             idx++;
                         }
                         CString sFormat;
-                        if (sAction.Equals("PLURAL")) {
+                        if (eAction == CCompiledTemplate::ActionPlural) {
                             CString sEnglishes;
                             int iNum = 0;
                             if (vsArgs.size() > idx) {
@@ -591,123 +896,114 @@ bool CTemplate::Print(const CString& sFileName, ostream& oOut) {
                                 GetValue(vsArgs[i + idx], false);
                         }
                         sOutput += CString::NamedFormat(sFormat, msParams);
-                    } else {
-                        bNotFound = true;
+                        break;
                     }
-                } else if (sAction.Equals("REM")) {
-                    uSkip++;
-                } else if (sAction.Equals("IF")) {
-                    uSkip++;
-                } else if (sAction.Equals("LOOP")) {
-                    uSkip++;
+                    case CCompiledTemplate::ActionEndIf:
+                    case CCompiledTemplate::ActionEndRem:
+                    case CCompiledTemplate::ActionEndLoop:
+                    case CCompiledTemplate::ActionElse:
+                        // Handled below
+                        break;
+                    default:
+                        bNotFound = true;
+                        break;
                 }
+            } else if (eAction == CCompiledTemplate::ActionRem ||
+                       eAction == CCompiledTemplate::ActionIf ||
+                       eAction == CCompiledTemplate::ActionLoop) {
+                uSkip++;
+            }
 
-                if (sAction.Equals("ENDIF")) {
-                    if (uSkip) {
-                        uSkip--;
-                    } else {
-                        uNestedIfs--;
-                    }
-                } else if (sAction.Equals("ENDREM")) {
-                    if (uSkip) {
-                        uSkip--;
-                    }
-                } else if (sAction.Equals("ENDLOOP")) {
-                    if (bLoopCont && uSkip == 1) {
-                        uSkip--;
-                        bLoopCont = false;
-                    }
-
-                    if (bLoopBreak && uSkip == 1) {
-                        uSkip--;
-                    }
+            if (bLineDone) {
+                // CONTINUE and BREAK skip the rest of the line
+                break;
+            }
 
-                    if (uSkip) {
-                        uSkip--;
-                    } else {
-                        // We are at the end of the loop so we need to inc the
-                        // index
-                        CTemplateLoopContext* pContext = GetCurLoopContext();
+            if (eAction == CCompiledTemplate::ActionEndIf) {
+                if (uSkip) {
+                    uSkip--;
+                } else {
+                    uNestedIfs--;
+                }
+            } else if (eAction == CCompiledTemplate::ActionEndRem) {
+                if (uSkip) {
+                    uSkip--;
+                }
+            } else if (eAction == CCompiledTemplate::ActionEndLoop) {
+                if (bLoopCont && uSkip == 1) {
+                    uSkip--;
+                    bLoopCont = false;
+                }
 
-                        if (pContext) {
-                            pContext->IncRowIndex();
+                if (bLoopBreak && uSkip == 1) {
+                    uSkip--;
+                }
 
-                            // If we didn't go out of bounds we need to seek
-                            // back to the top of our loop
-                            if (!bLoopBreak && pContext->GetCurRow()) {
-                                uCurPos = pContext->GetFilePosition();
-                                uFilePos = uCurPos;
-                                uLineSize = 0;
+                if (uSkip) {
+                    uSkip--;
+                } else {
+                    // We are at the end of the loop so we need to inc the
+                    // index
+                    CTemplateLoopContext* pContext = GetCurLoopContext();
 
-                                File.Seek(uCurPos);
-                                bBroke = true;
+                    if (pContext) {
+                        pContext->IncRowIndex();
 
-                                if (!sOutput.Trim_n().empty()) {
-                                    pContext->SetHasData();
-                                }
+                        // If we didn't go out of bounds we need to go back to
+                        // the top of our loop
+                        if (!bLoopBreak && pContext->GetCurRow()) {
+                            spCode->Seek(pContext->GetFilePosition(),
+                                         uNextLine, pResume);
 
-                                break;
-                            } else {
-                                if (sOutput.Trim_n().empty()) {
-                                    sOutput.clear();
-                                }
+                            if (!sOutput.Trim_n().empty()) {
+                                pContext->SetHasData();
+                            }
 
-                                bTmplLoopHasData = pContext->HasData();
-                                DelCurLoopContext();
-                                bLoopBreak = false;
+                            break;
+                        } else {
+                            if (sOutput.Trim_n().empty()) {
+                                sOutput.clear();
                             }
-                        }
-                    }
-                } else if (sAction.Equals("ELSE")) {
-                    if (!bValidLastIf && uSkip == 1) {
-                        CString sArg = sArgs.Token(0);
 
-                        if (sArg.empty() || (sArg.Equals("IF") &&
-                                             ValidIf(sArgs.Token(1, true)))) {
-                            uSkip = 0;
-                            bValidLastIf = true;
+                            bTmplLoopHasData = pContext->HasData();
+                            DelCurLoopContext();
+                            bLoopBreak = false;
                         }
-                    } else if (!uSkip) {
-                        uSkip = 1;
                     }
-                } else if (bNotFound) {
-                    // Unknown tag that isn't being skipped...
-                    vector<std::shared_ptr<CTemplateTagHandler>>&
-                        vspTagHandlers = GetTagHandlers();
-
-                    if (!vspTagHandlers.empty()) {
-                        // @todo this should go up to the top to grab handlers
-                        CTemplate* pTmpl = GetCurTemplate();
-                        CString sCustomOutput;
-
-                        for (const auto& spTagHandler : vspTagHandlers) {
-                            if (spTagHandler->HandleTag(*pTmpl, sAction, sArgs,
-                                                        sCustomOutput)) {
-                                sOutput += sCustomOutput;
-                                bNotFound = false;
-                                break;
-                            }
+                }
+            } else if (eAction == CCompiledTemplate::ActionElse) {
+                if (!bValidLastIf && uSkip == 1) {
+                    if (Item.bFlag ||
+                        (!Item.vIf.empty() && ValidIf(Item.vIf))) {
+                        uSkip = 0;
+                        bValidLastIf = true;
+                    }
+                } else if (!uSkip) {
+                    uSkip = 1;
+                }
+            } else if (bNotFound) {
+                // Unknown tag that isn't being skipped...
+                vector<std::shared_ptr<CTemplateTagHandler>>& vspTagHandlers =
+                    GetTagHandlers();
+
+                if (!vspTagHandlers.empty()) {
+                    // @todo this should go up to the top to grab handlers
+                    CTemplate* pTmpl = GetCurTemplate();
+                    CString sCustomOutput;
+
+                    for (const auto& spTagHandler : vspTagHandlers) {
+                        if (spTagHandler->HandleTag(*pTmpl, sAction, sArgs,
+                                                    sCustomOutput)) {
+                            sOutput += sCustomOutput;
+                            bNotFound = false;
+                            break;
                         }
+                    }
 
-                        if (bNotFound) {
-                            DEBUG("Unknown/Unhandled tag [" + sAction + "]");
-                        }
+                    if (bNotFound) {
+                        DEBUG("Unknown/Unhandled tag [" + sAction + "]");
                     }
                 }
-
-                continue;
-            }
-
-            DEBUG("Malformed tag on line " + CString(uLineNum) + " of ["
-                  << File.GetLongName() + "]");
-            DEBUG("--------------- [" + sLine + "]");
-        }
-
-        if (!bBroke) {
-            uFilePos += uLineSize;
-
-            if (!uSkip) {
-                sOutput += sLine;
             }
         }
 
@@ -715,7 +1011,6 @@ bool CTemplate::Print(const CString& sFileName, ostream& oOut) {
             sOutput.find_first_not_of(" \t\r\n") != CString::npos) {
             if (bInSetBlock) {
                 CString sName = sSetBlockVar.Token(0);
-                // CString sValue = sSetBlockVar.Token(1, true);
                 (*this)[sName] += sOutput;
             } else {
                 oOut << sOutput;
@@ -749,7 +1044,10 @@ CTemplateLoopContext* CTemplate::GetCurLoopContext() {
     return nullptr;
 }
 
-bool CTemplate::ValidIf(const CString& sArgs) {
+bool CTemplate::ValidIf(const CString& sArgs) { return ValidIf(ParseIf(sArgs)); }
+
+vector<CTemplate::SIfExpr> CTemplate::ParseIf(const CString& sArgs) {
+    vector<SIfExpr> vExprs;
     CString sArgStr = sArgs;
     // sArgStr.Replace(" ", "", "\"", "\"", true);
     sArgStr.Replace(" &&", "&&", "\"", "\"", false);
@@ -771,67 +1069,100 @@ bool CTemplate::ValidIf(const CString& sArgs) {
         CString sExpr = sArgStr.Token(0, false, ((bAnd) ? "&&" : "||"));
         sArgStr = sArgStr.Token(1, true, ((bAnd) ? "&&" : "||"));
 
-        if (ValidExpr(sExpr)) {
-            if (!bAnd) {
+        vExprs.push_back(ParseExpr(sExpr));
+        vExprs.back().bAnd = bAnd;
+
+        uOrPos = sArgStr.find("||");
+        uAndPos = sArgStr.find("&&");
+    }
+
+    return vExprs;
+}
+
+bool CTemplate::ValidIf(const vector<SIfExpr>& vExprs) {
+    for (const SIfExpr& Expr : vExprs) {
+        if (ValidExpr(Expr)) {
+            if (!Expr.bAnd) {
                 return true;
             }
         } else {
-            if (bAnd) {
+            if (Expr.bAnd) {
                 return false;
             }
         }
-
-        uOrPos = sArgStr.find("||");
-        uAndPos = sArgStr.find("&&");
     }
 
     return false;
 }
 
 bool CTemplate::ValidExpr(const CString& sExpression) {
-    bool bNegate = false;
+    return ValidExpr(ParseExpr(sExpression));
+}
+
+CTemplate::SIfExpr CTemplate::ParseExpr(const CString& sExpression) {
+    static const pair<const char*, SIfExpr::EOp> aOps[] = {
+        {"!=", SIfExpr::Equals},      {"==", SIfExpr::Equals},
+        {">=", SIfExpr::GreaterEq},   {"<=", SIfExpr::LessEq},
+        {">", SIfExpr::Greater},      {"<", SIfExpr::Less},
+    };
+
+    SIfExpr Expr;
+    Expr.eOp = SIfExpr::Truth;
+    Expr.bAnd = false;
+    Expr.bNegate = false;
+    Expr.lValue = 0;
     CString sExpr(sExpression);
-    CString sName;
-    CString sValue;
 
     if (sExpr.TrimPrefix("!")) {
-        bNegate = true;
-    }
-
-    if (sExpr.Contains("!=")) {
-        sName = sExpr.Token(0, false, "!=").Trim_n();
-        sValue = sExpr.Token(1, true, "!=", false, "\"", "\"", true).Trim_n();
-        bNegate = !bNegate;
-    } else if (sExpr.Contains("==")) {
-        sName = sExpr.Token(0, false, "==").Trim_n();
-        sValue = sExpr.Token(1, true, "==", false, "\"", "\"", true).Trim_n();
-    } else if (sExpr.Contains(">=")) {
-        sName = sExpr.Token(0, false, ">=").Trim_n();
-        sValue = sExpr.Token(1, true, ">=", false, "\"", "\"", true).Trim_n();
-        return (GetValue(sName, true).ToLong() >= sValue.ToLong());
-    } else if (sExpr.Contains("<=")) {
-        sName = sExpr.Token(0, false, "<=").Trim_n();
-        sValue = sExpr.Token(1, true, "<=", false, "\"", "\"", true).Trim_n();
-        return (GetValue(sName, true).ToLong() <= sValue.ToLong());
-    } else if (sExpr.Contains(">")) {
-        sName = sExpr.Token(0, false, ">").Trim_n();
-        sValue = sExpr.Token(1, true, ">", false, "\"", "\"", true).Trim_n();
-        return (GetValue(sName, true).ToLong() > sValue.ToLong());
-    } else if (sExpr.Contains("<")) {
-        sName = sExpr.Token(0, false, "<").Trim_n();
-        sValue = sExpr.Token(1, true, "<", false, "\"", "\"", true).Trim_n();
-        return (GetValue(sName, true).ToLong() < sValue.ToLong());
-    } else {
-        sName = sExpr.Trim_n();
+        Expr.bNegate = true;
+    }
+
+    Expr.sName = sExpr.Trim_n();
+
+    for (const auto& Op : aOps) {
+        if (sExpr.Contains(Op.first)) {
+            Expr.eOp = Op.second;
+            Expr.sName = sExpr.Token(0, false, Op.first).Trim_n();
+            Expr.sValue =
+                sExpr.Token(1, true, Op.first, false, "\"", "\"", true)
+                    .Trim_n();
+            Expr.lValue = Expr.sValue.ToLong();
+
+            if (CString(Op.first) == "!=") {
+                Expr.bNegate = !Expr.bNegate;
+            }
+            break;
+        }
     }
 
-    if (sValue.empty()) {
-        return (bNegate != IsTrue(sName));
+    if (Expr.eOp == SIfExpr::Equals && Expr.sValue.empty()) {
+        Expr.eOp = SIfExpr::Truth;
     }
 
-    sValue = ResolveLiteral(sValue);
+    Expr.Name = ParseValueArgs(Expr.sName);
+
+    return Expr;
+}
+
+bool CTemplate::ValidExpr(const SIfExpr& Expr) {
+    switch (Expr.eOp) {
+        case SIfExpr::Truth:
+            return (Expr.bNegate !=
+                    (HasLoop(Expr.sName) || GetValue(Expr.Name, true).ToBool()));
+        case SIfExpr::Equals:
+            return (Expr.bNegate != GetValue(Expr.Name, true)
+                                        .Equals(ResolveLiteral(Expr.sValue)));
+        case SIfExpr::Less:
+            return (GetValue(Expr.Name, true).ToLong() < Expr.lValue);
+        case SIfExpr::LessEq:
+            return (GetValue(Expr.Name, true).ToLong() <= Expr.lValue);
+        case SIfExpr::Greater:
+            return (GetValue(Expr.Name, true).ToLong() > Expr.lValue);
+        case SIfExpr::GreaterEq:
+            return (GetValue(Expr.Name, true).ToLong() >= Expr.lValue);
+    }
 
-    return (bNegate != GetValue(sName, true).Equals(sValue));
+    return false;
 }
 
 bool CTemplate::IsTrue(const CString& sName) {
@@ -877,39 +1208,60 @@ CString CTemplate::ResolveLiteral(const CString& sString) {
 }
 
 CString CTemplate::GetValue(const CString& sArgs, bool bFromIf) {
-    CTemplateLoopContext* pContext = GetCurLoopContext();
-    CString sName = sArgs.Token(0);
-    CString sRest = sArgs.Token(1, true);
-    CString sRet;
+    return GetValue(ParseValueArgs(sArgs), bFromIf);
+}
+
+CTemplate::SValueArgs CTemplate::ParseValueArgs(const CString& sArgs) {
+    SValueArgs Args;
+    Args.sArgs = sArgs;
+    Args.sName = sArgs.Token(0);
+    Args.sRest = sArgs.Token(1, true);
 
+    CString sRest = Args.sRest;
     while (sRest.Replace(" =", "=", "\"", "\"")) {
     }
     while (sRest.Replace("= ", "=", "\"", "\"")) {
     }
 
     VCString vArgs;
-    MCString msArgs;
     // sRest.Split(" ", vArgs, false, "\"", "\"");
     sRest.QuoteSplit(vArgs);
 
     for (const CString& sArg : vArgs) {
-        msArgs[sArg.Token(0, false, "=").AsUpper()] = sArg.Token(1, true, "=");
+        Args.msArgs[sArg.Token(0, false, "=").AsUpper()] =
+            sArg.Token(1, true, "=");
     }
 
+    return Args;
+}
+
+CString CTemplate::GetValue(const SValueArgs& Args, bool bFromIf) {
+    CTemplateLoopContext* pContext = GetCurLoopContext();
+    const MCString& msArgs = Args.msArgs;
+    CString sRet;
+
     /* We have no CConfig in ZNC land
      * Hmm... Actually, we do have it now.
     if (msArgs.find("CONFIG") != msArgs.end()) {
         sRet = CConfig::GetValue(sName);
     } else*/ if (msArgs.find("ROWS") != msArgs.end()) {
-        vector<CTemplate*>* pLoop = GetLoop(sName);
+        vector<CTemplate*>* pLoop = GetLoop(Args.sName);
         sRet = CString((pLoop) ? pLoop->size() : 0);
     } else if (msArgs.find("TOP") == msArgs.end() && pContext) {
-        sRet = pContext->GetValue(sArgs, bFromIf);
+        CTemplate* pRow = pContext->GetCurRow();
+
+        if (!pRow) {
+            DEBUG("Loop [" + pContext->GetName() + "] has no row index [" +
+                  CString(pContext->GetRowIndex()) + "]");
+        } else if (!pContext->GetLoopValue(Args.sArgs, sRet)) {
+            sRet = pRow->GetValue(Args, bFromIf);
+        }
 
         if (!sRet.empty()) {
             return sRet;
         }
     } else {
+        CString sName = Args.sName;
         if (sName.TrimPrefix("*")) {
             MCString::iterator it = find(sName);
             sName = (it != end()) ? it->second : "";
@@ -931,15 +1283,13 @@ CString CTemplate::GetValue(const CString& sArgs, bool bFromIf) {
                 CString sCustomOutput;
 
                 if (!bFromIf &&
-                    spTagHandler->HandleVar(*pTmpl, sArgs.Token(0),
-                                            sArgs.Token(1, true),
+                    spTagHandler->HandleVar(*pTmpl, Args.sName, Args.sRest,
                                             sCustomOutput)) {
                     sRet = sCustomOutput;
                     break;
                 } else if (bFromIf &&
-                           spTagHandler->HandleIf(*pTmpl, sArgs.Token(0),
-                                                  sArgs.Token(1, true),
-                                                  sCustomOutput)) {
+                           spTagHandler->HandleIf(*pTmpl, Args.sName,
+                                                  Args.sRest, sCustomOutput)) {
                     sRet = sCustomOutput;
                     break;
                 }
@@ -955,10 +1305,11 @@ CString CTemplate::GetValue(const CString& sArgs, bool bFromIf) {
 
     if (!bFromIf) {
         if (sRet.empty()) {
-            sRet = ResolveLiteral(msArgs["DEFAULT"]);
+            MCString::const_iterator it = msArgs.find("DEFAULT");
+            sRet = ResolveLiteral((it != msArgs.end()) ? it->second : "");
         }
 
-        MCString::iterator it = msArgs.find("ESC");
+        MCString::const_iterator it = msArgs.find("ESC");
 
         if (it != msArgs.end()) {
             VCString vsEscs;
@@ -38,6 +38,9 @@ std::map<CString, CTranslationInfo> FillTranslations() {
     }
     return mTranslations;
 }
+
+// Each thread serves its own clients, see CLanguageScope
+thread_local VCString s_vsLanguageStack;
 }  // namespace
 
 std::map<CString, CTranslationInfo> CTranslationInfo::GetTranslations() {
@@ -54,7 +57,7 @@ CTranslation& CTranslation::Get() {
 CString CTranslation::Singular(const CString& sDomain, const CString& sContext,
                                const CString& sEnglish) {
 #ifdef HAVE_I18N
-    const std::locale& loc = LoadTranslation(sDomain);
+    const std::locale loc = LoadTranslation(sDomain);
     return boost::locale::translate(sContext, sEnglish).str(loc);
 #else
     return sEnglish;
@@ -64,7 +67,7 @@ CString CTranslation::Plural(const CString& sDomain, const CString& sContext,
                              const CString& sEnglish, const CString& sEnglishes,
                              int iNum) {
 #ifdef HAVE_I18N
-    const std::locale& loc = LoadTranslation(sDomain);
+    const std::locale loc = LoadTranslation(sDomain);
     return boost::locale::translate(sContext, sEnglish, sEnglishes, iNum)
         .str(loc);
 #else
@@ -76,14 +79,16 @@ CString CTranslation::Plural(const CString& sDomain, const CString& sContext,
 #endif
 }
 
-const std::locale& CTranslation::LoadTranslation(const CString& sDomain) {
-    CString sLanguage = m_sLanguageStack.empty() ? "" : m_sLanguageStack.back();
+std::locale CTranslation::LoadTranslation(const CString& sDomain) {
+    CString sLanguage =
+        s_vsLanguageStack.empty() ? "" : s_vsLanguageStack.back();
     sLanguage.Replace("-", "_");
     if (sLanguage.empty()) sLanguage = "C";
 #ifdef HAVE_I18N
     // Not using built-in support for multiple domains in single std::locale
     // via overloaded call to .str() because we need to be able to reload
     // translations from disk independently when a module gets updated
+    std::lock_guard<std::mutex> guard(m_mutex);
     auto& domain = m_Translations[sDomain];
     auto lang_it = domain.find(sLanguage);
     if (lang_it == domain.end()) {
@@ -102,14 +107,16 @@ const std::locale& CTranslation::LoadTranslation(const CString& sDomain) {
 }
 
 void CTranslation::PushLanguage(const CString& sLanguage) {
-    m_sLanguageStack.push_back(sLanguage);
+    s_vsLanguageStack.push_back(sLanguage);
 }
-void CTranslation::PopLanguage() { m_sLanguageStack.pop_back(); }
+void CTranslation::PopLanguage() { s_vsLanguageStack.pop_back(); }
 
 void CTranslation::NewReference(const CString& sDomain) {
+    std::lock_guard<std::mutex> guard(m_mutex);
     m_miReferences[sDomain]++;
 }
 void CTranslation::DelReference(const CString& sDomain) {
+    std::lock_guard<std::mutex> guard(m_mutex);
     if (!--m_miReferences[sDomain]) {
         m_Translations.erase(sDomain);
     }
@@ -81,6 +81,7 @@ CUser::CUser(const CString& sUsername)
       m_mssCTCPReplies(),
       m_sTimestampFormat("[%H:%M:%S]"),
       m_sTimezone(""),
+      m_TimestampFormatter(m_sTimestampFormat, m_sTimezone),
       m_eHashType(HASH_NONE),
       m_sUserPath(CZNC::Get().GetUserPath() + "/" + sUsername),
       m_bMultiClients(true),
@@ -643,8 +644,7 @@ CString CUser::AddTimestamp(timeval tv, const CString& sStr) const {
 
     if (!GetTimestampFormat().empty() &&
         (m_bAppendTimestamp || m_bPrependTimestamp)) {
-        CString sTimestamp =
-            CUtils::FormatTime(tv, GetTimestampFormat(), m_sTimezone);
+        CString sTimestamp = m_TimestampFormatter.Format(tv);
         if (sTimestamp.empty()) {
             return sRet;
         }
@@ -786,7 +786,7 @@ bool CUser::Clone(const CUser& User, CString& sErrorRet, bool bCloneNetworks) {
     SetLanguage(User.GetLanguage());
 
     // Allowed Hosts
-    m_ssAllowedHosts.clear();
+    ClearAllowedHosts();
     const set<CString>& ssHosts = User.GetAllowedHosts();
     for (const CString& sHost : ssHosts) {
         AddAllowedHost(sHost);
@@ -878,20 +878,42 @@ bool CUser::AddAllowedHost(const CString& sHostMask) {
     }
 
     m_ssAllowedHosts.insert(sHostMask);
+    UpdateAllowedHostMatcher();
     return true;
 }
 bool CUser::RemAllowedHost(const CString& sHostMask) {
-    return m_ssAllowedHosts.erase(sHostMask) > 0;
+    if (m_ssAllowedHosts.erase(sHostMask) == 0) return false;
+    UpdateAllowedHostMatcher();
+    return true;
+}
+void CUser::ClearAllowedHosts() {
+    m_ssAllowedHosts.clear();
+    UpdateAllowedHostMatcher();
+}
+
+void CUser::UpdateAllowedHostMatcher() {
+    m_AllowedHostMatcher.Clear();
+    m_vsAllowedRanges.clear();
+    for (const CString& sAllowedHost : m_ssAllowedHosts) {
+        m_AllowedHostMatcher.Add(sAllowedHost);
+        if (sAllowedHost.Contains("/")) {
+            m_vsAllowedRanges.push_back(sAllowedHost);
+        }
+    }
 }
-void CUser::ClearAllowedHosts() { m_ssAllowedHosts.clear(); }
 
 bool CUser::IsHostAllowed(const CString& sHost) const {
     if (m_ssAllowedHosts.empty()) {
         return true;
     }
 
-    for (const CString& sAllowedHost : m_ssAllowedHosts) {
-        if (CUtils::CheckCIDR(sHost, sAllowedHost)) {
+    // The same as CUtils::CheckCIDR() for all of them, but only ranges
+    // need to be parsed
+    if (m_AllowedHostMatcher.Matches(sHost)) {
+        return true;
+    }
+    for (const CString& sRange : m_vsAllowedRanges) {
+        if (CUtils::CheckCIDR(sHost, sRange)) {
             return true;
         }
     }
@@ -1059,34 +1081,30 @@ bool CUser::CheckPass(const CString& sPass) {
         return false;
     }
 
-    bool bResult = false;
     bool bUpgrade = false;
     switch (m_eHashType) {
         case HASH_MD5:
-            bResult = CUtils::ConstantTimeEquals(
-                m_sPass, CUtils::SaltedMD5Hash(sPass, m_sPassSalt));
             bUpgrade = true;
             break;
         case HASH_SHA256:
-            bResult = CUtils::ConstantTimeEquals(
-                m_sPass, CUtils::SaltedSHA256Hash(sPass, m_sPassSalt));
 #if ZNC_HAVE_ARGON
             bUpgrade = true;
 #endif
             break;
         case HASH_ARGON2ID:
-#if ZNC_HAVE_ARGON
-            return argon2id_verify(m_sPass.c_str(), sPass.data(), sPass.length()) == ARGON2_OK;
-#else
+#if !ZNC_HAVE_ARGON
             CUtils::PrintError("ZNC is built without Argon2 support, " + GetUsername() + " cannot authenticate");
             return false;
 #endif
+            break;
         case HASH_NONE:
             // Don't upgrade hash, since the only valid use case for plain are
             // manual tests, where it's simpler this way
-            return CUtils::ConstantTimeEquals(sPass, m_sPass);
+            break;
     }
 
+    bool bResult = VerifyPass(sPass, m_sPass, m_sPassSalt, m_eHashType);
+
     if (bResult && bUpgrade) {
         CString sSalt = CUtils::GetSalt();
         CString sHash = CUser::SaltedHash(sPass, sSalt);
@@ -1095,6 +1113,37 @@ bool CUser::CheckPass(const CString& sPass) {
     return bResult;
 }
 
+bool CUser::VerifyPass(const CString& sPass, const CString& sHash,
+                       const CString& sSalt, eHashType eHash) {
+    switch (eHash) {
+        case HASH_MD5:
+            return CUtils::ConstantTimeEquals(
+                sHash, CUtils::SaltedMD5Hash(sPass, sSalt));
+        case HASH_SHA256:
+            return CUtils::ConstantTimeEquals(
+                sHash, CUtils::SaltedSHA256Hash(sPass, sSalt));
+        case HASH_ARGON2ID:
+#if ZNC_HAVE_ARGON
+            return argon2id_verify(sHash.c_str(), sPass.data(), sPass.length()) == ARGON2_OK;
+#else
+            return false;
+#endif
+        case HASH_NONE:
+            return CUtils::ConstantTimeEquals(sPass, sHash);
+    }
+    return false;
+}
+
+bool CUser::IsPassCheckSlow() const {
+#if ZNC_HAVE_ARGON
+    // Argon2 is slow on purpose, the others take microseconds
+    return m_eHashType == HASH_ARGON2ID && !AuthOnlyViaModule() &&
+           !CZNC::Get().GetAuthOnlyViaModule();
+#else
+    return false;
+#endif
+}
+
 /*CClient* CUser::GetClient() {
     // Todo: optimize this by saving a pointer to the sock
     CSockManager& Manager = CZNC::Get().GetManager();
@@ -31,6 +31,7 @@
 #include <openssl/crypto.h>
 #include <openssl/rsa.h>
 #endif /* HAVE_LIBSSL */
+#include <algorithm>
 #include <memory>
 #include <unistd.h>
 #include <time.h>
@@ -511,8 +512,7 @@ CString CUtils::CTime(time_t t, const CString& sTimezone) {
     return FormatTime(t, "%c", sTimezone);
 }
 
-CString CUtils::FormatTime(time_t t, const CString& sFormat,
-                           const CString& sTimezone) {
+static cctz::time_zone LoadTimezone(const CString& sTimezone) {
     cctz::time_zone tz;
     if (sTimezone.empty()) {
         tz = cctz::local_time_zone();
@@ -522,23 +522,46 @@ CString CUtils::FormatTime(time_t t, const CString& sFormat,
     } else {
         cctz::load_time_zone(sTimezone, &tz);
     }
+    return tz;
+}
 
-    return cctz::format(sFormat, std::chrono::system_clock::from_time_t(t), tz);
+CString CUtils::FormatTime(time_t t, const CString& sFormat,
+                           const CString& sTimezone) {
+    return cctz::format(sFormat, std::chrono::system_clock::from_time_t(t),
+                        LoadTimezone(sTimezone));
 }
 
 CString CUtils::FormatTime(const timeval& tv, const CString& sFormat,
                            const CString& sTimezone) {
+    return CTimeFormatter(sFormat, sTimezone).Format(tv);
+}
+
+CString CUtils::FormatServerTime(const timeval& tv) {
+    // Runs for every line sent to clients with server-time
+    static thread_local const CTimeFormatter Formatter(
+        "%Y-%m-%dT%H:%M:%S.%3fZ", "UTC");
+    return Formatter.Format(tv);
+}
+
+struct CTimeFormatter::SZone {
+    cctz::time_zone tz;
+};
+
+CTimeFormatter::CTimeFormatter(const CString& sFormat,
+                               const CString& sTimezone)
+    : m_sFormat(sFormat),
+      m_sTimezone(sTimezone),
+      m_spZone(new SZone{LoadTimezone(sTimezone)}) {
     // Parse additional format specifiers before passing them to
     // strftime, since the way strftime treats unknown format
     // specifiers is undefined.
     // TODO: consider using cctz's %E#f instead.
-    CString sFormat2;
 
     // Make sure %% is parsed correctly, i.e. %%f is passed through to
     // strftime to become %f, and not 123.
     bool bInFormat = false;
-    int iDigits;
-    CString::size_type uLastCopied = 0, uFormatStart;
+    int iDigits = 3;
+    CString::size_type uLastCopied = 0, uFormatStart = 0;
 
     for (CString::size_type i = 0; i < sFormat.length(); i++) {
         if (!bInFormat) {
@@ -553,43 +576,61 @@ CString CUtils::FormatTime(const timeval& tv, const CString& sFormat,
                 case '5': case '6': case '7': case '8': case '9':
                     iDigits = sFormat[i] - '0';
                     break;
-                case 'f': {
-                    int iVal = tv.tv_usec;
-                    int iDigitDelta = iDigits - 6; // tv_user is in 10^-6 seconds
-                    for (; iDigitDelta > 0; iDigitDelta--)
-                        iVal *= 10;
-                    for (; iDigitDelta < 0; iDigitDelta++)
-                        iVal /= 10;
-                    sFormat2 += sFormat.substr(uLastCopied,
-                        uFormatStart - uLastCopied);
-                    CString sVal = CString(iVal);
-                    sFormat2 += CString(iDigits - sVal.length(), '0');
-                    sFormat2 += sVal;
+                case 'f':
+                    m_vPieces.push_back(
+                        {sFormat.substr(uLastCopied, uFormatStart - uLastCopied),
+                         iDigits});
                     uLastCopied = i + 1;
                     bInFormat = false;
                     break;
-                }
                 default:
                     bInFormat = false;
             }
         }
     }
 
-    if (uLastCopied) {
-        sFormat2 += sFormat.substr(uLastCopied);
-        return FormatTime(tv.tv_sec, sFormat2, sTimezone);
-    } else {
-        // If there are no extended format specifiers, avoid doing any
-        // memory allocations entirely.
-        return FormatTime(tv.tv_sec, sFormat, sTimezone);
+    m_vPieces.push_back({sFormat.substr(uLastCopied), 0});
+}
+
+void CTimeFormatter::Set(const CString& sFormat, const CString& sTimezone) {
+    if (sFormat != m_sFormat || sTimezone != m_sTimezone) {
+        *this = CTimeFormatter(sFormat, sTimezone);
     }
 }
 
-CString CUtils::FormatServerTime(const timeval& tv) {
-    using namespace std::chrono;
-    system_clock::time_point time{duration_cast<system_clock::duration>(
-        seconds(tv.tv_sec) + microseconds(tv.tv_usec))};
-    return cctz::format("%Y-%m-%dT%H:%M:%E3SZ", time, cctz::utc_time_zone());
+CString CTimeFormatter::Format(const timeval& tv) const {
+    if (m_vsCached.empty() || m_iCachedTime != tv.tv_sec) {
+        m_vsCached.clear();
+        const auto tp = std::chrono::system_clock::from_time_t(tv.tv_sec);
+        for (const SPiece& Piece : m_vPieces) {
+            m_vsCached.push_back(
+                Piece.sFormat.empty()
+                    ? ""
+                    : cctz::format(Piece.sFormat, tp, m_spZone->tz));
+        }
+        m_iCachedTime = tv.tv_sec;
+    }
+
+    // In the common case there is no %f, avoid copying more than needed
+    if (m_vPieces.size() == 1) return m_vsCached[0];
+
+    CString sRet;
+    for (size_t i = 0; i < m_vPieces.size(); ++i) {
+        sRet += m_vsCached[i];
+        if (i + 1 == m_vPieces.size()) break;
+
+        int iDigits = m_vPieces[i].iDigits;
+        int iVal = tv.tv_usec;
+        int iDigitDelta = iDigits - 6;  // tv_usec is in 10^-6 seconds
+        for (; iDigitDelta > 0; iDigitDelta--) iVal *= 10;
+        for (; iDigitDelta < 0; iDigitDelta++) iVal /= 10;
+        CString sVal = CString(iVal);
+        if (sVal.length() < (size_t)iDigits) {
+            sRet += CString(iDigits - sVal.length(), '0');
+        }
+        sRet += sVal;
+    }
+    return sRet;
 }
 
 timeval CUtils::ParseServerTime(const CString& sTime) {
@@ -938,6 +979,171 @@ void CTable::Clear() {
     m_msuWidths.clear();
 }
 
+size_t CWildcardSet::Add(const CString& sMask) {
+    m_vsMasks.push_back(sMask);
+    m_bCompiled = false;
+    return m_vsMasks.size() - 1;
+}
+
+void CWildcardSet::Clear() {
+    m_vsMasks.clear();
+    m_bCompiled = false;
+}
+
+unsigned char CWildcardSet::Fold(unsigned char c) const {
+    // The same as CString::MakeLower()
+    if (m_eCaseSensitivity == CString::CaseSensitive) return c;
+    return (unsigned char)tolower(c);
+}
+
+void CWildcardSet::Compile() const {
+    // Every character which appears in a mask gets its own class, all the
+    // others share class 0, which only ? matches
+    m_auClass.fill(0);
+    m_uClasses = 1;
+    for (const CString& sMask : m_vsMasks) {
+        for (unsigned char c : sMask) {
+            c = Fold(c);
+            if (c != '*' && c != '?' && m_auClass[c] == 0) {
+                m_auClass[c] = m_uClasses++;
+            }
+        }
+    }
+    for (unsigned int c = 0; c < 256; ++c) {
+        m_auClass[c] = m_auClass[Fold(c)];
+    }
+
+    // Consecutive stars are the same as one, and a star at the very end of
+    // a mask is a loop on its final state
+    struct SMask {
+        size_t uIndex;
+        CString sChars;
+        std::vector<bool> vbLoop;
+    };
+    std::vector<SMask> vAnyStart;
+    std::vector<std::vector<SMask>> vvByStart(256);
+    for (size_t i = 0; i < m_vsMasks.size(); ++i) {
+        SMask Mask{i, "", {false}};
+        for (unsigned char c : m_vsMasks[i]) {
+            if (c == '*') {
+                Mask.vbLoop.back() = true;
+            } else {
+                Mask.sChars += Fold(c);
+                Mask.vbLoop.push_back(false);
+            }
+        }
+        unsigned char cFirst = Mask.sChars.empty() ? 0 : Mask.sChars[0];
+        if (Mask.vbLoop[0] || Mask.sChars.empty() || cFirst == '?') {
+            vAnyStart.push_back(std::move(Mask));
+        } else {
+            vvByStart[cFirst].push_back(std::move(Mask));
+        }
+    }
+
+    auto Build = [&](const std::vector<SMask>& vMasks, SAutomaton& A) {
+        size_t uStates = 0;
+        for (const SMask& Mask : vMasks) uStates += Mask.sChars.size() + 1;
+        A = SAutomaton();
+        A.uWords = (uStates + 63) / 64;
+        A.vuStart.assign(A.uWords, 0);
+        A.vuLoop.assign(A.uWords, 0);
+        A.vuFinal.assign(A.uWords, 0);
+        A.vuEnter.assign(A.uWords * m_uClasses, 0);
+        auto Set = [](std::vector<uint64_t>& v, size_t uBit, size_t uOffset) {
+            v[uOffset + uBit / 64] |= uint64_t(1) << (uBit % 64);
+        };
+
+        size_t uBase = 0;
+        for (const SMask& Mask : vMasks) {
+            Set(A.vuStart, uBase, 0);
+            for (size_t i = 0; i < Mask.sChars.size(); ++i) {
+                unsigned char c = Mask.sChars[i];
+                for (size_t uClass = 0; uClass < m_uClasses; ++uClass) {
+                    if (c == '?' || m_auClass[c] == uClass) {
+                        Set(A.vuEnter, uBase + i + 1, uClass * A.uWords);
+                    }
+                }
+            }
+            for (size_t i = 0; i < Mask.vbLoop.size(); ++i) {
+                if (Mask.vbLoop[i]) Set(A.vuLoop, uBase + i, 0);
+            }
+            size_t uFinal = uBase + Mask.sChars.size();
+            Set(A.vuFinal, uFinal, 0);
+            A.vFinalStates.emplace_back(uFinal, Mask.uIndex);
+            uBase = uFinal + 1;
+        }
+    };
+
+    Build(vAnyStart, m_AnyStart);
+    m_vAutomatons.clear();
+    m_aiAutomaton.fill(-1);
+    for (unsigned int c = 0; c < 256; ++c) {
+        if (vvByStart[c].empty()) continue;
+        m_vAutomatons.emplace_back();
+        Build(vvByStart[c], m_vAutomatons.back());
+        m_aiAutomaton[c] = m_vAutomatons.size() - 1;
+    }
+    m_bCompiled = true;
+}
+
+bool CWildcardSet::Run(const SAutomaton& A, const CString& sString,
+                       std::vector<size_t>* pvuIndexes) const {
+    if (A.uWords == 0) return false;
+    m_vuState.assign(A.vuStart.begin(), A.vuStart.end());
+    uint64_t* puState = m_vuState.data();
+
+    for (unsigned char c : sString) {
+        const uint64_t* puEnter = &A.vuEnter[m_auClass[c] * A.uWords];
+        uint64_t uCarry = 0, uAny = 0, uDone = 0;
+        for (size_t w = 0; w < A.uWords; ++w) {
+            uint64_t uOld = puState[w];
+            uint64_t uNew = (((uOld << 1) | uCarry) & puEnter[w]) |
+                            (uOld & A.vuLoop[w]);
+            uCarry = uOld >> 63;
+            puState[w] = uNew;
+            uAny |= uNew;
+            // Masks ending with * stay matched whatever follows
+            uDone |= uNew & A.vuFinal[w] & A.vuLoop[w];
+        }
+        if (!uAny) return false;
+        if (uDone && !pvuIndexes) return true;
+    }
+
+    bool bMatched = false;
+    for (const auto& Final : A.vFinalStates) {
+        if (puState[Final.first / 64] & (uint64_t(1) << (Final.first % 64))) {
+            bMatched = true;
+            if (!pvuIndexes) break;
+            pvuIndexes->push_back(Final.second);
+        }
+    }
+    return bMatched;
+}
+
+bool CWildcardSet::Matches(const CString& sString) const {
+    if (m_vsMasks.empty()) return false;
+    if (!m_bCompiled) Compile();
+    if (Run(m_AnyStart, sString, nullptr)) return true;
+    if (sString.empty()) return false;
+    int iAutomaton = m_aiAutomaton[Fold(sString[0])];
+    return iAutomaton >= 0 && Run(m_vAutomatons[iAutomaton], sString, nullptr);
+}
+
+void CWildcardSet::FindAll(const CString& sString,
+                           std::vector<size_t>& vuIndexes) const {
+    vuIndexes.clear();
+    if (m_vsMasks.empty()) return;
+    if (!m_bCompiled) Compile();
+    Run(m_AnyStart, sString, &vuIndexes);
+    if (!sString.empty()) {
+        int iAutomaton = m_aiAutomaton[Fold(sString[0])];
+        if (iAutomaton >= 0) {
+            Run(m_vAutomatons[iAutomaton], sString, &vuIndexes);
+        }
+    }
+    std::sort(vuIndexes.begin(), vuIndexes.end());
+}
+
 #ifdef HAVE_LIBSSL
 CBlowfish::CBlowfish(const CString& sPassword, int iEncrypt,
                      const CString& sIvec)
@@ -18,6 +18,7 @@
 #include <znc/FileUtils.h>
 #include <znc/User.h>
 #include <znc/IRCNetwork.h>
+#include <znc/Profiler.h>
 #include <znc/znc.h>
 #include <time.h>
 #include <algorithm>
@@ -232,10 +233,10 @@ CWebSock::~CWebSock() {
     // not have a valid CModule* pointer.
     CUser* pUser = GetSession()->GetUser();
     if (pUser) {
-        pUser->AddBytesWritten(GetBytesWritten());
+        pUser->AddBytesWritten(GetBytesWritten() + GetFileBytesWritten());
         pUser->AddBytesRead(GetBytesRead());
     } else {
-        CZNC::Get().AddBytesWritten(GetBytesWritten());
+        CZNC::Get().AddBytesWritten(GetBytesWritten() + GetFileBytesWritten());
         CZNC::Get().AddBytesRead(GetBytesRead());
     }
 
@@ -633,6 +634,14 @@ void CWebSock::OnPageRequest(const CString& sURI) {
 
 CWebSock::EPageReqResult CWebSock::OnPageRequestInternal(const CString& sURI,
                                                          CString& sPageRet) {
+    // Users live in other threads than this socket, see CZNC::IsSharded()
+    if (CZNC::Get().IsSharded()) {
+        PrintErrorPage(503, "Service Unavailable",
+                       "The web interface is off while ZNC runs several "
+                       "event threads.");
+        return PAGE_DONE;
+    }
+
     // Check that their session really belongs to their IP address. IP-based
     // authentication is bad, but here it's just an extra layer that makes
     // stealing cookies harder to pull off.
@@ -709,6 +718,20 @@ CWebSock::EPageReqResult CWebSock::OnPageRequestInternal(const CString& sURI,
 
         Redirect("/");  // the login form is here
         return PAGE_DONE;
+    } else if (sURI == "/profile") {
+        // Machine-readable output of the profiler, see the Profile command
+        // of *status
+        if (!ForceLogin()) {
+            return PAGE_DONE;
+        } else if (!GetSession()->IsAdmin()) {
+            PrintErrorPage(403, "Forbidden",
+                           "You need to be an admin to access this page");
+            return PAGE_DONE;
+        }
+
+        SetContentType("application/json");
+        sPageRet = CProfiler::ToJSON();
+        return PAGE_PRINT;
     } else if (sURI.StartsWith("/pub/")) {
         return PrintStaticFile(sURI, sPageRet);
     } else if (sURI.StartsWith("/skinfiles/")) {
@@ -19,7 +19,11 @@
 #include <znc/Utils.h>
 #include <znc/MD5.h>
 #include <znc/SHA256.h>
+#include <atomic>
+#include <mutex>
 #include <sstream>
+#include <string_view>
+#include <unordered_map>
 
 using std::stringstream;
 
@@ -1579,3 +1583,96 @@ CString& MCString::Decode(CString& sValue) const {
     sValue = sTmp;
     return sValue;
 }
+
+struct CInternedString::SEntry {
+    SEntry(const CString& s) : sValue(s), uRefs(1), pFolded(nullptr) {}
+
+    const CString sValue;
+    // Dropping to 0 only happens with the pool's mutex held
+    std::atomic<unsigned int> uRefs;
+    // The lowercase version of this string, used by Equals()
+    SEntry* pFolded;
+};
+
+struct CInternedString::SPool {
+    // Lines and nicks are also made and destroyed in threads, e.g. in
+    // module jobs
+    std::mutex Mutex;
+    std::unordered_map<std::string_view, SEntry*> mEntries;
+
+    SEntry* Intern(const CString& sValue) {
+        auto it = mEntries.find(sValue);
+        if (it != mEntries.end()) {
+            it->second->uRefs++;
+            return it->second;
+        }
+
+        SEntry* pEntry = new SEntry(sValue);
+        mEntries[pEntry->sValue] = pEntry;
+        CString sFolded = sValue.AsLower();
+        pEntry->pFolded = sFolded == sValue ? pEntry : Intern(sFolded);
+        return pEntry;
+    }
+};
+
+CInternedString::SPool& CInternedString::GetPool() {
+    // Never destroyed, so that static CInternedStrings can outlive it
+    static SPool* pPool = new SPool;
+    return *pPool;
+}
+
+CInternedString::SEntry* CInternedString::Intern(const CString& sValue) {
+    if (sValue.empty()) return nullptr;
+
+    SPool& Pool = GetPool();
+    std::lock_guard<std::mutex> Lock(Pool.Mutex);
+    return Pool.Intern(sValue);
+}
+
+void CInternedString::Release(SEntry* pEntry) {
+    if (!pEntry) return;
+
+    // Only the last reference needs the pool
+    unsigned int uRefs = pEntry->uRefs.load();
+    while (uRefs > 1) {
+        if (pEntry->uRefs.compare_exchange_weak(uRefs, uRefs - 1)) return;
+    }
+
+    SPool& Pool = GetPool();
+    {
+        std::lock_guard<std::mutex> Lock(Pool.Mutex);
+        // Someone could have interned it again meanwhile
+        if (--pEntry->uRefs) return;
+        Pool.mEntries.erase(pEntry->sValue);
+    }
+    if (pEntry->pFolded != pEntry) {
+        Release(pEntry->pFolded);
+    }
+    delete pEntry;
+}
+
+CInternedString::CInternedString(const CString& sValue)
+    : m_pEntry(Intern(sValue)) {}
+
+CInternedString::CInternedString(const CInternedString& Other)
+    : m_pEntry(Other.m_pEntry) {
+    if (m_pEntry) m_pEntry->uRefs++;
+}
+
+CInternedString::~CInternedString() { Release(m_pEntry); }
+
+const CString& CInternedString::Get() const {
+    static const CString sEmpty;
+    return m_pEntry ? m_pEntry->sValue : sEmpty;
+}
+
+bool CInternedString::Equals(const CInternedString& Other) const {
+    if (!m_pEntry || !Other.m_pEntry) return m_pEntry == Other.m_pEntry;
+    return m_pEntry->pFolded == Other.m_pEntry->pFolded;
+}
+
+size_t CInternedString::GetPoolSize() {
+    SPool& Pool = GetPool();
+    std::lock_guard<std::mutex> Lock(Pool.Mutex);
+    return Pool.mEntries.size();
+}
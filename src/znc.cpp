@@ -22,6 +22,7 @@
 #include <znc/IRCNetwork.h>
 #include <znc/Config.h>
 #include <time.h>
+#include <thread>
 #include <tuple>
 #include <algorithm>
 
@@ -34,6 +35,90 @@ using std::list;
 using std::tuple;
 using std::make_tuple;
 
+namespace {
+// The event thread which runs this thread's loop, or which the main thread
+// works for, see CEventThreadScope
+thread_local CEventThread* s_pEventThread = nullptr;
+// Whether this is one of the event threads
+thread_local bool s_bInEventThread = false;
+
+// Makes GetManager() return the manager of pThread in this thread
+class CEventThreadScope {
+  public:
+    explicit CEventThreadScope(CEventThread* pThread)
+        : m_pOldThread(s_pEventThread) {
+        s_pEventThread = pThread;
+    }
+    ~CEventThreadScope() { s_pEventThread = m_pOldThread; }
+
+    CEventThreadScope(const CEventThreadScope&) = delete;
+    CEventThreadScope& operator=(const CEventThreadScope&) = delete;
+
+  private:
+    CEventThread* m_pOldThread;
+};
+}  // namespace
+
+// Runs the sockets and timers of some users, see CZNC::IsSharded()
+class CEventThread {
+  public:
+    CEventThread() : m_Manager(false), m_bStop(false), m_Thread() {}
+    ~CEventThread() { Stop(); }
+
+    CEventThread(const CEventThread&) = delete;
+    CEventThread& operator=(const CEventThread&) = delete;
+
+    CSockManager& GetManager() { return m_Manager; }
+
+    void Start() { m_Thread = std::thread([this]() { Run(); }); }
+
+    void Stop() {
+        if (!m_Thread.joinable()) return;
+        m_bStop = true;
+        // Wake it up
+        m_Manager.Post([]() {});
+        m_Thread.join();
+    }
+
+  private:
+    void Run() {
+        s_bInEventThread = true;
+        s_pEventThread = this;
+
+        while (!m_bStop) {
+            try {
+                m_Manager.RunPostedTasks();
+                CZNCSock::FlushWrites();
+                // Same as the main loop
+                m_Manager.DynamicSelectLoop(100 * 1000,
+                                            5 * 60 * 1000 * 1000);
+            } catch (const CException& e) {
+                // Shutting down and restarting are up to the main thread
+                CZNC::Get().m_Manager.Post([e]() { throw e; });
+            }
+        }
+    }
+
+    CSockManager m_Manager;
+    std::atomic<bool> m_bStop;
+    std::thread m_Thread;
+};
+
+// Keeps the event threads waiting while the main thread touches their users
+class CZNC::CExclusiveScope {
+  public:
+    explicit CExclusiveScope(CZNC& ZNC) : m_ZNC(ZNC) {
+        m_ZNC.PauseEventThreads();
+    }
+    ~CExclusiveScope() { m_ZNC.ResumeEventThreads(); }
+
+    CExclusiveScope(const CExclusiveScope&) = delete;
+    CExclusiveScope& operator=(const CExclusiveScope&) = delete;
+
+  private:
+    CZNC& m_ZNC;
+};
+
 CZNC::CZNC()
     : m_TimeStarted(time(nullptr)),
       m_eConfigState(ECONFIG_NOTHING),
@@ -73,10 +158,25 @@ CZNC::CZNC()
       m_sConnectThrottle(),
       m_bProtectWebSessions(true),
       m_bHideVersion(false),
+      m_bKernelTLS(false),
       m_bAuthOnlyViaModule(false),
       m_Translation("znc"),
       m_uiConfigWriteDelay(0),
-      m_pConfigTimer(nullptr) {
+      m_pConfigTimer(nullptr),
+      m_pConfigWriteJob(nullptr),
+      m_lpAuthQueue(),
+      m_uiMaxAuthThreads(4),
+      m_uiRunningAuthJobs(0),
+      m_uiEventThreads(1),
+      m_vpEventThreads(),
+      m_mpUserThreads(),
+      m_bEventThreadsRunning(false),
+      m_vMovingClients(),
+      m_mutexPause(),
+      m_condPause(),
+      m_bPausing(false),
+      m_uiPausedThreads(0),
+      m_uiPauseDepth(0) {
     if (!InitCsocket()) {
         CUtils::PrintError("Could not initialize Csocket!");
         exit(-1);
@@ -85,9 +185,12 @@ CZNC::CZNC()
 }
 
 CZNC::~CZNC() {
+    WaitForConfigWrite();
+    StopEventThreads();
     m_pModules->UnloadAll();
 
     for (const auto& it : m_msUsers) {
+        CEventThreadScope Scope(FindEventThread(it.second));
         it.second->GetModules().UnloadAll();
 
         const vector<CIRCNetwork*>& networks = it.second->GetNetworks();
@@ -108,6 +211,13 @@ CZNC::~CZNC() {
     // This deletes m_pConnectQueueTimer
     m_Manager.Cleanup();
     DeleteUsers();
+    for (CEventThread* pThread : m_vpEventThreads) {
+        delete pThread;
+    }
+    m_vpEventThreads.clear();
+#ifdef HAVE_LIBSSL
+    CSSLContextCache::Clear();
+#endif
 
     delete m_pModules;
     delete m_pLockFile;
@@ -190,6 +300,9 @@ class CConfigWriteTimer : public CCron {
 };
 
 void CZNC::Loop() {
+    // Only now, after forking
+    StartEventThreads();
+
     while (true) {
         CString sError;
 
@@ -216,19 +329,20 @@ void CZNC::Loop() {
                     }
                     break;
                 }
+                SetConfigState(ECONFIG_NEED_WRITE);
                 /* Fall through */
             case ECONFIG_NEED_WRITE:
             case ECONFIG_NEED_VERBOSE_WRITE:
+                // The state is kept until the previous write is done, the
+                // next one then includes all changes made meanwhile
+                if (m_pConfigWriteJob) break;
+
                 SetConfigState(ECONFIG_NOTHING);
 
                 // stop pending configuration timer
                 DisableConfigTimer();
 
-                if (!WriteConfig()) {
-                    Broadcast("Writing the config file failed", true);
-                } else if (eState == ECONFIG_NEED_VERBOSE_WRITE) {
-                    Broadcast("Writing the config succeeded", true);
-                }
+                StartConfigWrite(eState == ECONFIG_NEED_VERBOSE_WRITE);
                 break;
             case ECONFIG_NOTHING:
                 break;
@@ -242,9 +356,16 @@ void CZNC::Loop() {
             WriteConfig();
         }
 
+        // Send what was written to clients since the last iteration
+        CZNCSock::FlushWrites();
+
         // Csocket wants micro seconds
         // 100 msec to 5 min
         m_Manager.DynamicSelectLoop(100 * 1000, 5 * 60 * 1000 * 1000);
+
+        // What the event threads left for us
+        m_Manager.RunPostedTasks();
+        MoveClients();
     }
 }
 
@@ -329,11 +450,13 @@ bool CZNC::WritePemFile() {
 
 void CZNC::DeleteUsers() {
     for (const auto& it : m_msUsers) {
+        CEventThreadScope Scope(FindEventThread(it.second));
         it.second->SetBeingDeleted(true);
         delete it.second;
     }
 
     m_msUsers.clear();
+    m_mpUserThreads.clear();
     DisableConnectQueue();
 }
 
@@ -451,28 +574,29 @@ bool CZNC::WriteConfig() {
         return false;
     }
 
-    // We first write to a temporary file and then move it to the right place
-    CFile* pFile = new CFile(GetConfigFile() + "~");
-
-    if (!pFile->Open(O_WRONLY | O_CREAT | O_TRUNC, 0600)) {
-        DEBUG("Could not write config to " + GetConfigFile() + "~: " +
-              CString(strerror(errno)));
-        delete pFile;
-        return false;
+    if (s_bInEventThread) {
+        // Leave it to the main loop, which can stop the other threads
+        SetConfigState(ECONFIG_NEED_WRITE);
+        return true;
     }
 
-    // We have to "transfer" our lock on the config to the new file.
-    // The old file (= inode) is going away and thus a lock on it would be
-    // useless. These lock should always succeed (races, anyone?).
-    if (!pFile->TryExLock()) {
-        DEBUG("Error while locking the new config file, errno says: " +
-              CString(strerror(errno)));
-        pFile->Delete();
-        delete pFile;
+    // Both would use the same temporary file
+    WaitForConfigWrite();
+
+    CFile* pFile = WriteConfigFile(GetConfigFile(), MakeConfig());
+    if (!pFile) {
         return false;
     }
 
-    pFile->Write(MakeConfigHeader() + "\n");
+    // Make sure the lock is kept alive as long as we need it.
+    delete m_pLockFile;
+    m_pLockFile = pFile;
+
+    return true;
+}
+
+CString CZNC::MakeConfig() {
+    CExclusiveScope Scope(*this);
 
     CConfig config;
     config.AddKeyValuePair("AnonIPLimit", CString(m_uiAnonIPLimit));
@@ -483,9 +607,17 @@ bool CZNC::WriteConfig() {
     config.AddKeyValuePair("ProtectWebSessions",
                            CString(m_bProtectWebSessions));
     config.AddKeyValuePair("HideVersion", CString(m_bHideVersion));
+    if (m_bKernelTLS) {
+        config.AddKeyValuePair("KernelTLS", CString(m_bKernelTLS));
+    }
     config.AddKeyValuePair("AuthOnlyViaModule", CString(m_bAuthOnlyViaModule));
     config.AddKeyValuePair("Version", CString(VERSION_STR));
     config.AddKeyValuePair("ConfigWriteDelay", CString(m_uiConfigWriteDelay));
+    config.AddKeyValuePair("MaxAuthThreads", CString(m_uiMaxAuthThreads));
+    config.AddKeyValuePair("EventBackend", m_Manager.GetEventBackendName());
+    if (m_uiEventThreads != 1) {
+        config.AddKeyValuePair("EventThreads", CString(m_uiEventThreads));
+    }
 
     unsigned int l = 0;
     for (CListener* pListener : m_vpListeners) {
@@ -558,7 +690,33 @@ bool CZNC::WriteConfig() {
                             it.second->ToConfig());
     }
 
-    config.Write(*pFile);
+    return MakeConfigHeader() + "\n" + config.ToString();
+}
+
+CFile* CZNC::WriteConfigFile(const CString& sConfigFile,
+                             const CString& sConfig) {
+    // We first write to a temporary file and then move it to the right place
+    CFile* pFile = new CFile(sConfigFile + "~");
+
+    if (!pFile->Open(O_WRONLY | O_CREAT | O_TRUNC, 0600)) {
+        DEBUG("Could not write config to " + sConfigFile + "~: " +
+              CString(strerror(errno)));
+        delete pFile;
+        return nullptr;
+    }
+
+    // We have to "transfer" our lock on the config to the new file.
+    // The old file (= inode) is going away and thus a lock on it would be
+    // useless. These lock should always succeed (races, anyone?).
+    if (!pFile->TryExLock()) {
+        DEBUG("Error while locking the new config file, errno says: " +
+              CString(strerror(errno)));
+        pFile->Delete();
+        delete pFile;
+        return nullptr;
+    }
+
+    pFile->Write(sConfig);
 
     // If Sync() fails... well, let's hope nothing important breaks..
     pFile->Sync();
@@ -568,28 +726,109 @@ bool CZNC::WriteConfig() {
               CString(strerror(errno)));
         pFile->Delete();
         delete pFile;
-        return false;
+        return nullptr;
     }
 
     // We wrote to a temporary name, move it to the right place
-    if (!pFile->Move(GetConfigFile(), true)) {
+    if (!pFile->Move(sConfigFile, true)) {
         DEBUG(
             "Error while replacing the config file with a new version, errno "
             "says "
             << strerror(errno));
         pFile->Delete();
         delete pFile;
-        return false;
+        return nullptr;
     }
 
     // Everything went fine, just need to update the saved path.
-    pFile->SetFileName(GetConfigFile());
+    pFile->SetFileName(sConfigFile);
 
-    // Make sure the lock is kept alive as long as we need it.
-    delete m_pLockFile;
-    m_pLockFile = pFile;
+    return pFile;
+}
 
-    return true;
+#ifdef HAVE_PTHREAD
+// Only the config write leaves the main loop. Users are not split across
+// several event loop threads: module hooks, global ones included, use CZNC
+// and other users without locking, and a CSockManager is single threaded.
+class CConfigWriteJob : public CJob {
+  public:
+    CConfigWriteJob(const CString& sConfigFile, const CString& sConfig,
+                    bool bVerbose)
+        : CJob(),
+          m_sConfigFile(sConfigFile),
+          m_sConfig(sConfig),
+          m_bVerbose(bVerbose),
+          m_bStarted(false),
+          m_bReported(false),
+          m_pFile(nullptr) {}
+
+    ~CConfigWriteJob() override {
+        // Cancelled before a thread got to it, e.g. on shutdown. The changes
+        // must not get lost.
+        if (!m_bStarted) runThread();
+        // A cancelled job never gets runMain(), even if it already ran
+        if (!m_bReported) runMain();
+        CZNC::Get().ConfigWriteDone(m_pFile);
+    }
+
+    void runThread() override {
+        m_bStarted = true;
+        m_pFile = CZNC::WriteConfigFile(m_sConfigFile, m_sConfig);
+    }
+
+    void runMain() override {
+        m_bReported = true;
+        if (!m_pFile) {
+            CZNC::Get().Broadcast("Writing the config file failed", true);
+        } else if (m_bVerbose) {
+            CZNC::Get().Broadcast("Writing the config succeeded", true);
+        }
+    }
+
+  private:
+    CString m_sConfigFile;
+    CString m_sConfig;
+    bool m_bVerbose;
+    bool m_bStarted;
+    bool m_bReported;
+    CFile* m_pFile;
+};
+#endif
+
+void CZNC::StartConfigWrite(bool bVerbose) {
+#ifdef HAVE_PTHREAD
+    // Only the text is made here, writing and syncing a big config can take
+    // a while
+    if (!GetConfigFile().empty()) {
+        m_pConfigWriteJob =
+            new CConfigWriteJob(GetConfigFile(), MakeConfig(), bVerbose);
+        CThreadPool::Get().addJob(m_pConfigWriteJob);
+        return;
+    }
+#endif
+
+    if (!WriteConfig()) {
+        Broadcast("Writing the config file failed", true);
+    } else if (bVerbose) {
+        Broadcast("Writing the config succeeded", true);
+    }
+}
+
+void CZNC::WaitForConfigWrite() {
+#ifdef HAVE_PTHREAD
+    // The job still writes the config if it didn't start yet
+    if (m_pConfigWriteJob) {
+        CThreadPool::Get().cancelJob(m_pConfigWriteJob);
+    }
+#endif
+}
+
+void CZNC::ConfigWriteDone(CFile* pFile) {
+    m_pConfigWriteJob = nullptr;
+    if (pFile) {
+        delete m_pLockFile;
+        m_pLockFile = pFile;
+    }
 }
 
 CString CZNC::MakeConfigHeader() {
@@ -1083,13 +1322,26 @@ bool CZNC::ReadConfig(CConfig& config, CString& sError) {
 }
 
 bool CZNC::RehashConfig(CString& sError) {
+    if (IsSharded()) {
+        sError = t_s("Not possible while ZNC runs several event threads");
+        return false;
+    }
+
     ALLMODULECALL(OnPreRehash(), NOTHING);
 
+    // Read what was last written
+    WaitForConfigWrite();
+
     CConfig config;
     if (!ReadConfig(config, sError)) return false;
 
     if (!LoadGlobal(config, sError)) return false;
 
+#ifdef HAVE_LIBSSL
+    // The certificate may have changed, or the SSL settings
+    CSSLContextCache::Clear();
+#endif
+
     // do not reload users - it's dangerous!
 
     ALLMODULECALL(OnPostRehash(), NOTHING);
@@ -1228,6 +1480,8 @@ bool CZNC::LoadGlobal(CConfig& config, CString& sError) {
         m_bProtectWebSessions = sVal.ToBool();
     if (config.FindStringEntry("hideversion", sVal))
         m_bHideVersion = sVal.ToBool();
+    if (config.FindStringEntry("kerneltls", sVal))
+        m_bKernelTLS = sVal.ToBool();
     if (config.FindStringEntry("authonlyviamodule", sVal))
         m_bAuthOnlyViaModule = sVal.ToBool();
     if (config.FindStringEntry("sslprotocols", sVal)) {
@@ -1245,6 +1499,21 @@ bool CZNC::LoadGlobal(CConfig& config, CString& sError) {
     }
     if (config.FindStringEntry("configwritedelay", sVal))
         m_uiConfigWriteDelay = sVal.ToUInt();
+    if (config.FindStringEntry("maxauththreads", sVal))
+        m_uiMaxAuthThreads = sVal.ToUInt();
+    if (config.FindStringEntry("eventbackend", sVal)) {
+        if (!m_Manager.SetEventBackend(sVal)) {
+            VCString vsBackends = CSockManager::GetAvailableEventBackends();
+            CUtils::PrintError("Invalid EventBackend value [" + sVal + "]");
+            CUtils::PrintError(
+                "Available backends are [" +
+                CString(", ").Join(vsBackends.begin(), vsBackends.end()) +
+                "]");
+            return false;
+        }
+    }
+    if (config.FindStringEntry("eventthreads", sVal))
+        SetEventThreads(sVal.ToUInt());
 
     UnloadRemovedModules(msModules);
 
@@ -1258,15 +1527,39 @@ bool CZNC::LoadUsers(CConfig& config, CString& sError) {
 
     m_msUsers.clear();
 
+    if (m_uiEventThreads > 1 && m_vpEventThreads.empty()) {
+        CString sReason;
+        if (CanUseEventThreads(config, sReason)) {
+            CUtils::PrintMessage("Using [" + CString(m_uiEventThreads) +
+                                 "] event threads");
+            for (unsigned int i = 0; i < m_uiEventThreads; ++i) {
+                CEventThread* pThread = new CEventThread;
+                pThread->GetManager().SetEventBackend(
+                    m_Manager.GetEventBackendName());
+                m_vpEventThreads.push_back(pThread);
+            }
+        } else {
+            CUtils::PrintError("Ignoring EventThreads, " + sReason);
+        }
+    }
+
     CConfig::SubConfig subConf;
     config.FindSubConfig("user", subConf);
 
+    size_t uUser = 0;
     for (const auto& subIt : subConf) {
         const CString& sUsername = subIt.first;
         CConfig* pSubConf = subIt.second.m_pSubConfig;
 
         CUtils::PrintMessage("Loading user [" + sUsername + "]");
 
+        // Users stay in the thread they are created in
+        CEventThread* pThread = nullptr;
+        if (!m_vpEventThreads.empty()) {
+            pThread = m_vpEventThreads[uUser++ % m_vpEventThreads.size()];
+        }
+        CEventThreadScope Scope(pThread);
+
         std::unique_ptr<CUser> pUser(new CUser(sUsername));
 
         if (!m_sStatusPrefix.empty()) {
@@ -1299,6 +1592,7 @@ bool CZNC::LoadUsers(CConfig& config, CString& sError) {
             delete pRawUser;
             return false;
         }
+        if (pThread) m_mpUserThreads[pRawUser] = pThread;
     }
 
     if (m_msUsers.empty()) {
@@ -1437,14 +1731,17 @@ void CZNC::Broadcast(const CString& sMessage, bool bAdminOnly, CUser* pSkipUser,
         if (bAdminOnly && !it.second->IsAdmin()) continue;
 
         if (it.second != pSkipUser) {
-            // TODO: translate message to user's language
-            CString sMsg = sMessage;
+            CUser* pUser = it.second;
+            RunInUserThread(pUser, [=]() {
+                // TODO: translate message to user's language
+                CString sMsg = sMessage;
 
-            bool bContinue = false;
-            USERMODULECALL(OnBroadcast(sMsg), it.second, nullptr, &bContinue);
-            if (bContinue) continue;
+                bool bContinue = false;
+                USERMODULECALL(OnBroadcast(sMsg), pUser, nullptr, &bContinue);
+                if (bContinue) return;
 
-            it.second->PutStatusNotice("*** " + sMsg, nullptr, pSkipClient);
+                pUser->PutStatusNotice("*** " + sMsg, nullptr, pSkipClient);
+            });
         }
     }
 }
@@ -1468,6 +1765,9 @@ CModule* CZNC::FindModule(const CString& sModName, CUser* pUser) {
 }
 
 bool CZNC::UpdateModule(const CString& sModule) {
+    // Users' modules can't be reloaded from outside their thread
+    if (IsSharded()) return false;
+
     CModule* pModule;
 
     map<CUser*, CString> musLoaded;
@@ -1565,7 +1865,8 @@ CUser* CZNC::FindUser(const CString& sUsername) {
 bool CZNC::DeleteUser(const CString& sUsername) {
     CUser* pUser = FindUser(sUsername);
 
-    if (!pUser) {
+    // The event threads look users up without locking
+    if (!pUser || IsSharded()) {
         return false;
     }
 
@@ -1574,6 +1875,10 @@ bool CZNC::DeleteUser(const CString& sUsername) {
 }
 
 bool CZNC::AddUser(CUser* pUser, CString& sErrorRet, bool bStartup) {
+    if (!bStartup && IsSharded()) {
+        sErrorRet = t_s("Not possible while ZNC runs several event threads");
+        return false;
+    }
     if (FindUser(pUser->GetUsername()) != nullptr) {
         sErrorRet = t_s("User already exists");
         DEBUG("User [" << pUser->GetUsername() << "] - already exists");
@@ -1918,22 +2223,24 @@ CZNC::TrafficStatsMap CZNC::GetTrafficStats(TrafficStatsPair& Users,
         uiUsers_out += it.second->BytesWritten();
     }
 
-    for (Csock* pSock : m_Manager) {
-        CUser* pUser = nullptr;
-        if (pSock->GetSockName().StartsWith("IRC::")) {
-            pUser = ((CIRCSock*)pSock)->GetNetwork()->GetUser();
-        } else if (pSock->GetSockName().StartsWith("USR::")) {
-            pUser = ((CClient*)pSock)->GetUser();
-        }
+    for (CSockManager* pManager : GetManagers()) {
+        for (Csock* pSock : *pManager) {
+            CUser* pUser = nullptr;
+            if (pSock->GetSockName().StartsWith("IRC::")) {
+                pUser = ((CIRCSock*)pSock)->GetNetwork()->GetUser();
+            } else if (pSock->GetSockName().StartsWith("USR::")) {
+                pUser = ((CClient*)pSock)->GetUser();
+            }
 
-        if (pUser) {
-            ret[pUser->GetUsername()].first += pSock->GetBytesRead();
-            ret[pUser->GetUsername()].second += pSock->GetBytesWritten();
-            uiUsers_in += pSock->GetBytesRead();
-            uiUsers_out += pSock->GetBytesWritten();
-        } else {
-            uiZNC_in += pSock->GetBytesRead();
-            uiZNC_out += pSock->GetBytesWritten();
+            if (pUser) {
+                ret[pUser->GetUsername()].first += pSock->GetBytesRead();
+                ret[pUser->GetUsername()].second += pSock->GetBytesWritten();
+                uiUsers_in += pSock->GetBytesRead();
+                uiUsers_out += pSock->GetBytesWritten();
+            } else {
+                uiZNC_in += pSock->GetBytesRead();
+                uiZNC_out += pSock->GetBytesWritten();
+            }
         }
     }
 
@@ -1957,19 +2264,22 @@ CZNC::TrafficStatsMap CZNC::GetNetworkTrafficStats(const CString& sUsername,
             Total.second += pNetwork->BytesWritten();
         }
 
-        for (Csock* pSock : m_Manager) {
-            CIRCNetwork* pNetwork = nullptr;
-            if (pSock->GetSockName().StartsWith("IRC::")) {
-                pNetwork = ((CIRCSock*)pSock)->GetNetwork();
-            } else if (pSock->GetSockName().StartsWith("USR::")) {
-                pNetwork = ((CClient*)pSock)->GetNetwork();
-            }
+        for (CSockManager* pManager : GetManagers()) {
+            for (Csock* pSock : *pManager) {
+                CIRCNetwork* pNetwork = nullptr;
+                if (pSock->GetSockName().StartsWith("IRC::")) {
+                    pNetwork = ((CIRCSock*)pSock)->GetNetwork();
+                } else if (pSock->GetSockName().StartsWith("USR::")) {
+                    pNetwork = ((CClient*)pSock)->GetNetwork();
+                }
 
-            if (pNetwork && pNetwork->GetUser() == pUser) {
-                Networks[pNetwork->GetName()].first = pSock->GetBytesRead();
-                Networks[pNetwork->GetName()].second = pSock->GetBytesWritten();
-                Total.first += pSock->GetBytesRead();
-                Total.second += pSock->GetBytesWritten();
+                if (pNetwork && pNetwork->GetUser() == pUser) {
+                    Networks[pNetwork->GetName()].first = pSock->GetBytesRead();
+                    Networks[pNetwork->GetName()].second =
+                        pSock->GetBytesWritten();
+                    Total.first += pSock->GetBytesRead();
+                    Total.second += pSock->GetBytesWritten();
+                }
             }
         }
     }
@@ -1986,19 +2296,104 @@ void CZNC::AuthUser(std::shared_ptr<CAuthBase> AuthClass) {
 
     CUser* pUser = FindUser(AuthClass->GetUsername());
 
+#ifdef HAVE_PTHREAD
+    // Slow hashes are checked in a thread, so that one login doesn't stall
+    // everyone else
+    if (pUser && m_uiMaxAuthThreads > 0 && pUser->IsPassCheckSlow()) {
+        m_lpAuthQueue.push_back(AuthClass);
+        StartAuthJobs();
+        return;
+    }
+#endif
+
     if (!pUser || !pUser->CheckPass(AuthClass->GetPassword())) {
         AuthClass->RefuseLogin("Invalid Password");
         return;
     }
 
+    FinishAuth(AuthClass, *pUser);
+}
+
+void CZNC::FinishAuth(std::shared_ptr<CAuthBase> AuthClass, CUser& User) {
     CString sHost = AuthClass->GetRemoteIP();
 
-    if (!pUser->IsHostAllowed(sHost)) {
+    if (!User.IsHostAllowed(sHost)) {
         AuthClass->RefuseLogin("Your host [" + sHost + "] is not allowed");
         return;
     }
 
-    AuthClass->AcceptLogin(*pUser);
+    AuthClass->AcceptLogin(User);
+}
+
+#ifdef HAVE_PTHREAD
+class CAuthJob : public CJob {
+  public:
+    CAuthJob(std::shared_ptr<CAuthBase> AuthClass, const CUser& User)
+        : CJob(),
+          m_AuthClass(AuthClass),
+          m_sPassword(AuthClass->GetPassword()),
+          m_sHash(User.GetPass()),
+          m_sSalt(User.GetPassSalt()),
+          m_eHashType(User.GetPassHashType()),
+          m_bResult(false) {}
+
+    void runThread() override {
+        m_bResult =
+            CUser::VerifyPass(m_sPassword, m_sHash, m_sSalt, m_eHashType);
+    }
+
+    void runMain() override {
+        CZNC::Get().AuthJobDone(m_AuthClass, m_sHash, m_bResult);
+    }
+
+  private:
+    std::shared_ptr<CAuthBase> m_AuthClass;
+    // Copies, since the user must not be touched outside of the main thread
+    CString m_sPassword;
+    CString m_sHash;
+    CString m_sSalt;
+    CUser::eHashType m_eHashType;
+    bool m_bResult;
+};
+#endif
+
+void CZNC::StartAuthJobs() {
+#ifdef HAVE_PTHREAD
+    // The thread pool is shared with DNS lookups and modules, a flood of
+    // logins shouldn't take all of it
+    while (m_uiRunningAuthJobs < m_uiMaxAuthThreads &&
+           !m_lpAuthQueue.empty()) {
+        std::shared_ptr<CAuthBase> AuthClass = m_lpAuthQueue.front();
+        m_lpAuthQueue.pop_front();
+
+        // The client may have disconnected while waiting
+        if (!AuthClass->GetSocket()) continue;
+
+        CUser* pUser = FindUser(AuthClass->GetUsername());
+        if (!pUser) {
+            AuthClass->RefuseLogin("Invalid Password");
+            continue;
+        }
+
+        m_uiRunningAuthJobs++;
+        CThreadPool::Get().addJob(new CAuthJob(AuthClass, *pUser));
+    }
+#endif
+}
+
+void CZNC::AuthJobDone(std::shared_ptr<CAuthBase> AuthClass,
+                       const CString& sHash, bool bResult) {
+    m_uiRunningAuthJobs--;
+
+    // The user could have been deleted or changed the password meanwhile
+    CUser* pUser = FindUser(AuthClass->GetUsername());
+    if (!bResult || !pUser || pUser->GetPass() != sHash) {
+        AuthClass->RefuseLogin("Invalid Password");
+    } else {
+        FinishAuth(AuthClass, *pUser);
+    }
+
+    StartAuthJobs();
 }
 
 class CConnectQueueTimer : public CCron {
@@ -2024,6 +2419,12 @@ class CConnectQueueTimer : public CCron {
 
   protected:
     void RunJob() override {
+        CZNC& ZNC = CZNC::Get();
+        if (ZNC.IsSharded()) {
+            RunSharded(ZNC);
+            return;
+        }
+
         list<CIRCNetwork*> ConnectionQueue;
         list<CIRCNetwork*>& RealConnectionQueue =
             CZNC::Get().GetConnectionQueue();
@@ -2057,6 +2458,42 @@ class CConnectQueueTimer : public CCron {
             CZNC::Get().DisableConnectQueue();
         }
     }
+
+  private:
+    // Networks connect in the thread of their user, so whether that worked
+    // isn't known here. One network is tried per run, one which can't
+    // connect yet queues itself again.
+    void RunSharded(CZNC& ZNC) {
+        CIRCNetwork* pNetwork = nullptr;
+        CUser* pUser = nullptr;
+        bool bEmpty;
+        {
+            std::lock_guard<std::mutex> guard(ZNC.m_mutexConnectQueue);
+            if (!ZNC.m_lpConnectQueue.empty()) {
+                pNetwork = ZNC.m_lpConnectQueue.front();
+                ZNC.m_lpConnectQueue.pop_front();
+                // ~CIRCNetwork() leaves the queue before it forgets its user
+                pUser = pNetwork->GetUser();
+            }
+            bEmpty = ZNC.m_lpConnectQueue.empty();
+        }
+
+        if (pUser) {
+            ZNC.RunInUserThread(pUser, [=]() {
+                const vector<CIRCNetwork*>& vNetworks = pUser->GetNetworks();
+                // It may have been deleted meanwhile
+                if (std::find(vNetworks.begin(), vNetworks.end(), pNetwork) !=
+                    vNetworks.end()) {
+                    pNetwork->Connect();
+                }
+            });
+        }
+
+        if (bEmpty) {
+            DEBUG("ConnectQueueTimer done");
+            ZNC.DisableConnectQueue();
+        }
+    }
 };
 
 void CZNC::SetConnectDelay(unsigned int i) {
@@ -2117,10 +2554,14 @@ bool CZNC::SetSSLProtocols(const CString& sProtocols) {
 }
 
 void CZNC::EnableConnectQueue() {
-    if (!m_pConnectQueueTimer && !m_uiConnectPaused &&
-        !m_lpConnectQueue.empty()) {
+    bool bEmpty;
+    {
+        std::lock_guard<std::mutex> guard(m_mutexConnectQueue);
+        bEmpty = m_lpConnectQueue.empty();
+    }
+    if (!m_pConnectQueueTimer && !m_uiConnectPaused && !bEmpty) {
         m_pConnectQueueTimer = new CConnectQueueTimer(m_uiConnectDelay);
-        GetManager().AddCron(m_pConnectQueueTimer);
+        m_Manager.AddCron(m_pConnectQueueTimer);
     }
 }
 
@@ -2189,14 +2630,28 @@ CString CZNC::FixupEncoding(const CString& sEncoding) const {
 }
 
 void CZNC::AddNetworkToQueue(CIRCNetwork* pNetwork) {
-    // Make sure we are not already in the queue
-    if (std::find(m_lpConnectQueue.begin(), m_lpConnectQueue.end(), pNetwork) !=
-        m_lpConnectQueue.end()) {
-        return;
+    {
+        std::lock_guard<std::mutex> guard(m_mutexConnectQueue);
+        // Make sure we are not already in the queue
+        if (std::find(m_lpConnectQueue.begin(), m_lpConnectQueue.end(),
+                      pNetwork) != m_lpConnectQueue.end()) {
+            return;
+        }
+
+        m_lpConnectQueue.push_back(pNetwork);
     }
 
-    m_lpConnectQueue.push_back(pNetwork);
-    EnableConnectQueue();
+    if (s_bInEventThread) {
+        // The timer belongs to the main thread
+        m_Manager.Post([this]() { EnableConnectQueue(); });
+    } else {
+        EnableConnectQueue();
+    }
+}
+
+void CZNC::RemoveNetworkFromQueue(CIRCNetwork* pNetwork) {
+    std::lock_guard<std::mutex> guard(m_mutexConnectQueue);
+    m_lpConnectQueue.remove(pNetwork);
 }
 
 void CZNC::LeakConnectQueueTimer(CConnectQueueTimer* pTimer) {
@@ -2211,3 +2666,220 @@ void CZNC::DisableConfigTimer() {
         m_pConfigTimer = nullptr;
     }
 }
+
+void CZNC::SetConfigState(enum ConfigState e) {
+    {
+        std::lock_guard<std::mutex> guard(m_mutexConfigState);
+        m_eConfigState = e;
+    }
+    if (s_bInEventThread) {
+        // Wake up the main loop
+        m_Manager.Post([]() {});
+    }
+}
+
+bool CZNC::IsInEventThread() { return s_bInEventThread; }
+
+CSockManager& CZNC::GetManager() {
+    return s_pEventThread ? s_pEventThread->GetManager() : m_Manager;
+}
+
+const CSockManager& CZNC::GetManager() const {
+    return s_pEventThread ? s_pEventThread->GetManager() : m_Manager;
+}
+
+CEventThread* CZNC::FindEventThread(const CUser* pUser) const {
+    auto it = m_mpUserThreads.find(pUser);
+    return it == m_mpUserThreads.end() ? nullptr : it->second;
+}
+
+std::vector<CSockManager*> CZNC::GetManagers() {
+    vector<CSockManager*> vpManagers = {&m_Manager};
+    for (CEventThread* pThread : m_vpEventThreads) {
+        vpManagers.push_back(&pThread->GetManager());
+    }
+    return vpManagers;
+}
+
+bool CZNC::CanUseEventThreads(CConfig& config, CString& sReason) {
+    if (!m_pModules->empty()) {
+        sReason = "global module [" + (*m_pModules)[0]->GetModName() +
+                  "] is loaded";
+        return false;
+    }
+
+    // Users aren't loaded yet, look at their config
+    VCString vsLines;
+    CConfig::SubConfig Users;
+    config.FindSubConfig("user", Users, false);
+    for (const auto& User : Users) {
+        CConfig* pUserConfig = User.second.m_pSubConfig;
+        VCString vsUserLines;
+        pUserConfig->FindStringVector("loadmodule", vsUserLines, false);
+        vsLines.insert(vsLines.end(), vsUserLines.begin(), vsUserLines.end());
+
+        CConfig::SubConfig Networks;
+        pUserConfig->FindSubConfig("network", Networks, false);
+        for (const auto& Network : Networks) {
+            VCString vsNetworkLines;
+            Network.second.m_pSubConfig->FindStringVector(
+                "loadmodule", vsNetworkLines, false);
+            vsLines.insert(vsLines.end(), vsNetworkLines.begin(),
+                           vsNetworkLines.end());
+        }
+    }
+
+    SCString ssChecked;
+    for (const CString& sLine : vsLines) {
+        CString sModule = sLine.Token(0);
+        if (!ssChecked.insert(sModule).second) continue;
+
+        CModInfo Info;
+        CString sError;
+        // A module which can't be found fails to load later anyway
+        if (CModules::GetModInfo(Info, sModule, sError) &&
+            !Info.IsThreadAware()) {
+            sReason = "module [" + sModule + "] isn't thread-aware";
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void CZNC::StartEventThreads() {
+    if (m_vpEventThreads.empty() || m_bEventThreadsRunning) return;
+
+    m_bEventThreadsRunning = true;
+    for (CEventThread* pThread : m_vpEventThreads) {
+        pThread->Start();
+    }
+}
+
+void CZNC::StopEventThreads() {
+    if (!m_bEventThreadsRunning) return;
+
+    for (CEventThread* pThread : m_vpEventThreads) {
+        pThread->Stop();
+    }
+    m_bEventThreadsRunning = false;
+
+    // Tasks which came too late, e.g. handing over a client
+    for (CEventThread* pThread : m_vpEventThreads) {
+        CEventThreadScope Scope(pThread);
+        pThread->GetManager().RunPostedTasks();
+    }
+}
+
+void CZNC::PauseEventThreads() {
+    if (!m_bEventThreadsRunning || m_uiPauseDepth++ > 0) return;
+
+    {
+        std::lock_guard<std::mutex> guard(m_mutexPause);
+        m_bPausing = true;
+    }
+    for (CEventThread* pThread : m_vpEventThreads) {
+        pThread->GetManager().Post([this]() { WaitWhilePaused(); });
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutexPause);
+    m_condPause.wait(lock, [this]() {
+        return m_uiPausedThreads == m_vpEventThreads.size();
+    });
+}
+
+void CZNC::ResumeEventThreads() {
+    if (!m_bEventThreadsRunning || --m_uiPauseDepth > 0) return;
+
+    std::unique_lock<std::mutex> lock(m_mutexPause);
+    m_bPausing = false;
+    m_condPause.notify_all();
+    // Otherwise the next pause could count a thread which is still here
+    m_condPause.wait(lock, [this]() { return m_uiPausedThreads == 0; });
+}
+
+void CZNC::WaitWhilePaused() {
+    // What was written so far goes out before the main thread writes to the
+    // same clients
+    CZNCSock::FlushWrites();
+
+    std::unique_lock<std::mutex> lock(m_mutexPause);
+    ++m_uiPausedThreads;
+    m_condPause.notify_all();
+    m_condPause.wait(lock, [this]() { return !m_bPausing; });
+    --m_uiPausedThreads;
+    m_condPause.notify_all();
+}
+
+void CZNC::RunInUserThread(const CUser* pUser, std::function<void()> fTask) {
+    CEventThread* pThread = FindEventThread(pUser);
+    bool bNow = !pThread || !m_bEventThreadsRunning;
+    if (s_bInEventThread) {
+        bNow = bNow || pThread == s_pEventThread;
+    } else {
+        bNow = bNow || m_uiPauseDepth > 0;
+    }
+
+    if (bNow) {
+        CEventThreadScope Scope(s_bInEventThread ? s_pEventThread : pThread);
+        fTask();
+    } else {
+        pThread->GetManager().Post(std::move(fTask));
+    }
+}
+
+void CZNC::RunExclusively(std::function<void()> fTask) {
+    if (s_bInEventThread) {
+        m_Manager.Post([this, fTask]() { RunExclusively(fTask); });
+        return;
+    }
+
+    CExclusiveScope Scope(*this);
+    fTask();
+    // The event threads' clients get it before anything else from them
+    CZNCSock::FlushWrites();
+}
+
+bool CZNC::MoveClientToUserThread(CClient* pClient, CUser& User) {
+    CEventThread* pThread = FindEventThread(&User);
+    if (!pThread || !m_bEventThreadsRunning || s_bInEventThread) {
+        return false;
+    }
+
+    // Lines which are read already wait for the new thread
+    pClient->PauseRead();
+    m_vMovingClients.emplace_back(pClient, &User);
+    return true;
+}
+
+void CZNC::ForgetMovingClient(CClient* pClient) {
+    if (s_bInEventThread) return;
+
+    m_vMovingClients.erase(
+        std::remove_if(m_vMovingClients.begin(), m_vMovingClients.end(),
+                       [=](const std::pair<CClient*, CUser*>& Moving) {
+                           return Moving.first == pClient;
+                       }),
+        m_vMovingClients.end());
+}
+
+void CZNC::MoveClients() {
+    for (const auto& Moving : m_vMovingClients) {
+        CClient* pClient = Moving.first;
+        CUser* pUser = Moving.second;
+        CSockManager* pManager = &FindEventThread(pUser)->GetManager();
+
+        pClient->FlushWrite();
+        // Csocket can only delete its sockets, so take it out by hand
+        m_Manager.erase(
+            std::remove(m_Manager.begin(), m_Manager.end(), pClient),
+            m_Manager.end());
+
+        pManager->Post([=]() {
+            pManager->AddSock(pClient, pClient->GetSockName());
+            pClient->AcceptLogin(*pUser);
+            pClient->UnPauseRead();
+        });
+    }
+    m_vMovingClients.clear();
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2004-2026 ZNC, see the NOTICE file for details.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the memory taken by buffered lines.
+//
+// Usage: bufferbench [lines]
+//
+// Fills a CBuffer with the given number of tagged PRIVMSG lines from a few
+// senders, like a busy channel, and reports the heap bytes per line from
+// mallinfo2(). For comparison, the same lines are also kept as a vector of
+// CMessage, which is what every buffered line used to hold.
+
+#include <znc/Buffer.h>
+#include <malloc.h>
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+static size_t HeapUsed() {
+#if defined(__GLIBC__) && \
+    (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    return mallinfo2().uordblks;
+#else
+    return 0;
+#endif
+}
+
+static CMessage MakeLine(unsigned int i) {
+    CMessage Line(":nick" + CString(i % 50) + "!ident@host" + CString(i % 50) +
+                  ".example.com PRIVMSG #channel :{text}");
+    Line.SetTag("msgid", "id" + CString(i));
+    Line.SetTag("account", "account" + CString(i % 50));
+    return Line;
+}
+
+static CString MakeText(unsigned int i) {
+    return "Line " + CString(i) + ", and some more words to make it longer";
+}
+
+int main(int argc, char** argv) {
+    unsigned int uLines = argc > 1 ? CString(argv[1]).ToUInt() : 10000;
+
+    size_t uBefore = HeapUsed();
+    if (uBefore == 0) {
+        std::cerr << "mallinfo2() is not available" << std::endl;
+        return 1;
+    }
+    CBuffer Buffer(uLines);
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < uLines; ++i) {
+        Buffer.AddLine(MakeLine(i), MakeText(i));
+    }
+    double fElapsed = std::chrono::duration<double>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+    size_t uBuffer = HeapUsed() - uBefore;
+
+    uBefore = HeapUsed();
+    std::vector<std::pair<CMessage, CString>> vMessages;
+    vMessages.reserve(uLines);
+    for (unsigned int i = 0; i < uLines; ++i) {
+        vMessages.emplace_back(MakeLine(i), MakeText(i));
+    }
+    size_t uMessages = HeapUsed() - uBefore;
+
+    std::cout << uLines << " lines: CBuffer " << uBuffer / uLines
+              << " bytes per line (sizeof(CBufLine) = " << sizeof(CBufLine)
+              << "), CMessage " << uMessages / uLines
+              << " bytes per line (sizeof(CMessage) = " << sizeof(CMessage)
+              << "), " << unsigned(uLines / fElapsed) << " lines/s added"
+              << std::endl;
+    return 0;
+}
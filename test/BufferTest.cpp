@@ -89,6 +89,139 @@ TEST_F(BufferTest, AddLine) {
     EXPECT_EQ(buffer.Size(), 0u);
 }
 
+TEST_F(BufferTest, Wraparound) {
+    CBuffer buffer(3);
+    for (int i = 1; i <= 5; ++i) {
+        buffer.AddLine(CMessage("PRIVMSG nick :msg" + CString(i)));
+    }
+    EXPECT_EQ(buffer.Size(), 3u);
+    EXPECT_EQ(buffer.GetBufLine(0).GetFormat(), "PRIVMSG nick :msg3");
+    EXPECT_EQ(buffer.GetBufLine(1).GetFormat(), "PRIVMSG nick :msg4");
+    EXPECT_EQ(buffer.GetBufLine(2).GetFormat(), "PRIVMSG nick :msg5");
+
+    EXPECT_EQ(buffer.UpdateLine("PRIVMSG", CMessage("PRIVMSG nick :new")),
+              3u);
+    EXPECT_EQ(buffer.GetBufLine(0).GetFormat(), "PRIVMSG nick :new");
+
+    // Growing keeps the order of old lines
+    EXPECT_TRUE(buffer.SetLineCount(4, true));
+    buffer.AddLine(CMessage("PRIVMSG nick :msg6"));
+    buffer.AddLine(CMessage("PRIVMSG nick :msg7"));
+    EXPECT_EQ(buffer.Size(), 4u);
+    EXPECT_EQ(buffer.GetBufLine(0).GetFormat(), "PRIVMSG nick :msg4");
+    EXPECT_EQ(buffer.GetBufLine(3).GetFormat(), "PRIVMSG nick :msg7");
+
+    EXPECT_TRUE(buffer.SetLineCount(2, true));
+    EXPECT_EQ(buffer.Size(), 2u);
+    EXPECT_EQ(buffer.GetBufLine(0).GetFormat(), "PRIVMSG nick :msg6");
+    EXPECT_EQ(buffer.GetBufLine(1).GetFormat(), "PRIVMSG nick :msg7");
+}
+
+TEST_F(BufferTest, MemoryUsage) {
+    CBuffer buffer(3);
+    EXPECT_EQ(buffer.GetMemoryUsage(), 0u);
+
+    // What's left over after the lines is the space of the ring itself
+    auto ExpectConsistent = [&]() {
+        size_t uLines = 0;
+        for (size_t i = 0; i < buffer.Size(); ++i) {
+            uLines += buffer.GetBufLine(i).GetMemoryUsage();
+        }
+        size_t uRing = buffer.GetMemoryUsage() - uLines;
+        EXPECT_EQ(uRing % sizeof(CBufLine), 0u);
+        EXPECT_GE(uRing, buffer.Size() * sizeof(CBufLine));
+    };
+
+    for (int i = 1; i <= 5; ++i) {
+        buffer.AddLine(CMessage("PRIVMSG nick :" + CString(10 * i, 'x')));
+        ExpectConsistent();
+    }
+    buffer.UpdateLine("PRIVMSG", CMessage("PRIVMSG nick :short"));
+    ExpectConsistent();
+    buffer.SetLineCount(1, true);
+    ExpectConsistent();
+
+    buffer.Clear();
+    EXPECT_EQ(buffer.GetMemoryUsage(), 0u);
+}
+
+TEST_F(BufferTest, Usage) {
+    CBuffer::SUsage Usage;
+    auto ExpectUsage = [&](std::initializer_list<const CBuffer*> lpBuffers) {
+        size_t uLines = 0, uMemory = 0;
+        for (const CBuffer* pBuffer : lpBuffers) {
+            uLines += pBuffer->Size();
+            uMemory += pBuffer->GetMemoryUsage();
+        }
+        EXPECT_EQ(Usage.uLines, uLines);
+        EXPECT_EQ(Usage.uMemory, uMemory);
+    };
+
+    CBuffer buffer1(3);
+    buffer1.AddLine(CMessage("PRIVMSG nick :before"));
+    buffer1.SetUsage(&Usage);
+    ExpectUsage({&buffer1});
+    {
+        CBuffer buffer2(3);
+        buffer2.SetUsage(&Usage);
+        for (int i = 1; i <= 5; ++i) {
+            buffer1.AddLine(CMessage("PRIVMSG nick :" + CString(i, 'x')));
+            buffer2.AddLine(CMessage("PRIVMSG nick :" + CString(i, 'y')));
+            ExpectUsage({&buffer1, &buffer2});
+        }
+        buffer2.UpdateLine("PRIVMSG", CMessage("PRIVMSG nick :short"));
+        ExpectUsage({&buffer1, &buffer2});
+        buffer2.SetLineCount(1, true);
+        ExpectUsage({&buffer1, &buffer2});
+
+        // Copies aren't counted
+        CBuffer copy(buffer2);
+        ExpectUsage({&buffer1, &buffer2});
+        copy = buffer1;
+        ExpectUsage({&buffer1, &buffer2});
+        buffer2 = copy;
+        ExpectUsage({&buffer1, &buffer2});
+    }
+    ExpectUsage({&buffer1});
+
+    // Moving the lines out leaves the buffer empty
+    CBuffer moved(std::move(buffer1));
+    EXPECT_EQ(Usage.uLines, 0u);
+    EXPECT_EQ(Usage.uMemory, 0u);
+    buffer1 = std::move(moved);
+    ExpectUsage({&buffer1});
+    EXPECT_EQ(Usage.uLines, 3u);
+
+    buffer1.Clear();
+    EXPECT_EQ(Usage.uLines, 0u);
+    EXPECT_EQ(Usage.uMemory, 0u);
+
+    buffer1.AddLine(CMessage("PRIVMSG nick :after"));
+    buffer1.SetUsage(nullptr);
+    EXPECT_EQ(Usage.uLines, 0u);
+    EXPECT_EQ(Usage.uMemory, 0u);
+}
+
+TEST_F(BufferTest, PackedLine) {
+    CMessage msg(R"(@a=b\sc;d :nick!ident@host PRIVMSG #chan word)");
+    msg.SetTime({1234, 5678});
+    CBufLine line(msg, "text");
+    EXPECT_THAT(line.GetTags(),
+                ContainerEq(MCString{{"a", "b c"}, {"d", ""}}));
+    EXPECT_EQ(line.GetFormat(), ":nick!ident@host PRIVMSG #chan word");
+    EXPECT_EQ(line.GetText(), "text");
+    EXPECT_EQ(line.GetTime().tv_sec, 1234);
+    EXPECT_EQ(line.GetTime().tv_usec, 5678);
+    EXPECT_TRUE(line.Equals(CMessage(":nick PRIVMSG #chan :word")));
+    EXPECT_FALSE(line.Equals(CMessage(":nick PRIVMSG #chan :other")));
+
+    // The colon is retained
+    line.SetFormat(":nick PRIVMSG #chan :word");
+    EXPECT_EQ(line.GetFormat(), ":nick PRIVMSG #chan :word");
+    EXPECT_THAT(line.GetTags(),
+                ContainerEq(MCString{{"a", "b c"}, {"d", ""}}));
+}
+
 TEST_F(BufferTest, UpdateLine) {
     // clang-format off
     CBuffer buffer(50);
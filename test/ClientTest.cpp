@@ -171,6 +171,69 @@ TEST_F(ClientTest, UserhostInNames) {  // aka UHNAMES
                 ElementsAre(msg.ToString(), extmsg.ToString()));
 }
 
+TEST_F(ClientTest, PutUserSharedFormat) {
+    m_pTestSock->ReadLine(
+        ":server 005 guest UHNAMES :are supported by this server");
+    TestClient Same, Other, Skipped;
+    Same.AcceptLogin(*m_pTestUser);
+    Other.AcceptLogin(*m_pTestUser);
+    Skipped.AcceptLogin(*m_pTestUser);
+    Other.SetUHNames(true);
+    m_pTestClient->Reset();
+    Same.Reset();
+    Other.Reset();
+    Skipped.Reset();
+    m_pTestModule->Reset();
+
+    CMessage msg(":irc.bnc.im 353 guest = #atheme :Rylee somasonic");
+    CMessage extmsg(
+        ":irc.bnc.im 353 guest = #atheme :Rylee!rylai@localhost "
+        "somasonic!andrew@somasonic.org");
+    EXPECT_TRUE(m_pTestClient->HasSameMessageFormat(Same));
+    EXPECT_FALSE(m_pTestClient->HasSameMessageFormat(Other));
+
+    // Modules still see every client separately
+    m_pTestModule->bSendHooks = true;
+    m_pTestNetwork->PutUser(extmsg, nullptr, &Skipped);
+    m_pTestModule->bSendHooks = false;
+
+    EXPECT_THAT(m_pTestModule->vClients,
+                ElementsAre(m_pTestClient, &Same, &Other));
+    EXPECT_THAT(m_pTestClient->vsLines, ElementsAre(msg.ToString()));
+    EXPECT_THAT(Same.vsLines, ElementsAre(msg.ToString()));
+    EXPECT_THAT(Other.vsLines, ElementsAre(extmsg.ToString()));
+    EXPECT_THAT(Skipped.vsLines, IsEmpty());
+
+    // A module changing the message for one client doesn't affect the other
+    class ChangingModule : public CModule {
+      public:
+        ChangingModule()
+            : CModule(nullptr, nullptr, nullptr, "changing", "",
+                      CModInfo::NetworkModule) {}
+        EModRet OnSendToClientMessage(CMessage& msg) override {
+            if (msg.GetClient() == pClient) msg.SetParam(1, "changed");
+            return CONTINUE;
+        }
+        CClient* pClient = nullptr;
+    } Module;
+    Module.pClient = &Same;
+    CZNC::Get().GetModules().push_back(&Module);
+    m_pTestClient->Reset();
+    Same.Reset();
+    m_pTestNetwork->PutUser(CMessage(":nick!user@host PRIVMSG #chan :text"),
+                            nullptr, &Skipped);
+    CZNC::Get().GetModules().pop_back();
+
+    EXPECT_THAT(m_pTestClient->vsLines,
+                ElementsAre(":nick!user@host PRIVMSG #chan :text"));
+    EXPECT_THAT(Same.vsLines,
+                ElementsAre(":nick!user@host PRIVMSG #chan :changed"));
+
+    m_pTestNetwork->ClientDisconnected(&Same);
+    m_pTestNetwork->ClientDisconnected(&Other);
+    m_pTestNetwork->ClientDisconnected(&Skipped);
+}
+
 TEST_F(ClientTest, StatusMsg) {
     m_pTestSock->ReadLine(
         ":irc.znc.in 001 me :Welcome to the Internet Relay Network me");
@@ -390,3 +453,148 @@ TEST_F(ClientTest, OnSendToClientMessage) {
     EXPECT_THAT(m_pTestSock->vsLines, ElementsAre(msg.ToString()));
     m_pTestModule->bSendHooks = false;
 }
+
+TEST_F(ClientTest, BufferPlaybackIsIncremental) {
+    const unsigned int uLines = 1200;
+    m_pTestUser->SetTimestampPrepend(false);
+    m_pTestChan->SetBufferCount(uLines, true);
+    for (unsigned int i = 0; i < uLines; ++i) {
+        m_pTestChan->AddBuffer(":nick PRIVMSG #chan :{text}",
+                               "line " + CString(i));
+    }
+
+    m_pTestChan->SendBuffer(m_pTestClient);
+    EXPECT_TRUE(m_pTestClient->IsPlaybackQueued());
+    EXPECT_GT(m_pTestClient->vsLines.size(), 0u);
+    EXPECT_LT(m_pTestClient->vsLines.size(), uLines);
+    // The buffer was cleared, but the playback goes on
+    EXPECT_TRUE(m_pTestChan->GetBuffer().IsEmpty());
+
+    // Everything else waits for the playback
+    m_pTestClient->PutClient(":nick PRIVMSG #chan :live");
+    m_pTestClient->PutStatus("status");
+
+    timeval tv = {0, 0};
+    for (int i = 0; i < 10 && m_pTestClient->IsPlaybackQueued(); ++i) {
+        m_pTestClient->GetCrons().back()->run(tv);
+    }
+    EXPECT_FALSE(m_pTestClient->IsPlaybackQueued());
+
+    const VCString& vsLines = m_pTestClient->vsLines;
+    ASSERT_EQ(vsLines.size(), uLines + 3);
+    EXPECT_EQ(vsLines[0], ":***!znc@znc.in PRIVMSG #chan :Buffer Playback...");
+    for (unsigned int i = 0; i < uLines; ++i) {
+        EXPECT_EQ(vsLines[i + 1], ":nick PRIVMSG #chan :line " + CString(i));
+    }
+    EXPECT_EQ(vsLines[uLines + 1],
+              ":***!znc@znc.in PRIVMSG #chan :Playback Complete.");
+    // The queued lines are written at once
+    EXPECT_EQ(vsLines[uLines + 2],
+              ":nick PRIVMSG #chan :live\r\n"
+              ":*status!status@znc.in PRIVMSG me :status");
+
+    m_pTestClient->Reset();
+    m_pTestClient->PutClient(":nick PRIVMSG #chan :direct");
+    EXPECT_THAT(m_pTestClient->vsLines,
+                ElementsAre(":nick PRIVMSG #chan :direct"));
+}
+
+TEST_F(ClientTest, CancelledBufferPlayback) {
+    const unsigned int uLines = 1200;
+    m_pTestChan->SetBufferCount(uLines, true);
+    for (unsigned int i = 0; i < uLines; ++i) {
+        m_pTestChan->AddBuffer(":nick PRIVMSG #chan :{text}",
+                               "line " + CString(i));
+    }
+
+    m_pTestClient->SetBatch(true);
+    m_pTestModule->bPlaybackHooks = true;
+    m_pTestChan->SendBuffer(m_pTestClient);
+    ASSERT_TRUE(m_pTestClient->IsPlaybackQueued());
+    EXPECT_THAT(m_pTestModule->vsHooks, ElementsAre("OnChanBufferStarting"));
+
+    m_pTestClient->Reset();
+    m_pTestClient->SetNetwork(nullptr, false, false);
+    EXPECT_FALSE(m_pTestClient->IsPlaybackQueued());
+    // Modules still see the end of the playback, and so does the client
+    EXPECT_THAT(m_pTestModule->vsHooks,
+                ElementsAre("OnChanBufferStarting", "OnChanBufferEnding"));
+    ASSERT_GT(m_pTestClient->vsLines.size(), 0u);
+    EXPECT_EQ(m_pTestClient->vsLines[0],
+              ":znc.in BATCH -" + CString("#chan").MD5());
+    m_pTestModule->bPlaybackHooks = false;
+}
+
+TEST_F(ClientTest, BufferRenderCache) {
+    TestClient Same, Other;
+    Same.AcceptLogin(*m_pTestUser);
+    Other.AcceptLogin(*m_pTestUser);
+    Other.SetServerTime(true);
+
+    CBuffer Buffer(10);
+    Buffer.AddLine(CMessage(":nick PRIVMSG #chan :{text}"), "text");
+
+    const CMessage* pMessage = &Buffer.ToMessage(0, *m_pTestClient);
+    EXPECT_EQ(&Buffer.ToMessage(0, Same), pMessage);
+    // Copies share the rendered lines
+    CBuffer Copy(Buffer);
+    EXPECT_EQ(&Copy.ToMessage(0, Same), pMessage);
+
+    // Different kinds of clients don't push each other out
+    const CMessage* pOther = &Buffer.ToMessage(0, Other);
+    EXPECT_EQ(pOther->GetParam(1), "text");
+    EXPECT_NE(pOther, pMessage);
+    EXPECT_EQ(&Buffer.ToMessage(0, Same), pMessage);
+    EXPECT_EQ(&Buffer.ToMessage(0, Other), pOther);
+    EXPECT_NE(Buffer.ToMessage(0, Same).GetParam(1), "text");
+    const MCString msParams1 = {{"param", "1"}}, msParams2 = {{"param", "2"}};
+    const CMessage* pParams1 = &Buffer.ToMessage(0, Same, msParams1);
+    const CMessage* pParams2 = &Buffer.ToMessage(0, Same, msParams2);
+    EXPECT_EQ(&Buffer.ToMessage(0, Same), pMessage);
+    EXPECT_EQ(&Buffer.ToMessage(0, Other), pOther);
+    EXPECT_EQ(&Buffer.ToMessage(0, Same, msParams1), pParams1);
+    EXPECT_EQ(&Buffer.ToMessage(0, Same, msParams2), pParams2);
+
+    // Changing the user's settings changes the rendered lines
+    m_pTestUser->SetTimestampPrepend(false);
+    EXPECT_EQ(Buffer.ToMessage(0, Same).GetParam(1), "text");
+
+    Buffer.AddLine(CMessage(":nick PRIVMSG #chan :{text}"), "more");
+    EXPECT_EQ(Buffer.ToMessage(1, Same).GetParam(1), "more");
+
+    // Snapshots are shared until the buffer changes, and render on their own
+    std::shared_ptr<const CBuffer> spSnapshot = Buffer.GetSnapshot();
+    EXPECT_EQ(Buffer.GetSnapshot(), spSnapshot);
+    const CString sProfile = CBuffer::GetRenderProfile(Same);
+    pMessage = &spSnapshot->ToMessage(1, Same, MCString::EmptyMap, sProfile);
+    EXPECT_EQ(pMessage->GetParam(1), "more");
+    EXPECT_NE(&Buffer.ToMessage(1, Same), pMessage);
+    Buffer.AddLine(CMessage(":nick PRIVMSG #chan :{text}"), "new");
+    EXPECT_NE(Buffer.GetSnapshot(), spSnapshot);
+    EXPECT_EQ(spSnapshot->Size(), 2u);
+
+    m_pTestNetwork->ClientDisconnected(&Same);
+    m_pTestNetwork->ClientDisconnected(&Other);
+}
+
+TEST_F(ClientTest, CoalescedWrites) {
+    CClient Client;
+    EXPECT_TRUE(Client.GetCoalesceWrites());
+
+    Client.Write("PING :1\r\n");
+    Client.Write("PING :2\r\n");
+    // Nothing is sent until the main loop iteration is done
+    EXPECT_EQ(Client.GetBytesWritten(), 0u);
+    EXPECT_EQ(Client.GetPendingWriteSize(), 18u);
+
+    CZNCSock::FlushWrites();
+    EXPECT_EQ(Client.GetBytesWritten(), 18u);
+    EXPECT_EQ(Client.GetPendingWriteSize(), 0u);
+
+    // Turning it off sends what was collected so far
+    Client.Write("PING :3\r\n");
+    Client.SetCoalesceWrites(false);
+    EXPECT_EQ(Client.GetBytesWritten(), 27u);
+    Client.Write("PING :4\r\n");
+    EXPECT_EQ(Client.GetBytesWritten(), 36u);
+}
@@ -167,3 +167,22 @@ TEST_F(CConfigErrorTest, Comment3) {
 }
 TEST_F(CConfigSuccessTest, Comment4) { TEST_SUCCESS("/* Foo\n/* Bar */", ""); }
 TEST_F(CConfigSuccessTest, Comment5) { TEST_SUCCESS("/* Foo\n// */", ""); }
+
+TEST_F(CConfigTest, WriteToString) {
+    CFile& File = WriteFile("Foo = bar\n<a b>\nBaz = 1\nBaz = 2\n</a>\n");
+    CConfig conf;
+    CString sError;
+    ASSERT_TRUE(conf.Parse(File, sError)) << sError;
+
+    CString sExpected = "foo = bar\n\n<a b>\n\tbaz = 1\n\tbaz = 2\n</a>\n";
+    EXPECT_EQ(conf.ToString(), sExpected);
+
+    // Write() produces the same
+    File.Seek(0);
+    File.Truncate();
+    conf.Write(File);
+    CString sWritten;
+    File.Seek(0);
+    File.ReadFile(sWritten);
+    EXPECT_EQ(sWritten, sExpected);
+}
@@ -18,8 +18,10 @@
 #include <gtest/gtest.h>
 #include <znc/HTTPSock.h>
 #include <znc/znc.h>
+#include <sys/socket.h>
 
 using ::testing::Contains;
+using ::testing::HasSubstr;
 using ::testing::Not;
 using ::testing::StartsWith;
 
@@ -65,6 +67,20 @@ class CCapturingHTTPSock : public CHTTPSock {
         return true;
     }
 
+    void SetRequest(const CString& sIfNoneMatch, bool bAcceptGzip) {
+        m_sIfNoneMatch = sIfNoneMatch;
+        m_bAcceptGzip = bAcceptGzip;
+    }
+
+    CString GetHeader(const CString& sName) const {
+        for (const CString& sLine : m_vsLines) {
+            if (sLine.StartsWith(sName + ": ")) {
+                return sLine.Token(1, true, ": ").TrimRight_n("\r\n");
+            }
+        }
+        return "";
+    }
+
     VCString m_vsLines;
 };
 
@@ -150,3 +166,97 @@ TEST_F(HTTPSockHeadersTest, HardeningHeadersOmittedByCaller) {
     EXPECT_THAT(sock.m_vsLines, Contains(StartsWith("X-Content-Type-Options: nosniff")));
     EXPECT_THAT(sock.m_vsLines, Contains(CString("Referrer-Policy: no-referrer\r\n")));
 }
+
+TEST_F(HTTPSockHeadersTest, PrintFileCached) {
+    char sName[] = "./temp-XXXXXX.css";
+    int fd = mkstemps(sName, 4);
+    close(fd);
+    CString sContent;
+    for (int i = 0; i < 100; ++i) {
+        sContent += "body { color: black; }\n";
+    }
+    CFile File(sName);
+    ASSERT_TRUE(File.Open(O_WRONLY | O_TRUNC));
+    File.Write(sContent);
+    File.Close();
+
+    CCapturingHTTPSock sock1;
+    EXPECT_TRUE(sock1.PrintFile(sName));
+    EXPECT_EQ(sock1.m_vsLines.back(), sContent);
+    EXPECT_EQ(sock1.GetHeader("Content-Length"), CString(sContent.size()));
+    CString sETag = sock1.GetHeader("ETag");
+    EXPECT_EQ(sETag.size(), 34u);
+
+    // The ETag is derived from the content, not from the mtime
+    CCapturingHTTPSock sock2;
+    sock2.SetRequest("W/\"foo\", " + sETag, false);
+    EXPECT_TRUE(sock2.PrintFile(sName));
+    EXPECT_THAT(sock2.m_vsLines[0], HasSubstr("304"));
+
+    CCapturingHTTPSock sock3;
+    sock3.SetRequest(sETag, true);
+    EXPECT_TRUE(sock3.PrintFile(sName));
+    EXPECT_THAT(sock3.m_vsLines[0], HasSubstr("200"));
+    EXPECT_EQ(sock3.GetHeader("Content-Encoding"), "gzip");
+    EXPECT_EQ(sock3.GetHeader("ETag"), sETag.TrimSuffix_n("\"") + "-gzip\"");
+    EXPECT_LT(sock3.m_vsLines.back().size(), sContent.size());
+
+    ASSERT_TRUE(File.Open(O_WRONLY | O_TRUNC));
+    File.Write("p {}\n");
+    File.Close();
+
+    CCapturingHTTPSock sock4;
+    sock4.SetRequest(sETag, false);
+    EXPECT_TRUE(sock4.PrintFile(sName));
+    EXPECT_EQ(sock4.m_vsLines.back(), "p {}\n");
+    EXPECT_NE(sock4.GetHeader("ETag"), sETag);
+
+    CFile::Delete(sName);
+}
+
+#ifdef __linux__
+TEST_F(HTTPSockHeadersTest, PrintFileSendfile) {
+    char sName[] = "./temp-XXXXXX.png";
+    int fd = mkstemps(sName, 4);
+    close(fd);
+    // Too big for the cache of PrintFile()
+    CString sContent;
+    for (int i = 0; i < 3 * 1024 * 1024; ++i) {
+        sContent += char('a' + i % 26);
+    }
+    CFile File(sName);
+    ASSERT_TRUE(File.Open(O_WRONLY | O_TRUNC));
+    File.Write(sContent);
+    File.Close();
+
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+
+    CCapturingHTTPSock sock;
+    sock.SetRSock(fds[0]);
+    sock.SetWSock(fds[0]);
+    sock.SetIsConnected(true);
+    EXPECT_TRUE(sock.PrintFile(sName));
+    EXPECT_EQ(sock.GetHeader("Content-Length"), CString(sContent.size()));
+
+    // What doesn't fit into the socket buffer goes the usual way
+    CString sReceived;
+    char szBuf[4096];
+    ssize_t iLen;
+    while ((iLen = recv(fds[1], szBuf, sizeof(szBuf), MSG_DONTWAIT)) > 0) {
+        sReceived.append(szBuf, iLen);
+    }
+    EXPECT_GT(sReceived.size(), 0u);
+    EXPECT_EQ(sock.GetFileBytesWritten(), sReceived.size());
+    EXPECT_EQ(sock.GetFileBytesWritten() + sock.GetBytesWritten(),
+              sContent.size());
+    EXPECT_EQ(sReceived, sContent.substr(0, sReceived.size()));
+
+    sock.SetRSock(-1);
+    sock.SetWSock(-1);
+    close(fds[0]);
+    close(fds[1]);
+    CFile::Delete(sName);
+}
+#endif
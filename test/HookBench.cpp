@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2004-2026 ZNC, see the NOTICE file for details.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the cost of calling hooks which most modules don't override.
+//
+// Usage: hookbench [modules] [calls]
+//
+// Loads the given number of modules, of which only one overrides
+// OnRawMessage and OnPrivTextMessage, and calls both hooks. This is done once
+// with every module called for every hook, like before CModules looked at
+// which hooks are overridden, and once with the default behaviour.
+
+#include <znc/Modules.h>
+#include <znc/znc.h>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+class CBenchModule : public CModule {
+  public:
+    CBenchModule(const CString& sName)
+        : CModule(nullptr, nullptr, nullptr, sName, "",
+                  CModInfo::NetworkModule) {}
+};
+
+class CHandlingModule : public CBenchModule {
+  public:
+    using CBenchModule::CBenchModule;
+
+    EModRet OnRawMessage(CMessage& Message) override {
+        ++uCalls;
+        return CONTINUE;
+    }
+
+    EModRet OnPrivTextMessage(CTextMessage& Message) override {
+        ++uCalls;
+        return CONTINUE;
+    }
+
+    unsigned long uCalls = 0;
+};
+
+static double Run(CModules& Modules, unsigned int uCalls) {
+    CMessage Raw(":nick!ident@host PRIVMSG me :hello");
+    CTextMessage Text;
+    Text.Parse(":nick!ident@host PRIVMSG me :hello");
+
+    auto Start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < uCalls; ++i) {
+        Modules.OnRawMessage(Raw);
+        Modules.OnPrivTextMessage(Text);
+    }
+    std::chrono::duration<double> Time =
+        std::chrono::steady_clock::now() - Start;
+    return Time.count();
+}
+
+int main(int argc, char** argv) {
+    unsigned int uModules = argc > 1 ? CString(argv[1]).ToUInt() : 20;
+    unsigned int uCalls = argc > 2 ? CString(argv[2]).ToUInt() : 1000000;
+
+    CZNC::CreateInstance();
+    {
+        CModules& Modules = CZNC::Get().GetModules();
+        std::vector<std::unique_ptr<CBenchModule>> vpModules;
+        CHandlingModule Handler("handler");
+        Modules.push_back(&Handler);
+        for (unsigned int i = 1; i < uModules; ++i) {
+            vpModules.emplace_back(new CBenchModule("mod" + CString(i)));
+            Modules.push_back(vpModules.back().get());
+        }
+
+        for (CModule* pMod : Modules) pMod->SetSkipUnusedHooks(false);
+        Modules.ClearHookLists();
+        double fAll = Run(Modules, uCalls);
+
+        for (CModule* pMod : Modules) pMod->SetSkipUnusedHooks(true);
+        Modules.ClearHookLists();
+        double fSkip = Run(Modules, uCalls);
+
+        std::cout << uModules << " modules, " << uCalls << " calls of 2 hooks"
+                  << std::endl;
+        std::cout << "all modules:     " << fAll << " s" << std::endl;
+        std::cout << "overriding only: " << fSkip << " s" << std::endl;
+        if (Handler.uCalls != 4ul * uCalls) {
+            std::cerr << "The overriding module missed calls" << std::endl;
+            return 1;
+        }
+        Modules.clear();
+    }
+    CZNC::DestroyInstance();
+    return 0;
+}
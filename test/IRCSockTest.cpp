@@ -348,6 +348,26 @@ TEST_F(IRCSockTest, StatusModes) {
     EXPECT_FALSE(pNick.HasPerm('@'));
 }
 
+TEST_F(IRCSockTest, GetNicks) {
+    m_pTestChan->AddNicks("bob @alice");
+
+    // Still a sorted std::map for modules
+    const std::map<CString, CNick>& msNicks = m_pTestChan->GetNicks();
+    VCString vsNicks;
+    for (const std::pair<const CString, CNick>& it : msNicks) {
+        vsNicks.push_back(it.first);
+    }
+    EXPECT_THAT(vsNicks, ElementsAre("alice", "bob", "nick"));
+    EXPECT_TRUE(msNicks.at("alice").HasPerm('@'));
+
+    // The copy follows changes
+    m_pTestChan->FindNick("alice")->RemPerm('@');
+    EXPECT_FALSE(m_pTestChan->GetNicks().at("alice").HasPerm('@'));
+    m_pTestChan->RemNick("bob");
+    EXPECT_EQ(m_pTestChan->GetNicks().size(), 2u);
+    EXPECT_EQ(m_pTestChan->GetNickMap().size(), 2u);
+}
+
 TEST_F(IRCSockTest, OnPingMessage) {
     CMessage msg(":server PING :arg");
     m_pTestSock->ReadLine(msg.ToString());
@@ -595,4 +615,80 @@ TEST_F(IRCSockTest, PartingFlagOnError) {
 
     // Verify channel was deleted
     EXPECT_NE(m_pTestNetwork->FindChan("#chan"), nullptr);
-}
\ No newline at end of file
+}
+
+TEST_F(IRCSockTest, SendQueuePriority) {
+    // Use up the flood burst
+    while (m_pTestSock->GetSendQueueSize() == 0) {
+        m_pTestSock->PutIRC(CMessage("PRIVMSG #chan :burst"));
+    }
+    m_pTestSock->Reset();
+
+    m_pTestClient->ReadLine("PRIVMSG #chan :typed");
+    m_pTestSock->PutIRCQuick("PONG :irc.znc.in");
+    EXPECT_THAT(m_pTestSock->vsLines, IsEmpty());
+    EXPECT_EQ(m_pTestSock->GetSendQueueSize(), 3u);
+    EXPECT_EQ(m_pTestSock->GetSendQueueSize(CIRCSock::PriorityKeepalive), 1u);
+    EXPECT_EQ(
+        m_pTestSock->GetSendQueueSize(CIRCSock::PriorityInteractive), 1u);
+    EXPECT_EQ(m_pTestSock->GetSendQueueSize(CIRCSock::PriorityBulk), 1u);
+
+    // The timer only exists while something is queued
+    ASSERT_FALSE(m_pTestSock->GetCrons().empty());
+    CCron* pTimer = m_pTestSock->GetCrons().back();
+    EXPECT_EQ(pTimer->GetName(), "CIRCFloodTimer");
+
+    // The default flood rate is one line every 2 seconds
+    m_pTestSock->PassFloodTime(4000);
+    timeval tv = {0, 0};
+    pTimer->run(tv);
+    EXPECT_THAT(m_pTestSock->vsLines,
+                ElementsAre("PONG :irc.znc.in", "PRIVMSG #chan :typed"));
+    EXPECT_EQ(m_pTestSock->GetSendQueueSize(), 1u);
+
+    m_pTestSock->PassFloodTime(2000);
+    m_pTestSock->GetCrons().back()->run(tv);
+    EXPECT_EQ(m_pTestSock->vsLines.back(), "PRIVMSG #chan :burst");
+    EXPECT_EQ(m_pTestSock->GetSendQueueSize(), 0u);
+
+    const CIRCSock::SSendQueueStats& Stats =
+        m_pTestSock->GetSendQueueStats(CIRCSock::PriorityKeepalive);
+    EXPECT_EQ(Stats.uSent, 1u);
+    EXPECT_EQ(Stats.uDelayed, 1u);
+    EXPECT_EQ(
+        m_pTestSock->GetSendQueueStats(CIRCSock::PriorityInteractive).uSent,
+        1u);
+}
+
+TEST_F(IRCSockTest, SendQueueBytes) {
+    delete m_pTestSock;
+    m_pTestNetwork->SetFloodRate(-1);
+    m_pTestNetwork->SetFloodRecvQ(100);
+    m_pTestNetwork->SetFloodByteRate(50);
+    m_pTestSock = new TestIRCSock(m_pTestNetwork);
+
+    // 50 bytes with CR LF
+    const CString sLine = "PRIVMSG #chan :" + CString(33, 'x');
+    for (int i = 0; i < 3; ++i) {
+        m_pTestSock->PutIRC(CMessage(sLine));
+    }
+    EXPECT_EQ(m_pTestSock->vsLines.size(), 2u);
+    EXPECT_EQ(m_pTestSock->GetSendQueueSize(), 1u);
+
+    // The server has processed 50 bytes by now
+    m_pTestSock->PassFloodTime(1000);
+    timeval tv = {0, 0};
+    m_pTestSock->GetCrons().back()->run(tv);
+    EXPECT_EQ(m_pTestSock->vsLines.size(), 3u);
+    EXPECT_EQ(m_pTestSock->GetSendQueueSize(), 0u);
+
+    // Lines longer than the whole RecvQ wait until it's empty
+    m_pTestSock->PutIRC(CMessage("PRIVMSG #chan :" + CString(200, 'x')));
+    EXPECT_EQ(m_pTestSock->vsLines.size(), 3u);
+    m_pTestSock->PassFloodTime(1000);
+    m_pTestSock->GetCrons().back()->run(tv);
+    EXPECT_EQ(m_pTestSock->vsLines.size(), 3u);
+    m_pTestSock->PassFloodTime(1000);
+    m_pTestSock->GetCrons().back()->run(tv);
+    EXPECT_EQ(m_pTestSock->vsLines.size(), 4u);
+}
@@ -37,9 +37,11 @@ class TestClient : public CClient {
     void Reset() { vsLines.clear(); }
     void SetAccountNotify(bool bEnabled) { m_bAccountNotify = bEnabled; }
     void SetAwayNotify(bool bEnabled) { m_bAwayNotify = bEnabled; }
+    void SetServerTime(bool bEnabled) { m_bServerTime = bEnabled; }
     void SetExtendedJoin(bool bEnabled) { m_bExtendedJoin = bEnabled; }
     void SetNamesx(bool bEnabled) { m_bNamesx = bEnabled; }
     void SetUHNames(bool bEnabled) { m_bUHNames = bEnabled; }
+    void SetBatch(bool bEnabled) { m_bBatch = bEnabled; }
     VCString vsLines;
 };
 
@@ -53,6 +55,10 @@ class TestIRCSock : public CIRCSock {
         return true;
     }
     void Reset() { vsLines.clear(); }
+    /// Pretends that flood protection last counted its tokens earlier.
+    void PassFloodTime(unsigned long long uMillis) {
+        m_uFloodRefilled -= uMillis;
+    }
     VCString vsLines;
 };
 
@@ -176,6 +182,15 @@ class TestModule : public CModule {
         return OnMessage(msg);
     }
 
+    EModRet OnChanBufferStarting(CChan& Chan, CClient& Client) override {
+        if (bPlaybackHooks) vsHooks.push_back("OnChanBufferStarting");
+        return CONTINUE;
+    }
+    EModRet OnChanBufferEnding(CChan& Chan, CClient& Client) override {
+        if (bPlaybackHooks) vsHooks.push_back("OnChanBufferEnding");
+        return CONTINUE;
+    }
+
     EModRet OnMessage(const CMessage& msg) {
         vsMessages.push_back(msg.ToString());
         vNetworks.push_back(msg.GetNetwork());
@@ -199,6 +214,7 @@ class TestModule : public CModule {
     std::vector<CChan*> vChannels;
     EModRet eAction = CONTINUE;
     bool bSendHooks = false;
+    bool bPlaybackHooks = false;
 };
 
 class IRCTest : public ::testing::Test {
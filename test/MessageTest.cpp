@@ -239,6 +239,39 @@ TEST(MessageTest, Tags) {
     EXPECT_EQ(msg.ToString(), R"(@a=\:\s\\\r\n :rest)");
 }
 
+TEST(MessageTest, TagViews) {
+    // Serialized without unescaping, but like from GetTags()
+    const CString sLine = R"(@c=1;b=x\sy;a;b=2;d= :nick PRIVMSG #chan :hi)";
+    CMessage Msg(sLine);
+    EXPECT_TRUE(Msg.HasTag("a"));
+    EXPECT_FALSE(Msg.HasTag("e"));
+    EXPECT_EQ(Msg.ToString(), R"(@a;b=2;c=1;d :nick PRIVMSG #chan :hi)");
+    CMessage Copy(sLine);
+    Copy.GetTags();
+    EXPECT_EQ(Copy.ToString(), Msg.ToString());
+
+    Msg.FilterTags([](const CString& sKey) { return sKey != "b"; });
+    EXPECT_FALSE(Msg.HasTag("b"));
+    EXPECT_EQ(Msg.ToString(), "@a;c=1;d :nick PRIVMSG #chan :hi");
+    Msg.FilterTags([](const CString& sKey) { return false; });
+    EXPECT_EQ(Msg.ToString(), ":nick PRIVMSG #chan :hi");
+
+    Copy.FilterTags([](const CString& sKey) { return sKey == "b"; });
+    EXPECT_EQ(Copy.ToString(), "@b=2 :nick PRIVMSG #chan :hi");
+}
+
+TEST(MessageTest, TagViewsNonCanonicalEscapes) {
+    // Escapes which Escape() wouldn't produce come out the same as after
+    // GetTags()
+    const CString sLine = R"(@a=x\qy;b=\:\s\\;c=\z :nick PRIVMSG #chan :hi)";
+    CMessage Msg(sLine);
+    CMessage Copy(sLine);
+    Copy.GetTags();
+    EXPECT_EQ(Msg.ToString(), Copy.ToString());
+    EXPECT_EQ(Msg.ToString(),
+              R"(@a=xqy;b=\:\s\\;c=z :nick PRIVMSG #chan :hi)");
+}
+
 TEST(MessageTest, FormatFlags) {
     const CString line = "@foo=bar :irc.example.com COMMAND param";
 
@@ -251,6 +284,27 @@ TEST(MessageTest, FormatFlags) {
               "COMMAND param");
 }
 
+TEST(MessageTest, Identical) {
+    CMessage msg("@a=b :nick!ident@host PRIVMSG #chan :hi there");
+    CMessage copy(msg);
+    EXPECT_TRUE(copy.Identical(msg));
+    EXPECT_TRUE(CMessage(msg.ToString()).Identical(msg));
+
+    copy.SetTag("a", "c");
+    EXPECT_FALSE(copy.Identical(msg));
+
+    copy = msg;
+    copy.GetNick().SetIdent("other");
+    EXPECT_FALSE(copy.Identical(msg));
+
+    // Equal, but serialized differently
+    EXPECT_TRUE(
+        CMessage(":Nick JOIN #chan").Equals(CMessage(":nick JOIN #chan")));
+    EXPECT_FALSE(
+        CMessage(":Nick JOIN #chan").Identical(CMessage(":nick JOIN #chan")));
+    EXPECT_FALSE(CMessage("JOIN :#chan").Identical(CMessage("JOIN #chan")));
+}
+
 TEST(MessageTest, Equals) {
     EXPECT_TRUE(CMessage("JOIN #chan").Equals(CMessage("JOIN #chan")));
     EXPECT_FALSE(CMessage("JOIN #chan").Equals(CMessage("JOIN #znc")));
@@ -558,6 +612,34 @@ TEST(MessageTest, Parse) {
     EXPECT_EQ(msg.GetParam(0), ":)");
 }
 
+TEST(MessageTest, SharedLine) {
+    CMessage msg("@a=b\\sc;a=d :nick!ident@host PRIVMSG #chan :hello world");
+    CMessage copy = msg;
+
+    // Read-only access shouldn't need to copy the whole message out
+    EXPECT_EQ(msg.GetTag("a"), "d");
+    EXPECT_EQ(msg.GetParam(1), "hello world");
+    EXPECT_EQ(msg.GetParamsColon(0), "#chan :hello world");
+
+    msg.SetParam(1, "bye");
+    msg.SetTag("x", "y");
+    msg.GetNick().SetNick("other");
+    EXPECT_EQ(msg.ToString(), "@a=d;x=y :other!ident@host PRIVMSG #chan :bye");
+
+    // The copy is not affected by modifications of the original
+    EXPECT_EQ(copy.ToString(),
+              "@a=d :nick!ident@host PRIVMSG #chan :hello world");
+    EXPECT_THAT(copy.GetParams(), ElementsAre("#chan", "hello world"));
+    EXPECT_TRUE(copy.Equals(CMessage(":nick PRIVMSG #chan :hello world")));
+    EXPECT_FALSE(copy.Equals(msg));
+
+    copy.Parse("@c=\\\\\\s :foo CMD");
+    EXPECT_EQ(copy.GetTag("c"), "\\ ");
+    EXPECT_EQ(copy.GetTag("a"), "");
+    EXPECT_EQ(copy.GetNick().GetNick(), "foo");
+    EXPECT_THAT(copy.GetParams(), IsEmpty());
+}
+
 // The test data for MessageTest.Parse originates from
 // https://github.com/SaberUK/ircparser
 //
@@ -15,6 +15,7 @@
  */
 
 #include <gtest/gtest.h>
+#include <znc/FileUtils.h>
 #include <znc/Modules.h>
 #include <znc/znc.h>
 
@@ -447,3 +448,144 @@ TEST_F(ModulesTest, Hooks) {
 
     Modules.clear();
 }
+
+class CForwardingModule : public CModule {
+  public:
+    CForwardingModule(const CString& sName)
+        : CModule(nullptr, nullptr, nullptr, sName, "",
+                  CModInfo::NetworkModule) {}
+
+    EModRet OnRawMessage(CMessage& Message) override {
+        ++uCalls;
+        if (bForward) return CModule::OnRawMessage(Message);
+        return CONTINUE;
+    }
+
+    unsigned int uCalls = 0;
+    bool bForward = true;
+};
+
+class COldHookModule : public CModule {
+  public:
+    COldHookModule(const CString& sName)
+        : CModule(nullptr, nullptr, nullptr, sName, "",
+                  CModInfo::NetworkModule) {}
+
+    EModRet OnChanMsg(CNick& Nick, CChan& Channel, CString& sMessage) override {
+        ++uCalls;
+        return CONTINUE;
+    }
+
+    unsigned int uCalls = 0;
+};
+
+TEST_F(ModulesTest, UnusedHooks) {
+    CModules& Modules = CZNC::Get().GetModules();
+
+    CForwardingModule ForwardingMod("forwarding");
+    CForwardingModule ScriptMod("script");
+    ScriptMod.SetSkipUnusedHooks(false);
+    CForwardingModule HandlingMod("handling");
+    HandlingMod.bForward = false;
+    Modules.push_back(&ForwardingMod);
+    Modules.push_back(&ScriptMod);
+    Modules.push_back(&HandlingMod);
+
+    CMessage Msg(":nick PRIVMSG #chan :hello");
+    for (int i = 0; i < 3; ++i) {
+        Modules.OnRawMessage(Msg);
+    }
+    // Once a call ended up in CModule, the module isn't called anymore
+    EXPECT_EQ(ForwardingMod.uCalls, 1u);
+    EXPECT_EQ(ScriptMod.uCalls, 3u);
+    EXPECT_EQ(HandlingMod.uCalls, 3u);
+
+    // Also not after the lists were rebuilt
+    Modules.ClearHookLists();
+    Modules.OnRawMessage(Msg);
+    EXPECT_EQ(ForwardingMod.uCalls, 1u);
+    EXPECT_EQ(ScriptMod.uCalls, 4u);
+    EXPECT_EQ(HandlingMod.uCalls, 4u);
+
+    // Hooks which CModule forwards to older hooks reach modules overriding
+    // only the older hook
+    COldHookModule OldHookMod("oldhook");
+    Modules.push_back(&OldHookMod);
+    Modules.ClearHookLists();
+    CTextMessage ChanMsg;
+    Modules.OnChanTextMessage(ChanMsg);
+    Modules.OnChanTextMessage(ChanMsg);
+    EXPECT_EQ(OldHookMod.uCalls, 2u);
+    EXPECT_EQ(ForwardingMod.uCalls, 1u);
+
+    Modules.clear();
+}
+
+TEST_F(ModulesTest, RegistryJournal) {
+    char sDir[] = "/tmp/znc-registry-XXXXXX";
+    ASSERT_NE(mkdtemp(sDir), nullptr);
+    CZNC::Get().InitDirs("", sDir);
+    const CString sModDir = CString(sDir) + "/moddata/registry";
+    const CString sPath = sModDir + "/.registry";
+
+    // Registries written by older versions are still read
+    CDir::MakeDir(sModDir);
+    CFile File(sPath);
+    ASSERT_TRUE(File.Open(O_WRONLY | O_CREAT));
+    File.Write("old value\n");
+    File.Close();
+
+    {
+        CForwardingModule Mod("registry");
+        EXPECT_EQ(Mod.GetNV("old"), "value");
+        Mod.SetNV("a", "1");
+        Mod.SetNV("b", "two words");
+        Mod.DelNV("a");
+        EXPECT_TRUE(CFile::Exists(sPath + ".journal"));
+
+        // Changes are only appended to the journal, which is replayed on load
+        CForwardingModule Mod2("registry");
+        EXPECT_EQ(Mod2.GetNV("old"), "value");
+        EXPECT_EQ(Mod2.GetNV("b"), "two words");
+        EXPECT_FALSE(Mod2.HasNV("a"));
+    }
+    // Unloading writes everything to .registry
+    EXPECT_FALSE(CFile::Exists(sPath + ".journal"));
+
+    {
+        CForwardingModule Mod("registry");
+        Mod.SetNV("c", "3");
+    }
+    CFile Journal(sPath + ".journal");
+    ASSERT_TRUE(Journal.Open(O_WRONLY | O_CREAT));
+    Journal.Write("+ d 4\n+ e");
+    Journal.Close();
+    {
+        // A torn record at the end of the journal is ignored
+        CForwardingModule Mod("registry");
+        EXPECT_EQ(Mod.GetNV("b"), "two words");
+        EXPECT_EQ(Mod.GetNV("c"), "3");
+        EXPECT_EQ(Mod.GetNV("d"), "4");
+        EXPECT_FALSE(Mod.HasNV("e"));
+
+        // A long journal is compacted in a thread
+        for (int i = 0; i < 1100; ++i) {
+            Mod.SetNV("counter", CString(i));
+        }
+        EXPECT_TRUE(CFile::Exists(sPath + ".journal.old"));
+        CThreadPool::Get().handlePipeReadable();
+        EXPECT_FALSE(CFile::Exists(sPath + ".journal.old"));
+        Mod.SetNV("counter", "done");
+
+        CForwardingModule Mod2("registry");
+        EXPECT_EQ(Mod2.GetNV("counter"), "done");
+        EXPECT_EQ(Mod2.GetNV("c"), "3");
+
+        Mod.ClearNV();
+        Mod2.ClearNV();
+    }
+
+    rmdir(sModDir.c_str());
+    rmdir((CString(sDir) + "/moddata").c_str());
+    rmdir(sDir);
+}
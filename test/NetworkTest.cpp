@@ -15,7 +15,9 @@
  */
 
 #include <gtest/gtest.h>
+#include <znc/Chan.h>
 #include <znc/IRCNetwork.h>
+#include <znc/Query.h>
 #include <znc/User.h>
 #include <znc/znc.h>
 
@@ -81,6 +83,83 @@ TEST_F(NetworkTest, FindQuery) {
     EXPECT_FALSE(network.FindQuery("FF"));
 }
 
+TEST_F(NetworkTest, CaseMapping) {
+    CUser user("user");
+    CIRCNetwork network(&user, "network");
+
+    EXPECT_TRUE(network.AddChan("#foo[1]", false));
+    EXPECT_TRUE(network.AddChan("#foo{1}", false));
+    EXPECT_TRUE(network.AddQuery("nick[away]"));
+    EXPECT_EQ(network.GetCaseMapping(), CIRCNetwork::CaseMappingAscii);
+    EXPECT_EQ(network.FindChan("#FOO{1}")->GetName(), "#foo{1}");
+    EXPECT_FALSE(network.FindQuery("nick{away}"));
+
+    network.SetCaseMapping("rfc1459");
+    EXPECT_EQ(network.CaseFold("Nick[]\\~"), "nick{}|^");
+    EXPECT_EQ(network.FindChan("#FOO{1}")->GetName(), "#foo[1]");
+    EXPECT_EQ(network.FindQuery("NICK{AWAY}")->GetName(), "nick[away]");
+    EXPECT_FALSE(network.AddChan("#Foo{1}", false));
+    // The other channel takes over the shared name
+    EXPECT_TRUE(network.DelChan("#foo{1}"));
+    EXPECT_EQ(network.FindChan("#foo[1]")->GetName(), "#foo{1}");
+    EXPECT_TRUE(network.DelQuery("nick{away}"));
+    EXPECT_TRUE(network.GetQueries().empty());
+
+    network.SetCaseMapping("strict-rfc1459");
+    EXPECT_EQ(network.CaseFold("Nick[]\\~"), "nick{}|~");
+    EXPECT_EQ(network.FindChan("#foo{1}")->GetName(), "#foo{1}");
+    EXPECT_EQ(network.GetChans().size(), 1u);
+}
+
+TEST_F(NetworkTest, NormalizedChanName) {
+    CUser user("user");
+    CIRCNetwork network(&user, "network");
+    network.SetChanPrefixes("#");
+
+    EXPECT_TRUE(network.AddChan("foo key", false));
+    ASSERT_TRUE(network.FindChan("#FOO"));
+    EXPECT_EQ(network.FindChan("#FOO")->GetName(), "#foo");
+    EXPECT_FALSE(network.AddChan("#foo", false));
+    // The duplicate check uses the normalized name too
+    EXPECT_FALSE(network.AddChan("FOO", false));
+    EXPECT_FALSE(network.AddChan("#Foo otherkey", false));
+    EXPECT_EQ(network.GetChans().size(), 1u);
+    EXPECT_TRUE(network.DelChan("#foo"));
+    EXPECT_TRUE(network.GetChans().empty());
+}
+
+TEST_F(NetworkTest, BufferUsage) {
+    CUser user("user");
+    CIRCNetwork network(&user, "network");
+
+    EXPECT_TRUE(network.AddChan("#foo", false));
+    EXPECT_TRUE(network.AddChan("#bar", false));
+    CQuery* pQuery = network.AddQuery("nick");
+    ASSERT_TRUE(pQuery);
+    network.FindChan("#foo")->AddBuffer(":nick PRIVMSG #foo :{text}", "a");
+    network.FindChan("#bar")->AddBuffer(":nick PRIVMSG #bar :{text}", "b");
+    network.FindChan("#bar")->AddBuffer(":nick PRIVMSG #bar :{text}", "c");
+    pQuery->AddBuffer(":nick PRIVMSG me :{text}", "d");
+
+    const CIRCNetwork& constNetwork = network;
+    EXPECT_EQ(constNetwork.GetChanBufferUsage().uLines, 3u);
+    EXPECT_EQ(constNetwork.GetChanBufferUsage().uMemory,
+              network.FindChan("#foo")->GetBuffer().GetMemoryUsage() +
+                  network.FindChan("#bar")->GetBuffer().GetMemoryUsage());
+    EXPECT_EQ(constNetwork.GetQueryBufferUsage().uLines, 1u);
+    EXPECT_EQ(constNetwork.GetQueryBufferUsage().uMemory,
+              pQuery->GetBuffer().GetMemoryUsage());
+
+    EXPECT_TRUE(network.DelChan("#bar"));
+    EXPECT_EQ(constNetwork.GetChanBufferUsage().uLines, 1u);
+    network.FindChan("#foo")->ClearBuffer();
+    EXPECT_EQ(constNetwork.GetChanBufferUsage().uLines, 0u);
+    EXPECT_EQ(constNetwork.GetChanBufferUsage().uMemory, 0u);
+    EXPECT_TRUE(network.DelQuery("nick"));
+    EXPECT_EQ(constNetwork.GetQueryBufferUsage().uLines, 0u);
+    EXPECT_EQ(constNetwork.GetQueryBufferUsage().uMemory, 0u);
+}
+
 TEST_F(NetworkTest, FindQueries) {
     CUser user("user");
     CIRCNetwork network(&user, "network");
@@ -15,6 +15,8 @@
  */
 
 #include <gtest/gtest.h>
+#include <znc/Chan.h>
+#include <znc/IRCNetwork.h>
 #include <znc/Nick.h>
 
 TEST(NickTest, Parse) {
@@ -34,3 +36,93 @@ TEST(NickTest, Parse) {
     EXPECT_EQ(Nick2.GetHostMask(), "nick!~ident@host");
     EXPECT_TRUE(Nick2.NickEquals("nick"));
 }
+
+TEST(NickTest, Perms) {
+    CNick Nick("nick");
+    EXPECT_TRUE(Nick.AddPerm('+'));
+    EXPECT_TRUE(Nick.AddPerm('@'));
+    EXPECT_FALSE(Nick.AddPerm('@'));
+    EXPECT_FALSE(Nick.AddPerm('\xff'));
+    EXPECT_TRUE(Nick.HasPerm('@'));
+    EXPECT_FALSE(Nick.HasPerm('%'));
+    // Without a server, "@+" is assumed
+    EXPECT_EQ(Nick.GetPermStr(), "@+");
+    EXPECT_EQ(Nick.GetPermChar(), '@');
+    EXPECT_TRUE(Nick.RemPerm('@'));
+    EXPECT_FALSE(Nick.RemPerm('@'));
+    EXPECT_EQ(Nick.GetPermStr(), "+");
+}
+
+TEST(NickTest, Share) {
+    size_t uPoolSize = CInternedString::GetPoolSize();
+
+    // Nicks of parsed messages don't touch the pool
+    CNick Nick("nick!ident@some.unique.host");
+    EXPECT_EQ(CInternedString::GetPoolSize(), uPoolSize);
+
+    {
+        CNickMap Nicks(
+            CIRCNetwork::GetCaseFoldTable(CIRCNetwork::CaseMappingRFC1459));
+        CNick& Stored = Nicks.Insert(Nick);
+        EXPECT_EQ(Stored.GetNickMask(), "nick!ident@some.unique.host");
+        EXPECT_GT(CInternedString::GetPoolSize(), uPoolSize);
+
+        Stored.SetHost("other.unique.host");
+        EXPECT_EQ(Stored.GetHost(), "other.unique.host");
+        EXPECT_EQ(Nick.GetHost(), "some.unique.host");
+    }
+    EXPECT_EQ(CInternedString::GetPoolSize(), uPoolSize);
+}
+
+TEST(NickTest, NickMap) {
+    CNickMap Nicks(
+        CIRCNetwork::GetCaseFoldTable(CIRCNetwork::CaseMappingRFC1459));
+    EXPECT_TRUE(Nicks.empty());
+    EXPECT_FALSE(Nicks.Find("nick"));
+    EXPECT_EQ(Nicks.find("nick"), Nicks.end());
+
+    Nicks.Insert(CNick("Nick[away]!ident@host"));
+    EXPECT_EQ(Nicks.size(), 1u);
+    EXPECT_EQ(Nicks.at("NICK{AWAY}").GetHost(), "host");
+    EXPECT_EQ(Nicks.find("nick{away}")->first, "Nick[away]");
+    EXPECT_THROW(Nicks.at("nick"), std::out_of_range);
+
+    // Equal nicks replace each other
+    Nicks.Insert(CNick("nick{AWAY}"));
+    EXPECT_EQ(Nicks.size(), 1u);
+    EXPECT_EQ(Nicks.begin()->second.GetNick(), "nick{AWAY}");
+
+    Nicks.SetCaseFold(
+        CIRCNetwork::GetCaseFoldTable(CIRCNetwork::CaseMappingAscii));
+    EXPECT_FALSE(Nicks.Find("nick[away]"));
+    EXPECT_TRUE(Nicks.Find("NICK{away}"));
+
+    // Grow the table and punch holes into it, the rest must stay reachable
+    std::map<CString, CNick> msExpected;
+    for (int i = 0; i < 1000; ++i) {
+        CNick Nick("user" + CString(i));
+        Nicks.Insert(Nick);
+        msExpected[Nick.GetNick()] = Nick;
+    }
+    for (int i = 0; i < 1000; i += 3) {
+        EXPECT_TRUE(Nicks.Erase("USER" + CString(i)));
+        msExpected.erase("user" + CString(i));
+    }
+    EXPECT_FALSE(Nicks.Erase("user0"));
+    EXPECT_TRUE(Nicks.Erase("nick{away}"));
+
+    std::map<CString, CNick> msNicks = Nicks.ToMap();
+    EXPECT_EQ(msNicks.size(), msExpected.size());
+    EXPECT_EQ(Nicks.size(), msExpected.size());
+    size_t uIterated = 0;
+    for (const auto& it : Nicks) {
+        EXPECT_EQ(msExpected.count(it.first), 1u);
+        EXPECT_EQ(Nicks.Find(it.first), &it.second);
+        ++uIterated;
+    }
+    EXPECT_EQ(uIterated, msExpected.size());
+
+    Nicks.Clear();
+    EXPECT_TRUE(Nicks.empty());
+    EXPECT_EQ(Nicks.begin(), Nicks.end());
+}
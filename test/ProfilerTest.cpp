@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2004-2026 ZNC, see the NOTICE file for details.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <znc/Profiler.h>
+#include "IRCTest.h"
+
+TEST(ProfileStatsTest, Percentiles) {
+    CProfileStats Stats;
+    EXPECT_EQ(Stats.GetPercentile(50), 0u);
+
+    for (int i = 0; i < 98; ++i) Stats.Add(3);
+    Stats.Add(100);
+    Stats.Add(5000);
+
+    EXPECT_EQ(Stats.GetCount(), 100u);
+    EXPECT_EQ(Stats.GetTotal(), 98u * 3 + 100 + 5000);
+    EXPECT_EQ(Stats.GetMax(), 5000u);
+    EXPECT_EQ(Stats.GetBucket(2), 98u);  // [2, 4)
+    // Upper bounds of the buckets
+    EXPECT_EQ(Stats.GetPercentile(50), 4u);
+    EXPECT_EQ(Stats.GetPercentile(99), 128u);
+    EXPECT_EQ(Stats.GetPercentile(100), 5000u);
+}
+
+class ProfilerTest : public IRCTest {
+  protected:
+    void TearDown() override {
+        CProfiler::SetEnabled(false);
+        CProfiler::Reset();
+        IRCTest::TearDown();
+    }
+};
+
+TEST_F(ProfilerTest, DisabledRecordsNothing) {
+    m_pTestClient->ReadLine("PRIVMSG #chan :hello");
+    m_pTestSock->ReadLine(":nick PRIVMSG me :hello");
+
+    EXPECT_EQ(CProfiler::GetTimer(CProfiler::ClientReadLine).GetCount(), 0u);
+    EXPECT_EQ(CProfiler::GetTimer(CProfiler::IRCReadLine).GetCount(), 0u);
+    EXPECT_TRUE(CProfiler::GetHookStats().empty());
+}
+
+TEST_F(ProfilerTest, ReadLineAndHooks) {
+    CProfiler::SetEnabled(true);
+    m_pTestClient->ReadLine("PRIVMSG #chan :hello");
+    m_pTestSock->ReadLine(":nick PRIVMSG me :hello");
+    m_pTestSock->ReadLine(":nick PRIVMSG me :again");
+
+    EXPECT_EQ(CProfiler::GetTimer(CProfiler::ClientReadLine).GetCount(), 1u);
+    EXPECT_EQ(CProfiler::GetTimer(CProfiler::IRCReadLine).GetCount(), 2u);
+
+    bool bFound = false;
+    for (const CProfiler::SHookStats& Hook : CProfiler::GetHookStats()) {
+        EXPECT_EQ(Hook.sModule, "testmod");
+        if (Hook.sHook == "OnPrivTextMessage(Message)") {
+            EXPECT_EQ(Hook.Stats.GetCount(), 2u);
+            bFound = true;
+        }
+    }
+    EXPECT_TRUE(bFound);
+
+    CString sJSON = CProfiler::ToJSON();
+    EXPECT_TRUE(sJSON.StartsWith("{\"enabled\":true,")) << sJSON;
+    EXPECT_TRUE(sJSON.Contains("\"IRCReadLine\":{\"count\":2,")) << sJSON;
+    EXPECT_TRUE(sJSON.Contains("{\"module\":\"testmod\",\"hook\":"
+                               "\"OnPrivTextMessage(Message)\",\"stats\":"
+                               "{\"count\":2,"))
+        << sJSON;
+    EXPECT_TRUE(sJSON.Contains("\"IRCSendQueue\":{\"total\":0,\"max\":0}"))
+        << sJSON;
+
+    CProfiler::Reset();
+    EXPECT_EQ(CProfiler::GetTimer(CProfiler::IRCReadLine).GetCount(), 0u);
+    EXPECT_TRUE(CProfiler::GetHookStats().empty());
+}
@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2004-2026 ZNC, see the NOTICE file for details.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the TLS handshake rate over loopback.
+//
+// Usage: sslbench [handshakes]
+//
+// Generates a certificate like `znc --makepem` does, then does the given
+// number of handshakes in three ways:
+//  - new contexts: both sides create a new SSL_CTX for every connection, as
+//    Csocket does on its own
+//  - shared: the contexts come from CSSLContextCache, every handshake is
+//    still a full one
+//  - resumed: the same, and the client offers the session of the previous
+//    connection
+
+#include <znc/Socket.h>
+#include <znc/Utils.h>
+#include <znc/znc.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+#ifndef HAVE_LIBSSL
+int main() {
+    std::cerr << "ZNC was built without SSL" << std::endl;
+    return 1;
+}
+#else
+
+enum EMode { NewContexts, Shared, Resumed };
+
+static CString s_sPemFile;
+
+// The cache isn't thread safe, so the server thread gets its context upfront
+static SSL_CTX* ServerContext(SSL_CTX* pShared) {
+    if (pShared) {
+        SSL_CTX_up_ref(pShared);
+        return pShared;
+    }
+    SSL_CTX* pCTX = SSL_CTX_new(TLS_server_method());
+    SSL_CTX_use_certificate_chain_file(pCTX, s_sPemFile.c_str());
+    SSL_CTX_use_PrivateKey_file(pCTX, s_sPemFile.c_str(), SSL_FILETYPE_PEM);
+    return pCTX;
+}
+
+static SSL_CTX* ClientContext(EMode eMode) {
+    if (eMode != NewContexts) {
+        return CSSLContextCache::GetClientContext("", "", "");
+    }
+    SSL_CTX* pCTX = SSL_CTX_new(TLS_client_method());
+    SSL_CTX_set_default_verify_paths(pCTX);
+    return pCTX;
+}
+
+static void Serve(int iListener, SSL_CTX* pShared, unsigned int uCount) {
+    for (unsigned int i = 0; i < uCount; ++i) {
+        int iSock = accept(iListener, nullptr, nullptr);
+        if (iSock < 0) return;
+        SSL_CTX* pCTX = ServerContext(pShared);
+        SSL* pSSL = SSL_new(pCTX);
+        SSL_set_fd(pSSL, iSock);
+        if (SSL_accept(pSSL) == 1) {
+            // Lets the client receive the TLS 1.3 session tickets
+            SSL_write(pSSL, "x", 1);
+            SSL_shutdown(pSSL);
+        }
+        SSL_free(pSSL);
+        SSL_CTX_free(pCTX);
+        close(iSock);
+    }
+}
+
+static int Run(EMode eMode, const char* szName, unsigned int uCount) {
+    int iListener = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in Addr = {};
+    Addr.sin_family = AF_INET;
+    Addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t uLen = sizeof(Addr);
+    if (iListener < 0 ||
+        bind(iListener, reinterpret_cast<sockaddr*>(&Addr), uLen) != 0 ||
+        listen(iListener, SOMAXCONN) != 0 ||
+        getsockname(iListener, reinterpret_cast<sockaddr*>(&Addr), &uLen) !=
+            0) {
+        std::cerr << "Can't listen" << std::endl;
+        return 1;
+    }
+
+    CSSLContextCache::Clear();
+    SSL_CTX* pShared = eMode == NewContexts
+                           ? nullptr
+                           : CSSLContextCache::GetServerContext(s_sPemFile,
+                                                                "", "", "");
+    std::thread Server(Serve, iListener, pShared, uCount);
+
+    SSL_SESSION* pSession = nullptr;
+    unsigned int uResumed = 0;
+    unsigned int uFailed = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < uCount; ++i) {
+        int iSock = socket(AF_INET, SOCK_STREAM, 0);
+        if (connect(iSock, reinterpret_cast<sockaddr*>(&Addr), uLen) != 0) {
+            std::cerr << "Can't connect" << std::endl;
+            return 1;
+        }
+        SSL_CTX* pCTX = ClientContext(eMode);
+        SSL* pSSL = SSL_new(pCTX);
+        SSL_set_fd(pSSL, iSock);
+        if (pSession) SSL_set_session(pSSL, pSession);
+        char c;
+        if (SSL_connect(pSSL) == 1 && SSL_read(pSSL, &c, 1) == 1) {
+            if (SSL_session_reused(pSSL)) uResumed++;
+            if (eMode == Resumed) {
+                SSL_SESSION_free(pSession);
+                pSession = SSL_get1_session(pSSL);
+            }
+            // Otherwise OpenSSL marks the session as not resumable
+            SSL_shutdown(pSSL);
+        } else {
+            uFailed++;
+        }
+        SSL_free(pSSL);
+        SSL_CTX_free(pCTX);
+        close(iSock);
+    }
+    double fElapsed = std::chrono::duration<double>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+    Server.join();
+    SSL_CTX_free(pShared);
+    SSL_SESSION_free(pSession);
+    close(iListener);
+
+    std::cout << szName << ": " << unsigned(uCount / fElapsed)
+              << " handshakes/s, " << uResumed << " resumed, " << uFailed
+              << " failed" << std::endl;
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    unsigned int uCount = argc > 1 ? CString(argv[1]).ToUInt() : 1000;
+
+    char szPemFile[] = "/tmp/sslbench-XXXXXX";
+    int iFD = mkstemp(szPemFile);
+    FILE* pFile = iFD < 0 ? nullptr : fdopen(iFD, "w");
+    if (!pFile) {
+        std::cerr << "Can't create a temporary file" << std::endl;
+        return 1;
+    }
+    CUtils::GenerateCert(pFile);
+    fclose(pFile);
+    s_sPemFile = szPemFile;
+
+    CZNC::CreateInstance();
+    int iRet = Run(NewContexts, "new contexts", uCount);
+    if (iRet == 0) iRet = Run(Shared, "shared", uCount);
+    if (iRet == 0) iRet = Run(Resumed, "resumed", uCount);
+    CSSLContextCache::Clear();
+    CZNC::DestroyInstance();
+
+    unlink(szPemFile);
+    return iRet;
+}
+
+#endif
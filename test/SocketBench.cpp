@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2004-2026 ZNC, see the NOTICE file for details.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Compares the event backends of CSockManager.
+//
+// Usage: socketbench [idle connections] [active connections] [seconds]
+//
+// Opens the given number of loopback connections. Idle ones never send
+// anything, active ones bounce a line back and forth as fast as possible.
+// Then the main loop is run for the given time with every available backend,
+// and the number of lines and loop iterations per second is reported.
+
+#include <znc/Socket.h>
+#include <znc/znc.h>
+#include <sys/resource.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+static unsigned int s_uConnected = 0;
+static unsigned long s_uLines = 0;
+
+class CBenchSock : public CZNCSock {
+  public:
+    // Outgoing connection
+    explicit CBenchSock(bool bActive)
+        : CZNCSock(0), m_bOutgoing(true), m_bActive(bActive) {
+        EnableReadLine();
+    }
+    // Incoming connection, or the listener
+    CBenchSock(const CString& sHost, u_short uPort)
+        : CZNCSock(sHost, uPort, 0), m_bOutgoing(false), m_bActive(false) {
+        EnableReadLine();
+    }
+
+    Csock* GetSockObj(const CString& sHost, u_short uPort) override {
+        return new CBenchSock(sHost, uPort);
+    }
+
+    void Connected() override {
+        if (m_bOutgoing) s_uConnected++;
+        if (m_bActive) Write("ping\n");
+    }
+
+    void ReadLine(const CString& sLine) override {
+        s_uLines++;
+        Write(sLine);
+    }
+
+  private:
+    bool m_bOutgoing;
+    bool m_bActive;
+};
+
+static double SecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start)
+        .count();
+}
+
+static int Run(unsigned int uIdle, unsigned int uActive,
+               unsigned int uSeconds) {
+    CSockManager Manager;
+
+    u_short uPort = Manager.ListenRand("bench-listener", "127.0.0.1", false,
+                                       SOMAXCONN, new CBenchSock("127.0.0.1", 0),
+                                       0, ADDR_IPV4ONLY);
+    if (uPort == 0) {
+        std::cerr << "Can't listen" << std::endl;
+        return 1;
+    }
+
+    for (unsigned int i = 0; i < uIdle + uActive; ++i) {
+        Manager.Connect("127.0.0.1", uPort, "bench", 60, false, "",
+                        new CBenchSock(i >= uIdle));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    while (s_uConnected < uIdle + uActive && SecondsSince(start) < 60) {
+        Manager.Loop();
+    }
+    if (s_uConnected < uIdle + uActive) {
+        std::cerr << "Only " << s_uConnected << " of " << uIdle + uActive
+                  << " connections succeeded" << std::endl;
+        return 1;
+    }
+
+    std::cout << uIdle << " idle, " << uActive << " active connections, "
+              << uSeconds << "s per backend" << std::endl;
+
+    for (const CString& sBackend : CSockManager::GetAvailableEventBackends()) {
+        Manager.SetEventBackend(sBackend);
+        s_uLines = 0;
+        unsigned long uLoops = 0;
+        start = std::chrono::steady_clock::now();
+        while (SecondsSince(start) < uSeconds) {
+            Manager.Loop();
+            uLoops++;
+        }
+        double fElapsed = SecondsSince(start);
+        std::cout << sBackend << ": " << unsigned(s_uLines / fElapsed)
+                  << " lines/s, " << unsigned(uLoops / fElapsed)
+                  << " loops/s, " << fElapsed * 1e6 / uLoops
+                  << " us/loop" << std::endl;
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    unsigned int uIdle = argc > 1 ? CString(argv[1]).ToUInt() : 1000;
+    unsigned int uActive = argc > 2 ? CString(argv[2]).ToUInt() : 10;
+    unsigned int uSeconds = argc > 3 ? CString(argv[3]).ToUInt() : 5;
+
+    // Both ends of every connection live in this process
+    rlim_t uNeeded = 2 * (uIdle + uActive) + 64;
+    struct rlimit lim;
+    if (getrlimit(RLIMIT_NOFILE, &lim) == 0 && lim.rlim_cur < uNeeded) {
+        lim.rlim_cur = std::min(uNeeded, lim.rlim_max);
+        setrlimit(RLIMIT_NOFILE, &lim);
+        if (lim.rlim_cur < uNeeded) {
+            std::cerr << "Need " << uNeeded << " file descriptors, but only "
+                      << lim.rlim_cur << " are allowed" << std::endl;
+            return 1;
+        }
+    }
+
+    CZNC::CreateInstance();
+    int iRet = Run(uIdle, uActive, uSeconds);
+    CZNC::DestroyInstance();
+
+    return iRet;
+}
@@ -17,6 +17,7 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 #include <znc/ZNCString.h>
+#include <thread>
 
 using ::testing::ElementsAre;
 using ::testing::IsEmpty;
@@ -344,3 +345,48 @@ TEST(StringTest, StripControls) {
     // Strips underline
     EXPECT_EQ(CString("\x1Ftest").StripControls(), "test");
 }
+
+TEST(StringTest, InternedString) {
+    size_t uPoolSize = CInternedString::GetPoolSize();
+    {
+        CInternedString a("SomeNick"), b(CString("SomeNick"));
+        EXPECT_EQ(&a.Get(), &b.Get());
+        EXPECT_EQ(a, b);
+        EXPECT_EQ(a.Get(), "SomeNick");
+
+        // The folded form is interned too
+        CInternedString c("somenick");
+        EXPECT_NE(a, c);
+        EXPECT_TRUE(a.Equals(c));
+        EXPECT_FALSE(a.Equals(CInternedString("othernick")));
+        EXPECT_EQ(CInternedString::GetPoolSize(), uPoolSize + 2);
+
+        CInternedString d = a;
+        a = "";
+        EXPECT_TRUE(a.empty());
+        EXPECT_EQ(a.Get(), "");
+        EXPECT_EQ(d, b);
+    }
+    // Strings are dropped from the pool once nothing refers to them
+    EXPECT_EQ(CInternedString::GetPoolSize(), uPoolSize);
+}
+
+TEST(StringTest, InternedStringThreads) {
+    size_t uPoolSize = CInternedString::GetPoolSize();
+    CInternedString sShared("Shared");
+    std::vector<std::thread> vThreads;
+    for (int t = 0; t < 4; ++t) {
+        vThreads.emplace_back([&sShared] {
+            for (int i = 0; i < 20000; ++i) {
+                CInternedString a("Nick" + CString(i % 10));
+                CInternedString b = a;
+                CInternedString c = sShared;
+                CInternedString d("nick" + CString(i % 10));
+                EXPECT_TRUE(b.Equals(d));
+            }
+        });
+    }
+    for (std::thread& Thread : vThreads) Thread.join();
+    EXPECT_EQ(sShared.Get(), "Shared");
+    EXPECT_EQ(CInternedString::GetPoolSize(), uPoolSize + 2);
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2004-2026 ZNC, see the NOTICE file for details.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures how fast CTemplate renders a big page.
+//
+// Usage: templatebench [users] [seconds]
+//
+// Renders webadmin's listusers page with the given number of users for the
+// given time, and reports the number of pages and bytes per second.
+
+#include <znc/Template.h>
+#include <chrono>
+#include <iostream>
+
+static double SecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start)
+        .count();
+}
+
+int main(int argc, char** argv) {
+    unsigned int uUsers = argc > 1 ? CString(argv[1]).ToUInt() : 1000;
+    unsigned int uSeconds = argc > 2 ? CString(argv[2]).ToUInt() : 5;
+    const CString sSourceDir = ZNC_SOURCE_DIR;
+
+    unsigned long uPages = 0;
+    unsigned long long uBytes = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (SecondsSince(start) < uSeconds) {
+        CTemplate Tmpl;
+        Tmpl.AppendPath(sSourceDir + "/webskins/_default_/tmpl/");
+        Tmpl.AppendPath(sSourceDir + "/modules/data/webadmin/tmpl/");
+        Tmpl["URIPrefix"] = "/znc";
+        Tmpl["ModPath"] = "/mods/global/webadmin/";
+        for (unsigned int i = 0; i < uUsers; ++i) {
+            CTemplate& Row = Tmpl.AddRow("UserLoop");
+            Row["Username"] = "user" + CString(i);
+            Row["Networks"] = CString(i % 5);
+            Row["Clients"] = CString(i % 3);
+            Row["IsSelf"] = CString(i == 0);
+        }
+        if (!Tmpl.SetFile("listusers.tmpl")) {
+            std::cerr << "Can't find listusers.tmpl in " << sSourceDir
+                      << std::endl;
+            return 1;
+        }
+
+        CString sPage;
+        if (!Tmpl.PrintString(sPage)) {
+            std::cerr << "Can't render listusers.tmpl" << std::endl;
+            return 1;
+        }
+        uPages++;
+        uBytes += sPage.size();
+    }
+    double fElapsed = SecondsSince(start);
+
+    std::cout << uUsers << " users: " << uPages / fElapsed << " pages/s, "
+              << unsigned(uBytes / fElapsed / 1024) << " KiB/s" << std::endl;
+    return 0;
+}
@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2004-2026 ZNC, see the NOTICE file for details.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <znc/FileUtils.h>
+#include <znc/Template.h>
+
+class TemplateTest : public ::testing::Test {
+  protected:
+    ~TemplateTest() override {
+        for (const CString& sFile : m_vsFiles) {
+            CFile::Delete(sFile);
+        }
+    }
+
+    CString WriteFile(const CString& sContent) {
+        char sName[] = "./temp-XXXXXX";
+        int fd = mkstemp(sName);
+        close(fd);
+        m_vsFiles.push_back(sName);
+        Rewrite(sName, sContent);
+        return sName;
+    }
+
+    void Rewrite(const CString& sFile, const CString& sContent) {
+        CFile File(sFile);
+        ASSERT_TRUE(File.Open(O_WRONLY | O_TRUNC));
+        File.Write(sContent);
+    }
+
+    CString Render(CTemplate& Tmpl, const CString& sFile) {
+        Tmpl.AppendPath(".");
+        EXPECT_TRUE(Tmpl.SetFile(sFile.TrimPrefix_n("./")));
+        CString sRet;
+        EXPECT_TRUE(Tmpl.PrintString(sRet));
+        return sRet;
+    }
+
+  private:
+    VCString m_vsFiles;
+};
+
+TEST_F(TemplateTest, Var) {
+    CString sFile = WriteFile(
+        "a<? VAR Foo ?>b\n"
+        "<? VAR Missing DEFAULT=def ?>\n"
+        "<? VAR Html ESC=HTML ?>\n");
+    CTemplate Tmpl;
+    Tmpl["Foo"] = "foo";
+    Tmpl["Html"] = "<&>";
+    EXPECT_EQ(Render(Tmpl, sFile), "afoob\ndef\n&lt;&amp;&gt;\n");
+}
+
+TEST_F(TemplateTest, If) {
+    CString sFile = WriteFile(
+        "<? IF A ?>a<? ELSE IF B == 2 ?>b<? ELSE ?>c<? ENDIF ?>\n");
+    CTemplate Tmpl1;
+    Tmpl1["A"] = "true";
+    EXPECT_EQ(Render(Tmpl1, sFile), "a\n");
+    CTemplate Tmpl2;
+    Tmpl2["B"] = "2";
+    EXPECT_EQ(Render(Tmpl2, sFile), "b\n");
+    CTemplate Tmpl3;
+    Tmpl3["B"] = "3";
+    EXPECT_EQ(Render(Tmpl3, sFile), "c\n");
+}
+
+TEST_F(TemplateTest, Loop) {
+    CString sFile = WriteFile(
+        "<ul><? LOOP L ?><li><? VAR X ?><? IF __LAST__ ?>!<? ENDIF ?></li>"
+        "<? ENDLOOP ?></ul>\n"
+        "<? LOOP L REVERSE ?>\n"
+        "<? VAR __ID__ ?>=<? VAR X ?><? VAR Top TOP ?>\n"
+        "<? ENDLOOP ?>\n");
+    CTemplate Tmpl;
+    Tmpl["Top"] = "t";
+    Tmpl.AddRow("L")["X"] = "a";
+    Tmpl.AddRow("L")["X"] = "b";
+    EXPECT_EQ(Render(Tmpl, sFile),
+              "<ul><li>a</li><li>b!</li></ul>\n"
+              "1=bt\n"
+              "2=at\n");
+}
+
+TEST_F(TemplateTest, ReloadChangedFile) {
+    CString sFile = WriteFile("old <? VAR Foo ?>\n");
+    CTemplate Tmpl1;
+    Tmpl1["Foo"] = "1";
+    EXPECT_EQ(Render(Tmpl1, sFile), "old 1\n");
+
+    // Rendering again uses the same compiled file
+    CTemplate Tmpl2;
+    Tmpl2["Foo"] = "2";
+    EXPECT_EQ(Render(Tmpl2, sFile), "old 2\n");
+
+    Rewrite(sFile, "new one <? VAR Foo ?>\n");
+    CTemplate Tmpl3;
+    Tmpl3["Foo"] = "3";
+    EXPECT_EQ(Render(Tmpl3, sFile), "new one 3\n");
+}
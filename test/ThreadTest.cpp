@@ -16,7 +16,9 @@
 
 #include <gtest/gtest.h>
 #include <znc/Threads.h>
+#include <znc/Socket.h>
 #include <sys/select.h>
+#include <thread>
 
 class CWaitingJob : public CJob {
   public:
@@ -183,3 +185,21 @@ TEST(Thread, CancelJobWhenDone) {
     // cancelJob() should only return after successful cancellation
     EXPECT_TRUE(destroyed);
 }
+
+TEST(Thread, PostToManager) {
+    CSockManager Manager(false);
+    std::vector<int> viRan;
+
+    std::thread Thread([&]() {
+        Manager.Post([&]() { viRan.push_back(1); });
+        Manager.Post([&]() { viRan.push_back(2); });
+    });
+    Thread.join();
+
+    // Only the loop's own thread runs them
+    EXPECT_TRUE(viRan.empty());
+    Manager.RunPostedTasks();
+    EXPECT_EQ(viRan, std::vector<int>({1, 2}));
+    Manager.RunPostedTasks();
+    EXPECT_EQ(viRan, std::vector<int>({1, 2}));
+}
@@ -198,3 +198,25 @@ TEST_F(UserTest, CheckPassSHA256) {
     EXPECT_FALSE(user.CheckPass("Another-password"));
     EXPECT_TRUE(user.CheckPass(sCorrect));
 }
+
+TEST_F(UserTest, VerifyPass) {
+    CString sSalt = "salt";
+    CString sMD5 = CUtils::SaltedMD5Hash("password", sSalt);
+    CString sSHA256 = CUtils::SaltedSHA256Hash("password", sSalt);
+
+    EXPECT_TRUE(CUser::VerifyPass("password", "password", "",
+                                  CUser::HASH_NONE));
+    EXPECT_FALSE(CUser::VerifyPass("wrong", "password", "",
+                                   CUser::HASH_NONE));
+    EXPECT_TRUE(CUser::VerifyPass("password", sMD5, sSalt, CUser::HASH_MD5));
+    EXPECT_FALSE(CUser::VerifyPass("password", sMD5, "", CUser::HASH_MD5));
+    EXPECT_TRUE(
+        CUser::VerifyPass("password", sSHA256, sSalt, CUser::HASH_SHA256));
+    EXPECT_FALSE(
+        CUser::VerifyPass("wrong", sSHA256, sSalt, CUser::HASH_SHA256));
+
+    // Only argon2id is worth moving off the main loop
+    CUser user("user");
+    user.SetPass(sSHA256, CUser::HASH_SHA256, sSalt);
+    EXPECT_FALSE(user.IsPassCheckSlow());
+}
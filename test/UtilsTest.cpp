@@ -16,7 +16,10 @@
 
 #include <gtest/gtest.h>
 #include <znc/FileUtils.h>
+#include <znc/Socket.h>
 #include <znc/Utils.h>
+#include <znc/znc.h>
+#include <utime.h>
 
 namespace {
 CString WriteTempFile(const CString& sContent, mode_t iMode) {
@@ -308,3 +311,122 @@ TEST(UtilsTest, FormatTime) {
     CString str3 = CUtils::FormatTime(tv2, "a%fb", "UTC");
     EXPECT_EQ(str3, "a123b");
 }
+
+TEST(UtilsTest, TimeFormatter) {
+    CTimeFormatter Formatter("[%H:%M:%S.%f] %6f", "GMT+2");
+    timeval tv = {42, 123456};
+    EXPECT_EQ(Formatter.Format(tv), "[02:00:42.123] 123456");
+    // The same second, only the fraction changes
+    tv.tv_usec = 7;
+    EXPECT_EQ(Formatter.Format(tv), "[02:00:42.000] 000007");
+    tv.tv_sec = 43;
+    EXPECT_EQ(Formatter.Format(tv), "[02:00:43.000] 000007");
+
+    Formatter.Set("%H:%M:%S", "UTC");
+    EXPECT_EQ(Formatter.Format(tv), "00:00:43");
+    EXPECT_EQ(Formatter.Format(tv), CUtils::FormatTime(tv, "%H:%M:%S", "UTC"));
+    Formatter.Set("%H:%M:%S", "GMT-1");
+    EXPECT_EQ(Formatter.Format(tv), "23:00:43");
+
+    tv = {1318956051, 620999};
+    EXPECT_EQ(CUtils::FormatServerTime(tv), "2011-10-18T16:40:51.620Z");
+    tv.tv_usec = 5000;
+    EXPECT_EQ(CUtils::FormatServerTime(tv), "2011-10-18T16:40:51.005Z");
+}
+
+#ifdef HAVE_LIBSSL
+TEST(UtilsTest, SSLContextCache) {
+    CZNC::CreateInstance();
+    char szPemFile[] = "./ssltest-XXXXXX";
+    int fd = mkstemp(szPemFile);
+    ASSERT_NE(fd, -1);
+    FILE* pFile = fdopen(fd, "w");
+    CUtils::GenerateCert(pFile);
+    fclose(pFile);
+
+    SSL_CTX* pCTX1 = CSSLContextCache::GetServerContext(szPemFile, "", "", "");
+    SSL_CTX* pCTX2 = CSSLContextCache::GetServerContext(szPemFile, "", "", "");
+    ASSERT_NE(pCTX1, nullptr);
+    EXPECT_EQ(pCTX1, pCTX2);
+    SSL_CTX_free(pCTX2);
+
+    // A renewed certificate is picked up without a rehash
+    struct utimbuf Times = {1, 1};
+    ASSERT_EQ(utime(szPemFile, &Times), 0);
+    pCTX2 = CSSLContextCache::GetServerContext(szPemFile, "", "", "");
+    ASSERT_NE(pCTX2, nullptr);
+    EXPECT_NE(pCTX1, pCTX2);
+    SSL_CTX_free(pCTX1);
+    SSL_CTX_free(pCTX2);
+
+    EXPECT_EQ(CSSLContextCache::GetServerContext("./nonexistent", "", "", ""),
+              nullptr);
+
+    EXPECT_EQ(CSSLContextCache::GetSession("user/net"), nullptr);
+    SSL_SESSION* pSession = SSL_SESSION_new();
+    CSSLContextCache::AddSession("user/net", pSession);
+    SSL_SESSION* pCached = CSSLContextCache::GetSession("user/net");
+    EXPECT_EQ(pCached, pSession);
+    SSL_SESSION_free(pCached);
+    CSSLContextCache::AddSession("", SSL_SESSION_new());
+    EXPECT_EQ(CSSLContextCache::GetSession(""), nullptr);
+
+    CSSLContextCache::Clear();
+    EXPECT_EQ(CSSLContextCache::GetSession("user/net"), nullptr);
+
+    CFile::Delete(szPemFile);
+    CZNC::DestroyInstance();
+}
+#endif
+
+TEST(UtilsTest, WildcardSet) {
+    CWildcardSet Masks;
+    EXPECT_FALSE(Masks.Matches(""));
+    EXPECT_EQ(Masks.Add("*!*@*.example.com"), 0u);
+    EXPECT_EQ(Masks.Add("Nick!*@*"), 1u);
+    EXPECT_EQ(Masks.Add("n?ck!ident@host"), 2u);
+    EXPECT_EQ(Masks.Add(""), 3u);
+
+    std::vector<size_t> vuIndexes;
+    EXPECT_TRUE(Masks.Matches("nick!ident@host"));
+    Masks.FindAll("nick!ident@host", vuIndexes);
+    EXPECT_EQ(vuIndexes, std::vector<size_t>({1, 2}));
+    Masks.FindAll("NICK!x@a.EXAMPLE.com", vuIndexes);
+    EXPECT_EQ(vuIndexes, std::vector<size_t>({0, 1}));
+    Masks.FindAll("", vuIndexes);
+    EXPECT_EQ(vuIndexes, std::vector<size_t>({3}));
+    EXPECT_FALSE(Masks.Matches("other!ident@example.com"));
+
+    Masks.Clear();
+    EXPECT_FALSE(Masks.Matches("nick!ident@host"));
+
+    CWildcardSet CaseSensitive(CString::CaseSensitive);
+    CaseSensitive.Add("*A*b*c*");
+    EXPECT_TRUE(CaseSensitive.Matches("xAybzc"));
+    EXPECT_FALSE(CaseSensitive.Matches("abc"));
+
+    // Same results as WildCmp(), also with more masks than fit into a word
+    const VCString vsMasks = {"*a*b*c*", "*!?bar@foo", "a*", "*a", "?",
+                              "*?*", "a?c", "**b**", "abc", "a*b*c",
+                              "*.example.com", "x*y*x*y*x*y*x*y*x*y*x*y*"};
+    const VCString vsStrings = {"", "a", "abc", "Abc", "axbyc", "I_am!~bar@foo",
+                                "ab", "cab", "irc.example.com", "xyxyxyxyxyxy",
+                                "xyxyxyxyxyx", "b"};
+    for (auto cs : {CString::CaseSensitive, CString::CaseInsensitive}) {
+        CWildcardSet All(cs);
+        for (int i = 0; i < 10; ++i) {
+            for (const CString& sMask : vsMasks) All.Add(sMask);
+        }
+        for (const CString& sString : vsStrings) {
+            std::vector<size_t> vuExpected;
+            for (size_t i = 0; i < All.size(); ++i) {
+                if (CString::WildCmp(All.GetMask(i), sString, cs)) {
+                    vuExpected.push_back(i);
+                }
+            }
+            All.FindAll(sString, vuIndexes);
+            EXPECT_EQ(vuIndexes, vuExpected) << sString;
+            EXPECT_EQ(All.Matches(sString), !vuExpected.empty()) << sString;
+        }
+    }
+}
@@ -268,6 +268,34 @@ TEST_F(ZNCTest, ModuleCSRFOverride) {
     EXPECT_THAT(reply, HasSubstr("ipsum"));
 }
 
+TEST_F(ZNCTest, PrometheusModule) {
+    int port = PickPortNumber();
+    auto znc = Run();
+    auto ircd = ConnectIRCd();
+    auto client = LoginClient();
+    client.Write(QStringLiteral("znc addport %1 all all").arg(port).toUtf8());
+    client.Write("znc loadmod prometheus");
+    client.ReadUntil("Loaded module");
+    QNetworkRequest request;
+    request.setRawHeader("Authorization",
+                         "Basic " + QByteArray("user:hunter2").toBase64());
+    request.setUrl(QUrl(
+        QStringLiteral("http://127.0.0.1:%1/mods/global/prometheus/metrics")
+            .arg(port)));
+    auto reply = HttpGet(request)->readAll().toStdString();
+    EXPECT_THAT(reply, HasSubstr("\nznc_network_clients{user=\"user\","
+                                 "network=\"test\"} 1\n"));
+    EXPECT_THAT(reply, HasSubstr("\nznc_client_logins_total 0\n"));
+    EXPECT_THAT(reply, HasSubstr("\n# EOF\n"));
+
+    // Every scrape reads the current values
+    auto client2 = LoginClient();
+    reply = HttpGet(request)->readAll().toStdString();
+    EXPECT_THAT(reply, HasSubstr("\nznc_network_clients{user=\"user\","
+                                 "network=\"test\"} 2\n"));
+    EXPECT_THAT(reply, HasSubstr("\nznc_client_logins_total 1\n"));
+}
+
 class SaslModuleTest : public ZNCTest,
                        public testing::WithParamInterface<
                            std::pair<int, std::vector<std::string>>> {
@@ -540,5 +568,32 @@ TEST_F(ZNCTest, StripControlsModule) {
 
 }
 
+TEST_F(ZNCTest, LogModule) {
+    auto znc = Run();
+    auto ircd = ConnectIRCd();
+    auto client = LoginClient();
+    client.Write("znc loadmod log -timestamp [ts] $NETWORK/$WINDOW.log");
+    client.ReadUntil("Loaded module");
+
+    ircd.Write(":server 001 nick :Hello");
+    client.Write("JOIN #test");
+    ircd.ReadUntil("JOIN #test");
+    ircd.Write(":nick JOIN :#test");
+    client.ReadUntil(":nick JOIN :#test");
+    ircd.Write(":user!id@host PRIVMSG #test :first");
+    client.ReadUntil(":user!id@host PRIVMSG #test :first");
+    ircd.Write(":user!id@host PRIVMSG #test :second");
+    client.ReadUntil(":user!id@host PRIVMSG #test :second");
+
+    // Lines are written from another thread, unloading flushes them
+    client.Write("znc unloadmod log");
+    client.ReadUntil("Module log unloaded.");
+
+    QFile log(m_dir.path() + "/users/user/moddata/log/test/#test.log");
+    ASSERT_TRUE(log.open(QIODevice::ReadOnly | QIODevice::Text));
+    EXPECT_THAT(log.readAll().toStdString(),
+                HasSubstr("[ts] <user> first\n[ts] <user> second\n"));
+}
+
 }  // namespace
 }  // namespace znc_inttest